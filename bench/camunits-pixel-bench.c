@@ -0,0 +1,1154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+
+#include <glib.h>
+
+#include <camunits/pixels.h>
+
+#ifdef __APPLE__
+#define MALLOC_ALIGNED(s) malloc(s)
+#else
+#include <malloc.h>
+#define MALLOC_ALIGNED(s) memalign(16,s)
+#endif
+
+#define ALIGN128(x) (((x) + 0x7f) & (~0x7f))
+
+/* Space reserved around each image so that kernels that read or write a
+ * replicated border stay within the buffer. */
+#define BORDER_ROWS 4
+#define BORDER_BYTES 64
+
+typedef struct _bench_ctx_t {
+    int width;
+    int height;
+    uint8_t *src;
+    int sstride;
+    uint8_t *dst;
+    int dstride;
+    uint8_t *planes[4];
+    int pstride;
+    uint8_t lut[4 * 256];
+    uint8_t *lut16;
+    int shift;
+    int big_endian;
+    CamPixelRemap *remap;
+
+    /* output of the BENCH_STREAM kernels.  The decoders reuse it as long as
+     * stream_func, the encoder that wrote it, is their own. */
+    uint8_t *stream;
+    int stream_size;
+    int stream_used;
+    int (*stream_func) (struct _bench_ctx_t *c);
+
+    /* start of each allocation */
+    uint8_t *src_buf;
+    uint8_t *dst_buf;
+    uint8_t *plane_bufs[4];
+} bench_ctx_t;
+
+typedef int (*bench_func_t) (bench_ctx_t *c);
+
+typedef struct _bench_kernel_t {
+    const char *name;
+    bench_func_t func;
+    /* bits per pixel of the source and destination images, used to size
+     * the buffers and compute throughput */
+    int src_bpp;
+    int dst_bpp;
+    /* CamPixelIsaFlags for which the kernel has its own code path.  Other
+     * instruction sets are skipped, since they would just time the same
+     * code again. */
+    int paths;
+    /* CamPixelIsaFlags the kernel can't run without */
+    int required_isa;
+    /* BenchKernelFlags */
+    int flags;
+} bench_kernel_t;
+
+typedef enum {
+    /* the kernel writes the four bayer planes instead of dst */
+    BENCH_PLANES_OUT = 1 << 0,
+    /* the kernel needs 16-byte aligned buffers and 128-byte aligned
+     * strides */
+    BENCH_ALIGNED    = 1 << 1,
+    /* the kernel needs an even width and height */
+    BENCH_BAYER      = 1 << 2,
+    /* the output is half the width and height of the input */
+    BENCH_HALF       = 1 << 3,
+    /* the kernel works on the largest square in the top-left corner of
+     * the image, so that rotated output fits the destination buffer */
+    BENCH_SQUARE     = 1 << 4,
+    /* the output is planar 4:2:0, with the chroma planes below the image */
+    BENCH_PLANAR_OUT = 1 << 5,
+    /* the output is the stream_used bytes of stream instead of dst */
+    BENCH_STREAM     = 1 << 6,
+    /* the output must also equal the source image */
+    BENCH_ROUNDTRIP  = 1 << 7,
+} BenchKernelFlags;
+
+#define STD_KERNEL(fn) \
+    static int run_##fn (bench_ctx_t *c) \
+    { \
+        return cam_pixel_##fn ((void*) c->dst, c->dstride, c->width, \
+                c->height, (void*) c->src, c->sstride); \
+    }
+
+STD_KERNEL (convert_8u_gray_to_8u_RGB)
+STD_KERNEL (convert_8u_gray_to_8u_RGBA)
+STD_KERNEL (convert_8u_gray_to_32f_gray)
+STD_KERNEL (convert_8u_gray_to_64f_gray)
+STD_KERNEL (convert_32f_gray_to_8u_gray)
+STD_KERNEL (convert_8u_rgb_to_8u_gray)
+STD_KERNEL (convert_8u_rgb_to_32f_gray)
+STD_KERNEL (convert_8u_rgb_to_8u_bgr)
+STD_KERNEL (convert_8u_bgr_to_8u_rgb)
+STD_KERNEL (convert_8u_rgb_to_8u_bgra)
+STD_KERNEL (convert_8u_bgra_to_8u_bgr)
+STD_KERNEL (convert_8u_bgra_to_8u_rgb)
+STD_KERNEL (convert_8u_yuv420p_to_8u_rgb)
+STD_KERNEL (convert_8u_yuv420p_to_8u_rgba)
+STD_KERNEL (convert_8u_yuv420p_to_8u_bgr)
+STD_KERNEL (convert_8u_yuv420p_to_8u_bgra)
+STD_KERNEL (convert_8u_yuv420p_to_8u_gray)
+STD_KERNEL (convert_8u_nv12_to_8u_yuv420p)
+STD_KERNEL (convert_8u_nv12_to_8u_rgb)
+STD_KERNEL (convert_8u_nv12_to_8u_bgr)
+STD_KERNEL (convert_8u_nv12_to_8u_bgra)
+STD_KERNEL (convert_8u_uyvy_to_8u_gray)
+STD_KERNEL (convert_8u_uyvy_to_8u_bgra)
+STD_KERNEL (convert_8u_uyvy_to_8u_rgb)
+STD_KERNEL (convert_8u_yuyv_to_8u_gray)
+STD_KERNEL (convert_8u_yuyv_to_8u_bgra)
+STD_KERNEL (convert_8u_yuyv_to_8u_rgb)
+STD_KERNEL (convert_8u_iyu1_to_8u_gray)
+STD_KERNEL (convert_8u_iyu1_to_8u_bgra)
+STD_KERNEL (convert_8u_iyu1_to_8u_rgb)
+STD_KERNEL (swap_bytes_16u)
+#undef STD_KERNEL
+
+static int
+run_apply_lut_8u (bench_ctx_t *c)
+{
+    return cam_pixel_apply_lut_8u (c->dst, c->dstride, c->width, c->height,
+            c->src, c->sstride, c->lut);
+}
+
+#define LUT_KERNEL(name, src_channels, dst_channels) \
+    static int \
+    run_ ## name (bench_ctx_t *c) \
+    { \
+        return cam_pixel_apply_lut_8u_multi (c->dst, c->dstride, c->width, \
+                c->height, c->src, c->sstride, src_channels, dst_channels, \
+                c->lut); \
+    }
+LUT_KERNEL (apply_lut_8u_rgb, 3, 3)
+LUT_KERNEL (apply_lut_8u_bgra, 4, 4)
+LUT_KERNEL (apply_lut_8u_gray_to_rgb, 1, 3)
+#undef LUT_KERNEL
+
+/* the random samples overflow the tables whenever shift is not 0 */
+#define LUT16_KERNEL(name, src_channels, dst_channels) \
+    static int \
+    run_ ## name (bench_ctx_t *c) \
+    { \
+        return cam_pixel_apply_lut_16u_to_8u (c->dst, c->dstride, c->width, \
+                c->height, (uint16_t*) c->src, c->sstride, src_channels, \
+                dst_channels, 16 - c->shift, c->lut16, c->big_endian); \
+    }
+LUT16_KERNEL (apply_lut_16u_to_8u_gray, 1, 1)
+LUT16_KERNEL (apply_lut_16u_to_8u_rgb, 3, 3)
+LUT16_KERNEL (apply_lut_16u_gray_to_8u_rgb, 1, 3)
+#undef LUT16_KERNEL
+
+static int
+run_convert_16u_gray_to_8u_gray (bench_ctx_t *c)
+{
+    return cam_pixel_convert_16u_gray_to_8u_gray (c->dst, c->dstride,
+            c->width, c->height, (uint16_t*) c->src, c->sstride, c->shift,
+            c->big_endian);
+}
+
+/* windows from a few hundred values wide to the full range, derived from
+ * the random shift */
+static int
+run_convert_16u_gray_to_8u_gray_window (bench_ctx_t *c)
+{
+    int low = c->shift * 4099;
+    int high = low + (97 << c->shift);
+    if (high > 0xffff)
+        high = 0xffff;
+    return cam_pixel_convert_16u_gray_to_8u_gray_window (c->dst, c->dstride,
+            c->width, c->height, (uint16_t*) c->src, c->sstride, low, high,
+            c->big_endian);
+}
+
+static int
+run_convert_8u_gray_to_16u_gray (bench_ctx_t *c)
+{
+    return cam_pixel_convert_8u_gray_to_16u_gray ((uint16_t*) c->dst,
+            c->dstride, c->width, c->height, c->src, c->sstride, c->shift,
+            c->big_endian);
+}
+
+#define UNPACK_KERNEL(bits) \
+    static int run_unpack_##bits##p_to_16u (bench_ctx_t *c) \
+    { \
+        return cam_pixel_unpack_##bits##p_to_16u ((uint16_t*) c->dst, \
+                c->dstride, c->width, c->height, c->src, c->sstride); \
+    } \
+    static int run_unpack_##bits##p_to_8u (bench_ctx_t *c) \
+    { \
+        return cam_pixel_unpack_##bits##p_to_8u (c->dst, c->dstride, \
+                c->width, c->height, c->src, c->sstride, c->shift); \
+    } \
+    static int run_split_bayer_planes_##bits##p_to_8u (bench_ctx_t *c) \
+    { \
+        return cam_pixel_split_bayer_planes_##bits##p_to_8u (c->planes, \
+                c->pstride, c->src, c->sstride, c->width / 2, \
+                c->height / 2, c->shift); \
+    }
+
+UNPACK_KERNEL (10)
+UNPACK_KERNEL (12)
+#undef UNPACK_KERNEL
+
+static int
+run_replicate_bayer_border_8u (bench_ctx_t *c)
+{
+    return cam_pixel_replicate_bayer_border_8u (c->src, c->sstride,
+            c->width, c->height);
+}
+
+static int
+run_split_bayer_planes_8u (bench_ctx_t *c)
+{
+    return cam_pixel_split_bayer_planes_8u (c->planes, c->pstride,
+            c->src, c->sstride, c->width / 2, c->height / 2);
+}
+
+static int
+run_split_bayer_planes_16u_to_8u (bench_ctx_t *c)
+{
+    return cam_pixel_split_bayer_planes_16u_to_8u (c->planes, c->pstride,
+            (uint16_t*) c->src, c->sstride, c->width / 2, c->height / 2,
+            c->shift, c->big_endian);
+}
+
+static int
+run_bayer_interpolate_to_8u_bgra (bench_ctx_t *c)
+{
+    return cam_pixel_bayer_interpolate_to_8u_bgra (c->planes, c->pstride,
+            c->dst, c->dstride, c->width, c->height,
+            CAM_PIXEL_FORMAT_BAYER_GBRG);
+}
+
+static int
+run_bayer_interpolate_to_8u_gray (bench_ctx_t *c)
+{
+    return cam_pixel_bayer_interpolate_to_8u_gray (c->src, c->sstride,
+            c->dst, c->dstride, c->width, c->height,
+            CAM_PIXEL_FORMAT_BAYER_GBRG);
+}
+
+static int
+run_bayer_interpolate_edge_to_8u_bgra (bench_ctx_t *c)
+{
+    return cam_pixel_bayer_interpolate_edge_to_8u_bgra (c->src, c->sstride,
+            c->dst, c->dstride, c->width, c->height,
+            CAM_PIXEL_FORMAT_BAYER_GBRG);
+}
+
+static int
+run_bayer_interpolate_to_16u_rgb (bench_ctx_t *c)
+{
+    return cam_pixel_bayer_interpolate_to_16u_rgb ((uint16_t*) c->src,
+            c->sstride, (uint16_t*) c->dst, c->dstride, c->width, c->height,
+            CAM_PIXEL_FORMAT_BAYER_GBRG);
+}
+
+static int
+run_bayer_interpolate_to_16u_gray (bench_ctx_t *c)
+{
+    return cam_pixel_bayer_interpolate_to_16u_gray ((uint16_t*) c->src,
+            c->sstride, (uint16_t*) c->dst, c->dstride, c->width, c->height,
+            CAM_PIXEL_FORMAT_BAYER_GBRG);
+}
+
+static int
+run_convert_bayer_to_8u_bgra (bench_ctx_t *c)
+{
+    return cam_pixel_convert_bayer_to_8u_bgra (c->dst, c->dstride,
+            c->width, c->height, c->src, c->sstride,
+            CAM_PIXEL_FORMAT_BAYER_GBRG);
+}
+
+static int
+run_convert_bayer_to_8u_gray (bench_ctx_t *c)
+{
+    return cam_pixel_convert_bayer_to_8u_gray (c->dst, c->dstride,
+            c->width, c->height, c->src, c->sstride,
+            CAM_PIXEL_FORMAT_BAYER_GBRG);
+}
+
+#define BIN_KERNEL(name) \
+    static int run_##name (bench_ctx_t *c) \
+    { \
+        return cam_pixel_##name (c->dst, c->dstride, c->width / 2, \
+                c->height / 2, c->src, c->sstride, \
+                CAM_PIXEL_FORMAT_BAYER_GBRG); \
+    }
+
+BIN_KERNEL (bayer_bin_to_8u_bgra)
+BIN_KERNEL (bayer_bin_to_8u_rgb)
+BIN_KERNEL (bayer_bin_to_8u_gray)
+#undef BIN_KERNEL
+
+#define ROTATE_KERNEL(fmt, orientation) \
+    static int run_rotate_##fmt##_##orientation (bench_ctx_t *c) \
+    { \
+        int n = MIN (c->width, c->height); \
+        return cam_pixel_rotate_##fmt (c->dst, c->dstride, n, n, \
+                c->src, c->sstride, CAM_PIXEL_ORIENTATION_##orientation); \
+    }
+
+ROTATE_KERNEL (8u_gray, ROTATE_90)
+ROTATE_KERNEL (8u_gray, ROTATE_180)
+ROTATE_KERNEL (8u_gray, ROTATE_270)
+ROTATE_KERNEL (8u_gray, TRANSVERSE)
+ROTATE_KERNEL (8u_rgb, ROTATE_90)
+ROTATE_KERNEL (8u_bgra, ROTATE_90)
+ROTATE_KERNEL (8u_bgra, ROTATE_180)
+ROTATE_KERNEL (8u_bgra, FLIP_HORIZONTAL)
+ROTATE_KERNEL (8u_bgra, TRANSPOSE)
+#undef ROTATE_KERNEL
+
+#define RESIZE_KERNEL(name, kernel, type, channels, shrink) \
+    static int run_##name (bench_ctx_t *c) \
+    { \
+        return cam_pixel_##kernel ((type*) c->dst, c->dstride, \
+                c->width / 2, c->height / 2, (type*) c->src, c->sstride, \
+                c->width - shrink, c->height - shrink, channels); \
+    }
+
+/* the bilinear kernels shrink by a little more than two, so that the
+ * interpolation weights vary */
+RESIZE_KERNEL (resize_box_8u_gray, resize_box_8u, uint8_t, 1, 0)
+RESIZE_KERNEL (resize_box_8u_bgra, resize_box_8u, uint8_t, 4, 0)
+RESIZE_KERNEL (resize_box_16u_gray, resize_box_16u, uint16_t, 1, 0)
+RESIZE_KERNEL (resize_bilinear_8u_gray, resize_bilinear_8u, uint8_t, 1, 1)
+RESIZE_KERNEL (resize_bilinear_8u_bgra, resize_bilinear_8u, uint8_t, 4, 1)
+RESIZE_KERNEL (resize_bilinear_16u_gray, resize_bilinear_16u, uint16_t, 1, 1)
+#undef RESIZE_KERNEL
+
+#define REMAP_KERNEL(name, channels) \
+    static int run_##name (bench_ctx_t *c) \
+    { \
+        if (!c->remap) \
+            return -1; \
+        return cam_pixel_remap_8u (c->dst, c->dstride, c->src, c->sstride, \
+                channels, c->remap); \
+    }
+
+REMAP_KERNEL (remap_8u_gray, 1)
+REMAP_KERNEL (remap_8u_bgra, 4)
+#undef REMAP_KERNEL
+
+/* Letterboxes or stretches most of the source image into a tensor the
+ * size of the destination, with ImageNet normalization.  Planar tensors
+ * put their planes one after the other in the destination rows. */
+static int
+run_tensor (bench_ctx_t *c, int src_channels, int channels, int flags)
+{
+    CamPixelTensor t;
+    memset (&t, 0, sizeof (t));
+    t.width = c->width;
+    t.height = flags & CAM_PIXEL_TENSOR_PLANAR ? c->height / channels :
+        c->height;
+    if (t.height < 1)
+        return -1;
+    t.channels = channels;
+    t.flags = flags;
+    t.src_width = c->width - c->width / 3;
+    t.src_height = c->height - c->height / 4;
+    t.src_channels = src_channels;
+    t.pad = 114;
+    cam_pixel_tensor_fit (&t, c->shift & 1);
+
+    static const float mean[3] = { 0.485, 0.456, 0.406 };
+    static const float std[3] = { 0.229, 0.224, 0.225 };
+    for (int k = 0; k < channels; k++)
+        cam_pixel_tensor_set_channel (&t, k,
+                src_channels == 4 ? 2 - k : k, mean[k], std[k]);
+    return cam_pixel_convert_8u_to_tensor (c->dst, c->dstride, c->src,
+            c->sstride, &t);
+}
+
+#define TENSOR_KERNEL(name, src_channels, channels, flags) \
+    static int run_##name (bench_ctx_t *c) \
+    { \
+        return run_tensor (c, src_channels, channels, flags); \
+    }
+
+TENSOR_KERNEL (tensor_8u_gray_to_32f, 1, 1, 0)
+TENSOR_KERNEL (tensor_8u_rgb_to_32f, 3, 3, 0)
+TENSOR_KERNEL (tensor_8u_bgra_to_32f_planar, 4, 3, CAM_PIXEL_TENSOR_PLANAR)
+TENSOR_KERNEL (tensor_8u_rgb_to_16f, 3, 3, CAM_PIXEL_TENSOR_HALF)
+TENSOR_KERNEL (tensor_8u_bgra_to_16f_planar, 4, 3,
+        CAM_PIXEL_TENSOR_PLANAR | CAM_PIXEL_TENSOR_HALF)
+#undef TENSOR_KERNEL
+
+/* Compares the source image against the random rows below it */
+static int
+run_sad_8u (bench_ctx_t *c)
+{
+    uint64_t sad;
+    int status = cam_pixel_sad_8u (c->src, c->sstride,
+            c->src + c->height * c->sstride, c->sstride, c->width,
+            c->height, &sad);
+    memcpy (c->stream, &sad, sizeof (sad));
+    c->stream_used = sizeof (sad);
+    c->stream_func = NULL;
+    return status;
+}
+
+/* Codes the source image against the random rows below it, as a
+ * contiguous buffer of sstride * height bytes */
+static int
+run_delta_encode_8u (bench_ctx_t *c)
+{
+    int n = c->sstride * c->height;
+    c->stream_used = cam_pixel_delta_encode_8u (c->stream, c->stream_size,
+            c->src, c->src + n, n);
+    c->stream_func = c->stream_used < 0 ? NULL : run_delta_encode_8u;
+    return c->stream_used < 0 ? -1 : 0;
+}
+
+static int
+run_delta_decode_8u (bench_ctx_t *c)
+{
+    int n = c->sstride * c->height;
+    uint8_t *out = c->dst;
+    if (c->stream_func != run_delta_encode_8u && run_delta_encode_8u (c) < 0)
+        return -1;
+    // the rows are contiguous, so the decoded buffer is copied out to the
+    // destination stride
+    if (c->dstride != c->sstride)
+        out = malloc (n);
+    int status = cam_pixel_delta_decode_8u (out, c->src + n, n, c->stream,
+            c->stream_used);
+    if (out != c->dst) {
+        for (int i = 0; i < c->height; i++)
+            memcpy (c->dst + i * c->dstride, out + i * c->sstride, c->width);
+        free (out);
+    }
+    return status;
+}
+
+/* Compresses the source image into the stream buffer */
+static int
+lossless_stream (bench_ctx_t *c, CamPixelFormat pfmt, bench_func_t func)
+{
+    c->stream_used = cam_pixel_lossless_encode (c->stream, c->stream_size,
+            c->src, c->sstride, pfmt, c->width, c->height, 1);
+    c->stream_func = c->stream_used < 0 ? NULL : func;
+    return c->stream_used < 0 ? -1 : 0;
+}
+
+/* The encoders cover the residual and packing stages, and the decoders the
+ * unpacking and reconstruction stages, on one thread.  The decoders reuse
+ * the stream of the last encode of the same format. */
+#define LOSSLESS_KERNEL(name, pfmt) \
+    static int run_lossless_encode_##name (bench_ctx_t *c) \
+    { \
+        return lossless_stream (c, CAM_PIXEL_FORMAT_##pfmt, \
+                run_lossless_encode_##name); \
+    } \
+    static int run_lossless_decode_##name (bench_ctx_t *c) \
+    { \
+        if (c->stream_func != run_lossless_encode_##name && \
+                run_lossless_encode_##name (c) < 0) \
+            return -1; \
+        return cam_pixel_lossless_decode (c->dst, c->dstride, c->width, \
+                c->height, CAM_PIXEL_FORMAT_##pfmt, c->stream, \
+                c->stream_used, 1); \
+    }
+
+LOSSLESS_KERNEL (8u_gray, GRAY)
+LOSSLESS_KERNEL (8u_bayer, BAYER_GBRG)
+LOSSLESS_KERNEL (16u_gray, LE_GRAY16)
+LOSSLESS_KERNEL (16u_bayer, LE_BAYER16_GBRG)
+#undef LOSSLESS_KERNEL
+
+#define SSE2 CAM_PIXEL_ISA_SSE2
+#define SSE3 CAM_PIXEL_ISA_SSE3
+#define BAYER BENCH_BAYER
+#define PLANES BENCH_PLANES_OUT
+#define ALIGNED BENCH_ALIGNED
+#define HALF BENCH_HALF
+#define SQUARE BENCH_SQUARE
+#define STREAM BENCH_STREAM
+#define ROUNDTRIP BENCH_ROUNDTRIP
+#define K(fn, sbpp, dbpp, paths, req, flags) \
+    { #fn, run_##fn, sbpp, dbpp, paths, req, flags }
+
+static const bench_kernel_t kernels[] = {
+    K (convert_8u_gray_to_8u_RGB, 8, 24, 0, 0, 0),
+    K (convert_8u_gray_to_8u_RGBA, 8, 32, 0, 0, 0),
+    K (convert_8u_gray_to_32f_gray, 8, 32, 0, 0, 0),
+    K (convert_8u_gray_to_64f_gray, 8, 64, 0, 0, 0),
+    K (convert_32f_gray_to_8u_gray, 32, 8, 0, 0, 0),
+    K (apply_lut_8u, 8, 8, 0, 0, 0),
+    K (apply_lut_8u_rgb, 24, 24, SSE2, 0, 0),
+    K (apply_lut_8u_bgra, 32, 32, SSE2, 0, 0),
+    K (apply_lut_8u_gray_to_rgb, 8, 24, 0, 0, 0),
+    K (apply_lut_16u_to_8u_gray, 16, 8, SSE2, 0, 0),
+    K (apply_lut_16u_to_8u_rgb, 48, 24, SSE2, 0, 0),
+    K (apply_lut_16u_gray_to_8u_rgb, 16, 24, 0, 0, 0),
+    K (convert_8u_rgb_to_8u_gray, 24, 8, 0, 0, 0),
+    K (convert_8u_rgb_to_32f_gray, 24, 32, 0, 0, 0),
+    K (convert_8u_rgb_to_8u_bgr, 24, 24, 0, 0, 0),
+    K (convert_8u_bgr_to_8u_rgb, 24, 24, 0, 0, 0),
+    K (convert_8u_rgb_to_8u_bgra, 24, 32, 0, 0, 0),
+    K (convert_8u_bgra_to_8u_bgr, 32, 24, 0, 0, 0),
+    K (convert_8u_bgra_to_8u_rgb, 32, 24, 0, 0, 0),
+    K (convert_8u_yuv420p_to_8u_rgb, 12, 24, 0, 0, 0),
+    K (convert_8u_yuv420p_to_8u_rgba, 12, 32, 0, 0, 0),
+    K (convert_8u_yuv420p_to_8u_bgr, 12, 24, 0, 0, 0),
+    K (convert_8u_yuv420p_to_8u_bgra, 12, 32, 0, 0, 0),
+    K (convert_8u_yuv420p_to_8u_gray, 12, 8, 0, 0, 0),
+    K (convert_8u_nv12_to_8u_yuv420p, 12, 8, SSE2, 0,
+            BENCH_BAYER | BENCH_PLANAR_OUT),
+    K (convert_8u_nv12_to_8u_rgb, 12, 24, 0, 0, BENCH_BAYER),
+    K (convert_8u_nv12_to_8u_bgr, 12, 24, 0, 0, BENCH_BAYER),
+    K (convert_8u_nv12_to_8u_bgra, 12, 32, 0, 0, BENCH_BAYER),
+    K (convert_8u_uyvy_to_8u_gray, 16, 8, 0, 0, 0),
+    K (convert_8u_uyvy_to_8u_bgra, 16, 32, 0, 0, 0),
+    K (convert_8u_uyvy_to_8u_rgb, 16, 24, 0, 0, 0),
+    K (convert_8u_yuyv_to_8u_gray, 16, 8, 0, 0, 0),
+    K (convert_8u_yuyv_to_8u_bgra, 16, 32, 0, 0, 0),
+    K (convert_8u_yuyv_to_8u_rgb, 16, 24, 0, 0, 0),
+    K (convert_8u_iyu1_to_8u_gray, 12, 8, 0, 0, 0),
+    K (convert_8u_iyu1_to_8u_bgra, 12, 32, 0, 0, 0),
+    K (convert_8u_iyu1_to_8u_rgb, 12, 24, 0, 0, 0),
+    K (swap_bytes_16u, 16, 16, SSE2, 0, 0),
+    K (convert_16u_gray_to_8u_gray, 16, 8, SSE2, 0, 0),
+    K (convert_16u_gray_to_8u_gray_window, 16, 8, SSE2, 0, 0),
+    K (convert_8u_gray_to_16u_gray, 8, 16, SSE2, 0, 0),
+    K (unpack_10p_to_16u, 10, 16, SSE2, 0, 0),
+    K (unpack_12p_to_16u, 12, 16, SSE2, 0, 0),
+    K (unpack_10p_to_8u, 10, 8, SSE2, 0, 0),
+    K (unpack_12p_to_8u, 12, 8, SSE2, 0, 0),
+    K (replicate_bayer_border_8u, 8, 0, 0, 0, BAYER),
+    K (split_bayer_planes_8u, 8, 8, SSE2, 0, BAYER | PLANES),
+    K (split_bayer_planes_16u_to_8u, 16, 8, SSE2, 0, BAYER | PLANES),
+    K (split_bayer_planes_10p_to_8u, 10, 8, SSE2, 0, BAYER | PLANES),
+    K (split_bayer_planes_12p_to_8u, 12, 8, SSE2, 0, BAYER | PLANES),
+    K (bayer_interpolate_to_8u_bgra, 8, 32, SSE2 | SSE3, SSE2,
+            BAYER | ALIGNED),
+    K (bayer_interpolate_to_8u_gray, 8, 8, SSE2 | SSE3, SSE2, BAYER | ALIGNED),
+    K (bayer_interpolate_edge_to_8u_bgra, 8, 32, SSE2, 0, BAYER),
+    K (bayer_interpolate_to_16u_rgb, 16, 48, SSE2, 0, BAYER),
+    K (bayer_interpolate_to_16u_gray, 16, 16, SSE2, 0, BAYER),
+    K (convert_bayer_to_8u_bgra, 8, 32, SSE2 | SSE3, SSE2, BAYER),
+    K (convert_bayer_to_8u_gray, 8, 8, SSE2 | SSE3, SSE2, BAYER),
+    K (bayer_bin_to_8u_bgra, 8, 32, SSE2, 0, BAYER | HALF),
+    K (bayer_bin_to_8u_rgb, 8, 24, 0, 0, BAYER | HALF),
+    K (bayer_bin_to_8u_gray, 8, 8, SSE2, 0, BAYER | HALF),
+    K (rotate_8u_gray_ROTATE_90, 8, 8, SSE2, 0, SQUARE),
+    K (rotate_8u_gray_ROTATE_180, 8, 8, SSE2, 0, SQUARE),
+    K (rotate_8u_gray_ROTATE_270, 8, 8, SSE2, 0, SQUARE),
+    K (rotate_8u_gray_TRANSVERSE, 8, 8, SSE2, 0, SQUARE),
+    K (rotate_8u_rgb_ROTATE_90, 24, 24, 0, 0, SQUARE),
+    K (rotate_8u_bgra_ROTATE_90, 32, 32, SSE2, 0, SQUARE),
+    K (rotate_8u_bgra_ROTATE_180, 32, 32, SSE2, 0, SQUARE),
+    K (rotate_8u_bgra_FLIP_HORIZONTAL, 32, 32, SSE2, 0, SQUARE),
+    K (rotate_8u_bgra_TRANSPOSE, 32, 32, SSE2, 0, SQUARE),
+    K (resize_box_8u_gray, 8, 8, SSE2, 0, BAYER | HALF),
+    K (resize_box_8u_bgra, 32, 32, SSE2, 0, BAYER | HALF),
+    K (resize_box_16u_gray, 16, 16, SSE2, 0, BAYER | HALF),
+    K (resize_bilinear_8u_gray, 8, 8, SSE2, 0, BAYER | HALF),
+    K (resize_bilinear_8u_bgra, 32, 32, SSE2, 0, BAYER | HALF),
+    K (resize_bilinear_16u_gray, 16, 16, 0, 0, BAYER | HALF),
+    K (remap_8u_gray, 8, 8, SSE2, 0, 0),
+    K (remap_8u_bgra, 32, 32, SSE2, 0, 0),
+    K (tensor_8u_gray_to_32f, 8, 32, SSE2, 0, 0),
+    K (tensor_8u_rgb_to_32f, 24, 96, SSE2, 0, 0),
+    K (tensor_8u_bgra_to_32f_planar, 32, 32, SSE2, 0, 0),
+    K (tensor_8u_rgb_to_16f, 24, 48, SSE2, 0, 0),
+    K (tensor_8u_bgra_to_16f_planar, 32, 16, SSE2, 0, 0),
+    K (sad_8u, 16, 0, SSE2, 0, STREAM),
+    K (delta_encode_8u, 16, 0, SSE2, 0, STREAM),
+    K (delta_decode_8u, 8, 8, SSE2, 0, ROUNDTRIP),
+    /* the throughput of the lossless codec is that of the raw image */
+    K (lossless_encode_8u_gray, 8, 0, SSE2, 0, STREAM),
+    K (lossless_encode_8u_bayer, 8, 0, SSE2, 0, BAYER | STREAM),
+    K (lossless_encode_16u_gray, 16, 0, SSE2, 0, STREAM),
+    K (lossless_encode_16u_bayer, 16, 0, SSE2, 0, BAYER | STREAM),
+    K (lossless_decode_8u_gray, 8, 8, SSE2, 0, ROUNDTRIP),
+    K (lossless_decode_8u_bayer, 8, 8, SSE2, 0, BAYER | ROUNDTRIP),
+    K (lossless_decode_16u_gray, 16, 16, SSE2, 0, ROUNDTRIP),
+    K (lossless_decode_16u_bayer, 16, 16, SSE2, 0, BAYER | ROUNDTRIP),
+};
+#undef K
+#undef SSE2
+#undef SSE3
+#undef BAYER
+#undef PLANES
+#undef ALIGNED
+#undef HALF
+#undef SQUARE
+#undef STREAM
+#undef ROUNDTRIP
+#define NUM_KERNELS (sizeof (kernels) / sizeof (kernels[0]))
+
+static const struct {
+    const char *name;
+    int mask;
+} isas[] = {
+    { "c", 0 },
+    { "sse2", CAM_PIXEL_ISA_SSE2 },
+    { "sse3", CAM_PIXEL_ISA_SSE2 | CAM_PIXEL_ISA_SSE3 },
+};
+#define NUM_ISAS (sizeof (isas) / sizeof (isas[0]))
+
+static const int default_sizes[][2] = {
+    { 640, 480 },
+    { 1280, 720 },
+    { 1920, 1080 },
+    { 2592, 1944 },
+    { 3840, 2160 },
+};
+#define NUM_DEFAULT_SIZES (sizeof (default_sizes) / sizeof (default_sizes[0]))
+
+/* Allocates the buffers for one image size.  Buffers are sized for the
+ * largest pixel formats any kernel uses, so one context can serve every
+ * kernel.  Each image starts @offset bytes past a 16-byte boundary. */
+static bench_ctx_t *
+bench_ctx_new (int width, int height, int sstride, int dstride, int pstride,
+        int offset, GRand *rng)
+{
+    bench_ctx_t *c = (bench_ctx_t*) calloc (1, sizeof (bench_ctx_t));
+    c->width = width;
+    c->height = height;
+    c->sstride = sstride;
+    c->dstride = dstride;
+    c->pstride = pstride;
+    c->shift = 4;
+
+    /* room for two extra planes of 4:2:0 chroma below the image */
+    int size = sstride * (height * 2 + 2 * BORDER_ROWS) + 2 * BORDER_BYTES;
+    c->src_buf = MALLOC_ALIGNED (size + offset);
+    for (int i = 0; i < size + offset; i++)
+        c->src_buf[i] = g_rand_int (rng) & 0xff;
+    c->src = c->src_buf + BORDER_ROWS * sstride + BORDER_BYTES + offset;
+
+    /* room for planar 4:2:0 output */
+    size = dstride * height * 3 / 2 + 2 * BORDER_BYTES;
+    c->dst_buf = MALLOC_ALIGNED (size + offset);
+    memset (c->dst_buf, 0, size + offset);
+    c->dst = c->dst_buf + BORDER_BYTES + offset;
+
+    size = pstride * (height / 2 + 2 * BORDER_ROWS) + 2 * BORDER_BYTES;
+    for (int i = 0; i < 4; i++) {
+        c->plane_bufs[i] = MALLOC_ALIGNED (size + offset);
+        for (int j = 0; j < size + offset; j++)
+            c->plane_bufs[i][j] = g_rand_int (rng) & 0xff;
+        c->planes[i] = c->plane_bufs[i] + BORDER_ROWS * pstride +
+            BORDER_BYTES + offset;
+    }
+    for (int i = 0; i < 4 * 256; i++)
+        c->lut[i] = g_rand_int (rng) & 0xff;
+    c->lut16 = malloc (4 << 16);
+    for (int i = 0; i < 4 << 16; i++)
+        c->lut16[i] = g_rand_int (rng) & 0xff;
+
+    /* large enough for the compressed stream of any lossless format, and
+     * the delta residual of the source image */
+    c->stream_size = MAX (cam_pixel_lossless_max_size (
+                CAM_PIXEL_FORMAT_LE_GRAY16, width, height),
+            cam_pixel_delta_max_size (sstride * height));
+    c->stream_size = MAX (c->stream_size, 64);
+    c->stream = malloc (c->stream_size);
+    c->stream_used = 0;
+    c->stream_func = NULL;
+
+    /* barrel distortion strong enough that the corners of the map fall
+     * outside the source image */
+    if (width < 2 || height < 2)
+        return c;
+    c->remap = cam_pixel_remap_new (width, height, width, height);
+    double cx = (width - 1) / 2.0;
+    double cy = (height - 1) / 2.0;
+    double f = 1.0 / (cx * cx + cy * cy);
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            double r2 = ((j - cx) * (j - cx) + (i - cy) * (i - cy)) * f;
+            double k = 1 + 0.3 * r2;
+            cam_pixel_remap_set (c->remap, j, i, cx + (j - cx) * k,
+                    cy + (i - cy) * k);
+        }
+    }
+    return c;
+}
+
+static void
+bench_ctx_free (bench_ctx_t *c)
+{
+    free (c->src_buf);
+    free (c->dst_buf);
+    for (int i = 0; i < 4; i++)
+        free (c->plane_bufs[i]);
+    cam_pixel_remap_free (c->remap);
+    free (c->lut16);
+    free (c->stream);
+    free (c);
+}
+
+/* Returns the mask of the newest instruction set in @mask */
+static int
+newest_isa (int mask)
+{
+    return mask & ~(mask >> 1);
+}
+
+/* Whether @mask selects a code path of @k that the CPU can run */
+static int
+isa_applies (const bench_kernel_t *k, int mask, int supported)
+{
+    int newest = newest_isa (mask);
+    return (mask & supported) == mask &&
+        (k->required_isa & mask) == k->required_isa &&
+        (!newest || (k->paths & newest));
+}
+
+/* Runs the kernel repeatedly for at least @min_time seconds and returns
+ * the fastest single run in seconds, or a negative value if the kernel
+ * failed. */
+static double
+time_kernel (const bench_kernel_t *k, bench_ctx_t *c, double min_time)
+{
+    GTimer *timer = g_timer_new ();
+    double best = -1;
+    double total = 0;
+    int iters = 0;
+
+    while (iters < 3 || total < min_time) {
+        g_timer_start (timer);
+        int status = k->func (c);
+        double t = g_timer_elapsed (timer, NULL);
+        if (status != 0) {
+            best = -1;
+            break;
+        }
+        if (best < 0 || t < best)
+            best = t;
+        total += t;
+        iters++;
+    }
+    g_timer_destroy (timer);
+    return best;
+}
+
+/* Copies the part of the output of @k that is defined into @out, or
+ * compares it against @out if @compare is set.  Returns the offset of the
+ * first differing byte plus one, or 0 if the outputs match.  Streams are
+ * preceded by their length. */
+static int
+collect_output (const bench_kernel_t *k, bench_ctx_t *c, uint8_t *out,
+        int compare)
+{
+    if (k->flags & BENCH_STREAM) {
+        int n = c->stream_used > 0 ? c->stream_used : 0;
+        if (!compare) {
+            memcpy (out, &n, sizeof (n));
+            memcpy (out + sizeof (n), c->stream, n);
+            return 0;
+        }
+        if (memcmp (out, &n, sizeof (n)))
+            return 1;
+        for (int j = 0; j < n; j++)
+            if (out[sizeof (n) + j] != c->stream[j])
+                return sizeof (n) + j + 1;
+        return 0;
+    }
+
+    int nimages = 1;
+    int rows = c->height;
+    int row_bytes = (c->width * k->dst_bpp + 7) / 8;
+    int stride = c->dstride;
+    if (k->flags & (BENCH_PLANES_OUT | BENCH_HALF)) {
+        rows = c->height / 2;
+        row_bytes = (c->width / 2 * k->dst_bpp + 7) / 8;
+    }
+    if (k->flags & BENCH_SQUARE) {
+        rows = MIN (c->width, c->height);
+        row_bytes = (rows * k->dst_bpp + 7) / 8;
+    }
+    if (k->flags & BENCH_PLANES_OUT) {
+        nimages = 4;
+        stride = c->pstride;
+    }
+    if (k->flags & BENCH_PLANAR_OUT) {
+        rows = 1;
+        row_bytes = c->dstride * c->height * 3 / 2;
+    }
+
+    int pos = 0;
+    for (int n = 0; n < nimages; n++) {
+        const uint8_t *img = nimages == 1 ? c->dst : c->planes[n];
+        for (int i = 0; i < rows; i++) {
+            const uint8_t *row = img + i * stride;
+            if (!compare) {
+                memcpy (out + pos, row, row_bytes);
+            } else {
+                for (int j = 0; j < row_bytes; j++)
+                    if (out[pos + j] != row[j])
+                        return pos + j + 1;
+            }
+            pos += row_bytes;
+        }
+    }
+    return 0;
+}
+
+/* Returns the offset of the first byte of the output of @k that differs
+ * from the source image plus one, or 0 if they match */
+static int
+compare_source (const bench_kernel_t *k, bench_ctx_t *c)
+{
+    int row_bytes = (c->width * k->dst_bpp + 7) / 8;
+    for (int i = 0; i < c->height; i++) {
+        const uint8_t *srow = c->src + i * c->sstride;
+        const uint8_t *drow = c->dst + i * c->dstride;
+        for (int j = 0; j < row_bytes; j++)
+            if (srow[j] != drow[j])
+                return i * row_bytes + j + 1;
+    }
+    return 0;
+}
+
+static void
+clear_output (const bench_kernel_t *k, bench_ctx_t *c)
+{
+    if (k->flags & BENCH_STREAM) {
+        c->stream_used = 0;
+        c->stream_func = NULL;
+        return;
+    }
+    if (k->flags & BENCH_PLANES_OUT) {
+        for (int i = 0; i < 4; i++)
+            memset (c->planes[i], 0, c->pstride * (c->height / 2));
+    } else {
+        memset (c->dst, 0, c->dstride * c->height * 3 / 2);
+    }
+}
+
+/* Picks a stride of at least @row_bytes.  Unless the kernel requires
+ * aligned strides, the padding is random and may leave the stride odd. */
+static int
+fuzz_stride (GRand *rng, const bench_kernel_t *k, int row_bytes, int bpp)
+{
+    if (k->flags & BENCH_ALIGNED)
+        return ALIGN128 (row_bytes + g_rand_int_range (rng, 0, 256));
+    int stride = row_bytes + g_rand_int_range (rng, 0, 40);
+    if (bpp % 16 == 0)
+        stride = (stride + 1) & ~1;
+    return stride;
+}
+
+/* Runs each SIMD code path of each kernel on images of random size,
+ * stride and alignment, and checks that the output matches that of the
+ * lowest code path, normally the portable C one.  Returns the number of
+ * failed comparisons. */
+static int
+verify_kernels (const char *kernel_filter, const char *isa_filter,
+        int trials, guint32 seed)
+{
+    int supported = cam_pixel_get_supported_isa ();
+    int nfailed = 0;
+    GRand *rng = g_rand_new_with_seed (seed);
+
+    printf ("# kernel\tisa\treference\ttrials\tresult\n");
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        const bench_kernel_t *kern = &kernels[k];
+        if (!kern->paths)
+            continue;
+        if (kernel_filter && !strstr (kern->name, kernel_filter))
+            continue;
+        int ref_mask = kern->required_isa;
+        if ((ref_mask & supported) != ref_mask)
+            continue;
+        const char *ref_name = NULL;
+        for (int a = 0; a < NUM_ISAS; a++)
+            if (isas[a].mask == ref_mask)
+                ref_name = isas[a].name;
+
+        for (int a = 0; a < NUM_ISAS; a++) {
+            int mask = isas[a].mask;
+            if (mask == ref_mask || !isa_applies (kern, mask, supported))
+                continue;
+            if (isa_filter && strcmp (isa_filter, isas[a].name))
+                continue;
+
+            int failed = 0;
+            for (int t = 0; t < trials && !failed; t++) {
+                int width = g_rand_int_range (rng, 1, 200);
+                int height = g_rand_int_range (rng, 1, 24);
+                if (kern->flags & BENCH_BAYER) {
+                    width = (width + 4) & ~1;
+                    height = (height + 4) & ~1;
+                }
+                int wide = kern->flags & (BENCH_PLANES_OUT | BENCH_HALF) ?
+                    width / 2 : width;
+                int sstride = fuzz_stride (rng, kern,
+                        (width * kern->src_bpp + 7) / 8, kern->src_bpp);
+                int dstride = fuzz_stride (rng, kern,
+                        (wide * kern->dst_bpp + 7) / 8, kern->dst_bpp);
+                int pstride = fuzz_stride (rng, kern, width / 2 + 1, 8);
+                int offset = 0;
+                if (!(kern->flags & BENCH_ALIGNED)) {
+                    offset = g_rand_int_range (rng, 0, 16);
+                    if (kern->src_bpp % 16 == 0 || kern->dst_bpp % 16 == 0)
+                        offset &= ~1;
+                }
+
+                bench_ctx_t *ctx = bench_ctx_new (width, height, sstride,
+                        dstride, pstride, offset, rng);
+                ctx->shift = g_rand_int_range (rng, 0, 9);
+                ctx->big_endian = g_rand_boolean (rng);
+
+                int size = 4 * dstride * height + 4 * pstride * height +
+                    sizeof (int) + ctx->stream_size;
+                uint8_t *ref = malloc (size);
+
+                cam_pixel_set_isa_mask (ref_mask);
+                clear_output (kern, ctx);
+                int ref_status = kern->func (ctx);
+                collect_output (kern, ctx, ref, 0);
+
+                int ref_trip = (kern->flags & BENCH_ROUNDTRIP) &&
+                    ref_status == 0 ? compare_source (kern, ctx) : 0;
+
+                cam_pixel_set_isa_mask (mask);
+                clear_output (kern, ctx);
+                int status = kern->func (ctx);
+                int diff = collect_output (kern, ctx, ref, 1);
+                int trip = (kern->flags & BENCH_ROUNDTRIP) && status == 0 ?
+                    compare_source (kern, ctx) : 0;
+
+                if (ref_trip || trip) {
+                    fprintf (stderr, "%s: %s output differs from the source "
+                            "image at %dx%d, byte %d\n", kern->name,
+                            ref_trip ? ref_name : isas[a].name, width,
+                            height, (ref_trip ? ref_trip : trip) - 1);
+                    failed = 1;
+                }
+                if (status != ref_status || diff) {
+                    fprintf (stderr, "%s: %s differs from %s at %dx%d, "
+                            "strides %d/%d/%d, offset %d, shift %d%s: ",
+                            kern->name, isas[a].name, ref_name, width,
+                            height, sstride, dstride, pstride, offset,
+                            ctx->shift, ctx->big_endian ? " BE" : "");
+                    if (status != ref_status)
+                        fprintf (stderr, "returned %d instead of %d\n",
+                                status, ref_status);
+                    else
+                        fprintf (stderr, "output byte %d\n", diff - 1);
+                    failed = 1;
+                }
+                free (ref);
+                bench_ctx_free (ctx);
+            }
+            printf ("%s\t%s\t%s\t%d\t%s\n", kern->name, isas[a].name,
+                    ref_name, trials, failed ? "FAIL" : "ok");
+            nfailed += failed;
+        }
+    }
+    cam_pixel_set_isa_mask (~0);
+    g_rand_free (rng);
+    return nfailed;
+}
+
+static void
+usage (void)
+{
+    fprintf (stderr,
+        "Usage: camunits-pixel-bench [OPTIONS]\n"
+        "\n"
+        "Times the libcamunits cam_pixel_ kernels on synthetic images at\n"
+        "several resolutions, once for each instruction set that both the\n"
+        "CPU and the kernel support.  Results are written to stdout as\n"
+        "tab-separated columns:\n"
+        "\n"
+        "  kernel  isa  width  height  ns/pixel  GB/s\n"
+        "\n"
+        "where GB/s counts both the bytes read and the bytes written, except\n"
+        "for the decoders, whose throughput is that of the decoded image.\n"
+        "Rows are always printed in the same order, so that results from\n"
+        "two builds can be compared with paste or join.\n"
+        "\n"
+        "With --verify, the SIMD code paths are instead checked against the\n"
+        "portable C code on images of random size, stride, and alignment.\n"
+        "The exit status is nonzero if any output differs.\n"
+        "\n"
+        "Options:\n"
+        " -h, --help          Show this help text and exit.\n"
+        " -k, --kernel NAME   Only run kernels whose name contains NAME.\n"
+        " -s, --size WxH      Only run at resolution WxH.  May be given\n"
+        "                     more than once.\n"
+        " -i, --isa ISA       Only run the c, sse2, or sse3 code path.\n"
+        " -t, --time SECONDS  Minimum time spent on each measurement.\n"
+        "                     Default 0.2.\n"
+        " -o, --offset BYTES  Misalign the images by BYTES bytes.  Kernels\n"
+        "                     that need aligned images are skipped.\n"
+        " -l, --list          List the kernels and exit.\n"
+        " -v, --verify        Check the SIMD code paths instead of timing.\n"
+        " -n, --trials N      Number of random images per kernel and code\n"
+        "                     path when verifying.  Default 200.\n"
+        " -S, --seed SEED     Random seed used when verifying.\n");
+}
+
+int main (int argc, char **argv)
+{
+    const char *kernel_filter = NULL;
+    const char *isa_filter = NULL;
+    double min_time = 0.2;
+    int sizes[32][2];
+    int nsizes = 0;
+    int offset = 0;
+    int verify = 0;
+    int trials = 200;
+    guint32 seed = 1;
+
+    char *optstring = "hk:s:i:t:o:lvn:S:";
+    int c;
+    struct option long_opts[] = {
+        { "help", no_argument, 0, 'h' },
+        { "kernel", required_argument, 0, 'k' },
+        { "size", required_argument, 0, 's' },
+        { "isa", required_argument, 0, 'i' },
+        { "time", required_argument, 0, 't' },
+        { "offset", required_argument, 0, 'o' },
+        { "list", no_argument, 0, 'l' },
+        { "verify", no_argument, 0, 'v' },
+        { "trials", required_argument, 0, 'n' },
+        { "seed", required_argument, 0, 'S' },
+        { 0, 0, 0, 0 }
+    };
+
+    while ((c = getopt_long (argc, argv, optstring, long_opts, 0)) >= 0) {
+        switch (c) {
+            case 'k':
+                kernel_filter = optarg;
+                break;
+            case 's':
+                if (nsizes >= 32 || 2 != sscanf (optarg, "%dx%d",
+                            &sizes[nsizes][0], &sizes[nsizes][1]) ||
+                        sizes[nsizes][0] < 16 || sizes[nsizes][1] < 4) {
+                    fprintf (stderr, "Invalid size %s\n", optarg);
+                    return 1;
+                }
+                /* the bayer kernels need an even size */
+                sizes[nsizes][0] &= ~1;
+                sizes[nsizes][1] &= ~1;
+                nsizes++;
+                break;
+            case 'i':
+                isa_filter = optarg;
+                break;
+            case 't':
+                min_time = strtod (optarg, NULL);
+                break;
+            case 'o':
+                offset = atoi (optarg) & 0xf;
+                break;
+            case 'v':
+                verify = 1;
+                break;
+            case 'n':
+                trials = atoi (optarg);
+                break;
+            case 'S':
+                seed = strtoul (optarg, NULL, 10);
+                break;
+            case 'l':
+                for (int i = 0; i < NUM_KERNELS; i++)
+                    printf ("%s\n", kernels[i].name);
+                return 0;
+            case 'h':
+            default:
+                usage ();
+                return 1;
+        }
+    }
+
+    if (verify)
+        return verify_kernels (kernel_filter, isa_filter, trials, seed) ?
+            1 : 0;
+
+    if (!nsizes) {
+        for (int i = 0; i < NUM_DEFAULT_SIZES; i++) {
+            sizes[i][0] = default_sizes[i][0];
+            sizes[i][1] = default_sizes[i][1];
+        }
+        nsizes = NUM_DEFAULT_SIZES;
+    }
+
+    int supported = cam_pixel_get_supported_isa ();
+    GRand *rng = g_rand_new_with_seed (seed);
+
+    printf ("# kernel\tisa\twidth\theight\tns/pixel\tGB/s\n");
+    for (int s = 0; s < nsizes; s++) {
+        int width = sizes[s][0];
+        int height = sizes[s][1];
+        /* destination rows are wide enough for 96-bit float RGB */
+        bench_ctx_t *ctx = bench_ctx_new (width, height,
+                ALIGN128 (width * 8 + 2 * BORDER_BYTES), ALIGN128 (width * 12),
+                ALIGN128 (width / 2 + 2 * BORDER_BYTES), offset, rng);
+
+        for (int k = 0; k < NUM_KERNELS; k++) {
+            const bench_kernel_t *kern = &kernels[k];
+            if (kernel_filter && !strstr (kern->name, kernel_filter))
+                continue;
+            if (offset && (kern->flags & BENCH_ALIGNED))
+                continue;
+
+            for (int a = 0; a < NUM_ISAS; a++) {
+                if (isa_filter && strcmp (isa_filter, isas[a].name))
+                    continue;
+                int mask = isas[a].mask;
+                if (!isa_applies (kern, mask, supported))
+                    continue;
+
+                cam_pixel_set_isa_mask (mask);
+                double t = time_kernel (kern, ctx, min_time);
+                if (t < 0) {
+                    fprintf (stderr, "%s failed on %s at %dx%d\n",
+                            kern->name, isas[a].name, width, height);
+                    continue;
+                }
+
+                double pixels = (double) width * height;
+                if (kern->flags & BENCH_SQUARE)
+                    pixels = (double) MIN (width, height) * MIN (width, height);
+                double bytes = pixels * (kern->src_bpp + kern->dst_bpp) / 8;
+                /* the decoders read the compressed stream, not the source */
+                if (kern->flags & BENCH_ROUNDTRIP)
+                    bytes = pixels * kern->dst_bpp / 8;
+                if (kern->flags & BENCH_HALF)
+                    bytes = pixels * (kern->src_bpp + kern->dst_bpp / 4) / 8;
+                printf ("%s\t%s\t%d\t%d\t%.3f\t%.3f\n", kern->name,
+                        isas[a].name, width, height, t * 1e9 / pixels,
+                        bytes / t / 1e9);
+            }
+        }
+        bench_ctx_free (ctx);
+    }
+    cam_pixel_set_isa_mask (~0);
+    g_rand_free (rng);
+    return 0;
+}
@@ -0,0 +1,4 @@
+#!/bin/sh
+# Checks the SIMD code paths of the cam_pixel_ kernels against the
+# portable C code.  Run by make check.
+exec ./camunits-pixel-bench --verify
@@ -1,10 +1,19 @@
 #include "cpuid.h"
 
+/* ebx may hold the PIC register, so it is saved around cpuid by hand.  On
+ * x86-64 the whole of rbx must be swapped, since writing ebx clears the
+ * upper half of rbx. */
+#ifdef __x86_64__
+#define CPUID_XCHG "xchgq %%rbx, %q1    \n\t"
+#else
+#define CPUID_XCHG "xchgl %%ebx, %1    \n\t"
+#endif
+
 #define CPUID(func,ax,bx,cx,dx)\
     __asm__ __volatile__ ( \
-            "xchgl %%ebx, %1    \n\t" \
+            CPUID_XCHG \
             "cpuid              \n\t" \
-            "xchgl %%ebx, %1    \n\t" \
+            CPUID_XCHG \
             : "=a" (ax), "=r" (bx), "=c" (cx), "=d" (dx) \
             : "a" (func) \
             : "cc")
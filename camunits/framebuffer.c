@@ -51,6 +51,7 @@ cam_framebuffer_init (CamFrameBuffer *self)
     self->bytesused = 0;
     self->timestamp = 0;
     self->owns_data = 0;
+    self->view_parent = NULL;
 
     self->metadata = g_hash_table_new_full (g_str_hash, g_str_equal,
             NULL, cam_metadata_pair_free);
@@ -71,6 +72,10 @@ cam_framebuffer_finalize (GObject *obj)
     if (self->data && self->owns_data) {
         free (self->data);
     }
+    if (self->view_parent) {
+        g_object_unref (self->view_parent);
+        self->view_parent = NULL;
+    }
     self->data = NULL;
     self->length = 0;
     g_hash_table_destroy (self->metadata);
@@ -101,6 +106,21 @@ cam_framebuffer_new_alloc (int length)
     return self;
 }
 
+CamFrameBuffer *
+cam_framebuffer_new_view (CamFrameBuffer *parent, int offset, int length)
+{
+    if (offset < 0 || length < 0 ||
+            (unsigned int) offset + length > parent->length) {
+        g_warning ("framebuffer view [%d, %d) outside of parent buffer "
+                "of %u bytes", offset, offset + length, parent->length);
+        return NULL;
+    }
+    CamFrameBuffer *self = cam_framebuffer_new (parent->data + offset,
+            length);
+    self->view_parent = g_object_ref (parent);
+    return self;
+}
+
 static void
 _copy_keyval (void *key, void *value, void *user_data)
 {
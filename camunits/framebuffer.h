@@ -67,6 +67,7 @@ struct _CamFrameBuffer {
     /*< private >*/
     int owns_data;
     GHashTable *metadata;
+    CamFrameBuffer *view_parent;
 };
 
 struct _CamFrameBufferClass {
@@ -97,6 +98,24 @@ CamFrameBuffer * cam_framebuffer_new (uint8_t * data, int length);
  */
 CamFrameBuffer * cam_framebuffer_new_alloc (int length);
 
+/**
+ * cam_framebuffer_new_view:
+ * @parent: the #CamFrameBuffer whose data the view refers to.
+ * @offset: byte offset of the view into the data buffer of @parent.
+ * @length: the size, in bytes, of the view.
+ *
+ * Creates a frame buffer that shares a region of the data buffer of
+ * @parent instead of copying it.  The view holds a reference to @parent,
+ * so the data stays valid for as long as the view exists.  Typically used
+ * together with a #CamUnitFormat whose row stride is that of @parent, to
+ * describe a sub-rectangle of an image.
+ *
+ * Returns: a newly allocated #CamFrameBuffer, or NULL if @offset and
+ *          @length do not lie within the data buffer of @parent.
+ */
+CamFrameBuffer * cam_framebuffer_new_view (CamFrameBuffer *parent,
+        int offset, int length);
+
 /**
  * cam_framebuffer_copy_metadata:
  * @self: the CamFrameBuffer
@@ -44,6 +44,18 @@ struct _CamLog {
 
     int64_t next_offset;
     uint64_t prev_offset;
+
+    // temporal delta encoding.  When writing, key_frame holds a copy of the
+    // last keyframe written; when reading, the last keyframe decoded for a
+    // delta frame.
+    int keyframe_interval;
+    int frames_since_key;
+    CamFrameBuffer * key_frame;
+    CamLogFrameFormat key_format;
+    int64_t key_offset;
+    uint8_t * delta_buf;
+    int delta_buf_size;
+    uint32_t curr_delta_len;    // residual size, 0 for full frames
 };
 
 
@@ -60,6 +72,7 @@ typedef enum {
     LOG_TYPE_FRAME_INFO_0 = 7,      // legacy, from v2
     LOG_TYPE_FRAME_INFO_1 = 8,
     LOG_TYPE_METADATA = 9,
+    LOG_TYPE_FRAME_DELTA = 10,
     LOG_TYPE_MAX
 } LogType;
 
@@ -95,6 +108,13 @@ typedef enum {
 //       uint32_t value_len;
 //       data_len * uint8_t value;
 
+// LOG_TYPE_FRAME_DELTA: (written instead of LOG_TYPE_FRAME_DATA)
+//    uint64_t keyframe_offset;   (backwards from the start of this frame)
+//    uint32_t data_len;          (of the reconstructed frame)
+//    residual until the end of the field, as written by
+//       cam_pixel_delta_encode_8u() with the keyframe as reference;
+#define LOG_FRAME_DELTA_HEADER_SIZE 12
+
 static inline int
 log_put_uint8 (uint8_t val, FILE * f)
 {
@@ -259,7 +279,7 @@ log_resync (FILE * f)
                 return -1;
             if (log_get_uint16 (&type, f) < 0)
                 return -1;
-            if (marker == LOG_MARKER && type > 0 && type < 10) {
+            if (marker == LOG_MARKER && type > 0 && type < LOG_TYPE_MAX) {
                 /* Seek back to the start of the field */
                 fseeko (f, -(off_t)length-12, SEEK_CUR);
                 return 0;
@@ -277,6 +297,7 @@ log_resync (FILE * f)
 }
 // =================================================
 
+
 static int find_last_frame_info (CamLog *self);
 static int process_frame (CamLog * self);
 
@@ -344,6 +365,9 @@ cam_log_destroy (CamLog *self)
     if (self->fp) {
         fclose (self->fp);
     }
+    if (self->key_frame)
+        g_object_unref (self->key_frame);
+    free (self->delta_buf);
     memset (self,0,sizeof(CamLog));
     free (self);
 }
@@ -377,12 +401,87 @@ cam_log_get_frame_info (CamLog * self, CamLogFrameInfo * info)
     return 0;
 }
 
+/* Reads the data of the keyframe at @offset into self->key_frame, unless it
+ * is already there.  The file position is not restored. */
+static int
+load_keyframe (CamLog * self, int64_t offset)
+{
+    if (self->key_frame && self->key_offset == offset)
+        return 0;
+    if (self->key_frame) {
+        g_object_unref (self->key_frame);
+        self->key_frame = NULL;
+    }
+    if (fseeko (self->fp, offset, SEEK_SET) < 0)
+        return -1;
+
+    // skip the format, info and metadata fields of the keyframe
+    uint16_t type;
+    uint32_t len;
+    while (log_get_next_field (&type, &len, self->fp) == 0) {
+        if (type == LOG_TYPE_FRAME_DATA) {
+            CamFrameBuffer * key = cam_framebuffer_new_alloc (len);
+            if (fread (key->data, 1, len, self->fp) != len) {
+                g_object_unref (key);
+                return -1;
+            }
+            key->bytesused = len;
+            self->key_frame = key;
+            self->key_offset = offset;
+            return 0;
+        }
+        if (type == LOG_TYPE_FRAME_DELTA)
+            break;
+        if (fseeko (self->fp, len, SEEK_CUR) < 0)
+            break;
+    }
+    dbg (DBG_LOG, "No keyframe found at %"PRId64"\n", offset);
+    return -1;
+}
+
+static CamFrameBuffer *
+get_delta_frame (CamLog * self)
+{
+    CamLogFrameInfo * ci = &self->curr_info;
+    uint32_t payload_len = self->curr_delta_len;
+    if (load_keyframe (self, ci->keyframe_offset) < 0)
+        return NULL;
+    if (self->key_frame->bytesused != ci->data_len) {
+        dbg (DBG_LOG, "Keyframe size mismatch at %"PRId64"\n", ci->offset);
+        return NULL;
+    }
+
+    uint8_t * payload = malloc (payload_len);
+    if (fseeko (self->fp, ci->data_offset, SEEK_SET) < 0 ||
+            fread (payload, 1, payload_len, self->fp) != payload_len) {
+        free (payload);
+        return NULL;
+    }
+    CamFrameBuffer * framebuffer = cam_framebuffer_new_alloc (ci->data_len);
+    cam_framebuffer_copy_metadata (framebuffer, self->curr_frame);
+    if (cam_pixel_delta_decode_8u (framebuffer->data, self->key_frame->data,
+                ci->data_len, payload, payload_len) < 0) {
+        dbg (DBG_LOG, "Corrupt delta frame at %"PRId64"\n", ci->offset);
+        free (payload);
+        g_object_unref (framebuffer);
+        return NULL;
+    }
+    free (payload);
+    framebuffer->bytesused = ci->data_len;
+    return framebuffer;
+}
+
 CamFrameBuffer *
 cam_log_get_frame (CamLog * self)
 {
     if (!self->curr_frame)
         return NULL;
     int64_t offset = ftello (self->fp);
+    if (self->curr_delta_len) {
+        CamFrameBuffer * framebuffer = get_delta_frame (self);
+        fseeko (self->fp, offset, SEEK_SET);
+        return framebuffer;
+    }
     if (fseeko (self->fp, self->curr_info.data_offset, SEEK_SET) < 0)
         return NULL;
     CamFrameBuffer * framebuffer =
@@ -475,10 +574,33 @@ process_frame (CamLog * self)
         else if (type == LOG_TYPE_FRAME_DATA) {
             self->curr_info.data_len = len;
             self->curr_info.data_offset = ftello (f);
+            self->curr_info.keyframe_offset = self->curr_info.offset;
+            self->curr_delta_len = 0;
             if (fseeko (f, len, SEEK_CUR) < 0)
                 return -1;
             got_data = 1;
         }
+        else if (type == LOG_TYPE_FRAME_DELTA) {
+            CamLogFrameInfo * ci = &self->curr_info;
+            uint64_t key_dist;
+            uint32_t data_len;
+            if (len <= LOG_FRAME_DELTA_HEADER_SIZE) {
+                dbg (DBG_LOG, "Delta field had wrong length\n");
+                return -1;
+            }
+            if (log_get_uint64 (&key_dist, f) != 0 ||
+                    log_get_uint32 (&data_len, f) != 0) {
+                dbg (DBG_LOG, "Error parsing delta field\n");
+                return -1;
+            }
+            ci->data_len = data_len;
+            ci->data_offset = ftello (f);
+            ci->keyframe_offset = ci->offset - key_dist;
+            self->curr_delta_len = len - LOG_FRAME_DELTA_HEADER_SIZE;
+            if (fseeko (f, self->curr_delta_len, SEEK_CUR) < 0)
+                return -1;
+            got_data = 1;
+        }
         else if (type == LOG_TYPE_FRAME_TIMESTAMP) {
             uint32_t sec, usec, bus_timestamp;
             if (len != 12)
@@ -654,16 +776,75 @@ cam_log_write_frame (CamLog * self, CamLogFrameFormat * format,
         g_list_free (list);
     }
 
-    // write frame data
-    log_put_field (LOG_TYPE_FRAME_DATA, frame->bytesused, self->fp);
-    int status = fwrite (frame->data, 1, frame->bytesused, self->fp);
+    // write frame data, as a residual against the last keyframe if that
+    // is possible and pays off
+    int delta_len = -1;
+    if (self->key_frame && self->frames_since_key < self->keyframe_interval &&
+            frame->bytesused == self->key_frame->bytesused &&
+            format->width == self->key_format.width &&
+            format->height == self->key_format.height &&
+            format->stride == self->key_format.stride &&
+            format->pixelformat == self->key_format.pixelformat) {
+        int max_size = cam_pixel_delta_max_size (frame->bytesused);
+        if (self->delta_buf_size < max_size) {
+            free (self->delta_buf);
+            self->delta_buf = malloc (max_size);
+            self->delta_buf_size = max_size;
+        }
+        delta_len = cam_pixel_delta_encode_8u (self->delta_buf,
+                self->delta_buf_size, frame->data, self->key_frame->data,
+                frame->bytesused);
+    }
+
+    int status;
+    if (delta_len > 0 && delta_len < frame->bytesused) {
+        log_put_field (LOG_TYPE_FRAME_DELTA,
+                LOG_FRAME_DELTA_HEADER_SIZE + delta_len, self->fp);
+        log_put_uint64 (frame_start_offset - self->key_offset, self->fp);
+        log_put_uint32 (frame->bytesused, self->fp);
+        status = fwrite (self->delta_buf, 1, delta_len, self->fp) == delta_len;
+        self->frames_since_key++;
+    } else {
+        log_put_field (LOG_TYPE_FRAME_DATA, frame->bytesused, self->fp);
+        status = fwrite (frame->data, 1, frame->bytesused, self->fp) ==
+            frame->bytesused;
+
+        // only raw formats, whose bytes line up from frame to frame, are
+        // worth differencing
+        if (self->key_frame) {
+            g_object_unref (self->key_frame);
+            self->key_frame = NULL;
+        }
+        if (self->keyframe_interval > 1 &&
+                cam_pixel_format_stride_meaningful (format->pixelformat)) {
+            self->key_frame = cam_framebuffer_new_alloc (frame->bytesused);
+            memcpy (self->key_frame->data, frame->data, frame->bytesused);
+            self->key_frame->bytesused = frame->bytesused;
+            self->key_format = *format;
+            self->key_offset = frame_start_offset;
+            self->frames_since_key = 1;
+        }
+    }
     self->file_size = ftello (self->fp);
 
-    if (status != frame->bytesused)
+    if (!status)
         return -1;
     return 0;
 }
 
+int
+cam_log_set_keyframe_interval (CamLog *self, int interval)
+{
+    if (self->mode != CAMLOG_MODE_WRITE || interval < 0)
+        return -1;
+    self->keyframe_interval = interval;
+    if (interval <= 1 && self->key_frame) {
+        g_object_unref (self->key_frame);
+        self->key_frame = NULL;
+    }
+    return 0;
+}
+
 int 
 cam_log_count_frames (CamLog *self)
 {
@@ -806,7 +987,7 @@ find_last_frame_info (CamLog *self)
 {
     int64_t search_inc = 5000000;
 
-    for (int i=1; i < (self->file_size / search_inc) + 1 ; i++) {
+    for (int i=1; i <= (self->file_size / search_inc) + 1 ; i++) {
         off_t offset = MAX (0, self->file_size - i * search_inc);
 
         if (0 == cam_log_seek_to_offset (self, offset)) {
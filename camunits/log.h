@@ -30,6 +30,7 @@ typedef struct _CamLogFrameInfo {
     int64_t offset;
     uint64_t data_len;
     int64_t data_offset;
+    int64_t keyframe_offset;
 } CamLogFrameInfo;
 
 /**
@@ -53,6 +54,30 @@ CamFrameBuffer * cam_log_get_frame (CamLog * self);
 int cam_log_write_frame (CamLog * self, CamLogFrameFormat * format,
         CamFrameBuffer * frame, int64_t * offset);
 
+/**
+ * cam_log_set_keyframe_interval:
+ * @interval: 0 to store every frame in full, or the largest number of
+ *     frames from one keyframe to the next.
+ *
+ * Enables temporal delta encoding for the frames written after this call.
+ * Keyframes are stored in full, and the frames in between as their
+ * difference from the last keyframe, coded with
+ * cam_pixel_delta_encode_8u().  Static areas cost almost nothing and
+ * sensor noise a few bits per byte.  A frame that differs too much from
+ * the keyframe, or whose format or size changed, starts a new keyframe.
+ * Compressed formats such as #CAM_PIXEL_FORMAT_MJPEG are always stored in
+ * full.
+ *
+ * Delta frames are reconstructed transparently by cam_log_get_frame().
+ * Each one records the offset of its keyframe, so that it can be decoded
+ * after any seek with one extra read.
+ *
+ * Write-mode only.
+ *
+ * Returns: 0 on success, -1 on failure
+ */
+int cam_log_set_keyframe_interval (CamLog *self, int interval);
+
 /**
  * cam_log_count_frames:
  *
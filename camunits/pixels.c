@@ -30,15 +30,54 @@
 static int cpuid_detected = 0;
 static int has_sse2;
 static int has_sse3;
+static int cpu_sse2;
+static int cpu_sse3;
+static int isa_mask = ~0;
+
+static void
+apply_isa_mask (void)
+{
+    has_sse2 = cpu_sse2 && (isa_mask & CAM_PIXEL_ISA_SSE2);
+    has_sse3 = has_sse2 && cpu_sse3 && (isa_mask & CAM_PIXEL_ISA_SSE3);
+}
 
 int cam_pixel_check_sse2(){
     if (!cpuid_detected) {
-        cpuid_detect (&has_sse2, &has_sse3);
+        cpuid_detect (&cpu_sse2, &cpu_sse3);
         cpuid_detected = 1;
+        apply_isa_mask ();
     }
     return has_sse2;
 }
 
+int
+cam_pixel_get_supported_isa (void)
+{
+    cam_pixel_check_sse2 ();
+#ifdef HAVE_INTEL
+    return (cpu_sse2 ? CAM_PIXEL_ISA_SSE2 : 0) |
+        (cpu_sse3 ? CAM_PIXEL_ISA_SSE3 : 0);
+#else
+    return 0;
+#endif
+}
+
+void
+cam_pixel_set_isa_mask (int mask)
+{
+    cam_pixel_check_sse2 ();
+    isa_mask = mask;
+    apply_isa_mask ();
+}
+
+int
+cam_pixel_get_isa (void)
+{
+    cam_pixel_check_sse2 ();
+    return (has_sse2 ? CAM_PIXEL_ISA_SSE2 : 0) |
+        (has_sse3 ? CAM_PIXEL_ISA_SSE3 : 0);
+}
+
 GType
 cam_pixel_format_get_type (void)
 {
@@ -76,9 +115,33 @@ cam_pixel_format_get_type (void)
             { CAM_PIXEL_FORMAT_LE_BAYER16_GBRG, "CAM_PIXEL_FORMAT_LE_BAYER16_GBRG", "Bayer GBRG Little-Endian 16bpp" },
             { CAM_PIXEL_FORMAT_LE_BAYER16_GRBG, "CAM_PIXEL_FORMAT_LE_BAYER16_GRBG", "Bayer GRBG Little-Endian 16bpp" },
             { CAM_PIXEL_FORMAT_LE_BAYER16_RGGB, "CAM_PIXEL_FORMAT_LE_BAYER16_RGGB", "Bayer RGGB Little-Endian 16bpp" },
+            { CAM_PIXEL_FORMAT_BAYER10P_BGGR, "CAM_PIXEL_FORMAT_BAYER10P_BGGR", "Bayer BGGR Packed 10bpp" },
+            { CAM_PIXEL_FORMAT_BAYER10P_GBRG, "CAM_PIXEL_FORMAT_BAYER10P_GBRG", "Bayer GBRG Packed 10bpp" },
+            { CAM_PIXEL_FORMAT_BAYER10P_GRBG, "CAM_PIXEL_FORMAT_BAYER10P_GRBG", "Bayer GRBG Packed 10bpp" },
+            { CAM_PIXEL_FORMAT_BAYER10P_RGGB, "CAM_PIXEL_FORMAT_BAYER10P_RGGB", "Bayer RGGB Packed 10bpp" },
+            { CAM_PIXEL_FORMAT_BAYER12P_BGGR, "CAM_PIXEL_FORMAT_BAYER12P_BGGR", "Bayer BGGR Packed 12bpp" },
+            { CAM_PIXEL_FORMAT_BAYER12P_GBRG, "CAM_PIXEL_FORMAT_BAYER12P_GBRG", "Bayer GBRG Packed 12bpp" },
+            { CAM_PIXEL_FORMAT_BAYER12P_GRBG, "CAM_PIXEL_FORMAT_BAYER12P_GRBG", "Bayer GRBG Packed 12bpp" },
+            { CAM_PIXEL_FORMAT_BAYER12P_RGGB, "CAM_PIXEL_FORMAT_BAYER12P_RGGB", "Bayer RGGB Packed 12bpp" },
+            { CAM_PIXEL_FORMAT_GRAY10P, "CAM_PIXEL_FORMAT_GRAY10P", "Gray Packed 10bpp" },
+            { CAM_PIXEL_FORMAT_GRAY12P, "CAM_PIXEL_FORMAT_GRAY12P", "Gray Packed 12bpp" },
             { CAM_PIXEL_FORMAT_MJPEG, "CAM_PIXEL_FORMAT_MJPEG", "Motion-JPEG" },
             { CAM_PIXEL_FORMAT_FLOAT_GRAY32, "CAM_PIXEL_FORMAT_FLOAT_GRAY32", "Gray float-32bpp" },
-//            { CAM_PIXEL_FORMAT_FLOAT_RGB32, "CAM_PIXEL_FORMAT_FLOAT_RGB32", "RGB float-96bpp" },
+            { CAM_PIXEL_FORMAT_FLOAT_RGB32, "CAM_PIXEL_FORMAT_FLOAT_RGB32", "RGB float-96bpp" },
+            { CAM_PIXEL_FORMAT_FLOAT_RGB32_PLANAR, "CAM_PIXEL_FORMAT_FLOAT_RGB32_PLANAR", "Planar RGB float-96bpp" },
+            { CAM_PIXEL_FORMAT_HALF_GRAY16, "CAM_PIXEL_FORMAT_HALF_GRAY16", "Gray half-16bpp" },
+            { CAM_PIXEL_FORMAT_HALF_RGB16, "CAM_PIXEL_FORMAT_HALF_RGB16", "RGB half-48bpp" },
+            { CAM_PIXEL_FORMAT_HALF_RGB16_PLANAR, "CAM_PIXEL_FORMAT_HALF_RGB16_PLANAR", "Planar RGB half-48bpp" },
+            { CAM_PIXEL_FORMAT_LOSSLESS_GRAY, "CAM_PIXEL_FORMAT_LOSSLESS_GRAY", "Lossless Gray 8bpp" },
+            { CAM_PIXEL_FORMAT_LOSSLESS_BAYER_BGGR, "CAM_PIXEL_FORMAT_LOSSLESS_BAYER_BGGR", "Lossless Bayer BGGR 8bpp" },
+            { CAM_PIXEL_FORMAT_LOSSLESS_BAYER_GBRG, "CAM_PIXEL_FORMAT_LOSSLESS_BAYER_GBRG", "Lossless Bayer GBRG 8bpp" },
+            { CAM_PIXEL_FORMAT_LOSSLESS_BAYER_GRBG, "CAM_PIXEL_FORMAT_LOSSLESS_BAYER_GRBG", "Lossless Bayer GRBG 8bpp" },
+            { CAM_PIXEL_FORMAT_LOSSLESS_BAYER_RGGB, "CAM_PIXEL_FORMAT_LOSSLESS_BAYER_RGGB", "Lossless Bayer RGGB 8bpp" },
+            { CAM_PIXEL_FORMAT_LOSSLESS_LE_GRAY16, "CAM_PIXEL_FORMAT_LOSSLESS_LE_GRAY16", "Lossless Gray Little-Endian 16bpp" },
+            { CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_BGGR, "CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_BGGR", "Lossless Bayer BGGR Little-Endian 16bpp" },
+            { CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_GBRG, "CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_GBRG", "Lossless Bayer GBRG Little-Endian 16bpp" },
+            { CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_GRBG, "CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_GRBG", "Lossless Bayer GRBG Little-Endian 16bpp" },
+            { CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_RGGB, "CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_RGGB", "Lossless Bayer RGGB Little-Endian 16bpp" },
             { CAM_PIXEL_FORMAT_INVALID, "CAM_PIXEL_FORMAT_INVALID", "Invalid / Unsupported" },
             { CAM_PIXEL_FORMAT_ANY, "CAM_PIXEL_FORMAT_ANY", "Any Pixel Format" },
             {0, NULL, NULL}
@@ -121,7 +184,7 @@ cam_pixel_format_bpp (CamPixelFormat p)
         case CAM_PIXEL_FORMAT_I420:
             return 12;
         case CAM_PIXEL_FORMAT_NV12:
-            return 10;
+            return 12;
         case CAM_PIXEL_FORMAT_RGBA:
         case CAM_PIXEL_FORMAT_BGRA:
             return 32;
@@ -147,12 +210,42 @@ cam_pixel_format_bpp (CamPixelFormat p)
         case CAM_PIXEL_FORMAT_LE_BAYER16_GRBG:
         case CAM_PIXEL_FORMAT_LE_BAYER16_RGGB:
             return 16;
+        case CAM_PIXEL_FORMAT_GRAY10P:
+        case CAM_PIXEL_FORMAT_BAYER10P_BGGR:
+        case CAM_PIXEL_FORMAT_BAYER10P_GBRG:
+        case CAM_PIXEL_FORMAT_BAYER10P_GRBG:
+        case CAM_PIXEL_FORMAT_BAYER10P_RGGB:
+            return 10;
+        case CAM_PIXEL_FORMAT_GRAY12P:
+        case CAM_PIXEL_FORMAT_BAYER12P_BGGR:
+        case CAM_PIXEL_FORMAT_BAYER12P_GBRG:
+        case CAM_PIXEL_FORMAT_BAYER12P_GRBG:
+        case CAM_PIXEL_FORMAT_BAYER12P_RGGB:
+            return 12;
         case CAM_PIXEL_FORMAT_MJPEG:
             return 12; /* worst-case estimate */
         case CAM_PIXEL_FORMAT_FLOAT_GRAY32:
             return 32;
-//        case CAM_PIXEL_FORMAT_FLOAT_RGB32:
-//            return 96;
+        case CAM_PIXEL_FORMAT_FLOAT_RGB32:
+        case CAM_PIXEL_FORMAT_FLOAT_RGB32_PLANAR:
+            return 96;
+        case CAM_PIXEL_FORMAT_HALF_GRAY16:
+            return 16;
+        case CAM_PIXEL_FORMAT_HALF_RGB16:
+        case CAM_PIXEL_FORMAT_HALF_RGB16_PLANAR:
+            return 48;
+        case CAM_PIXEL_FORMAT_LOSSLESS_GRAY:
+        case CAM_PIXEL_FORMAT_LOSSLESS_BAYER_BGGR:
+        case CAM_PIXEL_FORMAT_LOSSLESS_BAYER_GBRG:
+        case CAM_PIXEL_FORMAT_LOSSLESS_BAYER_GRBG:
+        case CAM_PIXEL_FORMAT_LOSSLESS_BAYER_RGGB:
+            return 9; /* worst-case estimate */
+        case CAM_PIXEL_FORMAT_LOSSLESS_LE_GRAY16:
+        case CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_BGGR:
+        case CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_GBRG:
+        case CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_GRBG:
+        case CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_RGGB:
+            return 17; /* worst-case estimate */
         case CAM_PIXEL_FORMAT_INVALID:
         case CAM_PIXEL_FORMAT_ANY:
             return 0;
@@ -167,10 +260,69 @@ int cam_pixel_format_stride_meaningful (CamPixelFormat p)
         case CAM_PIXEL_FORMAT_INVALID:
             return 0;
         default:
-            return 1;
+            return cam_pixel_format_lossless_source (p) ==
+                CAM_PIXEL_FORMAT_INVALID;
+    }
+}
+
+int
+cam_pixel_format_packed_bits (CamPixelFormat p)
+{
+    switch (p) {
+        case CAM_PIXEL_FORMAT_GRAY10P:
+        case CAM_PIXEL_FORMAT_BAYER10P_BGGR:
+        case CAM_PIXEL_FORMAT_BAYER10P_GBRG:
+        case CAM_PIXEL_FORMAT_BAYER10P_GRBG:
+        case CAM_PIXEL_FORMAT_BAYER10P_RGGB:
+            return 10;
+        case CAM_PIXEL_FORMAT_GRAY12P:
+        case CAM_PIXEL_FORMAT_BAYER12P_BGGR:
+        case CAM_PIXEL_FORMAT_BAYER12P_GBRG:
+        case CAM_PIXEL_FORMAT_BAYER12P_GRBG:
+        case CAM_PIXEL_FORMAT_BAYER12P_RGGB:
+            return 12;
+        default:
+            return 0;
     }
 }
 
+static const CamPixelFormat lossless_formats[][2] = {
+    { CAM_PIXEL_FORMAT_GRAY, CAM_PIXEL_FORMAT_LOSSLESS_GRAY },
+    { CAM_PIXEL_FORMAT_BAYER_BGGR, CAM_PIXEL_FORMAT_LOSSLESS_BAYER_BGGR },
+    { CAM_PIXEL_FORMAT_BAYER_GBRG, CAM_PIXEL_FORMAT_LOSSLESS_BAYER_GBRG },
+    { CAM_PIXEL_FORMAT_BAYER_GRBG, CAM_PIXEL_FORMAT_LOSSLESS_BAYER_GRBG },
+    { CAM_PIXEL_FORMAT_BAYER_RGGB, CAM_PIXEL_FORMAT_LOSSLESS_BAYER_RGGB },
+    { CAM_PIXEL_FORMAT_LE_GRAY16, CAM_PIXEL_FORMAT_LOSSLESS_LE_GRAY16 },
+    { CAM_PIXEL_FORMAT_LE_BAYER16_BGGR,
+        CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_BGGR },
+    { CAM_PIXEL_FORMAT_LE_BAYER16_GBRG,
+        CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_GBRG },
+    { CAM_PIXEL_FORMAT_LE_BAYER16_GRBG,
+        CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_GRBG },
+    { CAM_PIXEL_FORMAT_LE_BAYER16_RGGB,
+        CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_RGGB },
+};
+
+CamPixelFormat
+cam_pixel_format_lossless (CamPixelFormat p)
+{
+    int i;
+    for (i = 0; i < G_N_ELEMENTS (lossless_formats); i++)
+        if (lossless_formats[i][0] == p)
+            return lossless_formats[i][1];
+    return CAM_PIXEL_FORMAT_INVALID;
+}
+
+CamPixelFormat
+cam_pixel_format_lossless_source (CamPixelFormat p)
+{
+    int i;
+    for (i = 0; i < G_N_ELEMENTS (lossless_formats); i++)
+        if (lossless_formats[i][1] == p)
+            return lossless_formats[i][0];
+    return CAM_PIXEL_FORMAT_INVALID;
+}
+
 int
 cam_pixel_convert_8u_gray_to_8u_RGB (uint8_t * dest, int dstride,
         int dwidth, int dheight, const uint8_t * src, int sstride)
@@ -252,13 +404,111 @@ int
 cam_pixel_apply_lut_8u (uint8_t * dest, int dstride, int dwidth, int dheight,
         const uint8_t * src, int sstride, const uint8_t * lut)
 {
-    int i, j;
+    return cam_pixel_apply_lut_8u_multi (dest, dstride, dwidth, dheight,
+            src, sstride, 1, 1, lut);
+}
 
-    for (i = 0; i < dheight; i++) {
-        uint8_t * drow = dest + i * dstride;
-        const uint8_t * srow = src + i * sstride;
-        for (j = 0; j < dwidth; j++) {
-            drow[j] = lut[srow[j]];
+static int
+check_lut_channels (const char *func, int src_channels, int dst_channels)
+{
+    if (src_channels < 1 || src_channels > 4 ||
+        dst_channels < 1 || dst_channels > 4 ||
+        (src_channels != 1 && src_channels != dst_channels)) {
+        fprintf (stderr, "%s: invalid channels %d -> %d\n", func,
+                src_channels, dst_channels);
+        return -1;
+    }
+    return 0;
+}
+
+int
+cam_pixel_apply_lut_8u_multi (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, int src_channels,
+        int dst_channels, const uint8_t *lut)
+{
+    int i, j, k;
+    if (check_lut_channels (__FUNCTION__, src_channels, dst_channels) < 0)
+        return -1;
+
+    if (src_channels == 1 && dst_channels > 1) {
+        /* gather the outputs for each value into one word, and store
+         * whole words, which spill into the next pixel except on the last
+         * pixel of the row */
+        uint8_t packed[256][4];
+        for (j = 0; j < 256; j++)
+            for (k = 0; k < 4; k++)
+                packed[j][k] = k < dst_channels ? lut[k * 256 + j] : 0;
+        for (i = 0; i < height; i++) {
+            const uint8_t *srow = src + i * sstride;
+            uint8_t *drow = dest + i * dstride;
+            for (j = 0; j < width - 1; j++)
+                memcpy (drow + j * dst_channels, packed[srow[j]], 4);
+            if (width > 0)
+                memcpy (drow + j * dst_channels, packed[srow[j]],
+                        dst_channels);
+        }
+        return 0;
+    }
+
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+#ifdef HAVE_INTEL
+    if (has_sse2 && src_channels > 1)
+        return cam_pixel_apply_lut_8u_sse2 (dest, dstride, width, height,
+                src, sstride, src_channels, lut);
+#endif
+
+    for (i = 0; i < height; i++) {
+        const uint8_t *srow = src + i * sstride;
+        uint8_t *drow = dest + i * dstride;
+        if (src_channels == 1) {
+            for (j = 0; j < width; j++)
+                drow[j] = lut[srow[j]];
+            continue;
+        }
+        for (j = 0; j < width * src_channels; j += src_channels)
+            for (k = 0; k < src_channels; k++)
+                drow[j + k] = lut[k * 256 + srow[j + k]];
+    }
+    return 0;
+}
+
+int
+cam_pixel_apply_lut_16u_to_8u (uint8_t *dest, int dstride, int width,
+        int height, const uint16_t *src, int sstride, int src_channels,
+        int dst_channels, int bits, const uint8_t *lut, int big_endian)
+{
+    int i, j, k;
+    if (check_lut_channels (__FUNCTION__, src_channels, dst_channels) < 0)
+        return -1;
+    if (bits < 1 || bits > 16) {
+        fprintf (stderr, "%s: invalid bits %d\n", __FUNCTION__, bits);
+        return -1;
+    }
+
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+#ifdef HAVE_INTEL
+    if (has_sse2 && src_channels == dst_channels)
+        return cam_pixel_apply_lut_16u_to_8u_sse2 (dest, dstride, width,
+                height, src, sstride, src_channels, bits, lut, big_endian);
+#endif
+
+    int max = (1 << bits) - 1;
+    for (i = 0; i < height; i++) {
+        const uint16_t *srow = (const uint16_t*)((const uint8_t*)src +
+                i*sstride);
+        uint8_t *drow = dest + i * dstride;
+        for (j = 0; j < width; j++) {
+            for (k = 0; k < dst_channels; k++) {
+                int v = srow[src_channels == 1 ? j : j * src_channels + k];
+                if (big_endian)
+                    v = ((v << 8) | (v >> 8)) & 0xffff;
+                drow[j * dst_channels + k] =
+                    lut[(k << bits) + (v > max ? max : v)];
+            }
         }
     }
     return 0;
@@ -616,6 +866,116 @@ cam_pixel_convert_8u_yuv420p_to_8u_gray(uint8_t *dest, int dstride, int dwidth,
     return 0;
 }
 
+int
+cam_pixel_convert_8u_nv12_to_8u_yuv420p (uint8_t *dest, int dstride,
+        int width, int height, const uint8_t *src, int sstride)
+{
+    if ((width | height) & 1) {
+        fprintf (stderr, "%s: odd image size %dx%d\n", __FUNCTION__,
+                width, height);
+        return -1;
+    }
+    const uint8_t *uvplane = src + height * sstride;
+    uint8_t *uplane = dest + height * dstride;
+    uint8_t *vplane = uplane + height * dstride / 4;
+    int i, j;
+
+    for (i = 0; i < height; i++)
+        memcpy (dest + i * dstride, src + i * sstride, width);
+
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+    for (i = 0; i < height / 2; i++) {
+        const uint8_t *uvrow = uvplane + i * sstride;
+        uint8_t *urow = uplane + i * dstride / 2;
+        uint8_t *vrow = vplane + i * dstride / 2;
+        j = 0;
+#ifdef HAVE_INTEL
+        if (has_sse2)
+            j = cam_pixel_deinterleave_8u_c2_sse2 (urow, vrow, uvrow,
+                    width / 2);
+#endif
+        for (; j < width / 2; j++) {
+            urow[j] = uvrow[2*j];
+            vrow[j] = uvrow[2*j+1];
+        }
+    }
+    return 0;
+}
+
+/* Converts NV12 to RGB with the same arithmetic as the I420 conversions,
+ * writing the red, green and blue samples of each pixel at offsets @r, 1
+ * and @b of @bpp bytes.  With 4 bytes per pixel, alpha is set as by
+ * cam_pixel_convert_8u_yuv420p_to_8u_bgra().  Inlined so that the
+ * offsets are constants. */
+static inline int
+_nv12_to_rgb (uint8_t *dest, int dstride, int width, int height,
+        const uint8_t *src, int sstride, int r, int b, int bpp)
+{
+    if ((width | height) & 1) {
+        fprintf (stderr, "%s: odd image size %dx%d\n", __FUNCTION__,
+                width, height);
+        return -1;
+    }
+    const uint8_t *uvplane = src + height * sstride;
+    int i, j;
+
+    for (i = 0; i < height / 2; i++) {
+        const uint8_t *yrow1 = src + i*2*sstride;
+        const uint8_t *yrow2 = yrow1 + sstride;
+        const uint8_t *uvrow = uvplane + i*sstride;
+        uint8_t *drow1 = dest + i*2*dstride;
+        uint8_t *drow2 = drow1 + dstride;
+        for (j = 0; j < width / 2; j++) {
+            int cb = ((uvrow[2*j] - 128) * 454) >> 8;
+            int cr = ((uvrow[2*j+1] - 128) * 359) >> 8;
+            int cg = ((uvrow[2*j+1] - 128) * 183 +
+                    (uvrow[2*j] - 128) * 88) >> 8;
+            int y;
+            uint8_t *d;
+#define NV12_PUT(drow, col, yrow) \
+            y = yrow[col]; \
+            d = drow + (col) * bpp; \
+            d[r] = MAX (0, MIN (255, y + cr)); \
+            d[1] = MAX (0, MIN (255, y - cg)); \
+            d[b] = MAX (0, MIN (255, y + cb)); \
+            if (bpp == 4) \
+                d[3] = 1;
+            NV12_PUT (drow1, 2*j, yrow1);
+            NV12_PUT (drow1, 2*j+1, yrow1);
+            NV12_PUT (drow2, 2*j, yrow2);
+            NV12_PUT (drow2, 2*j+1, yrow2);
+#undef NV12_PUT
+        }
+    }
+    return 0;
+}
+
+int
+cam_pixel_convert_8u_nv12_to_8u_rgb (uint8_t *dest, int dstride,
+        int width, int height, const uint8_t *src, int sstride)
+{
+    return _nv12_to_rgb (dest, dstride, width, height, src, sstride,
+            0, 2, 3);
+}
+
+int
+cam_pixel_convert_8u_nv12_to_8u_bgr (uint8_t *dest, int dstride,
+        int width, int height, const uint8_t *src, int sstride)
+{
+    return _nv12_to_rgb (dest, dstride, width, height, src, sstride,
+            2, 0, 3);
+}
+
+int
+cam_pixel_convert_8u_nv12_to_8u_bgra (uint8_t *dest, int dstride,
+        int width, int height, const uint8_t *src, int sstride)
+{
+    return _nv12_to_rgb (dest, dstride, width, height, src, sstride,
+            2, 0, 4);
+}
+
 int 
 cam_pixel_convert_8u_uyvy_to_8u_gray (uint8_t *dest, int dstride, int dwidth,
         int dheight, const uint8_t *src, int sstride)
@@ -971,11 +1331,8 @@ int
 cam_pixel_split_bayer_planes_8u (uint8_t *dst[4], int dstride,
         const uint8_t * src, int sstride, int width, int height)
 {
-  if (!cpuid_detected) {
-      fprintf(stderr,"Error in cam_pixel_split_bayer_planes_8u"
-          "must call cam_pixel_check_sse2 first\n");
-      return -1;
-  }
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
 
 #ifdef HAVE_INTEL
     if (has_sse2)
@@ -983,9 +1340,133 @@ cam_pixel_split_bayer_planes_8u (uint8_t *dst[4], int dstride,
                 src, sstride, width, height);
 #endif
 
-    fprintf (stderr, "Error: cam_pixel_split_bayer_planes_8u requires at "
-            "least SSE2 support\n");
-    return -1;
+    int i, j, k;
+    for (i = 0; i < height; i++) {
+        for (k = 0; k < 2; k++) {
+            const uint8_t * srow = src + (2*i + k)*sstride;
+            uint8_t * drow1 = dst[2*k] + i * dstride;
+            uint8_t * drow2 = dst[2*k+1] + i * dstride;
+            for (j = 0; j < width; j++) {
+                drow1[j] = srow[2*j];
+                drow2[j] = srow[2*j+1];
+            }
+        }
+    }
+    return 0;
+}
+
+/* Finds where the red, blue and two green pixels are within a 2x2 bayer
+ * tile, numbered as in cam_pixel_split_bayer_planes_8u() */
+static int
+bayer_tile_positions (CamPixelFormat format, int pos[4])
+{
+    switch (format) {
+        case CAM_PIXEL_FORMAT_BAYER_GBRG:
+            pos[0] = 2; pos[1] = 1; pos[2] = 0; pos[3] = 3;
+            return 0;
+        case CAM_PIXEL_FORMAT_BAYER_GRBG:
+            pos[0] = 1; pos[1] = 2; pos[2] = 0; pos[3] = 3;
+            return 0;
+        case CAM_PIXEL_FORMAT_BAYER_BGGR:
+            pos[0] = 3; pos[1] = 0; pos[2] = 1; pos[3] = 2;
+            return 0;
+        case CAM_PIXEL_FORMAT_BAYER_RGGB:
+            pos[0] = 0; pos[1] = 3; pos[2] = 1; pos[3] = 2;
+            return 0;
+        default:
+            fprintf (stderr, "Error: invalid bayer tiling %s\n",
+                    cam_pixel_format_nickname (format));
+            return -1;
+    }
+}
+
+/* Bins columns @start through @width - 1 of a bayer image, writing @bpp
+ * bytes per pixel: 4 for BGRA, 3 for RGB or 1 for gray */
+static void
+bayer_bin_8u (uint8_t *dest, int dstride, int start, int width, int height,
+        const uint8_t *src, int sstride, const int pos[4], int bpp)
+{
+    int i, j;
+    for (i = 0; i < height; i++) {
+        const uint8_t *s0 = src + 2*i*sstride;
+        const uint8_t *s1 = s0 + sstride;
+        uint8_t *drow = dest + i*dstride;
+        for (j = start; j < width; j++) {
+            int t[4] = { s0[2*j], s0[2*j+1], s1[2*j], s1[2*j+1] };
+            int r = t[pos[0]];
+            int b = t[pos[1]];
+            int g = (t[pos[2]] + t[pos[3]] + 1) >> 1;
+            switch (bpp) {
+                case 4:
+                    drow[4*j+0] = b;
+                    drow[4*j+1] = g;
+                    drow[4*j+2] = r;
+                    drow[4*j+3] = 0xff;
+                    break;
+                case 3:
+                    drow[3*j+0] = r;
+                    drow[3*j+1] = g;
+                    drow[3*j+2] = b;
+                    break;
+                default:
+                    drow[j] = (54*r + 183*g + 19*b + 128) >> 8;
+                    break;
+            }
+        }
+    }
+}
+
+int
+cam_pixel_bayer_bin_to_8u_bgra (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, CamPixelFormat format)
+{
+    int pos[4];
+    if (bayer_tile_positions (format, pos) < 0)
+        return -1;
+
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+    int j = 0;
+#ifdef HAVE_INTEL
+    if (has_sse2)
+        j = cam_pixel_bayer_bin_to_8u_bgra_sse2 (dest, dstride, width,
+                height, src, sstride, pos);
+#endif
+    bayer_bin_8u (dest, dstride, j, width, height, src, sstride, pos, 4);
+    return 0;
+}
+
+int
+cam_pixel_bayer_bin_to_8u_rgb (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, CamPixelFormat format)
+{
+    int pos[4];
+    if (bayer_tile_positions (format, pos) < 0)
+        return -1;
+    bayer_bin_8u (dest, dstride, 0, width, height, src, sstride, pos, 3);
+    return 0;
+}
+
+int
+cam_pixel_bayer_bin_to_8u_gray (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, CamPixelFormat format)
+{
+    int pos[4];
+    if (bayer_tile_positions (format, pos) < 0)
+        return -1;
+
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+    int j = 0;
+#ifdef HAVE_INTEL
+    if (has_sse2)
+        j = cam_pixel_bayer_bin_to_8u_gray_sse2 (dest, dstride, width,
+                height, src, sstride, pos);
+#endif
+    bayer_bin_8u (dest, dstride, j, width, height, src, sstride, pos, 1);
+    return 0;
 }
 
 int
@@ -1059,19 +1540,11 @@ cam_pixel_convert_bayer_to_8u_bgra (uint8_t *dest, int dstride, int width,
         bayer_planes[i] = MALLOC_ALIGNED (plane_stride * (height + 2));
     }
 
-    // alocate a 16-byte aligned buffer for the interpolated image
-    int bgra_stride = width*4;
+    // alocate a 16-byte aligned buffer for the interpolated image.  The
+    // interpolation needs a 128-byte aligned stride.
+    int bgra_stride = (width*4 + 0x7f) & (~0x7f);
     void *bgra_img = MALLOC_ALIGNED (height * bgra_stride);
 
-    // allocate a 16-byte aligned buffer for the source image
-    int bayer_stride = width;
-    void *bayer_img = MALLOC_ALIGNED (height * bayer_stride);
-
-    // copy the source image into the 16-byte aligned buffer
-    cam_pixel_copy_8u_generic (src, sstride, 
-            bayer_img, bayer_stride,
-            0, 0, 0, 0, width, height, 8);
-
     // split the bayer image 
     uint8_t * planes[] = {
         bayer_planes[0] + plane_stride + 16,
@@ -1083,7 +1556,7 @@ cam_pixel_convert_bayer_to_8u_bgra (uint8_t *dest, int dstride, int width,
     int p_height = height / 2;
 
     cam_pixel_split_bayer_planes_8u (planes, plane_stride,
-            bayer_img, bayer_stride, p_width, p_height);
+            src, sstride, p_width, p_height);
     for (int j = 0; j < 4; j++)
         cam_pixel_replicate_border_8u (planes[j], plane_stride, p_width, p_height);
 
@@ -1097,7 +1570,6 @@ cam_pixel_convert_bayer_to_8u_bgra (uint8_t *dest, int dstride, int width,
             dest, dstride, 0, 0, 0, 0, width, height, 8 * 4);
 
     // release allocated memory
-    free (bayer_img);
     free (bgra_img);
     for (int i=0; i<4; i++) {
         free (bayer_planes[i]);
@@ -1128,7 +1600,7 @@ cam_pixel_convert_bayer_to_8u_gray (uint8_t *dest, int dstride, int width,
             plane, plane_stride,
             0, 0, 0, 0, width, height, 8);
 
-    cam_pixel_replicate_border_8u (plane, plane_stride, width, height);
+    cam_pixel_replicate_bayer_border_8u (plane, plane_stride, width, height);
 
     if (!CAM_IS_ALIGNED16 (dest) || !CAM_IS_ALIGNED16 (dstride)) {
         void *gray_buf = MALLOC_ALIGNED (height * plane_stride);
@@ -1152,6 +1624,2226 @@ cam_pixel_convert_bayer_to_8u_gray (uint8_t *dest, int dstride, int width,
     return 0;
 }
 
+static inline uint8_t
+shift_16u_to_8u (uint16_t v, int shift, int big_endian)
+{
+    if (big_endian)
+        v = (v << 8) | (v >> 8);
+    v >>= shift;
+    return v > 255 ? 255 : v;
+}
+
+int
+cam_pixel_swap_bytes_16u (uint16_t *dest, int dstride, int width, int height,
+        const uint16_t *src, int sstride)
+{
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+#ifdef HAVE_INTEL
+    if (has_sse2)
+        return cam_pixel_swap_bytes_16u_sse2 (dest, dstride, width, height,
+                src, sstride);
+#endif
+
+    int i, j;
+    for (i = 0; i < height; i++) {
+        const uint16_t *srow = (const uint16_t*)((const uint8_t*)src +
+                i*sstride);
+        uint16_t *drow = (uint16_t*)((uint8_t*)dest + i*dstride);
+        for (j = 0; j < width; j++)
+            drow[j] = (srow[j] << 8) | (srow[j] >> 8);
+    }
+    return 0;
+}
+
+int
+cam_pixel_convert_16u_gray_to_8u_gray (uint8_t *dest, int dstride,
+        int width, int height, const uint16_t *src, int sstride, int shift,
+        int big_endian)
+{
+    if (shift < 0 || shift > 8) {
+        fprintf (stderr, "%s: invalid shift %d\n", __FUNCTION__, shift);
+        return -1;
+    }
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+#ifdef HAVE_INTEL
+    if (has_sse2)
+        return cam_pixel_convert_16u_gray_to_8u_gray_sse2 (dest, dstride,
+                width, height, src, sstride, shift, big_endian);
+#endif
+
+    int i, j;
+    for (i = 0; i < height; i++) {
+        const uint16_t *srow = (const uint16_t*)((const uint8_t*)src +
+                i*sstride);
+        uint8_t *drow = dest + i*dstride;
+        for (j = 0; j < width; j++)
+            drow[j] = shift_16u_to_8u (srow[j], shift, big_endian);
+    }
+    return 0;
+}
+
+static inline uint8_t
+window_16u_to_8u (uint16_t v, int low, int range, int pshift, int factor,
+        int big_endian)
+{
+    if (big_endian)
+        v = (v << 8) | (v >> 8);
+    unsigned int d = v > low ? v - low : 0;
+    if (d > range)
+        d = range;
+    d = ((d << pshift) * factor) >> 16;
+    return (d + 64) >> 7;
+}
+
+int
+cam_pixel_convert_16u_gray_to_8u_gray_window (uint8_t *dest, int dstride,
+        int width, int height, const uint16_t *src, int sstride, int low,
+        int high, int big_endian)
+{
+    if (low < 0 || high > 0xffff || high <= low) {
+        fprintf (stderr, "%s: invalid window %d - %d\n", __FUNCTION__,
+                low, high);
+        return -1;
+    }
+
+    /* The window is shifted up to fill 16 bits, so that a 16-bit
+     * multiply-high by factor leaves 255 << 7 at the top of the window
+     * with 7 bits of fraction to round away. */
+    int range = high - low;
+    int pshift = 0;
+    while ((range << (pshift + 1)) <= 0xffff)
+        pshift++;
+    int factor = ((255 << 23) + (range << pshift) / 2) / (range << pshift);
+
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+#ifdef HAVE_INTEL
+    if (has_sse2)
+        return cam_pixel_convert_16u_gray_to_8u_gray_window_sse2 (dest,
+                dstride, width, height, src, sstride, low, range, pshift,
+                factor, big_endian);
+#endif
+
+    int i, j;
+    for (i = 0; i < height; i++) {
+        const uint16_t *srow = (const uint16_t*)((const uint8_t*)src +
+                i*sstride);
+        uint8_t *drow = dest + i*dstride;
+        for (j = 0; j < width; j++)
+            drow[j] = window_16u_to_8u (srow[j], low, range, pshift, factor,
+                    big_endian);
+    }
+    return 0;
+}
+
+int
+cam_pixel_convert_8u_gray_to_16u_gray (uint16_t *dest, int dstride,
+        int width, int height, const uint8_t *src, int sstride, int shift,
+        int big_endian)
+{
+    if (shift < 0 || shift > 8) {
+        fprintf (stderr, "%s: invalid shift %d\n", __FUNCTION__, shift);
+        return -1;
+    }
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+#ifdef HAVE_INTEL
+    if (has_sse2)
+        return cam_pixel_convert_8u_gray_to_16u_gray_sse2 (dest, dstride,
+                width, height, src, sstride, shift, big_endian);
+#endif
+
+    int i, j;
+    for (i = 0; i < height; i++) {
+        const uint8_t *srow = src + i*sstride;
+        uint16_t *drow = (uint16_t*)((uint8_t*)dest + i*dstride);
+        for (j = 0; j < width; j++) {
+            uint16_t d = srow[j] << shift;
+            drow[j] = big_endian ? (d << 8) | (d >> 8) : d;
+        }
+    }
+    return 0;
+}
+
+int
+cam_pixel_replicate_bayer_border_16u (uint16_t * src, int sstride, int width,
+        int height)
+{
+    uint8_t * s = (uint8_t*) src;
+    memcpy (s - 2*sstride, s, width*2);
+    memcpy (s - sstride, s + sstride, width*2);
+
+    memcpy (s + (height+1)*sstride, s + (height-1)*sstride, width*2);
+    memcpy (s + height*sstride, s + (height-2)*sstride, width*2);
+
+    int i;
+    for (i = -2; i < height+2; i++) {
+        uint16_t * row = (uint16_t*)(s + i*sstride);
+        row[-2] = row[0];
+        row[-1] = row[1];
+        row[width + 1] = row[width - 1];
+        row[width] = row[width - 2];
+    }
+    return 0;
+}
+
+int
+cam_pixel_split_bayer_planes_16u_to_8u (uint8_t *dst[4], int dstride,
+        const uint16_t * src, int sstride, int width, int height, int shift,
+        int big_endian)
+{
+    if (shift < 0 || shift > 8) {
+        fprintf (stderr, "%s: invalid shift %d\n", __FUNCTION__, shift);
+        return -1;
+    }
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+#ifdef HAVE_INTEL
+    if (has_sse2)
+        return cam_pixel_split_bayer_planes_16u_to_8u_sse2 (dst, dstride,
+                src, sstride, width, height, shift, big_endian);
+#endif
+
+    int i, j, k;
+    for (i = 0; i < height; i++) {
+        for (k = 0; k < 2; k++) {
+            const uint16_t * srow = (const uint16_t*)((const uint8_t*)src +
+                    (2*i + k)*sstride);
+            uint8_t * drow1 = dst[2*k] + i * dstride;
+            uint8_t * drow2 = dst[2*k+1] + i * dstride;
+            for (j = 0; j < width; j++) {
+                drow1[j] = shift_16u_to_8u (srow[2*j], shift, big_endian);
+                drow2[j] = shift_16u_to_8u (srow[2*j+1], shift, big_endian);
+            }
+        }
+    }
+    return 0;
+}
+
+/* Sample @j of a row of packed 10-bit or 12-bit samples */
+static inline int
+unpack_10p (const uint8_t *srow, int j)
+{
+    const uint8_t *s = srow + j / 4 * 5;
+    int k = j & 3;
+    return (s[k] << 2) | ((s[4] >> (2 * k)) & 0x3);
+}
+
+static inline int
+unpack_12p (const uint8_t *srow, int j)
+{
+    const uint8_t *s = srow + j / 2 * 3;
+    int k = j & 1;
+    return (s[k] << 4) | ((s[2] >> (4 * k)) & 0xf);
+}
+
+static int
+unpack_packed_to_16u (uint16_t *dest, int dstride, int width, int height,
+        const uint8_t *src, int sstride, int bits)
+{
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+    int i, j;
+    for (i = 0; i < height; i++) {
+        const uint8_t *srow = src + i * sstride;
+        uint16_t *drow = (uint16_t*)((uint8_t*)dest + i * dstride);
+        j = 0;
+#ifdef HAVE_INTEL
+        if (has_sse2)
+            j = bits == 10 ?
+                cam_pixel_unpack_10p_to_16u_sse2 (drow, srow, width) :
+                cam_pixel_unpack_12p_to_16u_sse2 (drow, srow, width);
+#endif
+        if (bits == 10)
+            for (; j < width; j++)
+                drow[j] = unpack_10p (srow, j);
+        else
+            for (; j < width; j++)
+                drow[j] = unpack_12p (srow, j);
+    }
+    return 0;
+}
+
+int
+cam_pixel_unpack_10p_to_16u (uint16_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride)
+{
+    return unpack_packed_to_16u (dest, dstride, width, height, src, sstride,
+            10);
+}
+
+int
+cam_pixel_unpack_12p_to_16u (uint16_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride)
+{
+    return unpack_packed_to_16u (dest, dstride, width, height, src, sstride,
+            12);
+}
+
+/* Unpacks one row of packed samples to 8 bits */
+static void
+unpack_row_to_8u (uint8_t *drow, const uint8_t *srow, int width, int bits,
+        int shift)
+{
+    int j = 0;
+#ifdef HAVE_INTEL
+    if (has_sse2)
+        j = bits == 10 ?
+            cam_pixel_unpack_10p_to_8u_sse2 (drow, srow, width, shift) :
+            cam_pixel_unpack_12p_to_8u_sse2 (drow, srow, width, shift);
+#endif
+    for (; j < width; j++) {
+        int v = (bits == 10 ? unpack_10p (srow, j) : unpack_12p (srow, j)) >>
+            shift;
+        drow[j] = v > 255 ? 255 : v;
+    }
+}
+
+static int
+unpack_packed_to_8u (const char *func, uint8_t *dest, int dstride,
+        int width, int height, const uint8_t *src, int sstride, int bits,
+        int shift)
+{
+    if (shift < 0 || shift > 8) {
+        fprintf (stderr, "%s: invalid shift %d\n", func, shift);
+        return -1;
+    }
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+    int i;
+    for (i = 0; i < height; i++)
+        unpack_row_to_8u (dest + i * dstride, src + i * sstride, width,
+                bits, shift);
+    return 0;
+}
+
+int
+cam_pixel_unpack_10p_to_8u (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, int shift)
+{
+    return unpack_packed_to_8u (__FUNCTION__, dest, dstride, width, height,
+            src, sstride, 10, shift);
+}
+
+int
+cam_pixel_unpack_12p_to_8u (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, int shift)
+{
+    return unpack_packed_to_8u (__FUNCTION__, dest, dstride, width, height,
+            src, sstride, 12, shift);
+}
+
+static int
+split_bayer_planes_packed_to_8u (const char *func, uint8_t *dst[4],
+        int dstride, const uint8_t *src, int sstride, int width, int height,
+        int bits, int shift)
+{
+    if (shift < 0 || shift > 8) {
+        fprintf (stderr, "%s: invalid shift %d\n", func, shift);
+        return -1;
+    }
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+    /* two unpacked source rows at a time */
+    int rstride = (2 * width + 0xf) & (~0xf);
+    uint8_t *rows = (uint8_t*) MALLOC_ALIGNED (2 * rstride);
+    int i;
+    for (i = 0; i < height; i++) {
+        uint8_t *planes[4] = {
+            dst[0] + i * dstride, dst[1] + i * dstride,
+            dst[2] + i * dstride, dst[3] + i * dstride,
+        };
+        unpack_row_to_8u (rows, src + 2 * i * sstride, 2 * width, bits,
+                shift);
+        unpack_row_to_8u (rows + rstride, src + (2 * i + 1) * sstride,
+                2 * width, bits, shift);
+        cam_pixel_split_bayer_planes_8u (planes, dstride, rows, rstride,
+                width, 1);
+    }
+    free (rows);
+    return 0;
+}
+
+int
+cam_pixel_split_bayer_planes_10p_to_8u (uint8_t *dst[4], int dstride,
+        const uint8_t *src, int sstride, int width, int height, int shift)
+{
+    return split_bayer_planes_packed_to_8u (__FUNCTION__, dst, dstride, src,
+            sstride, width, height, 10, shift);
+}
+
+int
+cam_pixel_split_bayer_planes_12p_to_8u (uint8_t *dst[4], int dstride,
+        const uint8_t *src, int sstride, int width, int height, int shift)
+{
+    return split_bayer_planes_packed_to_8u (__FUNCTION__, dst, dstride, src,
+            sstride, width, height, 12, shift);
+}
+
+/* Column and row parity of the red pixel within the 2x2 bayer tile. */
+static int
+bayer_red_offset (CamPixelFormat format, int *red_x, int *red_y)
+{
+    switch (format) {
+        case CAM_PIXEL_FORMAT_BAYER_RGGB:
+        case CAM_PIXEL_FORMAT_BE_BAYER16_RGGB:
+        case CAM_PIXEL_FORMAT_LE_BAYER16_RGGB:
+            *red_x = 0; *red_y = 0;
+            return 0;
+        case CAM_PIXEL_FORMAT_BAYER_GRBG:
+        case CAM_PIXEL_FORMAT_BE_BAYER16_GRBG:
+        case CAM_PIXEL_FORMAT_LE_BAYER16_GRBG:
+            *red_x = 1; *red_y = 0;
+            return 0;
+        case CAM_PIXEL_FORMAT_BAYER_GBRG:
+        case CAM_PIXEL_FORMAT_BE_BAYER16_GBRG:
+        case CAM_PIXEL_FORMAT_LE_BAYER16_GBRG:
+            *red_x = 0; *red_y = 1;
+            return 0;
+        case CAM_PIXEL_FORMAT_BAYER_BGGR:
+        case CAM_PIXEL_FORMAT_BE_BAYER16_BGGR:
+        case CAM_PIXEL_FORMAT_LE_BAYER16_BGGR:
+            *red_x = 1; *red_y = 1;
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+static inline int
+clamp_16u (int v)
+{
+    return v < 0 ? 0 : (v > 65535 ? 65535 : v);
+}
+
+/* Reference Malvar-He-Cutler interpolation of a single pixel.  Filter taps
+ * are scaled by 16 so that the half-integer coefficients stay exact.  This
+ * must match bayer16_mhc_4() in pixels_sse2.c bit for bit. */
+static inline void
+bayer16_mhc_pixel (const uint16_t * p, int stride, int chroma, int red_row,
+        int *r, int *g, int *b)
+{
+    int c = p[0];
+    int ew = p[-1] + p[1];
+    int ns = p[-stride] + p[stride];
+    int ew2 = p[-2] + p[2];
+    int ns2 = p[-2*stride] + p[2*stride];
+    int diag = p[-stride-1] + p[-stride+1] + p[stride-1] + p[stride+1];
+
+    int x, y;
+    if (chroma) {
+        *g = 8*c + 4*(ew + ns) - 2*(ew2 + ns2);
+        x = 16*c;
+        y = 12*c + 4*diag - 3*(ew2 + ns2);
+    } else {
+        *g = 16*c;
+        x = 10*c + 8*ew - 2*ew2 - 2*diag + ns2;
+        y = 10*c + 8*ns - 2*ns2 - 2*diag + ew2;
+    }
+    *g = clamp_16u ((*g + 8) >> 4);
+    x = clamp_16u ((x + 8) >> 4);
+    y = clamp_16u ((y + 8) >> 4);
+    *r = red_row ? x : y;
+    *b = red_row ? y : x;
+}
+
+static int
+bayer_interpolate_to_16u (const uint16_t * src, int sstride, uint16_t * dst,
+        int dstride, int width, int height, int red_x, int red_y,
+        int channels)
+{
+    int stride = sstride / 2;
+    int i, j;
+    for (i = 0; i < height; i++) {
+        const uint16_t * srow = src + i*stride;
+        uint16_t * drow = (uint16_t*)((uint8_t*)dst + i*dstride);
+        int red_row = (i & 1) == red_y;
+        int chroma_x = red_row ? red_x : !red_x;
+        for (j = 0; j < width; j++) {
+            int r, g, b;
+            bayer16_mhc_pixel (srow + j, stride, (j & 1) == chroma_x,
+                    red_row, &r, &g, &b);
+            if (channels == 3) {
+                drow[3*j+0] = r;
+                drow[3*j+1] = g;
+                drow[3*j+2] = b;
+            } else {
+                drow[j] = (r + 2*g + b + 2) >> 2;
+            }
+        }
+    }
+    return 0;
+}
+
+int
+cam_pixel_bayer_interpolate_to_16u_rgb (const uint16_t * src, int sstride,
+        uint16_t * dst, int dstride, int width, int height,
+        CamPixelFormat format)
+{
+    int red_x, red_y;
+    if (bayer_red_offset (format, &red_x, &red_y) < 0) {
+        fprintf (stderr, "%s: invalid pixel format %s\n", __FUNCTION__,
+                cam_pixel_format_nickname (format));
+        return -1;
+    }
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+#ifdef HAVE_INTEL
+    if (has_sse2 && width >= 8)
+        return cam_pixel_bayer_interpolate_to_16u_rgb_sse2 (src, sstride,
+                dst, dstride, width, height, red_x, red_y);
+#endif
+
+    return bayer_interpolate_to_16u (src, sstride, dst, dstride, width,
+            height, red_x, red_y, 3);
+}
+
+int
+cam_pixel_bayer_interpolate_to_16u_gray (const uint16_t * src, int sstride,
+        uint16_t * dst, int dstride, int width, int height,
+        CamPixelFormat format)
+{
+    int red_x, red_y;
+    if (bayer_red_offset (format, &red_x, &red_y) < 0) {
+        fprintf (stderr, "%s: invalid pixel format %s\n", __FUNCTION__,
+                cam_pixel_format_nickname (format));
+        return -1;
+    }
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+#ifdef HAVE_INTEL
+    if (has_sse2 && width >= 8)
+        return cam_pixel_bayer_interpolate_to_16u_gray_sse2 (src, sstride,
+                dst, dstride, width, height, red_x, red_y);
+#endif
+
+    return bayer_interpolate_to_16u (src, sstride, dst, dstride, width,
+            height, red_x, red_y, 1);
+}
+
+/* Edge-directed (Hamilton-Adams style) demosaic.  Green is interpolated
+ * at R and B sites along whichever of the horizontal or vertical directions
+ * has the smaller gradient, with a Laplacian correction from the center
+ * color.  R and B are then filled in by bilinear interpolation of the color
+ * difference to green.  Green is computed one row ahead into a three row
+ * ring buffer, so any band of rows can be processed independently.  The
+ * SSE2 version in pixels_sse2.c must match this bit for bit. */
+static void
+bayer_edge_green_row (const uint8_t *m, int stride, uint8_t *g, int width,
+        int chroma_x)
+{
+    int x;
+    for (x = 0; x < width; x++) {
+        const uint8_t *p = m + x;
+        if ((x & 1) != chroma_x) {
+            g[x] = p[0];
+            continue;
+        }
+        int lh = 2*p[0] - p[-2] - p[2];
+        int lv = 2*p[0] - p[-2*stride] - p[2*stride];
+        int dh = abs (p[-1] - p[1]) + abs (lh);
+        int dv = abs (p[-stride] - p[stride]) + abs (lv);
+        int gh4 = 2*(p[-1] + p[1]) + lh;
+        int gv4 = 2*(p[-stride] + p[stride]) + lv;
+        int v;
+        if (dh < dv)
+            v = gh4 >> 2;
+        else if (dv < dh)
+            v = gv4 >> 2;
+        else
+            v = (gh4 + gv4) >> 3;
+        g[x] = MAX (0, MIN (255, v));
+    }
+    g[-1] = g[1];
+    g[width] = g[width - 2];
+}
+
+static void
+bayer_edge_bgra_row (const uint8_t *m, int stride, const uint8_t *gm,
+        const uint8_t *g0, const uint8_t *gp, uint8_t *d, int width,
+        int chroma_x, int red_row)
+{
+    int x;
+    for (x = 0; x < width; x++) {
+        const uint8_t *p = m + x;
+        int gc = g0[x];
+        int xc, yc;
+        if ((x & 1) == chroma_x) {
+            xc = p[0];
+            yc = gc + ((p[-stride-1] - gm[x-1] + p[-stride+1] - gm[x+1] +
+                        p[stride-1] - gp[x-1] + p[stride+1] - gp[x+1]) >> 2);
+        } else {
+            xc = gc + ((p[-1] - g0[x-1] + p[1] - g0[x+1]) >> 1);
+            yc = gc + ((p[-stride] - gm[x] + p[stride] - gp[x]) >> 1);
+        }
+        xc = MAX (0, MIN (255, xc));
+        yc = MAX (0, MIN (255, yc));
+        d[4*x+0] = red_row ? yc : xc;
+        d[4*x+1] = gc;
+        d[4*x+2] = red_row ? xc : yc;
+        d[4*x+3] = 255;
+    }
+}
+
+static int
+bayer_interpolate_edge_to_8u_bgra (const uint8_t * src, int sstride,
+        uint8_t * dst, int dstride, int width, int height, int row_start,
+        int row_end, int red_x, int red_y)
+{
+    int gstride = ((width + 0xf) & ~0xf) + 32;
+    uint8_t * ring = malloc (3 * gstride);
+    int r, y;
+
+    if (!ring)
+        return -1;
+
+    for (r = row_start - 1; r <= row_end; r++) {
+        /* rows outside the image mirror the bayer border replication */
+        int sr = r < 0 ? 1 : (r >= height ? height - 2 : r);
+        int chroma_x = ((sr & 1) == red_y) ? red_x : !red_x;
+        bayer_edge_green_row (src + sr*sstride, sstride,
+                ring + ((r + 3) % 3) * gstride + 16, width, chroma_x);
+
+        y = r - 1;
+        if (y < row_start)
+            continue;
+        int red_row = (y & 1) == red_y;
+        bayer_edge_bgra_row (src + y*sstride, sstride,
+                ring + ((y + 2) % 3) * gstride + 16,
+                ring + ((y + 3) % 3) * gstride + 16,
+                ring + ((y + 4) % 3) * gstride + 16,
+                dst + y*dstride, width, red_row ? red_x : !red_x, red_row);
+    }
+    free (ring);
+    return 0;
+}
+
+int
+cam_pixel_bayer_interpolate_edge_to_8u_bgra_rows (const uint8_t * src,
+        int sstride, uint8_t * dst, int dstride, int width, int height,
+        int row_start, int row_end, CamPixelFormat format)
+{
+    int red_x, red_y;
+    if (bayer_red_offset (format, &red_x, &red_y) < 0) {
+        fprintf (stderr, "%s: invalid pixel format %s\n", __FUNCTION__,
+                cam_pixel_format_nickname (format));
+        return -1;
+    }
+    if (height < 2 || row_start < 0 || row_end > height ||
+            row_start > row_end) {
+        fprintf (stderr, "%s: invalid rows %d-%d of %d\n", __FUNCTION__,
+                row_start, row_end, height);
+        return -1;
+    }
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+#ifdef HAVE_INTEL
+    if (has_sse2 && width >= 8)
+        return cam_pixel_bayer_interpolate_edge_to_8u_bgra_sse2 (src, sstride,
+                dst, dstride, width, height, row_start, row_end, red_x, red_y);
+#endif
+
+    return bayer_interpolate_edge_to_8u_bgra (src, sstride, dst, dstride,
+            width, height, row_start, row_end, red_x, red_y);
+}
+
+int
+cam_pixel_bayer_interpolate_edge_to_8u_bgra (const uint8_t * src,
+        int sstride, uint8_t * dst, int dstride, int width, int height,
+        CamPixelFormat format)
+{
+    return cam_pixel_bayer_interpolate_edge_to_8u_bgra_rows (src, sstride,
+            dst, dstride, width, height, 0, height, format);
+}
+
+/* Fixed-point bits of the bilinear interpolation weights.  8-bit images
+ * use 7 bits so that a horizontally interpolated sample still fits in a
+ * signed 16-bit integer. */
+#define RESIZE_BITS_8U 7
+#define RESIZE_BITS_16U 8
+
+static int
+check_resize_args (const char *func, int dwidth, int dheight, int swidth,
+        int sheight, int channels)
+{
+    if (channels < 1 || channels > 4) {
+        fprintf (stderr, "%s: invalid number of channels %d\n", func,
+                channels);
+        return -1;
+    }
+    if (dwidth < 1 || dheight < 1 || swidth < 1 || sheight < 1) {
+        fprintf (stderr, "%s: invalid size %dx%d -> %dx%d\n", func,
+                swidth, sheight, dwidth, dheight);
+        return -1;
+    }
+    return 0;
+}
+
+static int
+check_box_factors (const char *func, int dwidth, int dheight, int swidth,
+        int sheight, int *fx, int *fy)
+{
+    *fx = swidth / dwidth;
+    *fy = sheight / dheight;
+    if (*fx * dwidth != swidth || *fy * dheight != sheight ||
+            *fx > 256 || *fy > 256) {
+        fprintf (stderr, "%s: %dx%d -> %dx%d is not an integer reduction "
+                "of at most 256\n", func, swidth, sheight, dwidth, dheight);
+        return -1;
+    }
+    return 0;
+}
+
+/* Divides @sum by @n, rounding to nearest.  @shift is log2 (@n) if @n is
+ * a power of two, or -1 otherwise. */
+static inline uint32_t
+box_average (uint32_t sum, int n, int shift)
+{
+    if (shift >= 0)
+        return (sum + (n >> 1)) >> shift;
+    return (sum + (n >> 1)) / n;
+}
+
+static int
+log2_exact (int n)
+{
+    int shift = 0;
+    while ((1 << shift) < n)
+        shift++;
+    return (1 << shift) == n ? shift : -1;
+}
+
+int
+cam_pixel_resize_box_8u (uint8_t *dest, int dstride, int dwidth,
+        int dheight, const uint8_t *src, int sstride, int swidth,
+        int sheight, int channels)
+{
+    int fx, fy;
+    if (check_resize_args (__FUNCTION__, dwidth, dheight, swidth, sheight,
+                channels) < 0 ||
+        check_box_factors (__FUNCTION__, dwidth, dheight, swidth, sheight,
+                &fx, &fy) < 0)
+        return -1;
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+    int n = fx * fy;
+    int shift = log2_exact (n);
+    int row_len = swidth * channels;
+    uint16_t *acc = (uint16_t*) MALLOC_ALIGNED (row_len * sizeof (uint16_t));
+    int i, j, k, c;
+
+    for (i = 0; i < dheight; i++) {
+        /* sum the rows of the box vertically, at most 256 * 255 */
+        memset (acc, 0, row_len * sizeof (uint16_t));
+        for (k = 0; k < fy; k++) {
+            const uint8_t *srow = src + (i*fy + k) * sstride;
+#ifdef HAVE_INTEL
+            if (has_sse2) {
+                cam_pixel_resize_add_row_8u_sse2 (acc, srow, row_len);
+                continue;
+            }
+#endif
+            for (j = 0; j < row_len; j++)
+                acc[j] += srow[j];
+        }
+
+        /* then horizontally, one channel at a time */
+        uint8_t *drow = dest + i * dstride;
+        for (j = 0; j < dwidth; j++) {
+            const uint16_t *a = acc + j * fx * channels;
+            for (c = 0; c < channels; c++) {
+                uint32_t sum = 0;
+                for (k = 0; k < fx; k++)
+                    sum += a[k * channels + c];
+                drow[j * channels + c] = box_average (sum, n, shift);
+            }
+        }
+    }
+    free (acc);
+    return 0;
+}
+
+int
+cam_pixel_resize_box_16u (uint16_t *dest, int dstride, int dwidth,
+        int dheight, const uint16_t *src, int sstride, int swidth,
+        int sheight, int channels)
+{
+    int fx, fy;
+    if (check_resize_args (__FUNCTION__, dwidth, dheight, swidth, sheight,
+                channels) < 0 ||
+        check_box_factors (__FUNCTION__, dwidth, dheight, swidth, sheight,
+                &fx, &fy) < 0)
+        return -1;
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+    int n = fx * fy;
+    int shift = log2_exact (n);
+    int row_len = swidth * channels;
+    uint32_t *acc = (uint32_t*) MALLOC_ALIGNED (row_len * sizeof (uint32_t));
+    int i, j, k, c;
+
+    for (i = 0; i < dheight; i++) {
+        memset (acc, 0, row_len * sizeof (uint32_t));
+        for (k = 0; k < fy; k++) {
+            const uint16_t *srow = (const uint16_t*)((const uint8_t*)src +
+                    (i*fy + k) * sstride);
+#ifdef HAVE_INTEL
+            if (has_sse2) {
+                cam_pixel_resize_add_row_16u_sse2 (acc, srow, row_len);
+                continue;
+            }
+#endif
+            for (j = 0; j < row_len; j++)
+                acc[j] += srow[j];
+        }
+
+        /* fx * fy * 65535, plus rounding, fits in 32 bits as long as
+         * both factors are at most 256 */
+        uint16_t *drow = (uint16_t*)((uint8_t*)dest + i * dstride);
+        for (j = 0; j < dwidth; j++) {
+            const uint32_t *a = acc + j * fx * channels;
+            for (c = 0; c < channels; c++) {
+                uint32_t sum = 0;
+                for (k = 0; k < fx; k++)
+                    sum += a[k * channels + c];
+                drow[j * channels + c] = box_average (sum, n, shift);
+            }
+        }
+    }
+    free (acc);
+    return 0;
+}
+
+/* Maps the centre of destination pixel @dpos to the source image.  The
+ * result is interpolated between source pixels @p0 and @p1 with weight @w
+ * out of (1 << @bits) on @p1.  Positions outside the image are clamped
+ * to the edge. */
+static void
+bilinear_coord (int dpos, int dsize, int ssize, int bits, int *p0, int *p1,
+        int *w)
+{
+    int64_t s = (((int64_t)(2 * dpos + 1) * ssize) << bits) / (2 * dsize) -
+        (1 << (bits - 1));
+    if (s < 0)
+        s = 0;
+    int p = s >> bits;
+    if (p >= ssize - 1) {
+        *p0 = *p1 = ssize - 1;
+        *w = 0;
+        return;
+    }
+    *p0 = p;
+    *p1 = p + 1;
+    *w = s & ((1 << bits) - 1);
+}
+
+static int
+check_resize_rows (const char *func, int dheight, int row_start,
+        int row_end)
+{
+    if (row_start < 0 || row_end > dheight || row_start > row_end) {
+        fprintf (stderr, "%s: invalid rows %d-%d of %d\n", func,
+                row_start, row_end, dheight);
+        return -1;
+    }
+    return 0;
+}
+
+/* Interpolates source row @srow horizontally to the destination width.
+ * The results are scaled by (1 << RESIZE_BITS_8U). */
+static void
+bilinear_row_8u (int16_t *h, const uint8_t *srow, const int *x0,
+        const int *x1, const int *wx, int dwidth, int channels)
+{
+    int j, c;
+    for (j = 0; j < dwidth; j++) {
+        const uint8_t *s0 = srow + x0[j] * channels;
+        const uint8_t *s1 = srow + x1[j] * channels;
+        int w1 = wx[j];
+        int w0 = (1 << RESIZE_BITS_8U) - w1;
+        for (c = 0; c < channels; c++)
+            h[j * channels + c] = s0[c] * w0 + s1[c] * w1;
+    }
+}
+
+int
+cam_pixel_resize_bilinear_8u_rows (uint8_t *dest, int dstride, int dwidth,
+        int dheight, const uint8_t *src, int sstride, int swidth,
+        int sheight, int channels, int row_start, int row_end)
+{
+    if (check_resize_args (__FUNCTION__, dwidth, dheight, swidth, sheight,
+                channels) < 0 ||
+        check_resize_rows (__FUNCTION__, dheight, row_start, row_end) < 0)
+        return -1;
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+    int *x0 = (int*) malloc (3 * dwidth * sizeof (int));
+    int *x1 = x0 + dwidth;
+    int *wx = x1 + dwidth;
+    int i, j;
+    for (j = 0; j < dwidth; j++)
+        bilinear_coord (j, dwidth, swidth, RESIZE_BITS_8U, &x0[j], &x1[j],
+                &wx[j]);
+
+    /* horizontally interpolated copies of the two source rows in use.
+     * They are kept across output rows, since neighbouring output rows
+     * usually share source rows. */
+    int row_len = dwidth * channels;
+    int16_t *hbuf[2] = {
+        (int16_t*) MALLOC_ALIGNED (row_len * sizeof (int16_t)),
+        (int16_t*) MALLOC_ALIGNED (row_len * sizeof (int16_t)),
+    };
+    int hy[2] = { -1, -1 };
+
+    for (i = row_start; i < row_end; i++) {
+        int y0, y1, wy;
+        bilinear_coord (i, dheight, sheight, RESIZE_BITS_8U, &y0, &y1, &wy);
+        if (hy[1] == y0) {
+            int16_t *t = hbuf[0];
+            hbuf[0] = hbuf[1];
+            hbuf[1] = t;
+            hy[0] = hy[1];
+            hy[1] = -1;
+        }
+        if (hy[0] != y0) {
+            bilinear_row_8u (hbuf[0], src + y0 * sstride, x0, x1, wx,
+                    dwidth, channels);
+            hy[0] = y0;
+        }
+        if (hy[1] != y1) {
+            bilinear_row_8u (hbuf[1], src + y1 * sstride, x0, x1, wx,
+                    dwidth, channels);
+            hy[1] = y1;
+        }
+
+        uint8_t *drow = dest + i * dstride;
+        j = 0;
+#ifdef HAVE_INTEL
+        if (has_sse2)
+            j = cam_pixel_resize_blend_rows_8u_sse2 (drow, hbuf[0], hbuf[1],
+                    row_len, wy);
+#endif
+        for (; j < row_len; j++)
+            drow[j] = (hbuf[0][j] * ((1 << RESIZE_BITS_8U) - wy) +
+                    hbuf[1][j] * wy + (1 << (2*RESIZE_BITS_8U - 1))) >>
+                (2*RESIZE_BITS_8U);
+    }
+
+    free (hbuf[0]);
+    free (hbuf[1]);
+    free (x0);
+    return 0;
+}
+
+int
+cam_pixel_resize_bilinear_8u (uint8_t *dest, int dstride, int dwidth,
+        int dheight, const uint8_t *src, int sstride, int swidth,
+        int sheight, int channels)
+{
+    return cam_pixel_resize_bilinear_8u_rows (dest, dstride, dwidth, dheight,
+            src, sstride, swidth, sheight, channels, 0, dheight);
+}
+
+int
+cam_pixel_resize_bilinear_16u_rows (uint16_t *dest, int dstride,
+        int dwidth, int dheight, const uint16_t *src, int sstride,
+        int swidth, int sheight, int channels, int row_start, int row_end)
+{
+    if (check_resize_args (__FUNCTION__, dwidth, dheight, swidth, sheight,
+                channels) < 0 ||
+        check_resize_rows (__FUNCTION__, dheight, row_start, row_end) < 0)
+        return -1;
+
+    int *x0 = (int*) malloc (3 * dwidth * sizeof (int));
+    int *x1 = x0 + dwidth;
+    int *wx = x1 + dwidth;
+    int i, j, c;
+    for (j = 0; j < dwidth; j++)
+        bilinear_coord (j, dwidth, swidth, RESIZE_BITS_16U, &x0[j], &x1[j],
+                &wx[j]);
+
+    const uint32_t one = 1 << RESIZE_BITS_16U;
+    for (i = row_start; i < row_end; i++) {
+        int y0, y1, wy;
+        bilinear_coord (i, dheight, sheight, RESIZE_BITS_16U, &y0, &y1, &wy);
+        const uint16_t *srow0 = (const uint16_t*)((const uint8_t*)src +
+                y0 * sstride);
+        const uint16_t *srow1 = (const uint16_t*)((const uint8_t*)src +
+                y1 * sstride);
+        uint16_t *drow = (uint16_t*)((uint8_t*)dest + i * dstride);
+        for (j = 0; j < dwidth; j++) {
+            int a = x0[j] * channels;
+            int b = x1[j] * channels;
+            uint32_t w1 = wx[j];
+            uint32_t w0 = one - w1;
+            for (c = 0; c < channels; c++) {
+                uint32_t h0 = srow0[a + c] * w0 + srow0[b + c] * w1;
+                uint32_t h1 = srow1[a + c] * w0 + srow1[b + c] * w1;
+                uint32_t v = ((h0 + (1 << (RESIZE_BITS_16U - 1))) >>
+                        RESIZE_BITS_16U) * (one - wy) +
+                    ((h1 + (1 << (RESIZE_BITS_16U - 1))) >>
+                        RESIZE_BITS_16U) * wy;
+                drow[j * channels + c] = (v + (one >> 1)) >> RESIZE_BITS_16U;
+            }
+        }
+    }
+    free (x0);
+    return 0;
+}
+
+int
+cam_pixel_resize_bilinear_16u (uint16_t *dest, int dstride, int dwidth,
+        int dheight, const uint16_t *src, int sstride, int swidth,
+        int sheight, int channels)
+{
+    return cam_pixel_resize_bilinear_16u_rows (dest, dstride, dwidth,
+            dheight, src, sstride, swidth, sheight, channels, 0, dheight);
+}
+
+/* Size of the square tiles the C rotation path works through, so that
+ * the destination rows being written stay in cache */
+#define ROTATE_TILE 32
+
+/* Describes an orientation as an optional swap of the axes followed by
+ * reversing the source x (fx) and y (fy) directions. */
+static int
+orientation_flags (CamPixelOrientation orientation, int *swap, int *fx,
+        int *fy)
+{
+    static const int flags[8][3] = {
+        { 0, 0, 0 },    /* normal */
+        { 1, 0, 1 },    /* rotate 90 */
+        { 0, 1, 1 },    /* rotate 180 */
+        { 1, 1, 0 },    /* rotate 270 */
+        { 0, 1, 0 },    /* flip horizontal */
+        { 0, 0, 1 },    /* flip vertical */
+        { 1, 0, 0 },    /* transpose */
+        { 1, 1, 1 },    /* transverse */
+    };
+    if (orientation < CAM_PIXEL_ORIENTATION_NORMAL ||
+        orientation > CAM_PIXEL_ORIENTATION_TRANSVERSE)
+        return -1;
+    *swap = flags[orientation][0];
+    *fx = flags[orientation][1];
+    *fy = flags[orientation][2];
+    return 0;
+}
+
+int
+cam_pixel_orientation_swaps_axes (CamPixelOrientation orientation)
+{
+    int swap, fx, fy;
+    if (orientation_flags (orientation, &swap, &fx, &fy) < 0)
+        return 0;
+    return swap;
+}
+
+/* Reorients the source pixels in columns @x0 to @x1 - 1 and rows @y0 to
+ * @y1 - 1, one pixel at a time */
+static void
+rotate_rect_8u (uint8_t *dest, int dstride, int width, int height,
+        const uint8_t *src, int sstride, int bpp, int swap, int fx, int fy,
+        int x0, int x1, int y0, int y1)
+{
+    int tx, ty, x, y;
+    for (ty = y0; ty < y1; ty += ROTATE_TILE) {
+        for (tx = x0; tx < x1; tx += ROTATE_TILE) {
+            for (y = ty; y < MIN (ty + ROTATE_TILE, y1); y++) {
+                const uint8_t *srow = src + y * sstride;
+                int dy = fy ? height - 1 - y : y;
+                for (x = tx; x < MIN (tx + ROTATE_TILE, x1); x++) {
+                    int dx = fx ? width - 1 - x : x;
+                    uint8_t *d = swap ? dest + dx * dstride + dy * bpp :
+                        dest + dy * dstride + dx * bpp;
+                    const uint8_t *s = srow + x * bpp;
+                    switch (bpp) {
+                        case 4:
+                            memcpy (d, s, 4);
+                            break;
+                        case 3:
+                            d[0] = s[0];
+                            d[1] = s[1];
+                            d[2] = s[2];
+                            break;
+                        default:
+                            *d = *s;
+                            break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static int
+rotate_8u (uint8_t *dest, int dstride, int width, int height,
+        const uint8_t *src, int sstride, int bpp,
+        CamPixelOrientation orientation)
+{
+    int swap, fx, fy;
+    if (orientation_flags (orientation, &swap, &fx, &fy) < 0) {
+        fprintf (stderr, "%s: invalid orientation %d\n", __FUNCTION__,
+                orientation);
+        return -1;
+    }
+
+    /* rows stay intact, so they can be copied whole */
+    if (!swap && !fx) {
+        int i;
+        for (i = 0; i < height; i++)
+            memcpy (dest + (fy ? height - 1 - i : i) * dstride,
+                    src + i * sstride, width * bpp);
+        return 0;
+    }
+
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+#ifdef HAVE_INTEL
+    if (has_sse2 && bpp != 3) {
+        if (swap) {
+            int t = bpp == 1 ? 8 : 4;
+            int wt = width & ~(t - 1);
+            int ht = height & ~(t - 1);
+            if (bpp == 1)
+                cam_pixel_transpose_tiles_8u_c1_sse2 (dest, dstride,
+                        width, height, src, sstride, fx, fy);
+            else
+                cam_pixel_transpose_tiles_8u_c4_sse2 (dest, dstride,
+                        width, height, src, sstride, fx, fy);
+            rotate_rect_8u (dest, dstride, width, height, src, sstride, bpp,
+                    swap, fx, fy, wt, width, 0, height);
+            rotate_rect_8u (dest, dstride, width, height, src, sstride, bpp,
+                    swap, fx, fy, 0, wt, ht, height);
+        } else {
+            int j = cam_pixel_mirror_rows_8u_sse2 (dest, dstride, width,
+                    height, src, sstride, bpp, fy);
+            rotate_rect_8u (dest, dstride, width, height, src, sstride, bpp,
+                    swap, fx, fy, j, width, 0, height);
+        }
+        return 0;
+    }
+#endif
+
+    rotate_rect_8u (dest, dstride, width, height, src, sstride, bpp,
+            swap, fx, fy, 0, width, 0, height);
+    return 0;
+}
+
+int
+cam_pixel_rotate_8u_gray (uint8_t *dest, int dstride, int width, int height,
+        const uint8_t *src, int sstride, CamPixelOrientation orientation)
+{
+    return rotate_8u (dest, dstride, width, height, src, sstride, 1,
+            orientation);
+}
+
+int
+cam_pixel_rotate_8u_rgb (uint8_t *dest, int dstride, int width, int height,
+        const uint8_t *src, int sstride, CamPixelOrientation orientation)
+{
+    return rotate_8u (dest, dstride, width, height, src, sstride, 3,
+            orientation);
+}
+
+int
+cam_pixel_rotate_8u_bgra (uint8_t *dest, int dstride, int width, int height,
+        const uint8_t *src, int sstride, CamPixelOrientation orientation)
+{
+    return rotate_8u (dest, dstride, width, height, src, sstride, 4,
+            orientation);
+}
+
+#define REMAP_ONE (1 << CAM_PIXEL_REMAP_FRAC_BITS)
+#define REMAP_WEIGHTS (REMAP_ONE + 1)
+#define REMAP_OUTSIDE (REMAP_WEIGHTS * REMAP_WEIGHTS)
+
+CamPixelRemap *
+cam_pixel_remap_new (int width, int height, int src_width, int src_height)
+{
+    if (width < 1 || height < 1 || src_width < 2 || src_height < 2 ||
+        src_width > 32767 || src_height > 32767) {
+        fprintf (stderr, "%s: invalid size %dx%d from %dx%d\n",
+                __FUNCTION__, width, height, src_width, src_height);
+        return NULL;
+    }
+
+    CamPixelRemap *map = (CamPixelRemap*) malloc (sizeof (CamPixelRemap));
+    map->width = width;
+    map->height = height;
+    map->src_width = src_width;
+    map->src_height = src_height;
+    map->xy = (int16_t*) calloc (2 * width * height, sizeof (int16_t));
+    map->frac = (uint16_t*) malloc (width * height * sizeof (uint16_t));
+    map->weights = (int16_t*) MALLOC_ALIGNED (4 * (REMAP_OUTSIDE + 1) *
+            sizeof (int16_t));
+
+    /* the weights are scaled by (1 << 14), which lets the SSE2 path
+     * multiply them against pixels with pmaddwd */
+    int i, j;
+    for (i = 0; i < REMAP_WEIGHTS; i++) {
+        for (j = 0; j < REMAP_WEIGHTS; j++) {
+            int16_t *w = map->weights + 4 * (i * REMAP_WEIGHTS + j);
+            int scale = (1 << 14) / (REMAP_ONE * REMAP_ONE);
+            w[0] = (REMAP_ONE - j) * (REMAP_ONE - i) * scale;
+            w[1] = j * (REMAP_ONE - i) * scale;
+            w[2] = (REMAP_ONE - j) * i * scale;
+            w[3] = j * i * scale;
+        }
+    }
+    memset (map->weights + 4 * REMAP_OUTSIDE, 0, 4 * sizeof (int16_t));
+
+    /* pixels outside the source image read the top left block with zero
+     * weights, so the kernels don't need to test for them */
+    for (i = 0; i < width * height; i++)
+        map->frac[i] = REMAP_OUTSIDE;
+    return map;
+}
+
+void
+cam_pixel_remap_free (CamPixelRemap *map)
+{
+    if (!map)
+        return;
+    free (map->xy);
+    free (map->frac);
+    free (map->weights);
+    free (map);
+}
+
+void
+cam_pixel_remap_set (CamPixelRemap *map, int x, int y, double sx,
+        double sy)
+{
+    int i = y * map->width + x;
+    double fx = sx * REMAP_ONE + 0.5;
+    double fy = sy * REMAP_ONE + 0.5;
+    if (!(fx >= 0 && fy >= 0 &&
+          fx < (map->src_width - 1) * REMAP_ONE + 1 &&
+          fy < (map->src_height - 1) * REMAP_ONE + 1)) {
+        map->xy[2*i] = 0;
+        map->xy[2*i+1] = 0;
+        map->frac[i] = REMAP_OUTSIDE;
+        return;
+    }
+
+    int ix = (int) fx;
+    int iy = (int) fy;
+    int x0 = ix >> CAM_PIXEL_REMAP_FRAC_BITS;
+    int y0 = iy >> CAM_PIXEL_REMAP_FRAC_BITS;
+    int wx = ix & (REMAP_ONE - 1);
+    int wy = iy & (REMAP_ONE - 1);
+
+    /* positions on the last column or row interpolate with full weight
+     * on the second pixel of the block, so that the block never reaches
+     * past the edge */
+    if (x0 == map->src_width - 1) {
+        x0--;
+        wx = REMAP_ONE;
+    }
+    if (y0 == map->src_height - 1) {
+        y0--;
+        wy = REMAP_ONE;
+    }
+    map->xy[2*i] = x0;
+    map->xy[2*i+1] = y0;
+    map->frac[i] = wy * REMAP_WEIGHTS + wx;
+}
+
+int
+cam_pixel_remap_8u_rows (uint8_t *dest, int dstride, const uint8_t *src,
+        int sstride, int channels, const CamPixelRemap *map, int row_start,
+        int row_end)
+{
+    if (channels < 1 || channels > 4) {
+        fprintf (stderr, "%s: invalid number of channels %d\n",
+                __FUNCTION__, channels);
+        return -1;
+    }
+    if (row_start < 0 || row_end > map->height || row_start > row_end) {
+        fprintf (stderr, "%s: invalid rows %d-%d of %d\n", __FUNCTION__,
+                row_start, row_end, map->height);
+        return -1;
+    }
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+    int i, j, c;
+    for (i = row_start; i < row_end; i++) {
+        uint8_t *drow = dest + i * dstride;
+        const int16_t *xy = map->xy + 2 * i * map->width;
+        const uint16_t *frac = map->frac + i * map->width;
+        j = 0;
+#ifdef HAVE_INTEL
+        if (has_sse2 && channels == 1)
+            j = cam_pixel_remap_row_8u_c1_sse2 (drow, src, sstride, xy,
+                    frac, map->weights, map->width);
+        else if (has_sse2 && channels == 4)
+            j = cam_pixel_remap_row_8u_c4_sse2 (drow, src, sstride, xy,
+                    frac, map->weights, map->width);
+#endif
+        for (; j < map->width; j++) {
+            const uint8_t *s = src + xy[2*j+1] * sstride + xy[2*j] * channels;
+            const int16_t *w = map->weights + 4 * frac[j];
+            for (c = 0; c < channels; c++)
+                drow[j * channels + c] = (s[c] * w[0] +
+                        s[c + channels] * w[1] +
+                        s[sstride + c] * w[2] +
+                        s[sstride + c + channels] * w[3] + (1 << 13)) >> 14;
+        }
+    }
+    return 0;
+}
+
+int
+cam_pixel_remap_8u (uint8_t *dest, int dstride, const uint8_t *src,
+        int sstride, int channels, const CamPixelRemap *map)
+{
+    return cam_pixel_remap_8u_rows (dest, dstride, src, sstride, channels,
+            map, 0, map->height);
+}
+
+void
+cam_pixel_tensor_fit (CamPixelTensor *t, int letterbox)
+{
+    t->roi_x = 0;
+    t->roi_y = 0;
+    t->roi_width = t->width;
+    t->roi_height = t->height;
+    if (!letterbox || t->src_width < 1 || t->src_height < 1)
+        return;
+
+    /* the side of the image that is relatively longer fills the tensor */
+    int64_t sw = t->src_width, sh = t->src_height;
+    if (sw * t->height > sh * t->width)
+        t->roi_height = MAX (1, (sh * t->width + sw / 2) / sw);
+    else
+        t->roi_width = MAX (1, (sw * t->height + sh / 2) / sh);
+    t->roi_x = (t->width - t->roi_width) / 2;
+    t->roi_y = (t->height - t->roi_height) / 2;
+}
+
+void
+cam_pixel_tensor_set_channel (CamPixelTensor *t, int channel,
+        int src_channel, float mean, float std)
+{
+    t->src_channel[channel] = src_channel;
+    t->scale[channel] = 1.0f / (255.0f * std);
+    t->bias[channel] = -mean / std;
+}
+
+/* Rounds to the nearest half precision float, with ties to even.  Values
+ * too large for half precision become infinity, and NaNs stay NaNs. */
+static inline uint16_t
+float_to_half (float f)
+{
+    union { float f; uint32_t u; } v = { f };
+    uint32_t sign = (v.u >> 16) & 0x8000;
+    uint32_t a = v.u & 0x7fffffff;
+
+    if (a >= 0x47800000)
+        return sign | (a > 0x7f800000 ? 0x7e00 : 0x7c00);
+    if (a < 0x38800000) {
+        /* subnormal: adding 0.5 lines the half precision mantissa up with
+         * the low bits of the float, and rounds it */
+        v.u = a;
+        v.f += 0.5f;
+        return sign | (v.u - 0x3f000000);
+    }
+    /* rebias the exponent and round the 13 dropped mantissa bits */
+    a += ((uint32_t)(15 - 127) << 23) + 0xfff + ((a >> 13) & 1);
+    return sign | (a >> 13);
+}
+
+static void
+convert_32f_to_16f (uint16_t *dst, const float *src, int n)
+{
+    int j = 0;
+#ifdef HAVE_INTEL
+    if (has_sse2)
+        j = cam_pixel_convert_32f_to_16f_sse2 (dst, src, n);
+#endif
+    for (; j < n; j++)
+        dst[j] = float_to_half (src[j]);
+}
+
+static int
+check_tensor (const char *func, const CamPixelTensor *t)
+{
+    int c;
+    if (t->width < 1 || t->height < 1 || t->channels < 1 ||
+        t->channels > 4 || t->src_width < 1 || t->src_height < 1 ||
+        t->src_channels < 1 || t->src_channels > 4 ||
+        t->roi_width < 1 || t->roi_height < 1 || t->roi_x < 0 ||
+        t->roi_y < 0 || t->roi_x + t->roi_width > t->width ||
+        t->roi_y + t->roi_height > t->height ||
+        t->pad < 0 || t->pad > 255) {
+        fprintf (stderr, "%s: invalid tensor description\n", func);
+        return -1;
+    }
+    for (c = 0; c < t->channels; c++) {
+        if (t->src_channel[c] < 0 || t->src_channel[c] >= t->src_channels) {
+            fprintf (stderr, "%s: invalid source channel %d\n", func,
+                    t->src_channel[c]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Interpolates source row @srow horizontally to the width of the tensor's
+ * image rectangle, into a separate row of @h for each tensor channel.  As
+ * with bilinear_row_8u(), the results are scaled by (1 << RESIZE_BITS_8U). */
+static void
+tensor_row_8u (int16_t *h, const uint8_t *srow, const int *x0,
+        const int *x1, const int *wx, const CamPixelTensor *t)
+{
+    int rw = t->roi_width;
+    int sc = t->src_channels;
+    int j, c;
+    for (j = 0; j < rw; j++) {
+        const uint8_t *s0 = srow + x0[j] * sc;
+        const uint8_t *s1 = srow + x1[j] * sc;
+        int w1 = wx[j];
+        int w0 = (1 << RESIZE_BITS_8U) - w1;
+        for (c = 0; c < t->channels; c++)
+            h[c * rw + j] = s0[t->src_channel[c]] * w0 +
+                s1[t->src_channel[c]] * w1;
+    }
+}
+
+int
+cam_pixel_convert_8u_to_tensor_rows (void *dest, int dstride,
+        const uint8_t *src, int sstride, const CamPixelTensor *t,
+        int row_start, int row_end)
+{
+    if (check_tensor (__FUNCTION__, t) < 0 ||
+        check_resize_rows (__FUNCTION__, t->height, row_start, row_end) < 0)
+        return -1;
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+    int nc = t->channels;
+    int half = t->flags & CAM_PIXEL_TENSOR_HALF;
+    int planar = (t->flags & CAM_PIXEL_TENSOR_PLANAR) || nc == 1;
+    int rw = t->roi_width;
+    int i, j, c;
+
+    int *x0 = (int*) malloc (3 * rw * sizeof (int));
+    int *x1 = x0 + rw;
+    int *wx = x1 + rw;
+    for (j = 0; j < rw; j++)
+        bilinear_coord (j, rw, t->src_width, RESIZE_BITS_8U, &x0[j], &x1[j],
+                &wx[j]);
+
+    /* horizontally interpolated copies of each channel of the two source
+     * rows in use, kept across tensor rows as in
+     * cam_pixel_resize_bilinear_8u_rows() */
+    int16_t *hbuf = (int16_t*) MALLOC_ALIGNED (2 * nc * rw *
+            sizeof (int16_t));
+    int16_t *hrow[2] = { hbuf, hbuf + nc * rw };
+    int hy[2] = { -1, -1 };
+
+    /* finished float rows of each channel, unless they can be written
+     * straight to planes of the tensor */
+    float *fbuf = NULL;
+    uint16_t *half_row = NULL;
+    if (half || !planar)
+        fbuf = (float*) MALLOC_ALIGNED (nc * t->width * sizeof (float));
+    if (half && !planar)
+        half_row = (uint16_t*) malloc (t->width * sizeof (uint16_t));
+
+    float pad[4], scale[4];
+    for (c = 0; c < nc; c++) {
+        pad[c] = t->pad * t->scale[c] + t->bias[c];
+        /* folds in the fixed point scale of the interpolation, which is an
+         * exact power of two */
+        scale[c] = t->scale[c] * (1.0f / (1 << (2*RESIZE_BITS_8U)));
+    }
+
+    for (i = row_start; i < row_end; i++) {
+        float *frow[4];
+        for (c = 0; c < nc; c++)
+            frow[c] = fbuf ? fbuf + c * t->width :
+                (float*)((uint8_t*) dest + (c * t->height + i) * dstride);
+
+        int y = i - t->roi_y;
+        if (y < 0 || y >= t->roi_height) {
+            for (c = 0; c < nc; c++)
+                for (j = 0; j < t->width; j++)
+                    frow[c][j] = pad[c];
+        } else {
+            int y0, y1, wy;
+            bilinear_coord (y, t->roi_height, t->src_height, RESIZE_BITS_8U,
+                    &y0, &y1, &wy);
+            if (hy[1] == y0) {
+                int16_t *tmp = hrow[0];
+                hrow[0] = hrow[1];
+                hrow[1] = tmp;
+                hy[0] = hy[1];
+                hy[1] = -1;
+            }
+            int k;
+            for (k = 0; k < 2; k++) {
+                int sy = k ? y1 : y0;
+                if (hy[k] == sy)
+                    continue;
+                tensor_row_8u (hrow[k], src + sy * sstride, x0, x1, wx, t);
+                hy[k] = sy;
+            }
+
+            for (c = 0; c < nc; c++) {
+                const int16_t *h0 = hrow[0] + c * rw;
+                const int16_t *h1 = hrow[1] + c * rw;
+                float *f = frow[c] + t->roi_x;
+                for (j = 0; j < t->roi_x; j++)
+                    frow[c][j] = pad[c];
+                for (j = t->roi_x + rw; j < t->width; j++)
+                    frow[c][j] = pad[c];
+
+                j = 0;
+#ifdef HAVE_INTEL
+                if (has_sse2)
+                    j = cam_pixel_tensor_blend_rows_sse2 (f, h0, h1, rw, wy,
+                            scale[c], t->bias[c]);
+#endif
+                for (; j < rw; j++)
+                    f[j] = (float)(h0[j] * ((1 << RESIZE_BITS_8U) - wy) +
+                            h1[j] * wy) * scale[c] + t->bias[c];
+            }
+        }
+
+        if (planar && half) {
+            for (c = 0; c < nc; c++)
+                convert_32f_to_16f ((uint16_t*)((uint8_t*) dest +
+                            (c * t->height + i) * dstride), frow[c],
+                        t->width);
+        } else if (!planar) {
+            uint8_t *drow = (uint8_t*) dest + i * dstride;
+            j = 0;
+#ifdef HAVE_INTEL
+            if (has_sse2 && nc == 3 && !half)
+                j = cam_pixel_interleave_32f_c3_sse2 ((float*) drow,
+                        frow[0], frow[1], frow[2], t->width);
+#endif
+            for (c = 0; c < nc && j < t->width; c++) {
+                int k;
+                if (half) {
+                    uint16_t *d = (uint16_t*) drow + c;
+                    convert_32f_to_16f (half_row, frow[c], t->width);
+                    for (k = j; k < t->width; k++)
+                        d[k * nc] = half_row[k];
+                } else {
+                    float *d = (float*) drow + c;
+                    for (k = j; k < t->width; k++)
+                        d[k * nc] = frow[c][k];
+                }
+            }
+        }
+    }
+
+    free (half_row);
+    free (fbuf);
+    free (hbuf);
+    free (x0);
+    return 0;
+}
+
+int
+cam_pixel_convert_8u_to_tensor (void *dest, int dstride, const uint8_t *src,
+        int sstride, const CamPixelTensor *t)
+{
+    return cam_pixel_convert_8u_to_tensor_rows (dest, dstride, src, sstride,
+            t, 0, t->height);
+}
+
+/* Lossless codec.  A stream starts with a LOSSLESS_HEADER_SIZE byte
+ * header: the magic "CLS1", then the source pixel format, width, height,
+ * rows per band and number of bands as little-endian 32-bit integers.  A
+ * table with the end offset of each band, relative to the end of the
+ * table, follows, and then the bands.  Each row of a band is coded as
+ * blocks of LOSSLESS_BLOCK residuals, the last one padded with zeros.  A
+ * block is a byte holding the bit width n of its residuals followed by 2n
+ * bytes: groups of 8 residuals packed little-endian into n bytes, or for
+ * n > 8, the 16 low bytes followed by the high n - 8 bits packed in the
+ * same way. */
+#define LOSSLESS_HEADER_SIZE 24
+#define LOSSLESS_BAND_ROWS 64
+#define LOSSLESS_BLOCK 16
+/* blocks are written with 8-byte stores, which may overrun the end of a
+ * band by this much */
+#define LOSSLESS_SLACK 8
+
+typedef struct {
+    uint8_t *dest;
+    int dstride;
+    const uint8_t *src;
+    int sstride;
+    int width;
+    int height;
+    int bits;
+    int dist;
+    int row_max;
+    uint32_t *band_end;
+    int status;
+} lossless_args_t;
+
+/* Sample size and distance to the nearest sample of the same color */
+static int
+_lossless_params (CamPixelFormat pfmt, int *bits, int *dist)
+{
+    switch (pfmt) {
+        case CAM_PIXEL_FORMAT_GRAY:
+            *bits = 8; *dist = 1;
+            return 0;
+        case CAM_PIXEL_FORMAT_BAYER_BGGR:
+        case CAM_PIXEL_FORMAT_BAYER_GBRG:
+        case CAM_PIXEL_FORMAT_BAYER_GRBG:
+        case CAM_PIXEL_FORMAT_BAYER_RGGB:
+            *bits = 8; *dist = 2;
+            return 0;
+        case CAM_PIXEL_FORMAT_LE_GRAY16:
+            *bits = 16; *dist = 1;
+            return 0;
+        case CAM_PIXEL_FORMAT_LE_BAYER16_BGGR:
+        case CAM_PIXEL_FORMAT_LE_BAYER16_GBRG:
+        case CAM_PIXEL_FORMAT_LE_BAYER16_GRBG:
+        case CAM_PIXEL_FORMAT_LE_BAYER16_RGGB:
+            *bits = 16; *dist = 2;
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+static int
+_lossless_row_max (int width, int bits)
+{
+    return (width + LOSSLESS_BLOCK - 1) / LOSSLESS_BLOCK * (1 + 2 * bits);
+}
+
+static void
+_put_le32 (uint8_t *p, uint32_t v)
+{
+    v = GUINT32_TO_LE (v);
+    memcpy (p, &v, 4);
+}
+
+static uint32_t
+_get_le32 (const uint8_t *p)
+{
+    uint32_t v;
+    memcpy (&v, p, 4);
+    return GUINT32_FROM_LE (v);
+}
+
+static inline int
+_bit_width (unsigned int v)
+{
+    return v ? 32 - __builtin_clz (v) : 0;
+}
+
+/* Residuals are mapped to unsigned values with the sign in the low bit, so
+ * that small negative residuals need few bits as well */
+static inline uint8_t
+_zigzag_8u (int r)
+{
+    uint8_t s = r;
+    return (uint8_t)((s << 1) ^ -(s >> 7));
+}
+
+static inline uint16_t
+_zigzag_16u (int r)
+{
+    uint16_t s = r;
+    return (uint16_t)((s << 1) ^ -(s >> 15));
+}
+
+static inline int
+_unzigzag (int z)
+{
+    return (z >> 1) ^ -(z & 1);
+}
+
+/* Predicts each sample as a + b - c from its nearest neighbours of the
+ * same color to the left, above and above-left, treating missing
+ * neighbours as 0.  Decoding then reduces to a running sum along each row,
+ * which, unlike the median predictor, can be vectorized. */
+static void
+_lossless_residuals_8u (uint8_t *res, const uint8_t *cur,
+        const uint8_t *up, int width, int d)
+{
+    int j = 0;
+#ifdef HAVE_INTEL
+    if (has_sse2)
+        j = cam_pixel_lossless_residuals_8u_sse2 (res, cur, up, width, d);
+#endif
+    for (; j < width; j++) {
+        int p = j >= d ? cur[j-d] : 0;
+        if (up)
+            p += up[j] - (j >= d ? up[j-d] : 0);
+        res[j] = _zigzag_8u (cur[j] - p);
+    }
+}
+
+static void
+_lossless_residuals_16u (uint16_t *res, const uint16_t *cur,
+        const uint16_t *up, int width, int d)
+{
+    int j = 0;
+#ifdef HAVE_INTEL
+    if (has_sse2)
+        j = cam_pixel_lossless_residuals_16u_sse2 (res, cur, up, width, d);
+#endif
+    for (; j < width; j++) {
+        int p = j >= d ? GUINT16_FROM_LE (cur[j-d]) : 0;
+        if (up)
+            p += GUINT16_FROM_LE (up[j]) -
+                (j >= d ? GUINT16_FROM_LE (up[j-d]) : 0);
+        res[j] = _zigzag_16u (GUINT16_FROM_LE (cur[j]) - p);
+    }
+}
+
+static void
+_lossless_reconstruct_8u (uint8_t *cur, const uint8_t *up,
+        const uint8_t *res, int width, int d)
+{
+    int j = 0;
+#ifdef HAVE_INTEL
+    if (has_sse2)
+        j = cam_pixel_lossless_reconstruct_8u_sse2 (cur, up, res, width, d);
+#endif
+    for (; j < width; j++) {
+        int p = j >= d ? cur[j-d] : 0;
+        if (up)
+            p += up[j] - (j >= d ? up[j-d] : 0);
+        cur[j] = p + _unzigzag (res[j]);
+    }
+}
+
+static void
+_lossless_reconstruct_16u (uint16_t *cur, const uint16_t *up,
+        const uint16_t *res, int width, int d)
+{
+    int j = 0;
+#ifdef HAVE_INTEL
+    if (has_sse2)
+        j = cam_pixel_lossless_reconstruct_16u_sse2 (cur, up, res, width,
+                d);
+#endif
+    for (; j < width; j++) {
+        int p = j >= d ? GUINT16_FROM_LE (cur[j-d]) : 0;
+        if (up)
+            p += GUINT16_FROM_LE (up[j]) -
+                (j >= d ? GUINT16_FROM_LE (up[j-d]) : 0);
+        cur[j] = GUINT16_TO_LE ((uint16_t)(p + _unzigzag (res[j])));
+    }
+}
+
+/* Packs 8 values of at most n bits, one per byte of @w, into the low 8n
+ * bits */
+static inline uint64_t
+_pack_group (uint64_t w, int n)
+{
+    w = (w & 0x00ff00ff00ff00ffULL) |
+        ((w >> 8 & 0x00ff00ff00ff00ffULL) << n);
+    w = (w & 0x0000ffff0000ffffULL) |
+        ((w >> 16 & 0x0000ffff0000ffffULL) << 2 * n);
+    return (w & 0xffffffffULL) | (w >> 32 << 4 * n);
+}
+
+/* The inverse of _pack_group(), for n < 8 */
+static inline uint64_t
+_unpack_group (uint64_t w, int n)
+{
+    uint64_t m = (1ULL << 4 * n) - 1;
+    w &= (1ULL << 8 * n) - 1;
+    w = (w & m) | ((w >> 4 * n & m) << 32);
+    m = ((1ULL << 2 * n) - 1) * 0x0000000100000001ULL;
+    w = (w & m) | ((w >> 2 * n & m) << 16);
+    m = ((1ULL << n) - 1) * 0x0001000100010001ULL;
+    return (w & m) | ((w >> n & m) << 8);
+}
+
+/* Writes the 16 bytes at @v as n-bit values.  Writes up to 8 bytes past
+ * the end of the block. */
+static uint8_t *
+_pack_block (uint8_t *out, const uint8_t *v, int n)
+{
+    uint64_t w[2];
+    int k;
+    if (n == 8) {
+        memcpy (out, v, LOSSLESS_BLOCK);
+        return out + LOSSLESS_BLOCK;
+    }
+    memcpy (w, v, LOSSLESS_BLOCK);
+    for (k = 0; k < 2; k++) {
+        uint64_t p = GUINT64_TO_LE (_pack_group (GUINT64_FROM_LE (w[k]), n));
+        memcpy (out, &p, 8);
+        out += n;
+    }
+    return out;
+}
+
+/* Reads 16 n-bit values into @v, with 2n bytes known to be available at
+ * @in but possibly not more */
+static const uint8_t *
+_unpack_block (uint8_t *v, const uint8_t *in, const uint8_t *end, int n)
+{
+    int k;
+    if (n == 8) {
+        memcpy (v, in, LOSSLESS_BLOCK);
+        return in + LOSSLESS_BLOCK;
+    }
+    for (k = 0; k < 2; k++) {
+        uint64_t w = 0;
+        memcpy (&w, in, end - in >= 8 ? 8 : n);
+        w = GUINT64_TO_LE (_unpack_group (GUINT64_FROM_LE (w), n));
+        memcpy (v + 8 * k, &w, 8);
+        in += n;
+    }
+    return in;
+}
+
+static uint8_t *
+_lossless_pack_8u (uint8_t *out, const uint8_t *res, int count)
+{
+    int j = 0, k;
+#ifdef HAVE_INTEL
+    if (has_sse2)
+        j = cam_pixel_lossless_pack_8u_sse2 (&out, res, count);
+#endif
+    for (; j < count; j += LOSSLESS_BLOCK) {
+        unsigned int any = 0;
+        for (k = 0; k < LOSSLESS_BLOCK; k++)
+            any |= res[j+k];
+        int n = _bit_width (any);
+        *out++ = n;
+        if (n)
+            out = _pack_block (out, res + j, n);
+    }
+    return out;
+}
+
+/* Blocks of 16-bit values wider than 8 bits store the low bytes followed
+ * by the remaining high bits */
+static uint8_t *
+_lossless_pack_16u (uint8_t *out, const uint16_t *res, int count)
+{
+    uint8_t lo[LOSSLESS_BLOCK], hi[LOSSLESS_BLOCK];
+    int j = 0, k;
+#ifdef HAVE_INTEL
+    if (has_sse2)
+        j = cam_pixel_lossless_pack_16u_sse2 (&out, res, count);
+#endif
+    for (; j < count; j += LOSSLESS_BLOCK) {
+        unsigned int any = 0;
+        for (k = 0; k < LOSSLESS_BLOCK; k++) {
+            any |= res[j+k];
+            lo[k] = res[j+k];
+            hi[k] = res[j+k] >> 8;
+        }
+        int n = _bit_width (any);
+        *out++ = n;
+        if (n > 8) {
+            memcpy (out, lo, LOSSLESS_BLOCK);
+            out = _pack_block (out + LOSSLESS_BLOCK, hi, n - 8);
+        } else if (n) {
+            out = _pack_block (out, lo, n);
+        }
+    }
+    return out;
+}
+
+/* Returns NULL if the blocks are corrupt */
+static const uint8_t *
+_lossless_unpack_8u (uint8_t *res, const uint8_t *in, const uint8_t *end,
+        int count)
+{
+    int j = 0;
+#ifdef HAVE_INTEL
+    if (has_sse2)
+        j = cam_pixel_lossless_unpack_8u_sse2 (res, &in, end, count);
+#endif
+    for (; j < count; j += LOSSLESS_BLOCK) {
+        if (in >= end)
+            return NULL;
+        int n = *in++;
+        if (n > 8 || end - in < 2 * n)
+            return NULL;
+        if (n)
+            in = _unpack_block (res + j, in, end, n);
+        else
+            memset (res + j, 0, LOSSLESS_BLOCK);
+    }
+    return in;
+}
+
+static const uint8_t *
+_lossless_unpack_16u (uint16_t *res, const uint8_t *in, const uint8_t *end,
+        int count)
+{
+    uint8_t lo[LOSSLESS_BLOCK], hi[LOSSLESS_BLOCK];
+    int j = 0, k;
+#ifdef HAVE_INTEL
+    if (has_sse2)
+        j = cam_pixel_lossless_unpack_16u_sse2 (res, &in, end, count);
+#endif
+    for (; j < count; j += LOSSLESS_BLOCK) {
+        if (in >= end)
+            return NULL;
+        int n = *in++;
+        if (n > 16 || end - in < 2 * n)
+            return NULL;
+        memset (lo, 0, LOSSLESS_BLOCK);
+        memset (hi, 0, LOSSLESS_BLOCK);
+        if (n > 8) {
+            memcpy (lo, in, LOSSLESS_BLOCK);
+            in = _unpack_block (hi, in + LOSSLESS_BLOCK, end, n - 8);
+        } else if (n) {
+            in = _unpack_block (lo, in, end, n);
+        }
+        for (k = 0; k < LOSSLESS_BLOCK; k++)
+            res[j+k] = lo[k] | (hi[k] << 8);
+    }
+    return in;
+}
+
+/* Each band is first written at the start of its worst-case space, right
+ * after the band table */
+static void
+_lossless_encode_bands (int row_start, int row_end, void *user_data)
+{
+    lossless_args_t *a = (lossless_args_t*) user_data;
+    int padded = (a->width + LOSSLESS_BLOCK - 1) & ~(LOSSLESS_BLOCK - 1);
+    int i, r;
+
+    void *res = calloc (padded, a->bits / 8);
+    if (!res) {
+        a->status = -1;
+        return;
+    }
+
+    for (r = row_start; r < row_end; r += LOSSLESS_BAND_ROWS) {
+        int band = r / LOSSLESS_BAND_ROWS;
+        int band_end = MIN (r + LOSSLESS_BAND_ROWS, a->height);
+        uint8_t *start = a->dest + r * a->row_max + band * LOSSLESS_SLACK;
+        uint8_t *out = start;
+
+        for (i = r; i < band_end; i++) {
+            const uint8_t *cur = a->src + i * a->sstride;
+            const uint8_t *up = i - r >= a->dist ?
+                cur - a->dist * a->sstride : NULL;
+            if (a->bits == 8) {
+                _lossless_residuals_8u (res, cur, up, a->width, a->dist);
+                out = _lossless_pack_8u (out, res, padded);
+            } else {
+                _lossless_residuals_16u (res, (const uint16_t*) cur,
+                        (const uint16_t*) up, a->width, a->dist);
+                out = _lossless_pack_16u (out, res, padded);
+            }
+        }
+        a->band_end[band] = out - start;
+    }
+    free (res);
+}
+
+static void
+_lossless_decode_bands (int row_start, int row_end, void *user_data)
+{
+    lossless_args_t *a = (lossless_args_t*) user_data;
+    int padded = (a->width + LOSSLESS_BLOCK - 1) & ~(LOSSLESS_BLOCK - 1);
+    int i, r;
+
+    void *res = malloc (padded * a->bits / 8);
+    if (!res) {
+        a->status = -1;
+        return;
+    }
+
+    for (r = row_start; r < row_end; r += LOSSLESS_BAND_ROWS) {
+        int band = r / LOSSLESS_BAND_ROWS;
+        int band_end = MIN (r + LOSSLESS_BAND_ROWS, a->height);
+        const uint8_t *in = a->src + (band ? a->band_end[band-1] : 0);
+        const uint8_t *end = a->src + a->band_end[band];
+
+        for (i = r; i < band_end && in; i++) {
+            uint8_t *cur = a->dest + i * a->dstride;
+            uint8_t *up = i - r >= a->dist ?
+                cur - a->dist * a->dstride : NULL;
+            if (a->bits == 8) {
+                in = _lossless_unpack_8u (res, in, end, padded);
+                if (in)
+                    _lossless_reconstruct_8u (cur, up, res, a->width,
+                            a->dist);
+            } else {
+                in = _lossless_unpack_16u (res, in, end, padded);
+                if (in)
+                    _lossless_reconstruct_16u ((uint16_t*) cur,
+                            (const uint16_t*) up, res, a->width, a->dist);
+            }
+        }
+        if (in != end)
+            a->status = -1;
+    }
+    free (res);
+}
+
+int
+cam_pixel_lossless_max_size (CamPixelFormat pfmt, int width, int height)
+{
+    int bits, dist;
+    if (0 != _lossless_params (pfmt, &bits, &dist) || width < 1 ||
+            height < 1)
+        return -1;
+    int nbands = (height + LOSSLESS_BAND_ROWS - 1) / LOSSLESS_BAND_ROWS;
+    return LOSSLESS_HEADER_SIZE + nbands * (4 + LOSSLESS_SLACK) +
+        height * _lossless_row_max (width, bits);
+}
+
+int
+cam_pixel_lossless_encode (uint8_t *dest, int dest_size,
+        const uint8_t *src, int sstride, CamPixelFormat pfmt,
+        int width, int height, int nthreads)
+{
+    int bits, dist, b;
+    int max_size = cam_pixel_lossless_max_size (pfmt, width, height);
+    if (max_size < 0 || dest_size < max_size) {
+        fprintf (stderr, "%s: unsupported format or buffer too small\n",
+                __FUNCTION__);
+        return -1;
+    }
+    _lossless_params (pfmt, &bits, &dist);
+
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+    int nbands = (height + LOSSLESS_BAND_ROWS - 1) / LOSSLESS_BAND_ROWS;
+    uint8_t *table = dest + LOSSLESS_HEADER_SIZE;
+    uint8_t *data = table + 4 * nbands;
+    lossless_args_t args = {
+        .dest = data,
+        .src = src,
+        .sstride = sstride,
+        .width = width,
+        .height = height,
+        .bits = bits,
+        .dist = dist,
+        .row_max = _lossless_row_max (width, bits),
+        .band_end = malloc (nbands * sizeof (uint32_t)),
+        .status = 0,
+    };
+    if (!args.band_end)
+        return -1;
+
+    cam_pixel_parallel_for (nthreads, height, LOSSLESS_BAND_ROWS,
+            2 * width * bits / 8, _lossless_encode_bands, &args);
+    if (0 != args.status) {
+        free (args.band_end);
+        return -1;
+    }
+
+    /* close the gaps between the bands */
+    int used = 0;
+    for (b = 0; b < nbands; b++) {
+        const uint8_t *band = data +
+            b * LOSSLESS_BAND_ROWS * args.row_max + b * LOSSLESS_SLACK;
+        memmove (data + used, band, args.band_end[b]);
+        used += args.band_end[b];
+        _put_le32 (table + 4 * b, used);
+    }
+    free (args.band_end);
+
+    memcpy (dest, "CLS1", 4);
+    _put_le32 (dest + 4, pfmt);
+    _put_le32 (dest + 8, width);
+    _put_le32 (dest + 12, height);
+    _put_le32 (dest + 16, LOSSLESS_BAND_ROWS);
+    _put_le32 (dest + 20, nbands);
+    return data + used - dest;
+}
+
+int
+cam_pixel_lossless_decode (uint8_t *dest, int dstride,
+        int width, int height, CamPixelFormat pfmt,
+        const uint8_t *src, int src_size, int nthreads)
+{
+    int bits, dist, b;
+    if (0 != _lossless_params (pfmt, &bits, &dist) ||
+            src_size < LOSSLESS_HEADER_SIZE || memcmp (src, "CLS1", 4) ||
+            _get_le32 (src + 4) != pfmt ||
+            _get_le32 (src + 8) != width ||
+            _get_le32 (src + 12) != height ||
+            _get_le32 (src + 16) != LOSSLESS_BAND_ROWS) {
+        fprintf (stderr, "%s: stream does not match the image\n",
+                __FUNCTION__);
+        return -1;
+    }
+
+    int nbands = (height + LOSSLESS_BAND_ROWS - 1) / LOSSLESS_BAND_ROWS;
+    if (_get_le32 (src + 20) != nbands ||
+            src_size - LOSSLESS_HEADER_SIZE < 4 * nbands) {
+        fprintf (stderr, "%s: corrupt band table\n", __FUNCTION__);
+        return -1;
+    }
+
+    const uint8_t *table = src + LOSSLESS_HEADER_SIZE;
+    lossless_args_t args = {
+        .dest = dest,
+        .dstride = dstride,
+        .src = table + 4 * nbands,
+        .width = width,
+        .height = height,
+        .bits = bits,
+        .dist = dist,
+        .band_end = malloc (nbands * sizeof (uint32_t)),
+        .status = 0,
+    };
+    if (!args.band_end)
+        return -1;
+
+    uint32_t prev = 0;
+    uint32_t avail = src_size - LOSSLESS_HEADER_SIZE - 4 * nbands;
+    for (b = 0; b < nbands; b++) {
+        args.band_end[b] = _get_le32 (table + 4 * b);
+        if (args.band_end[b] < prev || args.band_end[b] > avail) {
+            fprintf (stderr, "%s: corrupt band table\n", __FUNCTION__);
+            free (args.band_end);
+            return -1;
+        }
+        prev = args.band_end[b];
+    }
+
+    cam_pixel_parallel_for (nthreads, height, LOSSLESS_BAND_ROWS,
+            2 * width * bits / 8, _lossless_decode_bands, &args);
+    free (args.band_end);
+    if (0 != args.status)
+        fprintf (stderr, "%s: corrupt stream\n", __FUNCTION__);
+    return args.status;
+}
+
+/* Delta residuals are coded in chunks of this many bytes, a multiple of
+ * LOSSLESS_BLOCK */
+#define DELTA_CHUNK 4096
+
+int
+cam_pixel_delta_max_size (int n)
+{
+    if (n < 0)
+        return -1;
+    return _lossless_row_max (n, 8) + LOSSLESS_SLACK;
+}
+
+int
+cam_pixel_delta_encode_8u (uint8_t *dest, int dest_size, const uint8_t *src,
+        const uint8_t *ref, int n)
+{
+    uint8_t res[DELTA_CHUNK];
+    uint8_t *out = dest;
+    int i, j;
+    if (n < 0 || dest_size < cam_pixel_delta_max_size (n)) {
+        fprintf (stderr, "%s: destination buffer too small\n",
+                __FUNCTION__);
+        return -1;
+    }
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+    for (i = 0; i < n; i += DELTA_CHUNK) {
+        int count = MIN (DELTA_CHUNK, n - i);
+        int padded = (count + LOSSLESS_BLOCK - 1) & ~(LOSSLESS_BLOCK - 1);
+        j = 0;
+#ifdef HAVE_INTEL
+        if (has_sse2)
+            j = cam_pixel_delta_residuals_8u_sse2 (res, src + i, ref + i,
+                    count);
+#endif
+        for (; j < count; j++)
+            res[j] = _zigzag_8u (src[i+j] - ref[i+j]);
+        memset (res + count, 0, padded - count);
+        out = _lossless_pack_8u (out, res, padded);
+    }
+    return out - dest;
+}
+
+int
+cam_pixel_delta_decode_8u (uint8_t *dest, const uint8_t *ref, int n,
+        const uint8_t *src, int src_size)
+{
+    uint8_t res[DELTA_CHUNK];
+    const uint8_t *in = src;
+    const uint8_t *end = src + src_size;
+    int i, j;
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+    for (i = 0; i < n; i += DELTA_CHUNK) {
+        int count = MIN (DELTA_CHUNK, n - i);
+        in = _lossless_unpack_8u (res, in, end, count);
+        if (!in)
+            break;
+        j = 0;
+#ifdef HAVE_INTEL
+        if (has_sse2)
+            j = cam_pixel_delta_reconstruct_8u_sse2 (dest + i, ref + i, res,
+                    count);
+#endif
+        for (; j < count; j++)
+            dest[i+j] = ref[i+j] + _unzigzag (res[j]);
+    }
+    if (in != end) {
+        fprintf (stderr, "%s: corrupt residual\n", __FUNCTION__);
+        return -1;
+    }
+    return 0;
+}
+
+int
+cam_pixel_sad_8u (const uint8_t *a, int astride, const uint8_t *b,
+        int bstride, int width, int height, uint64_t *sad)
+{
+    if (width < 0 || height < 0) {
+        fprintf (stderr, "%s: invalid size %dx%d\n", __FUNCTION__,
+                width, height);
+        return -1;
+    }
+    if (!cpuid_detected)
+        cam_pixel_check_sse2 ();
+
+#ifdef HAVE_INTEL
+    if (has_sse2)
+        return cam_pixel_sad_8u_sse2 (a, astride, b, bstride, width, height,
+                sad);
+#endif
+
+    uint64_t total = 0;
+    int i, j;
+    for (i = 0; i < height; i++) {
+        const uint8_t *arow = a + i*astride;
+        const uint8_t *brow = b + i*bstride;
+        for (j = 0; j < width; j++)
+            total += abs (arow[j] - brow[j]);
+    }
+    *sad = total;
+    return 0;
+}
+
 int 
 cam_pixel_copy_8u_generic (const uint8_t *src, int sstride, 
         uint8_t *dst, int dstride, 
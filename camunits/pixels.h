@@ -62,6 +62,19 @@ typedef enum {
     CAM_PIXEL_FORMAT_LE_BAYER16_GRBG=cam_pf_fourcc('L','B','A','3'),
     CAM_PIXEL_FORMAT_LE_BAYER16_RGGB=cam_pf_fourcc('L','B','A','4'),
 
+    CAM_PIXEL_FORMAT_BAYER10P_BGGR=cam_pf_fourcc('p','B','A','A'), /* 10-bpp, bayer, MIPI packed */
+    CAM_PIXEL_FORMAT_BAYER10P_GBRG=cam_pf_fourcc('p','G','A','A'),
+    CAM_PIXEL_FORMAT_BAYER10P_GRBG=cam_pf_fourcc('p','g','A','A'),
+    CAM_PIXEL_FORMAT_BAYER10P_RGGB=cam_pf_fourcc('p','R','A','A'),
+
+    CAM_PIXEL_FORMAT_BAYER12P_BGGR=cam_pf_fourcc('p','B','C','C'), /* 12-bpp, bayer, MIPI packed */
+    CAM_PIXEL_FORMAT_BAYER12P_GBRG=cam_pf_fourcc('p','G','C','C'),
+    CAM_PIXEL_FORMAT_BAYER12P_GRBG=cam_pf_fourcc('p','g','C','C'),
+    CAM_PIXEL_FORMAT_BAYER12P_RGGB=cam_pf_fourcc('p','R','C','C'),
+
+    CAM_PIXEL_FORMAT_GRAY10P=cam_pf_fourcc('Y','1','0','P'), /* 10-bpp grayscale, MIPI packed */
+    CAM_PIXEL_FORMAT_GRAY12P=cam_pf_fourcc('Y','1','2','P'), /* 12-bpp grayscale, MIPI packed */
+
     CAM_PIXEL_FORMAT_BE_RGB16=358,          /* 48-bpp rgb (16-bits per channel), big-endian */
     CAM_PIXEL_FORMAT_LE_RGB16=cam_pf_fourcc('R','G','B','L'), /* 48-bpp rgb (16-bits per channel), little-endian */
 
@@ -73,7 +86,23 @@ typedef enum {
     CAM_PIXEL_FORMAT_BE_SIGNED_RGB16=360,
 
     CAM_PIXEL_FORMAT_FLOAT_GRAY32=cam_pf_fourcc('F','G','3','2'), /* 32-bit grayscale IEEE float, native byte order */
-//    CAM_PIXEL_FORMAT_FLOAT_RGB32,
+    CAM_PIXEL_FORMAT_FLOAT_RGB32=cam_pf_fourcc('F','R','3','2'), /* 96-bpp rgb IEEE float, native byte order */
+    CAM_PIXEL_FORMAT_FLOAT_RGB32_PLANAR=cam_pf_fourcc('F','R','P','3'), /* 96-bpp IEEE float, one plane per channel */
+    CAM_PIXEL_FORMAT_HALF_GRAY16=cam_pf_fourcc('H','G','1','6'), /* 16-bit grayscale IEEE half float, native byte order */
+    CAM_PIXEL_FORMAT_HALF_RGB16=cam_pf_fourcc('H','R','1','6'), /* 48-bpp rgb IEEE half float, native byte order */
+    CAM_PIXEL_FORMAT_HALF_RGB16_PLANAR=cam_pf_fourcc('H','R','P','3'), /* 48-bpp IEEE half float, one plane per channel */
+
+    /* cam_pixel_lossless_encode() streams, one tag per source format */
+    CAM_PIXEL_FORMAT_LOSSLESS_GRAY=cam_pf_fourcc('Z','G','R','Y'),
+    CAM_PIXEL_FORMAT_LOSSLESS_BAYER_BGGR=cam_pf_fourcc('Z','B','A','1'),
+    CAM_PIXEL_FORMAT_LOSSLESS_BAYER_GBRG=cam_pf_fourcc('Z','B','A','2'),
+    CAM_PIXEL_FORMAT_LOSSLESS_BAYER_GRBG=cam_pf_fourcc('Z','B','A','3'),
+    CAM_PIXEL_FORMAT_LOSSLESS_BAYER_RGGB=cam_pf_fourcc('Z','B','A','4'),
+    CAM_PIXEL_FORMAT_LOSSLESS_LE_GRAY16=cam_pf_fourcc('Z','G','1','6'),
+    CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_BGGR=cam_pf_fourcc('Z','L','B','1'),
+    CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_GBRG=cam_pf_fourcc('Z','L','B','2'),
+    CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_GRBG=cam_pf_fourcc('Z','L','B','3'),
+    CAM_PIXEL_FORMAT_LOSSLESS_LE_BAYER16_RGGB=cam_pf_fourcc('Z','L','B','4'),
     CAM_PIXEL_FORMAT_INVALID=0xFFFFFFFE,
     CAM_PIXEL_FORMAT_ANY=0xFFFFFFFF,
 } CamPixelFormat;
@@ -105,6 +134,34 @@ int cam_pixel_format_bpp (CamPixelFormat p);
  */
 int cam_pixel_format_stride_meaningful (CamPixelFormat p);
 
+/**
+ * cam_pixel_format_packed_bits:
+ *
+ * Returns: the number of significant bits in each sample of a packed raw
+ * CamPixelFormat such as #CAM_PIXEL_FORMAT_BAYER10P_GBRG or
+ * #CAM_PIXEL_FORMAT_GRAY12P, or 0 if @p is not a packed raw format.
+ */
+int cam_pixel_format_packed_bits (CamPixelFormat p);
+
+/**
+ * cam_pixel_format_lossless:
+ *
+ * Returns: the pixel format that tags cam_pixel_lossless_encode() streams
+ * of images in CamPixelFormat @p, for example
+ * #CAM_PIXEL_FORMAT_LOSSLESS_BAYER_GRBG for #CAM_PIXEL_FORMAT_BAYER_GRBG,
+ * or #CAM_PIXEL_FORMAT_INVALID if @p can't be losslessly compressed.
+ */
+CamPixelFormat cam_pixel_format_lossless (CamPixelFormat p);
+
+/**
+ * cam_pixel_format_lossless_source:
+ *
+ * Returns: the pixel format of the images in streams tagged with @p, or
+ * #CAM_PIXEL_FORMAT_INVALID if @p is not one of the lossless tags.  This
+ * is the inverse of cam_pixel_format_lossless().
+ */
+CamPixelFormat cam_pixel_format_lossless_source (CamPixelFormat p);
+
 /**
  * cam_pixel_convert_8u_gray_to_64f_gray:
  * @dest: The destination buffer pre-allocated by the caller.
@@ -185,6 +242,57 @@ int cam_pixel_convert_8u_gray_to_8u_RGBA (uint8_t * dest, int dstride,
 int cam_pixel_apply_lut_8u (uint8_t * dest, int dstride, int dwidth, int dheight,
         const uint8_t * src, int sstride, const uint8_t * lut);
 
+/**
+ * cam_pixel_apply_lut_8u_multi:
+ * @dest: The destination buffer pre-allocated by the caller.
+ * @dstride: Stride in bytes of the destination image.
+ * @width: Width of the image in pixels.
+ * @height: Height of the image in pixels.
+ * @src: The source image.
+ * @sstride: Stride in bytes of the source image.
+ * @src_channels: Number of 8-bit channels in each source pixel, from 1 to
+ *      4.
+ * @dst_channels: Number of 8-bit channels in each destination pixel.
+ *      Must equal @src_channels unless @src_channels is 1.
+ * @lut: @dst_channels lookup tables of 256 entries each, one after the
+ *      other.
+ *
+ * Applies a separate lookup table to each channel of an interleaved image.
+ * Channel c of the destination is looked up in table c, indexed by channel
+ * c of the source.  A single channel source indexes every table with its
+ * one channel instead, which maps gray images to color, e.g. for false
+ * color display.  Multi-channel images of equal channel counts are SSE2
+ * accelerated.
+ */
+int cam_pixel_apply_lut_8u_multi (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, int src_channels,
+        int dst_channels, const uint8_t *lut);
+
+/**
+ * cam_pixel_apply_lut_16u_to_8u:
+ * @dest: The destination buffer pre-allocated by the caller.
+ * @dstride: Stride in bytes of the destination image.
+ * @width: Width of the image in pixels.
+ * @height: Height of the image in pixels.
+ * @src: The source image, with 16-bit channels.
+ * @sstride: Stride in bytes of the source image.
+ * @src_channels: Number of channels in each source pixel, from 1 to 4.
+ * @dst_channels: Number of 8-bit channels in each destination pixel.
+ *      Must equal @src_channels unless @src_channels is 1.
+ * @bits: Number of significant bits in the source samples, from 1 to 16.
+ * @lut: @dst_channels lookup tables of 2^@bits entries each, one after
+ *      the other.
+ * @big_endian: 1 if the source samples are big-endian.
+ *
+ * Same as cam_pixel_apply_lut_8u_multi(), but maps 16-bit samples to 8
+ * bits, so that gamma and contrast curves can use the full precision of
+ * the source.  Samples larger than 2^@bits - 1 use the last table entry.
+ * Lookups of equal channel counts are SSE2 accelerated.
+ */
+int cam_pixel_apply_lut_16u_to_8u (uint8_t *dest, int dstride, int width,
+        int height, const uint16_t *src, int sstride, int src_channels,
+        int dst_channels, int bits, const uint8_t *lut, int big_endian);
+
 /**
  * cam_pixel_convert_8u_rgb_to_8u_bgr:
  * @dst: The destination buffer pre-allocated by the caller.
@@ -298,6 +406,45 @@ int cam_pixel_convert_8u_yuv420p_to_8u_bgra(uint8_t *dest, int dstride, int dwid
 int cam_pixel_convert_8u_yuv420p_to_8u_gray(uint8_t *dest, int dstride, int dwidth,
         int dheight, const uint8_t *src, int sstride);
 
+/**
+ * cam_pixel_convert_8u_nv12_to_8u_yuv420p:
+ * @dest: The destination buffer pre-allocated by the caller.
+ * @dstride: Stride in bytes of the Y plane of the destination image.  The
+ *      U and V planes follow the Y plane with half the stride.
+ * @width: Width of the image in pixels.  Must be even.
+ * @height: Height of the image in pixels.  Must be even.
+ * @src: The source image: a Y plane followed by a plane of interleaved U
+ *      and V samples with the same stride.
+ * @sstride: Stride in bytes of both planes of the source image.
+ *
+ * Converts NV12 to planar YUV 4:2:0 (I420) by copying the Y plane and
+ * separating the interleaved chroma samples into U and V planes.  This
+ * function is SSE2 accelerated.
+ */
+int cam_pixel_convert_8u_nv12_to_8u_yuv420p (uint8_t *dest, int dstride,
+        int width, int height, const uint8_t *src, int sstride);
+
+/**
+ * cam_pixel_convert_8u_nv12_to_8u_rgb:
+ * @dest: The destination buffer pre-allocated by the caller.
+ * @dstride: Number of bytes between the start of each row of @dest.
+ * @width: Width of the image in pixels.  Must be even.
+ * @height: Height of the image in pixels.  Must be even.
+ * @src: The source image, as for cam_pixel_convert_8u_nv12_to_8u_yuv420p().
+ * @sstride: Stride in bytes of both planes of the source image.
+ *
+ * Converts NV12 to RGB in one pass, without the planar YUV 4:2:0 image
+ * that cam_pixel_convert_8u_nv12_to_8u_yuv420p() followed by
+ * cam_pixel_convert_8u_yuv420p_to_8u_rgb() would write and read back.
+ * The output is identical to theirs.
+ */
+int cam_pixel_convert_8u_nv12_to_8u_rgb (uint8_t *dest, int dstride,
+        int width, int height, const uint8_t *src, int sstride);
+int cam_pixel_convert_8u_nv12_to_8u_bgr (uint8_t *dest, int dstride,
+        int width, int height, const uint8_t *src, int sstride);
+int cam_pixel_convert_8u_nv12_to_8u_bgra (uint8_t *dest, int dstride,
+        int width, int height, const uint8_t *src, int sstride);
+
 int cam_pixel_convert_8u_uyvy_to_8u_gray (uint8_t *dest, int dstride,
         int dwidth, int dheight, const uint8_t *src, int sstride);
 int cam_pixel_convert_8u_uyvy_to_8u_bgra(uint8_t *dest, int dstride,
@@ -367,23 +514,61 @@ int cam_pixel_replicate_bayer_border_8u (uint8_t * src, int sstride, int width,
  * @dst: Array of length 4 that contains destination pointers for the 4
  *     output planes.  Within the 2x2 bayer pattern, dst[0] is given the
  *     top-left set of pixels, dst[1] the top-right, dst[2] the bottom-left,
- *     and dst[3] the bottom-right.  The start of each buffer must be
- *     16-byte aligned.
+ *     and dst[3] the bottom-right.
  * @dstride: Number of bytes between the start of each row in the output
- *     buffers.  Each output buffer must have the same stride and it must
- *     be a multiple of 16 bytes.
- * @src: The source image.  Must be 16-byte aligned.
+ *     buffers.  Each output buffer must have the same stride.
+ * @src: The source image.
  * @sstride: Number of bytes between the start of each row in the input
- *     image.  Must be a multiple of 16 bytes.
+ *     image.
  * @width: Width of each output plane.
  * @height: Height of each output plane.
  *
  * Splits the R, B, Gb, and Gr components of a bayer-patterned image into
- * four separate planes.  This function is SSE2 accelerated.
+ * four separate planes.  There are no alignment requirements on any of
+ * the buffers.  This function is SSE2 accelerated.
  */
 int cam_pixel_split_bayer_planes_8u (uint8_t *dst[4], int dstride,
         const uint8_t * src, int sstride, int width, int height);
 
+/**
+ * cam_pixel_bayer_bin_to_8u_bgra:
+ * @dest: Destination image buffer.
+ * @dstride: Stride in bytes of the destination image.
+ * @width: Width in pixels of the output image, half the input width.
+ * @height: Height in pixels of the output image, half the input height.
+ * @src: The 8-bit bayer-patterned source image.
+ * @sstride: Stride in bytes of the source image.
+ * @format: Bayer tiling of the source image.
+ *
+ * Produces a half-resolution color image by turning each 2x2 bayer tile
+ * into one pixel.  Red and blue are taken as they are, and the two greens
+ * are averaged.  This is much cheaper than a full demosaic and is intended
+ * for previews.  There are no alignment requirements on any of the
+ * buffers.  This function is SSE2 accelerated.
+ */
+int cam_pixel_bayer_bin_to_8u_bgra (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, CamPixelFormat format);
+
+/**
+ * cam_pixel_bayer_bin_to_8u_rgb:
+ *
+ * Same as cam_pixel_bayer_bin_to_8u_bgra(), but produces RGB.  This
+ * function is not SIMD accelerated.
+ */
+int cam_pixel_bayer_bin_to_8u_rgb (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, CamPixelFormat format);
+
+/**
+ * cam_pixel_bayer_bin_to_8u_gray:
+ *
+ * Same as cam_pixel_bayer_bin_to_8u_bgra(), but produces the luminance
+ * of each binned pixel, using the weights of
+ * cam_pixel_convert_8u_rgb_to_8u_gray().  This function is SSE2
+ * accelerated.
+ */
+int cam_pixel_bayer_bin_to_8u_gray (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, CamPixelFormat format);
+
 /**
  * cam_pixel_bayer_interpolate_to_8u_bgra:
  * @src: An array of length 4 that contains the pointers to the 4
@@ -460,6 +645,853 @@ int cam_pixel_convert_bayer_to_8u_bgra (uint8_t *dest, int dstride, int dwidth,
 int cam_pixel_convert_bayer_to_8u_gray (uint8_t *dest, int dstride, int dwidth,
         int dheight, const uint8_t *src, int sstride, CamPixelFormat format);
 
+/**
+ * cam_pixel_swap_bytes_16u:
+ * @dest: The destination buffer pre-allocated by the caller.  May be the
+ *     same as @src.
+ * @dstride: Number of bytes between the start of each image row in the
+ *      destination buffer.
+ * @width: Number of 16-bit samples in each row.
+ * @height: Number of rows.
+ * @src: The source image.
+ * @sstride: Number of bytes between the start of each image row in the
+ *      source buffer.
+ *
+ * Swaps the byte order of every 16-bit sample, converting between
+ * big-endian and little-endian data.  This function is SSE2 accelerated.
+ */
+int cam_pixel_swap_bytes_16u (uint16_t *dest, int dstride, int width,
+        int height, const uint16_t *src, int sstride);
+
+/**
+ * cam_pixel_convert_16u_gray_to_8u_gray:
+ * @dest: The destination buffer pre-allocated by the caller.
+ * @dstride: Number of bytes between the start of each image row in the
+ *      destination buffer.
+ * @width: Width of the image in pixels.
+ * @height: Height of the image in pixels.
+ * @src: The source image.
+ * @sstride: Number of bytes between the start of each image row in the
+ *      source buffer.
+ * @shift: Number of bits to shift each sample right, from 0 to 8.  Use 8
+ *      to keep the most significant byte of full-range data, or e.g. 4 for
+ *      12-bit data stored in the low bits.  Results are saturated to 255.
+ * @big_endian: Nonzero if the samples of @src are big-endian.
+ *
+ * Reduces a 1-channel 16-bit image to 8 bits per pixel.  This function is
+ * SSE2 accelerated.
+ */
+int cam_pixel_convert_16u_gray_to_8u_gray (uint8_t *dest, int dstride,
+        int width, int height, const uint16_t *src, int sstride, int shift,
+        int big_endian);
+
+/**
+ * cam_pixel_convert_16u_gray_to_8u_gray_window:
+ * @dest: The destination buffer pre-allocated by the caller.
+ * @dstride: Number of bytes between the start of each image row in the
+ *      destination buffer.
+ * @width: Number of samples in each row.  Use the width in pixels times
+ *      the number of channels for multi-channel images.
+ * @height: Height of the image in pixels.
+ * @src: The source image.
+ * @sstride: Number of bytes between the start of each image row in the
+ *      source buffer.
+ * @low: Sample value mapped to 0.
+ * @high: Sample value mapped to 255.  Must be greater than @low.
+ * @big_endian: Nonzero if the samples of @src are big-endian.
+ *
+ * Reduces a 16-bit image to 8 bits per sample by stretching the window of
+ * sample values from @low to @high over the full 8-bit range.  Samples
+ * outside the window are clamped.  The scaling is done in 16-bit fixed
+ * point, and is exact to within one part in 32768 of the window.  This
+ * function is SSE2 accelerated.
+ */
+int cam_pixel_convert_16u_gray_to_8u_gray_window (uint8_t *dest, int dstride,
+        int width, int height, const uint16_t *src, int sstride, int low,
+        int high, int big_endian);
+
+/**
+ * cam_pixel_convert_8u_gray_to_16u_gray:
+ * @dest: The destination buffer pre-allocated by the caller.
+ * @dstride: Number of bytes between the start of each image row in the
+ *      destination buffer.
+ * @width: Number of samples in each row.  Use the width in pixels times
+ *      the number of channels for multi-channel images.
+ * @height: Height of the image in pixels.
+ * @src: The source image.
+ * @sstride: Number of bytes between the start of each image row in the
+ *      source buffer.
+ * @shift: Number of bits to shift each sample left, from 0 to 8.
+ * @big_endian: Nonzero to write big-endian samples to @dest.
+ *
+ * Widens an 8-bit image to 16 bits per sample.  This function is SSE2
+ * accelerated.
+ */
+int cam_pixel_convert_8u_gray_to_16u_gray (uint16_t *dest, int dstride,
+        int width, int height, const uint8_t *src, int sstride, int shift,
+        int big_endian);
+
+/**
+ * cam_pixel_replicate_bayer_border_16u:
+ * @src: Pointer to the top-left pixel of the input image.
+ * @sstride: Number of bytes between the start of each image row in the
+ *     input/output buffer.
+ * @width: Width of the input image.  Output image will have width @width+4.
+ * @height: Height of the input image.  Output image will have height
+ *     @height+4.
+ *
+ * 16-bit version of cam_pixel_replicate_bayer_border_8u().
+ */
+int cam_pixel_replicate_bayer_border_16u (uint16_t * src, int sstride,
+        int width, int height);
+
+/**
+ * cam_pixel_split_bayer_planes_16u_to_8u:
+ * @dst: Array of length 4 that contains destination pointers for the 4
+ *     output planes, in the same order as cam_pixel_split_bayer_planes_8u().
+ * @dstride: Number of bytes between the start of each row in the output
+ *     buffers.
+ * @src: The 16-bit bayer-patterned source image.
+ * @sstride: Number of bytes between the start of each row in the input
+ *     image.
+ * @width: Width of each output plane.
+ * @height: Height of each output plane.
+ * @shift: Number of bits to shift each sample right, as in
+ *     cam_pixel_convert_16u_gray_to_8u_gray().
+ * @big_endian: Nonzero if the samples of @src are big-endian.
+ *
+ * Splits a 16-bit bayer-patterned image into four 8-bit planes, reducing
+ * the bit depth in the same pass.  The output can be passed directly to
+ * cam_pixel_bayer_interpolate_to_8u_bgra().  There are no alignment
+ * requirements on any of the buffers.  This function is SSE2 accelerated.
+ */
+int cam_pixel_split_bayer_planes_16u_to_8u (uint8_t *dst[4], int dstride,
+        const uint16_t * src, int sstride, int width, int height, int shift,
+        int big_endian);
+
+/**
+ * cam_pixel_unpack_10p_to_16u:
+ * @dest: The destination buffer pre-allocated by the caller.
+ * @dstride: Number of bytes between the start of each image row in the
+ *      destination buffer.
+ * @width: Width of the image in pixels.
+ * @height: Height of the image in pixels.
+ * @src: The source image.
+ * @sstride: Number of bytes between the start of each image row in the
+ *      source buffer.
+ *
+ * Unpacks MIPI CSI-2 style packed 10-bit samples, as in
+ * #CAM_PIXEL_FORMAT_GRAY10P or the packed 10-bit bayer formats, to
+ * native-endian 16-bit samples from 0 to 1023.  Every 4 pixels are packed
+ * into 5 bytes: the 8 most significant bits of each pixel, followed by a
+ * byte holding the 2 least significant bits of all four, starting at bit
+ * 0.  The rows of @src must hold whole groups of 4 pixels.  The samples
+ * may be bayer-patterned or gray.  There are no alignment requirements on
+ * any of the buffers.  This function is SSE2 accelerated.
+ */
+int cam_pixel_unpack_10p_to_16u (uint16_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride);
+
+/**
+ * cam_pixel_unpack_12p_to_16u:
+ *
+ * Same as cam_pixel_unpack_10p_to_16u(), but for packed 12-bit samples.
+ * Every 2 pixels are packed into 3 bytes: the 8 most significant bits of
+ * each pixel, followed by a byte holding the 4 least significant bits of
+ * the first pixel in its low nibble and of the second in its high nibble.
+ * The rows of @src must hold whole groups of 2 pixels.  This function is
+ * SSE2 accelerated.
+ */
+int cam_pixel_unpack_12p_to_16u (uint16_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride);
+
+/**
+ * cam_pixel_unpack_10p_to_8u:
+ * @shift: Number of bits to shift each 10-bit sample right, from 0 to 8.
+ *      Use 2 to keep the 8 most significant bits.  Results are saturated
+ *      to 255.
+ *
+ * Unpacks packed 10-bit samples as in cam_pixel_unpack_10p_to_16u(), but
+ * reduces them to 8 bits in the same pass.  This function is SSE2
+ * accelerated.
+ */
+int cam_pixel_unpack_10p_to_8u (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, int shift);
+
+/**
+ * cam_pixel_unpack_12p_to_8u:
+ * @shift: Number of bits to shift each 12-bit sample right, from 0 to 8.
+ *      Use 4 to keep the 8 most significant bits.  Results are saturated
+ *      to 255.
+ *
+ * Unpacks packed 12-bit samples as in cam_pixel_unpack_12p_to_16u(), but
+ * reduces them to 8 bits in the same pass.  This function is SSE2
+ * accelerated.
+ */
+int cam_pixel_unpack_12p_to_8u (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, int shift);
+
+/**
+ * cam_pixel_split_bayer_planes_10p_to_8u:
+ * @dst: Array of length 4 that contains destination pointers for the 4
+ *     output planes, in the same order as cam_pixel_split_bayer_planes_8u().
+ * @dstride: Number of bytes between the start of each row in the output
+ *     buffers.
+ * @src: The packed 10-bit bayer-patterned source image.
+ * @sstride: Number of bytes between the start of each row in the input
+ *     image.
+ * @width: Width of each output plane.
+ * @height: Height of each output plane.
+ * @shift: Number of bits to shift each sample right, as in
+ *     cam_pixel_unpack_10p_to_8u().
+ *
+ * Splits a packed 10-bit bayer-patterned image into four 8-bit planes.
+ * Each pair of source rows is unpacked into a small buffer that stays in
+ * cache and split from there, so no full-size unpacked copy of the image
+ * is made.  This function is SSE2 accelerated.
+ */
+int cam_pixel_split_bayer_planes_10p_to_8u (uint8_t *dst[4], int dstride,
+        const uint8_t *src, int sstride, int width, int height, int shift);
+
+/**
+ * cam_pixel_split_bayer_planes_12p_to_8u:
+ *
+ * Same as cam_pixel_split_bayer_planes_10p_to_8u(), but for packed 12-bit
+ * samples.
+ */
+int cam_pixel_split_bayer_planes_12p_to_8u (uint8_t *dst[4], int dstride,
+        const uint8_t *src, int sstride, int width, int height, int shift);
+
+/**
+ * cam_pixel_bayer_interpolate_to_16u_rgb:
+ * @src: The source bayer-patterned image, in native byte order.  The border
+ *     of the source image must be duplicated with
+ *     cam_pixel_replicate_bayer_border_16u().
+ * @sstride: Stride in bytes of the source image.
+ * @dst: Destination image buffer.
+ * @dstride: Stride in bytes of destination image.
+ * @width: Width in pixels of output image.
+ * @height: Height in pixels of output image.
+ * @format: Pixel format of the bayer-patterned image.  May be any of the
+ *     8u or 16-bit bayer pattern pixel formats; only the tiling is used.
+ *
+ * Performs bayer interpolation on a 16-bit image and produces a 3-channel
+ * RGB image with 16 bits per channel.  The method is the same as that of
+ * cam_pixel_bayer_interpolate_to_8u_bgra(), computed with full 16-bit
+ * precision.  There are no alignment requirements on any of the buffers.
+ * This function is SSE2 accelerated.
+ */
+int cam_pixel_bayer_interpolate_to_16u_rgb (const uint16_t * src,
+        int sstride, uint16_t * dst, int dstride, int width, int height,
+        CamPixelFormat format);
+
+/**
+ * cam_pixel_bayer_interpolate_to_16u_gray:
+ * @src: The source bayer-patterned image, in native byte order.  The border
+ *     of the source image must be duplicated with
+ *     cam_pixel_replicate_bayer_border_16u().
+ * @sstride: Stride in bytes of the source image.
+ * @dst: Destination image buffer.
+ * @dstride: Stride in bytes of destination image.
+ * @width: Width in pixels of output image.
+ * @height: Height in pixels of output image.
+ * @format: Pixel format of the bayer-patterned image.  May be any of the
+ *     8u or 16-bit bayer pattern pixel formats; only the tiling is used.
+ *
+ * Like cam_pixel_bayer_interpolate_to_16u_rgb(), but sums the red, green,
+ * and blue channels with weights 0.25, 0.50, and 0.25 to produce a
+ * 1-channel 16-bit grayscale image.  This function is SSE2 accelerated.
+ */
+int cam_pixel_bayer_interpolate_to_16u_gray (const uint16_t * src,
+        int sstride, uint16_t * dst, int dstride, int width, int height,
+        CamPixelFormat format);
+
+/**
+ * cam_pixel_bayer_interpolate_edge_to_8u_bgra:
+ * @src: The source bayer-patterned image.  The border of the source image
+ *     must be duplicated with cam_pixel_replicate_bayer_border_8u().
+ * @sstride: Stride in bytes of the source image.
+ * @dst: Destination image buffer.
+ * @dstride: Stride in bytes of destination image.
+ * @width: Width in pixels of output image.
+ * @height: Height in pixels of output image.
+ * @format: Pixel format of the bayer-patterned image.  May be any of the
+ *     8u or 16-bit bayer pattern pixel formats; only the tiling is used.
+ *
+ * Performs edge-directed bayer interpolation on an image and produces a
+ * 4-channel BGRA image where alpha is set to 255.  Green is interpolated
+ * along the horizontal or vertical direction with the smaller gradient,
+ * with a Laplacian correction from the center color, and red and blue are
+ * interpolated from their color difference to green.  This follows:
+ *
+ * J.F. Hamilton and J.E. Adams. "Adaptive color plan interpolation in
+ * single sensor color electronic camera".  U.S. Patent 5,629,734.  1997.
+ *
+ * This is slower than cam_pixel_bayer_interpolate_to_8u_bgra() but produces
+ * much less zippering along sharp edges.  There are no alignment
+ * requirements on any of the buffers.  This function is SSE2 accelerated.
+ */
+int cam_pixel_bayer_interpolate_edge_to_8u_bgra (const uint8_t * src,
+        int sstride, uint8_t * dst, int dstride, int width, int height,
+        CamPixelFormat format);
+
+/**
+ * cam_pixel_bayer_interpolate_edge_to_8u_bgra_rows:
+ * @src: The source bayer-patterned image, as for
+ *     cam_pixel_bayer_interpolate_edge_to_8u_bgra().
+ * @sstride: Stride in bytes of the source image.
+ * @dst: Destination image buffer.  Points to the top row of the whole
+ *     image, not of the band.
+ * @dstride: Stride in bytes of destination image.
+ * @width: Width in pixels of output image.
+ * @height: Height in pixels of the whole output image.
+ * @row_start: First row of the band to produce.
+ * @row_end: One past the last row of the band to produce.
+ * @format: Pixel format of the bayer-patterned image.
+ *
+ * Produces only rows @row_start to @row_end - 1 of the output of
+ * cam_pixel_bayer_interpolate_edge_to_8u_bgra().  The result does not
+ * depend on how the image is divided into bands, so disjoint bands may be
+ * processed concurrently.
+ */
+int cam_pixel_bayer_interpolate_edge_to_8u_bgra_rows (const uint8_t * src,
+        int sstride, uint8_t * dst, int dstride, int width, int height,
+        int row_start, int row_end, CamPixelFormat format);
+
+/**
+ * cam_pixel_resize_box_8u:
+ * @dest: The destination buffer pre-allocated by the caller.
+ * @dstride: Number of bytes between the start of each image row in the
+ *      destination buffer.
+ * @dwidth: Width of the destination image in pixels.
+ * @dheight: Height of the destination image in pixels.
+ * @src: The source image.
+ * @sstride: Number of bytes between the start of each image row in the
+ *      source buffer.
+ * @swidth: Width of the source image in pixels.  Must be @dwidth times an
+ *      integer of at most 256.
+ * @sheight: Height of the source image in pixels.  Must be @dheight times
+ *      an integer of at most 256.
+ * @channels: Number of interleaved 8-bit channels per pixel, from 1 to 4.
+ *
+ * Reduces an image by integer factors, setting each destination pixel to
+ * the rounded average of the block of source pixels it covers.  There are
+ * no alignment requirements on any of the buffers.  This function is SSE2
+ * accelerated.
+ *
+ * Returns: 0 on success, -1 if the sizes are not an integer reduction.
+ */
+int cam_pixel_resize_box_8u (uint8_t *dest, int dstride, int dwidth,
+        int dheight, const uint8_t *src, int sstride, int swidth,
+        int sheight, int channels);
+
+/**
+ * cam_pixel_resize_box_16u:
+ *
+ * Same as cam_pixel_resize_box_8u(), but for native-endian 16-bit
+ * channels.
+ */
+int cam_pixel_resize_box_16u (uint16_t *dest, int dstride, int dwidth,
+        int dheight, const uint16_t *src, int sstride, int swidth,
+        int sheight, int channels);
+
+/**
+ * cam_pixel_resize_bilinear_8u:
+ * @dest: The destination buffer pre-allocated by the caller.
+ * @dstride: Number of bytes between the start of each image row in the
+ *      destination buffer.
+ * @dwidth: Width of the destination image in pixels.
+ * @dheight: Height of the destination image in pixels.
+ * @src: The source image.
+ * @sstride: Number of bytes between the start of each image row in the
+ *      source buffer.
+ * @swidth: Width of the source image in pixels.
+ * @sheight: Height of the source image in pixels.
+ * @channels: Number of interleaved 8-bit channels per pixel, from 1 to 4.
+ *
+ * Resizes an image to an arbitrary size by bilinear interpolation between
+ * the four source pixels nearest to the centre of each destination pixel.
+ * When reducing by more than a factor of two, source pixels between those
+ * are skipped, so cam_pixel_resize_box_8u() gives better results for
+ * integer reductions.  There are no alignment requirements on any of the
+ * buffers.  This function is SSE2 accelerated.
+ */
+int cam_pixel_resize_bilinear_8u (uint8_t *dest, int dstride, int dwidth,
+        int dheight, const uint8_t *src, int sstride, int swidth,
+        int sheight, int channels);
+
+/**
+ * cam_pixel_resize_bilinear_8u_rows:
+ * @row_start: First destination row to produce.
+ * @row_end: One past the last destination row to produce.
+ *
+ * Produces only rows @row_start to @row_end - 1 of the output of
+ * cam_pixel_resize_bilinear_8u().  @dest and @src point to the top row of
+ * the whole images, so disjoint bands may be processed concurrently.
+ */
+int cam_pixel_resize_bilinear_8u_rows (uint8_t *dest, int dstride,
+        int dwidth, int dheight, const uint8_t *src, int sstride,
+        int swidth, int sheight, int channels, int row_start, int row_end);
+
+/**
+ * cam_pixel_resize_bilinear_16u:
+ *
+ * Same as cam_pixel_resize_bilinear_8u(), but for native-endian 16-bit
+ * channels.  This function is not SIMD accelerated.
+ */
+int cam_pixel_resize_bilinear_16u (uint16_t *dest, int dstride, int dwidth,
+        int dheight, const uint16_t *src, int sstride, int swidth,
+        int sheight, int channels);
+
+/**
+ * cam_pixel_resize_bilinear_16u_rows:
+ *
+ * Band version of cam_pixel_resize_bilinear_16u(), as for
+ * cam_pixel_resize_bilinear_8u_rows().
+ */
+int cam_pixel_resize_bilinear_16u_rows (uint16_t *dest, int dstride,
+        int dwidth, int dheight, const uint16_t *src, int sstride,
+        int swidth, int sheight, int channels, int row_start, int row_end);
+
+/**
+ * CamPixelOrientation:
+ * @CAM_PIXEL_ORIENTATION_NORMAL: Unchanged.
+ * @CAM_PIXEL_ORIENTATION_ROTATE_90: Rotated 90 degrees clockwise.
+ * @CAM_PIXEL_ORIENTATION_ROTATE_180: Rotated 180 degrees.
+ * @CAM_PIXEL_ORIENTATION_ROTATE_270: Rotated 90 degrees counterclockwise.
+ * @CAM_PIXEL_ORIENTATION_FLIP_HORIZONTAL: Mirrored left to right.
+ * @CAM_PIXEL_ORIENTATION_FLIP_VERTICAL: Mirrored top to bottom.
+ * @CAM_PIXEL_ORIENTATION_TRANSPOSE: Mirrored about the main diagonal.
+ * @CAM_PIXEL_ORIENTATION_TRANSVERSE: Mirrored about the anti-diagonal.
+ *
+ * The ways an image can be rotated and mirrored by
+ * cam_pixel_rotate_8u_gray() and friends.
+ */
+typedef enum {
+    CAM_PIXEL_ORIENTATION_NORMAL = 0,
+    CAM_PIXEL_ORIENTATION_ROTATE_90,
+    CAM_PIXEL_ORIENTATION_ROTATE_180,
+    CAM_PIXEL_ORIENTATION_ROTATE_270,
+    CAM_PIXEL_ORIENTATION_FLIP_HORIZONTAL,
+    CAM_PIXEL_ORIENTATION_FLIP_VERTICAL,
+    CAM_PIXEL_ORIENTATION_TRANSPOSE,
+    CAM_PIXEL_ORIENTATION_TRANSVERSE
+} CamPixelOrientation;
+
+/**
+ * cam_pixel_orientation_swaps_axes:
+ *
+ * Returns: 1 if images reoriented with @orientation have their width and
+ * height swapped, 0 otherwise.
+ */
+int cam_pixel_orientation_swaps_axes (CamPixelOrientation orientation);
+
+/**
+ * cam_pixel_rotate_8u_gray:
+ * @dest: Destination image buffer.
+ * @dstride: Stride in bytes of the destination image.
+ * @width: Width in pixels of the source image.
+ * @height: Height in pixels of the source image.
+ * @src: Source image buffer.
+ * @sstride: Stride in bytes of the source image.
+ * @orientation: How to rotate or mirror the image.
+ *
+ * Rotates and/or mirrors an 8-bit image.  If
+ * cam_pixel_orientation_swaps_axes() is true for @orientation, the
+ * destination image is @height pixels wide and @width pixels high.
+ * Rotations by 90 and 270 degrees and the transposes are done by
+ * transposing small tiles in registers, a block of columns at a time, so
+ * both images are accessed in a cache friendly order.  Horizontal
+ * mirroring and 180 degree rotation take a single pass over the rows.
+ * There are no alignment requirements on any of the buffers.  This
+ * function is SSE2 accelerated.
+ */
+int cam_pixel_rotate_8u_gray (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride,
+        CamPixelOrientation orientation);
+
+/**
+ * cam_pixel_rotate_8u_rgb:
+ *
+ * Same as cam_pixel_rotate_8u_gray(), but for 24-bit pixels.  This
+ * function works through cache-sized tiles but is not SIMD accelerated.
+ */
+int cam_pixel_rotate_8u_rgb (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride,
+        CamPixelOrientation orientation);
+
+/**
+ * cam_pixel_rotate_8u_bgra:
+ *
+ * Same as cam_pixel_rotate_8u_gray(), but for 32-bit pixels.  This
+ * function is SSE2 accelerated.
+ */
+int cam_pixel_rotate_8u_bgra (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride,
+        CamPixelOrientation orientation);
+
+/**
+ * CAM_PIXEL_REMAP_FRAC_BITS:
+ *
+ * Number of fractional bits kept for the source coordinates in a
+ * #CamPixelRemap.
+ */
+#define CAM_PIXEL_REMAP_FRAC_BITS 5
+
+/**
+ * CamPixelRemap:
+ * @width: Width in pixels of the destination image.
+ * @height: Height in pixels of the destination image.
+ * @src_width: Width in pixels of the source image.
+ * @src_height: Height in pixels of the source image.
+ * @xy: For each destination pixel, the column and row of the top left
+ *      of the 2x2 block of source pixels it is interpolated from.
+ * @frac: For each destination pixel, an index into @weights.
+ * @weights: Four bilinear weights out of (1 << 14) for each combination of
+ *      horizontal and vertical fractions, followed by four zero weights
+ *      used for destination pixels that fall outside the source image.
+ *
+ * A lookup table moving each pixel of a destination image to an arbitrary
+ * position in a source image, with the positions rounded to
+ * 1 / (1 << #CAM_PIXEL_REMAP_FRAC_BITS) of a pixel.  A map takes 6 bytes
+ * per destination pixel, and is built once with cam_pixel_remap_new() and
+ * cam_pixel_remap_set() for use on any number of images.
+ */
+typedef struct _CamPixelRemap {
+    int width;
+    int height;
+    int src_width;
+    int src_height;
+    int16_t *xy;
+    uint16_t *frac;
+    int16_t *weights;
+} CamPixelRemap;
+
+/**
+ * cam_pixel_remap_new:
+ * @width: Width in pixels of the destination image.
+ * @height: Height in pixels of the destination image.
+ * @src_width: Width in pixels of the source image, from 2 to 32767.
+ * @src_height: Height in pixels of the source image, from 2 to 32767.
+ *
+ * Allocates a map in which every destination pixel is outside the source
+ * image.  Use cam_pixel_remap_set() to fill it in.
+ *
+ * Returns: a newly allocated #CamPixelRemap, to be freed with
+ * cam_pixel_remap_free(), or NULL if the sizes are out of range.
+ */
+CamPixelRemap * cam_pixel_remap_new (int width, int height, int src_width,
+        int src_height);
+
+/**
+ * cam_pixel_remap_free:
+ *
+ * Frees a map allocated by cam_pixel_remap_new().
+ */
+void cam_pixel_remap_free (CamPixelRemap *map);
+
+/**
+ * cam_pixel_remap_set:
+ * @x: Column of the destination pixel.
+ * @y: Row of the destination pixel.
+ * @sx: Column in the source image that pixel @x, @y is taken from.
+ * @sy: Row in the source image that pixel @x, @y is taken from.
+ *
+ * Sets the source position of one destination pixel.  Pixel centres are at
+ * integer positions.  Destination pixels whose source position is outside
+ * the source image are set to zero by cam_pixel_remap_8u().
+ */
+void cam_pixel_remap_set (CamPixelRemap *map, int x, int y, double sx,
+        double sy);
+
+/**
+ * cam_pixel_remap_8u:
+ * @dest: The destination buffer pre-allocated by the caller, of
+ *      @map->width by @map->height pixels.
+ * @dstride: Number of bytes between the start of each image row in the
+ *      destination buffer.
+ * @src: The source image, of @map->src_width by @map->src_height pixels.
+ * @sstride: Number of bytes between the start of each image row in the
+ *      source buffer.
+ * @channels: Number of interleaved 8-bit channels per pixel, from 1 to 4.
+ * @map: The map to apply.
+ *
+ * Moves the pixels of an image as described by @map, interpolating
+ * bilinearly between the four source pixels around each position.  This
+ * undistorts lens images, for example, when the map is built from a
+ * camera calibration.  There are no alignment requirements on any of the
+ * buffers.  This function is SSE2 accelerated for 1 and 4 channels.
+ */
+int cam_pixel_remap_8u (uint8_t *dest, int dstride, const uint8_t *src,
+        int sstride, int channels, const CamPixelRemap *map);
+
+/**
+ * cam_pixel_remap_8u_rows:
+ * @row_start: First destination row to produce.
+ * @row_end: One past the last destination row to produce.
+ *
+ * Produces only rows @row_start to @row_end - 1 of the output of
+ * cam_pixel_remap_8u().  @dest points to the top row of the whole image,
+ * so disjoint bands may be processed concurrently.
+ */
+int cam_pixel_remap_8u_rows (uint8_t *dest, int dstride, const uint8_t *src,
+        int sstride, int channels, const CamPixelRemap *map, int row_start,
+        int row_end);
+
+/**
+ * CamPixelTensorFlags:
+ * @CAM_PIXEL_TENSOR_PLANAR: Each channel is stored in its own plane of
+ *      @height rows, one after the other (CHW order).  Otherwise the
+ *      channels of each pixel are interleaved (HWC order).
+ * @CAM_PIXEL_TENSOR_HALF: Values are stored as IEEE half precision floats
+ *      instead of single precision.
+ *
+ * Layout options of the tensors written by cam_pixel_convert_8u_to_tensor().
+ */
+typedef enum {
+    CAM_PIXEL_TENSOR_PLANAR = 1 << 0,
+    CAM_PIXEL_TENSOR_HALF = 1 << 1
+} CamPixelTensorFlags;
+
+/**
+ * CamPixelTensor:
+ * @width: Width in pixels of the tensor.
+ * @height: Height in pixels of the tensor.
+ * @channels: Number of channels in the tensor, from 1 to 4.
+ * @flags: Bitwise OR of #CamPixelTensorFlags.
+ * @src_width: Width in pixels of the source image.
+ * @src_height: Height in pixels of the source image.
+ * @src_channels: Number of interleaved 8-bit channels per source pixel,
+ *      from 1 to 4.
+ * @src_channel: For each tensor channel, the source channel it is taken
+ *      from, which allows e.g. BGRA images to produce RGB tensors.
+ * @scale: For each tensor channel, the factor source values are
+ *      multiplied by.
+ * @bias: For each tensor channel, the value added after scaling.
+ * @roi_x: Column of the tensor where the left edge of the image lands.
+ * @roi_y: Row of the tensor where the top edge of the image lands.
+ * @roi_width: Width in pixels the image is resized to.
+ * @roi_height: Height in pixels the image is resized to.
+ * @pad: Source value, from 0 to 255, that the tensor is filled with
+ *      outside the image.
+ *
+ * Describes how cam_pixel_convert_8u_to_tensor() turns an 8-bit image
+ * into a tensor of floats for neural network inference.  The image is
+ * resized bilinearly into a rectangle of the tensor, and each value is
+ * normalized as @scale * source + @bias.  Fill in the sizes and use
+ * cam_pixel_tensor_fit() and cam_pixel_tensor_set_channel() to set up the
+ * rest.
+ */
+typedef struct _CamPixelTensor {
+    int width;
+    int height;
+    int channels;
+    int flags;
+    int src_width;
+    int src_height;
+    int src_channels;
+    int src_channel[4];
+    float scale[4];
+    float bias[4];
+    int roi_x;
+    int roi_y;
+    int roi_width;
+    int roi_height;
+    int pad;
+} CamPixelTensor;
+
+/**
+ * cam_pixel_tensor_fit:
+ * @tensor: A tensor description with its sizes filled in.
+ * @letterbox: Nonzero to keep the aspect ratio of the source image.
+ *
+ * Sets the rectangle of @tensor that the source image is resized into.
+ * The image is stretched over the whole tensor, or, with @letterbox,
+ * scaled to fit inside it and centred, with the remaining rows or columns
+ * left as padding.
+ */
+void cam_pixel_tensor_fit (CamPixelTensor *tensor, int letterbox);
+
+/**
+ * cam_pixel_tensor_set_channel:
+ * @tensor: A tensor description.
+ * @channel: Index of the tensor channel to set up.
+ * @src_channel: Index of the source channel to take it from.
+ * @mean: Mean of the channel, with source values mapped to 0.0 - 1.0.
+ * @std: Standard deviation of the channel in the same units.
+ *
+ * Sets up @channel to hold (source / 255 - @mean) / @std, the
+ * normalization most networks are trained with.  A @mean of 0 and @std
+ * of 1 gives values from 0 to 1.
+ */
+void cam_pixel_tensor_set_channel (CamPixelTensor *tensor, int channel,
+        int src_channel, float mean, float std);
+
+/**
+ * cam_pixel_convert_8u_to_tensor:
+ * @dest: The destination buffer pre-allocated by the caller.  Planar
+ *      tensors need @channels times @height rows.
+ * @dstride: Number of bytes between the start of each row of the tensor,
+ *      or of each plane row if it is planar.
+ * @src: The source image.
+ * @sstride: Number of bytes between the start of each image row in the
+ *      source buffer.
+ * @tensor: Description of the conversion.
+ *
+ * Resizes, reorders, normalizes and converts an 8-bit image to a float
+ * tensor in a single pass, without intermediate images.  Each tensor row
+ * interpolates two source rows as in cam_pixel_resize_bilinear_8u(), but
+ * keeps the full precision of the interpolation rather than rounding it
+ * to 8 bits.  There are no alignment requirements on any of the buffers.
+ * This function is SSE2 accelerated.
+ *
+ * Returns: 0 on success, -1 if @tensor is invalid.
+ */
+int cam_pixel_convert_8u_to_tensor (void *dest, int dstride,
+        const uint8_t *src, int sstride, const CamPixelTensor *tensor);
+
+/**
+ * cam_pixel_convert_8u_to_tensor_rows:
+ * @row_start: First tensor row to produce.
+ * @row_end: One past the last tensor row to produce.
+ *
+ * Produces only rows @row_start to @row_end - 1 of the output of
+ * cam_pixel_convert_8u_to_tensor(), in every plane.  @dest points to the
+ * start of the whole tensor, so disjoint bands may be processed
+ * concurrently.
+ */
+int cam_pixel_convert_8u_to_tensor_rows (void *dest, int dstride,
+        const uint8_t *src, int sstride, const CamPixelTensor *tensor,
+        int row_start, int row_end);
+
+/**
+ * cam_pixel_lossless_max_size:
+ * @pfmt: Pixel format of the uncompressed image.  Must be one of
+ *     #CAM_PIXEL_FORMAT_GRAY, #CAM_PIXEL_FORMAT_LE_GRAY16, or an 8-bit or
+ *     little-endian 16-bit bayer format.
+ * @width: Width of the image in pixels.
+ * @height: Height of the image in pixels.
+ *
+ * Returns: the size of the buffer that cam_pixel_lossless_encode() needs
+ * for an image of the given format and size, or -1 if @pfmt is not
+ * supported.  The compressed stream itself is usually much smaller.
+ */
+int cam_pixel_lossless_max_size (CamPixelFormat pfmt, int width, int height);
+
+/**
+ * cam_pixel_lossless_encode:
+ * @dest: The destination buffer pre-allocated by the caller.
+ * @dest_size: Size of @dest in bytes.  Must be at least
+ *     cam_pixel_lossless_max_size().
+ * @src: The image to compress.
+ * @sstride: Number of bytes between the start of each row of @src.
+ * @pfmt: Pixel format of @src, as for cam_pixel_lossless_max_size().
+ * @width: Width of the image in pixels.
+ * @height: Height of the image in pixels.
+ * @nthreads: Maximum number of threads to use, as for
+ *     cam_pixel_parallel_for().
+ *
+ * Compresses an image without loss.  Each sample is predicted as a + b - c
+ * from its nearest neighbours of the same color to the left (a), above (b)
+ * and above-left (c), and the residuals are packed in blocks of 16 with
+ * the fewest bits that hold the largest one.  Bands of 64 rows are coded
+ * independently, so that they are compressed and decompressed
+ * concurrently.  This function is SSE2 accelerated.
+ *
+ * Returns: the number of bytes written to @dest, or -1 on error.
+ */
+int cam_pixel_lossless_encode (uint8_t *dest, int dest_size,
+        const uint8_t *src, int sstride, CamPixelFormat pfmt,
+        int width, int height, int nthreads);
+
+/**
+ * cam_pixel_lossless_decode:
+ * @dest: The destination buffer pre-allocated by the caller.
+ * @dstride: Number of bytes between the start of each row of @dest.
+ * @width: Width of the image in pixels.
+ * @height: Height of the image in pixels.
+ * @pfmt: Pixel format of the uncompressed image.
+ * @src: A stream written by cam_pixel_lossless_encode().
+ * @src_size: Size of @src in bytes.
+ * @nthreads: Maximum number of threads to use, as for
+ *     cam_pixel_parallel_for().
+ *
+ * Decompresses an image compressed by cam_pixel_lossless_encode().  The
+ * format and size recorded in the stream must match @pfmt, @width and
+ * @height.  This function is SSE2 accelerated.
+ *
+ * Returns: 0 on success, -1 if the stream is corrupt or does not match.
+ */
+int cam_pixel_lossless_decode (uint8_t *dest, int dstride,
+        int width, int height, CamPixelFormat pfmt,
+        const uint8_t *src, int src_size, int nthreads);
+
+/**
+ * cam_pixel_delta_max_size:
+ * @n: Number of bytes to code.
+ *
+ * Returns: the size of the buffer that cam_pixel_delta_encode_8u() needs
+ * for @n bytes, which is slightly more than @n.
+ */
+int cam_pixel_delta_max_size (int n);
+
+/**
+ * cam_pixel_delta_encode_8u:
+ * @dest: The destination buffer pre-allocated by the caller.
+ * @dest_size: Size of @dest in bytes.  Must be at least
+ *     cam_pixel_delta_max_size().
+ * @src: The bytes to code.
+ * @ref: The reference bytes that @src is coded against.
+ * @n: Number of bytes in @src and @ref.
+ *
+ * Codes the difference between two equally sized buffers, typically a
+ * frame and an earlier frame of the same format.  The signed byte
+ * differences are packed in blocks of 16 with the fewest bits that hold
+ * the largest one, as in cam_pixel_lossless_encode(), so that sensor
+ * noise costs a few bits per byte and unchanged areas nearly nothing.
+ * This function is SSE2 accelerated.
+ *
+ * Returns: the number of bytes written to @dest, or -1 on error.
+ */
+int cam_pixel_delta_encode_8u (uint8_t *dest, int dest_size,
+        const uint8_t *src, const uint8_t *ref, int n);
+
+/**
+ * cam_pixel_delta_decode_8u:
+ * @dest: The destination buffer of @n bytes.
+ * @ref: The reference bytes given to cam_pixel_delta_encode_8u().
+ * @n: Number of bytes in @dest and @ref.
+ * @src: The output of cam_pixel_delta_encode_8u().
+ * @src_size: Size of @src in bytes.
+ *
+ * Reconstructs the bytes coded by cam_pixel_delta_encode_8u().  This
+ * function is SSE2 accelerated.
+ *
+ * Returns: 0 on success, -1 if @src is corrupt.
+ */
+int cam_pixel_delta_decode_8u (uint8_t *dest, const uint8_t *ref, int n,
+        const uint8_t *src, int src_size);
+
+/**
+ * cam_pixel_sad_8u:
+ * @a: The first image.
+ * @astride: Number of bytes between the start of each row of @a.
+ * @b: The second image.
+ * @bstride: Number of bytes between the start of each row of @b.
+ * @width: Width of the images in bytes, i.e. pixels times channels.
+ * @height: Height of the images in pixels.
+ * @sad: Output parameter for the sum of the absolute differences.
+ *
+ * Computes the sum of the absolute differences between corresponding
+ * bytes of two 8-bit images, e.g. to measure how much a frame differs from
+ * a background image.  There are no alignment requirements on any of the
+ * buffers.  This function is SSE2 accelerated.
+ *
+ * Returns: 0 on success, -1 on failure.
+ */
+int cam_pixel_sad_8u (const uint8_t *a, int astride, const uint8_t *b,
+        int bstride, int width, int height, uint64_t *sad);
+
 int cam_pixel_copy_8u_generic (const uint8_t *src, int sstride, 
         uint8_t *dst, int dstride, 
         int src_x, int src_y, 
@@ -468,6 +1500,54 @@ int cam_pixel_copy_8u_generic (const uint8_t *src, int sstride,
         int bits_per_pixel);
 
 
+/**
+ * CamPixelBandFunc:
+ * @row_start: First row of the band.
+ * @row_end: One past the last row of the band.
+ * @user_data: The user data passed to cam_pixel_parallel_for().
+ *
+ * Processes rows @row_start to @row_end - 1 of an image.
+ */
+typedef void (*CamPixelBandFunc) (int row_start, int row_end,
+        void *user_data);
+
+/**
+ * cam_pixel_parallel_for:
+ * @nthreads: Maximum number of threads to use, including the calling
+ *     thread.  If 0 or negative, the number of online CPUs is used.
+ * @height: Number of rows in the image.
+ * @row_multiple: Every band except the last starts and ends on a multiple
+ *     of this many rows.  Use 2 for bayer-patterned or 4:2:0 subsampled
+ *     images.
+ * @row_bytes: Approximate number of bytes of source and destination data
+ *     touched per row, used to size the bands to fit in cache.
+ * @func: Function called once for each band.
+ * @user_data: Passed to @func.
+ *
+ * Divides the rows of an image into horizontal bands and calls @func on
+ * each, distributing the bands over a persistent pool of worker threads.
+ * Returns once every band has been processed.  @func is called
+ * concurrently from multiple threads and must only write the rows of its
+ * own band.
+ *
+ * Only one job runs on the pool at a time.  If the pool is busy, for
+ * example because @func itself calls cam_pixel_parallel_for(), @func is
+ * called once for the whole image in the calling thread.
+ *
+ * Most cam_pixel_ kernels can be split into bands simply by offsetting
+ * the source and destination pointers by @row_start rows and passing
+ * @row_end - @row_start as the height.
+ */
+int cam_pixel_parallel_for (int nthreads, int height, int row_multiple,
+        int row_bytes, CamPixelBandFunc func, void *user_data);
+
+/**
+ * cam_pixel_get_num_cpus:
+ *
+ * Returns: the number of online CPUs.
+ */
+int cam_pixel_get_num_cpus (void);
+
 /**
  * cam_pixel_check_sse2:
  *
@@ -477,6 +1557,48 @@ int cam_pixel_copy_8u_generic (const uint8_t *src, int sstride,
  */
 int cam_pixel_check_sse2();
 
+/**
+ * CamPixelIsaFlags:
+ * @CAM_PIXEL_ISA_SSE2: SSE2 accelerated kernels.
+ * @CAM_PIXEL_ISA_SSE3: SSE3 accelerated kernels.
+ *
+ * Instruction set extensions that the cam_pixel_ kernels can use.
+ */
+typedef enum {
+    CAM_PIXEL_ISA_SSE2 = 1 << 0,
+    CAM_PIXEL_ISA_SSE3 = 1 << 1,
+} CamPixelIsaFlags;
+
+/**
+ * cam_pixel_get_supported_isa:
+ *
+ * Returns: the #CamPixelIsaFlags supported by both the CPU and this build
+ * of libcamunits.
+ */
+int cam_pixel_get_supported_isa (void);
+
+/**
+ * cam_pixel_set_isa_mask:
+ * @mask: Bitwise OR of the #CamPixelIsaFlags that kernels may use.  Pass 0
+ *     to force the plain C paths, or ~0 to restore the default.
+ *
+ * Restricts the accelerated code paths used by the cam_pixel_ kernels.
+ * This is intended for benchmarking and for checking the accelerated paths
+ * against the plain C ones.  Kernels that have no plain C path fail when
+ * the instruction set they require is masked out.  This is process-wide
+ * state and must not be changed while kernels are running in other
+ * threads.
+ */
+void cam_pixel_set_isa_mask (int mask);
+
+/**
+ * cam_pixel_get_isa:
+ *
+ * Returns: the #CamPixelIsaFlags currently in use, i.e. those supported
+ * and not masked out by cam_pixel_set_isa_mask().
+ */
+int cam_pixel_get_isa (void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "pixels.h"
+
+#ifndef MIN
+#define MIN(a,b) ( (a)<(b) ? (a) : (b) )
+#endif
+
+/* Approximate number of bytes a band should touch.  Small enough that a
+ * band's source and destination rows stay resident in a typical L2 cache,
+ * large enough that scheduling overhead is negligible. */
+#define BAND_BYTES (256 * 1024)
+
+typedef struct _ParallelJob {
+    CamPixelBandFunc func;
+    void *user_data;
+    int height;
+    int band_rows;
+    int nbands;
+    volatile gint next_band;
+    int nhelpers;
+    int active;
+} ParallelJob;
+
+/* Only one job runs on the pool at a time.  A caller that finds the pool
+ * busy (including a band function calling back in) runs its job serially
+ * instead of waiting. */
+static GStaticMutex job_lock = G_STATIC_MUTEX_INIT;
+static GStaticMutex pool_lock = G_STATIC_MUTEX_INIT;
+
+/* The remaining state is protected by pool_mutex.  Worker threads are
+ * created on demand and live for the rest of the process. */
+static GMutex *pool_mutex = NULL;
+static GCond *work_cond = NULL;
+static GCond *done_cond = NULL;
+static int nworkers = 0;
+static ParallelJob *current_job = NULL;
+static int job_serial = 0;
+
+static void
+run_bands (ParallelJob *job)
+{
+    int band;
+    while ((band = g_atomic_int_exchange_and_add (&job->next_band, 1)) <
+            job->nbands) {
+        int row_start = band * job->band_rows;
+        int row_end = MIN (job->height, row_start + job->band_rows);
+        job->func (row_start, row_end, job->user_data);
+    }
+}
+
+static gpointer
+worker_thread (gpointer data)
+{
+    int index = GPOINTER_TO_INT (data);
+    int seen = 0;
+
+    g_mutex_lock (pool_mutex);
+    while (1) {
+        while (seen == job_serial)
+            g_cond_wait (work_cond, pool_mutex);
+        seen = job_serial;
+
+        ParallelJob *job = current_job;
+        if (!job || index >= job->nhelpers)
+            continue;
+
+        g_mutex_unlock (pool_mutex);
+        run_bands (job);
+        g_mutex_lock (pool_mutex);
+
+        job->active--;
+        if (!job->active)
+            g_cond_signal (done_cond);
+    }
+    return NULL;
+}
+
+/* Makes sure at least @wanted worker threads exist and returns how many
+ * actually do. */
+static int
+ensure_workers (int wanted)
+{
+    g_static_mutex_lock (&pool_lock);
+    if (!pool_mutex) {
+        if (!g_thread_supported ()) g_thread_init (NULL);
+        pool_mutex = g_mutex_new ();
+        work_cond = g_cond_new ();
+        done_cond = g_cond_new ();
+    }
+    while (nworkers < wanted) {
+        GError *err = NULL;
+        GThread *thread = g_thread_create (worker_thread,
+                GINT_TO_POINTER (nworkers), FALSE, &err);
+        if (!thread) {
+            fprintf (stderr, "cam_pixel_parallel_for: unable to create "
+                    "worker thread: %s\n", err->message);
+            g_error_free (err);
+            break;
+        }
+        nworkers++;
+    }
+    int n = nworkers;
+    g_static_mutex_unlock (&pool_lock);
+    return n;
+}
+
+int
+cam_pixel_get_num_cpus (void)
+{
+    static int ncpus = 0;
+    if (!ncpus) {
+#ifdef _SC_NPROCESSORS_ONLN
+        ncpus = sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+        if (ncpus < 1)
+            ncpus = 1;
+    }
+    return ncpus;
+}
+
+int
+cam_pixel_parallel_for (int nthreads, int height, int row_multiple,
+        int row_bytes, CamPixelBandFunc func, void *user_data)
+{
+    if (height <= 0)
+        return 0;
+    if (row_multiple < 1)
+        row_multiple = 1;
+    if (nthreads <= 0)
+        nthreads = cam_pixel_get_num_cpus ();
+
+    /* pick cache-sized bands, but enough of them to keep every thread
+     * busy */
+    int band_rows = row_bytes > 0 ? BAND_BYTES / row_bytes : height;
+    int max_rows = (height + nthreads - 1) / nthreads;
+    band_rows = MIN (band_rows, max_rows);
+    band_rows -= band_rows % row_multiple;
+    if (band_rows < row_multiple)
+        band_rows = row_multiple;
+
+    int nbands = (height + band_rows - 1) / band_rows;
+    nthreads = MIN (nthreads, nbands);
+
+    if (nthreads <= 1 || !g_static_mutex_trylock (&job_lock)) {
+        func (0, height, user_data);
+        return 0;
+    }
+
+    ParallelJob job;
+    job.func = func;
+    job.user_data = user_data;
+    job.height = height;
+    job.band_rows = band_rows;
+    job.nbands = nbands;
+    job.next_band = 0;
+    job.nhelpers = MIN (nthreads - 1, ensure_workers (nthreads - 1));
+    job.active = job.nhelpers;
+
+    g_mutex_lock (pool_mutex);
+    current_job = &job;
+    job_serial++;
+    g_cond_broadcast (work_cond);
+    g_mutex_unlock (pool_mutex);
+
+    run_bands (&job);
+
+    g_mutex_lock (pool_mutex);
+    while (job.active)
+        g_cond_wait (done_cond, pool_mutex);
+    current_job = NULL;
+    g_mutex_unlock (pool_mutex);
+
+    g_static_mutex_unlock (&job_lock);
+    return 0;
+}
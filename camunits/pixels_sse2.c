@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <emmintrin.h>
 
 #include "pixels_sse2.h"
@@ -9,101 +11,38 @@ cam_pixel_split_bayer_planes_8u_sse2 (uint8_t *dst[4], int dstride,
         const uint8_t * src, int sstride, int width, int height)
 {
     __m128i mask;
-    int i, j;
-
-    for (i = 0; i < 4; i++) {
-        if (!CAM_IS_ALIGNED16(dst[i]) || !CAM_IS_ALIGNED16(dstride)) {
-            fprintf (stderr, "cam_pixel_split_bayer_planes_8u: dst[%d] is not "
-                    "16-byte aligned\n", i);
-            return -1;
-        }
-    }
-    if (!CAM_IS_ALIGNED16(src) || !CAM_IS_ALIGNED16(sstride)) {
-        fprintf (stderr, "cam_pixel_split_bayer_planes_8u: src is not 16-byte "
-                "aligned\n");
-        return -1;
-    }
-
-    /* If the source stride is not a multiple of 32 pixels, we need to
-     * fix up the last column at the end. */
-    if (!CAM_IS_ALIGNED32 (sstride))
-        width -= 8;
+    int i, j, k;
 
+    /* Unaligned loads and stores cost next to nothing when the data
+     * happens to be aligned, so any buffer is accepted.  Columns past the
+     * last full block of 16 are split one at a time. */
     mask = _mm_set1_epi16 (0xff);
     for (i = 0; i < height; i++) {
-        uint8_t * drow1 = dst[0] + i * dstride;
-        uint8_t * drow2 = dst[1] + i * dstride;
-        uint8_t * drow3 = dst[2] + i * dstride;
-        uint8_t * drow4 = dst[3] + i * dstride;
-        const uint8_t * srow = src + 2*i*sstride;
-        for (j = 0; j < width; j += 16) {
-            __m128i s1, s2, t1, t2, out;
-            s1 = _mm_load_si128 ((__m128i *)(srow + 2*j));
-            s2 = _mm_load_si128 ((__m128i *)(srow + 2*j + 16));
-
-            t1 = _mm_and_si128 (s1, mask);
-            t2 = _mm_and_si128 (s2, mask);
-
-            out = _mm_packus_epi16 (t1, t2);
-            _mm_store_si128 ((__m128i *)(drow1 + j), out);
-
-            t1 = _mm_srli_epi16 (s1, 8);
-            t2 = _mm_srli_epi16 (s2, 8);
+        for (k = 0; k < 2; k++) {
+            uint8_t * drow1 = dst[2*k] + i * dstride;
+            uint8_t * drow2 = dst[2*k+1] + i * dstride;
+            const uint8_t * srow = src + (2*i + k)*sstride;
+            for (j = 0; j + 16 <= width; j += 16) {
+                __m128i s1, s2, t1, t2;
+                s1 = _mm_loadu_si128 ((__m128i *)(srow + 2*j));
+                s2 = _mm_loadu_si128 ((__m128i *)(srow + 2*j + 16));
 
-            out = _mm_packus_epi16 (t1, t2);
-            _mm_store_si128 ((__m128i *)(drow2 + j), out);
+                t1 = _mm_and_si128 (s1, mask);
+                t2 = _mm_and_si128 (s2, mask);
+                _mm_storeu_si128 ((__m128i *)(drow1 + j),
+                        _mm_packus_epi16 (t1, t2));
 
-            s1 = _mm_load_si128 ((__m128i *)(srow + sstride + 2*j));
-            s2 = _mm_load_si128 ((__m128i *)(srow + sstride + 2*j + 16));
-
-            t1 = _mm_and_si128 (s1, mask);
-            t2 = _mm_and_si128 (s2, mask);
-
-            out = _mm_packus_epi16 (t1, t2);
-            _mm_store_si128 ((__m128i *)(drow3 + j), out);
-
-            t1 = _mm_srli_epi16 (s1, 8);
-            t2 = _mm_srli_epi16 (s2, 8);
-
-            out = _mm_packus_epi16 (t1, t2);
-            _mm_store_si128 ((__m128i *)(drow4 + j), out);
+                t1 = _mm_srli_epi16 (s1, 8);
+                t2 = _mm_srli_epi16 (s2, 8);
+                _mm_storeu_si128 ((__m128i *)(drow2 + j),
+                        _mm_packus_epi16 (t1, t2));
+            }
+            for (; j < width; j++) {
+                drow1[j] = srow[2*j];
+                drow2[j] = srow[2*j+1];
+            }
         }
     }
-    if (CAM_IS_ALIGNED32 (sstride))
-        return 0;
-
-    /* Fix up the last column if necessary */
-    const uint8_t * scol1 = src + 2*width;
-    const uint8_t * scol2 = src + 2*width + sstride;
-    uint8_t * dcol1 = dst[0] + width;
-    uint8_t * dcol2 = dst[1] + width;
-    uint8_t * dcol3 = dst[2] + width;
-    uint8_t * dcol4 = dst[3] + width;
-    __m128i t2 = _mm_set1_epi16 (0);
-    for (i = 0; i < height; i++) {
-        __m128i s1, t1, out;
-        s1 = _mm_load_si128 ((__m128i *)(scol1 + 2*i*sstride));
-        t1 = _mm_and_si128 (s1, mask);
-
-        out = _mm_packus_epi16 (t1, t2);
-        _mm_store_si128 ((__m128i *)(dcol1 + i*dstride), out);
-
-        t1 = _mm_srli_epi16 (s1, 8);
-
-        out = _mm_packus_epi16 (t1, t2);
-        _mm_store_si128 ((__m128i *)(dcol2 + i*dstride), out);
-
-        s1 = _mm_load_si128 ((__m128i *)(scol2 + 2*i*sstride));
-        t1 = _mm_and_si128 (s1, mask);
-
-        out = _mm_packus_epi16 (t1, t2);
-        _mm_store_si128 ((__m128i *)(dcol3 + i*dstride), out);
-
-        t1 = _mm_srli_epi16 (s1, 8);
-
-        out = _mm_packus_epi16 (t1, t2);
-        _mm_store_si128 ((__m128i *)(dcol4 + i*dstride), out);
-    }
     return 0;
 }
 
@@ -842,22 +781,22 @@ cam_pixel_bayer_interpolate_to_8u_gray_sse2 (uint8_t * src, int sstride,
         for (i = -2; i < height + 2; i += 2) {
             uint8_t * drow = dst + (i>=2)*(i-2)*dstride;
             uint8_t * srow = src + i*sstride;
-            int i5 = tmpstride * (i % 5);
-            int i4 = tmpstride * ((i+1) % 5);
-            int i3 = tmpstride * ((i+2) % 5);
-            int i2 = tmpstride * ((i+3) % 5);
-            int i1 = tmpstride * ((i+4) % 5);
+            int i5 = tmpstride * ((i+5) % 5);
+            int i4 = tmpstride * ((i+6) % 5);
+            int i3 = tmpstride * ((i+7) % 5);
+            int i2 = tmpstride * ((i+8) % 5);
+            int i1 = tmpstride * ((i+9) % 5);
 
             for (j = 0; j < width; j += 16)
                 INTERPOLATE_GRAY_ROW_GX();
 
             drow += dstride;
             srow += sstride;
-            i5 = tmpstride * ((i+1) % 5);
-            i4 = tmpstride * ((i+2) % 5);
-            i3 = tmpstride * ((i+3) % 5);
-            i2 = tmpstride * ((i+4) % 5);
-            i1 = tmpstride * ((i+5) % 5);
+            i5 = tmpstride * ((i+6) % 5);
+            i4 = tmpstride * ((i+7) % 5);
+            i3 = tmpstride * ((i+8) % 5);
+            i2 = tmpstride * ((i+9) % 5);
+            i1 = tmpstride * ((i+10) % 5);
 
             for (j = 0; j < width; j += 16)
                 INTERPOLATE_GRAY_ROW_XG();
@@ -867,22 +806,22 @@ cam_pixel_bayer_interpolate_to_8u_gray_sse2 (uint8_t * src, int sstride,
         for (i = -2; i < height + 2; i += 2) {
             uint8_t * drow = dst + (i>=2)*(i-2)*dstride;
             uint8_t * srow = src + i*sstride;
-            int i5 = tmpstride * (i % 5);
-            int i4 = tmpstride * ((i+1) % 5);
-            int i3 = tmpstride * ((i+2) % 5);
-            int i2 = tmpstride * ((i+3) % 5);
-            int i1 = tmpstride * ((i+4) % 5);
+            int i5 = tmpstride * ((i+5) % 5);
+            int i4 = tmpstride * ((i+6) % 5);
+            int i3 = tmpstride * ((i+7) % 5);
+            int i2 = tmpstride * ((i+8) % 5);
+            int i1 = tmpstride * ((i+9) % 5);
 
             for (j = 0; j < width; j += 16)
                 INTERPOLATE_GRAY_ROW_XG();
 
             drow += dstride;
             srow += sstride;
-            i5 = tmpstride * ((i+1) % 5);
-            i4 = tmpstride * ((i+2) % 5);
-            i3 = tmpstride * ((i+3) % 5);
-            i2 = tmpstride * ((i+4) % 5);
-            i1 = tmpstride * ((i+5) % 5);
+            i5 = tmpstride * ((i+6) % 5);
+            i4 = tmpstride * ((i+7) % 5);
+            i3 = tmpstride * ((i+8) % 5);
+            i2 = tmpstride * ((i+9) % 5);
+            i1 = tmpstride * ((i+10) % 5);
 
             for (j = 0; j < width; j += 16)
                 INTERPOLATE_GRAY_ROW_GX();
@@ -891,3 +830,1614 @@ cam_pixel_bayer_interpolate_to_8u_gray_sse2 (uint8_t * src, int sstride,
     return 0;
 }
 
+
+/* 16-bit bayer support.  Unlike the 8u kernels above, none of these require
+ * aligned buffers or strides. */
+
+#define SWAP_16U(v) _mm_or_si128 (_mm_slli_epi16 ((v), 8), \
+        _mm_srli_epi16 ((v), 8))
+
+/* min(v, 255) on unsigned 16-bit lanes, which SSE2 lacks. */
+#define CLAMP_16U_TO_8U(v) _mm_sub_epi16 ((v), \
+        _mm_subs_epu16 ((v), _mm_set1_epi16 (255)))
+
+static inline uint8_t
+shift_16u_to_8u (uint16_t v, int shift, int big_endian)
+{
+    if (big_endian)
+        v = (v << 8) | (v >> 8);
+    v >>= shift;
+    return v > 255 ? 255 : v;
+}
+
+int
+cam_pixel_swap_bytes_16u_sse2 (uint16_t *dest, int dstride, int width,
+        int height, const uint16_t *src, int sstride)
+{
+    int i, j;
+    for (i = 0; i < height; i++) {
+        const uint16_t *srow = (const uint16_t*)((const uint8_t*)src +
+                i*sstride);
+        uint16_t *drow = (uint16_t*)((uint8_t*)dest + i*dstride);
+        for (j = 0; j + 8 <= width; j += 8) {
+            __m128i v = _mm_loadu_si128 ((const __m128i *)(srow + j));
+            _mm_storeu_si128 ((__m128i *)(drow + j), SWAP_16U (v));
+        }
+        for (; j < width; j++)
+            drow[j] = (srow[j] << 8) | (srow[j] >> 8);
+    }
+    return 0;
+}
+
+int
+cam_pixel_convert_16u_gray_to_8u_gray_sse2 (uint8_t *dest, int dstride,
+        int width, int height, const uint16_t *src, int sstride, int shift,
+        int big_endian)
+{
+    __m128i count = _mm_cvtsi32_si128 (shift);
+    int i, j;
+    for (i = 0; i < height; i++) {
+        const uint16_t *srow = (const uint16_t*)((const uint8_t*)src +
+                i*sstride);
+        uint8_t *drow = dest + i*dstride;
+        for (j = 0; j + 16 <= width; j += 16) {
+            __m128i s1 = _mm_loadu_si128 ((const __m128i *)(srow + j));
+            __m128i s2 = _mm_loadu_si128 ((const __m128i *)(srow + j + 8));
+            if (big_endian) {
+                s1 = SWAP_16U (s1);
+                s2 = SWAP_16U (s2);
+            }
+            s1 = CLAMP_16U_TO_8U (_mm_srl_epi16 (s1, count));
+            s2 = CLAMP_16U_TO_8U (_mm_srl_epi16 (s2, count));
+            _mm_storeu_si128 ((__m128i *)(drow + j),
+                    _mm_packus_epi16 (s1, s2));
+        }
+        for (; j < width; j++)
+            drow[j] = shift_16u_to_8u (srow[j], shift, big_endian);
+    }
+    return 0;
+}
+
+static inline uint8_t
+window_16u_to_8u (uint16_t v, int low, int range, int pshift, int factor,
+        int big_endian)
+{
+    if (big_endian)
+        v = (v << 8) | (v >> 8);
+    unsigned int d = v > low ? v - low : 0;
+    if (d > range)
+        d = range;
+    d = ((d << pshift) * factor) >> 16;
+    return (d + 64) >> 7;
+}
+
+int
+cam_pixel_convert_16u_gray_to_8u_gray_window_sse2 (uint8_t *dest,
+        int dstride, int width, int height, const uint16_t *src, int sstride,
+        int low, int range, int pshift, int factor, int big_endian)
+{
+    __m128i low8 = _mm_set1_epi16 (low);
+    __m128i range8 = _mm_set1_epi16 (range);
+    __m128i factor8 = _mm_set1_epi16 (factor);
+    __m128i round8 = _mm_set1_epi16 (64);
+    __m128i count = _mm_cvtsi32_si128 (pshift);
+    int i, j, k;
+    for (i = 0; i < height; i++) {
+        const uint16_t *srow = (const uint16_t*)((const uint8_t*)src +
+                i*sstride);
+        uint8_t *drow = dest + i*dstride;
+        for (j = 0; j + 16 <= width; j += 16) {
+            __m128i s[2];
+            for (k = 0; k < 2; k++) {
+                __m128i d = _mm_loadu_si128 ((const __m128i *)
+                        (srow + j + 8*k));
+                if (big_endian)
+                    d = SWAP_16U (d);
+                /* min(max(v - low, 0), range), scaled so that range fills
+                 * the high bits of the multiply */
+                d = _mm_subs_epu16 (d, low8);
+                d = _mm_sub_epi16 (d, _mm_subs_epu16 (d, range8));
+                d = _mm_mulhi_epu16 (_mm_sll_epi16 (d, count), factor8);
+                s[k] = _mm_srli_epi16 (_mm_add_epi16 (d, round8), 7);
+            }
+            _mm_storeu_si128 ((__m128i *)(drow + j),
+                    _mm_packus_epi16 (s[0], s[1]));
+        }
+        for (; j < width; j++)
+            drow[j] = window_16u_to_8u (srow[j], low, range, pshift, factor,
+                    big_endian);
+    }
+    return 0;
+}
+
+int
+cam_pixel_convert_8u_gray_to_16u_gray_sse2 (uint16_t *dest, int dstride,
+        int width, int height, const uint8_t *src, int sstride, int shift,
+        int big_endian)
+{
+    __m128i count = _mm_cvtsi32_si128 (shift);
+    __m128i zero = _mm_setzero_si128 ();
+    int i, j;
+    for (i = 0; i < height; i++) {
+        const uint8_t *srow = src + i*sstride;
+        uint16_t *drow = (uint16_t*)((uint8_t*)dest + i*dstride);
+        for (j = 0; j + 16 <= width; j += 16) {
+            __m128i v = _mm_loadu_si128 ((const __m128i *)(srow + j));
+            __m128i d1 = _mm_sll_epi16 (_mm_unpacklo_epi8 (v, zero), count);
+            __m128i d2 = _mm_sll_epi16 (_mm_unpackhi_epi8 (v, zero), count);
+            if (big_endian) {
+                d1 = SWAP_16U (d1);
+                d2 = SWAP_16U (d2);
+            }
+            _mm_storeu_si128 ((__m128i *)(drow + j), d1);
+            _mm_storeu_si128 ((__m128i *)(drow + j + 8), d2);
+        }
+        for (; j < width; j++) {
+            uint16_t d = srow[j] << shift;
+            drow[j] = big_endian ? (d << 8) | (d >> 8) : d;
+        }
+    }
+    return 0;
+}
+
+/* Table lookups have no SIMD instruction in SSE2, so the lookups are done
+ * on general purpose registers, but the samples are still loaded and the
+ * results stored 16 at a time, through pextrw and pinsrw.  Rows are taken
+ * in chunks of 48 samples, which hold a whole number of pixels of any
+ * channel count, so that the table for each sample position is fixed.
+ * This pays off for multiple channels and for 16-bit samples, which need
+ * clamping; a plain C loop is just as fast for one 8-bit channel. */
+#define LUT_CHUNK 48
+
+/* Looks up the two bytes of word i of v in tables t0 and t1, and puts
+ * the results in word i of r */
+#define LUT_PAIR_8U(r,v,t0,t1,i) do { \
+    int w = _mm_extract_epi16 ((v), (i)); \
+    (r) = _mm_insert_epi16 ((r), (t0)[w & 0xff] | ((t1)[w >> 8] << 8), \
+            (i)); \
+} while (0)
+
+/* Same as LUT_PAIR_8U, but for 16-bit samples 2i and 2i + 1 out of 16,
+ * which are in the vector v holding samples 0 - 7 for i < 4 and samples
+ * 8 - 15 otherwise */
+#define LUT_PAIR_16U(r,v,t0,t1,i) do { \
+    int lo = _mm_extract_epi16 ((v), (2*(i)) & 7); \
+    int hi = _mm_extract_epi16 ((v), (2*(i)+1) & 7); \
+    (r) = _mm_insert_epi16 ((r), (t0)[lo] | ((t1)[hi] << 8), (i)); \
+} while (0)
+
+/* Looks up the 16 bytes of v in the tables for the sample positions of t */
+#define LUT_16_8U(r,v,t) do { \
+    LUT_PAIR_8U (r, v, (t)[0], (t)[1], 0); \
+    LUT_PAIR_8U (r, v, (t)[2], (t)[3], 1); \
+    LUT_PAIR_8U (r, v, (t)[4], (t)[5], 2); \
+    LUT_PAIR_8U (r, v, (t)[6], (t)[7], 3); \
+    LUT_PAIR_8U (r, v, (t)[8], (t)[9], 4); \
+    LUT_PAIR_8U (r, v, (t)[10], (t)[11], 5); \
+    LUT_PAIR_8U (r, v, (t)[12], (t)[13], 6); \
+    LUT_PAIR_8U (r, v, (t)[14], (t)[15], 7); \
+} while (0)
+
+int
+cam_pixel_apply_lut_8u_sse2 (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, int channels,
+        const uint8_t *lut)
+{
+    const uint8_t *tables[LUT_CHUNK];
+    int n = width * channels;
+    int i, j, k;
+    for (k = 0; k < LUT_CHUNK; k++)
+        tables[k] = lut + (k % channels) * 256;
+
+    for (i = 0; i < height; i++) {
+        const uint8_t *srow = src + i*sstride;
+        uint8_t *drow = dest + i*dstride;
+        for (j = 0; j + LUT_CHUNK <= n; j += LUT_CHUNK) {
+            for (k = 0; k < LUT_CHUNK; k += 16) {
+                __m128i v = _mm_loadu_si128 ((const __m128i *)(srow + j + k));
+                __m128i r = _mm_setzero_si128 ();
+                LUT_16_8U (r, v, tables + k);
+                _mm_storeu_si128 ((__m128i *)(drow + j + k), r);
+            }
+        }
+        for (; j < n; j++)
+            drow[j] = tables[j % LUT_CHUNK][srow[j]];
+    }
+    return 0;
+}
+
+int
+cam_pixel_apply_lut_16u_to_8u_sse2 (uint8_t *dest, int dstride, int width,
+        int height, const uint16_t *src, int sstride, int channels, int bits,
+        const uint8_t *lut, int big_endian)
+{
+    const uint8_t *tables[LUT_CHUNK];
+    int max = (1 << bits) - 1;
+    __m128i max8 = _mm_set1_epi16 (max);
+    int n = width * channels;
+    int i, j, k;
+    for (k = 0; k < LUT_CHUNK; k++)
+        tables[k] = lut + ((k % channels) << bits);
+
+    for (i = 0; i < height; i++) {
+        const uint16_t *srow = (const uint16_t*)((const uint8_t*)src +
+                i*sstride);
+        uint8_t *drow = dest + i*dstride;
+        for (j = 0; j + LUT_CHUNK <= n; j += LUT_CHUNK) {
+            for (k = 0; k < LUT_CHUNK; k += 16) {
+                const uint8_t **t = tables + k;
+                __m128i v0 = _mm_loadu_si128 ((const __m128i *)
+                        (srow + j + k));
+                __m128i v1 = _mm_loadu_si128 ((const __m128i *)
+                        (srow + j + k + 8));
+                if (big_endian) {
+                    v0 = SWAP_16U (v0);
+                    v1 = SWAP_16U (v1);
+                }
+                /* min(v, max) */
+                v0 = _mm_sub_epi16 (v0, _mm_subs_epu16 (v0, max8));
+                v1 = _mm_sub_epi16 (v1, _mm_subs_epu16 (v1, max8));
+                __m128i r = _mm_setzero_si128 ();
+                LUT_PAIR_16U (r, v0, t[0], t[1], 0);
+                LUT_PAIR_16U (r, v0, t[2], t[3], 1);
+                LUT_PAIR_16U (r, v0, t[4], t[5], 2);
+                LUT_PAIR_16U (r, v0, t[6], t[7], 3);
+                LUT_PAIR_16U (r, v1, t[8], t[9], 4);
+                LUT_PAIR_16U (r, v1, t[10], t[11], 5);
+                LUT_PAIR_16U (r, v1, t[12], t[13], 6);
+                LUT_PAIR_16U (r, v1, t[14], t[15], 7);
+                _mm_storeu_si128 ((__m128i *)(drow + j + k), r);
+            }
+        }
+        for (; j < n; j++) {
+            int v = big_endian ? ((srow[j] << 8) | (srow[j] >> 8)) & 0xffff :
+                srow[j];
+            drow[j] = tables[j % LUT_CHUNK][v > max ? max : v];
+        }
+    }
+    return 0;
+}
+
+int
+cam_pixel_split_bayer_planes_16u_to_8u_sse2 (uint8_t *dst[4], int dstride,
+        const uint16_t * src, int sstride, int width, int height, int shift,
+        int big_endian)
+{
+    __m128i count = _mm_cvtsi32_si128 (shift);
+    __m128i lo_mask = _mm_set1_epi32 (0xffff);
+    int i, j, k;
+
+    for (i = 0; i < height; i++) {
+        for (k = 0; k < 2; k++) {
+            const uint16_t * srow = (const uint16_t*)((const uint8_t*)src +
+                    (2*i + k)*sstride);
+            uint8_t * drow1 = dst[2*k] + i * dstride;
+            uint8_t * drow2 = dst[2*k+1] + i * dstride;
+            for (j = 0; j + 16 <= width; j += 16) {
+                __m128i s[4], even[4], odd[4];
+                int n;
+                for (n = 0; n < 4; n++) {
+                    s[n] = _mm_loadu_si128 ((const __m128i *)(srow + 2*j +
+                                8*n));
+                    if (big_endian)
+                        s[n] = SWAP_16U (s[n]);
+                    s[n] = CLAMP_16U_TO_8U (_mm_srl_epi16 (s[n], count));
+                    even[n] = _mm_and_si128 (s[n], lo_mask);
+                    odd[n] = _mm_srli_epi32 (s[n], 16);
+                }
+                _mm_storeu_si128 ((__m128i *)(drow1 + j),
+                        _mm_packus_epi16 (_mm_packs_epi32 (even[0], even[1]),
+                            _mm_packs_epi32 (even[2], even[3])));
+                _mm_storeu_si128 ((__m128i *)(drow2 + j),
+                        _mm_packus_epi16 (_mm_packs_epi32 (odd[0], odd[1]),
+                            _mm_packs_epi32 (odd[2], odd[3])));
+            }
+            for (; j < width; j++) {
+                drow1[j] = shift_16u_to_8u (srow[2*j], shift, big_endian);
+                drow2[j] = shift_16u_to_8u (srow[2*j+1], shift, big_endian);
+            }
+        }
+    }
+    return 0;
+}
+
+/* Clamps two vectors of 32-bit values to [0,65535] and packs them into one
+ * vector of unsigned 16-bit values.  SSE2 only has a signed 32->16 pack, so
+ * bias the values into the signed range first. */
+static inline __m128i
+pack_32s_to_16u (__m128i lo, __m128i hi)
+{
+    __m128i bias = _mm_set1_epi32 (32768);
+    __m128i out = _mm_packs_epi32 (_mm_sub_epi32 (lo, bias),
+            _mm_sub_epi32 (hi, bias));
+    return _mm_xor_si128 (out, _mm_set1_epi16 (0x8000));
+}
+
+static inline __m128i
+select_32 (__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128 (_mm_and_si128 (mask, a), _mm_andnot_si128 (mask, b));
+}
+
+/* Malvar-He-Cutler interpolation of four adjacent pixels of one row, using
+ * 32-bit lanes.  Filter taps are scaled by 16 so that the half-integer
+ * coefficients stay exact.  @chroma lanes are set where the pixel is the R
+ * (in a red row) or B (in a blue row) site; the remaining lanes are G. */
+static inline void
+bayer16_mhc_4 (__m128i c, __m128i ew, __m128i ns, __m128i ew2, __m128i ns2,
+        __m128i diag, __m128i chroma, int red_row,
+        __m128i *r, __m128i *g, __m128i *b)
+{
+    __m128i c2 = _mm_slli_epi32 (c, 1);
+    __m128i c8 = _mm_slli_epi32 (c, 3);
+    __m128i diag2 = _mm_slli_epi32 (diag, 1);
+    __m128i ax2 = _mm_add_epi32 (ew2, ns2);
+
+    __m128i center = _mm_slli_epi32 (c, 4);
+    __m128i cross = _mm_sub_epi32 (
+            _mm_add_epi32 (c8, _mm_slli_epi32 (_mm_add_epi32 (ew, ns), 2)),
+            _mm_slli_epi32 (ax2, 1));
+    __m128i hor = _mm_add_epi32 (
+            _mm_sub_epi32 (_mm_add_epi32 (_mm_add_epi32 (c8, c2),
+                    _mm_slli_epi32 (ew, 3)),
+                _mm_add_epi32 (_mm_slli_epi32 (ew2, 1), diag2)), ns2);
+    __m128i ver = _mm_add_epi32 (
+            _mm_sub_epi32 (_mm_add_epi32 (_mm_add_epi32 (c8, c2),
+                    _mm_slli_epi32 (ns, 3)),
+                _mm_add_epi32 (_mm_slli_epi32 (ns2, 1), diag2)), ew2);
+    __m128i opp = _mm_sub_epi32 (
+            _mm_add_epi32 (_mm_add_epi32 (c8, _mm_slli_epi32 (c, 2)),
+                _mm_slli_epi32 (diag, 2)),
+            _mm_add_epi32 (ax2, _mm_slli_epi32 (ax2, 1)));
+
+    __m128i round = _mm_set1_epi32 (8);
+    __m128i x = _mm_srai_epi32 (_mm_add_epi32 (
+                select_32 (chroma, center, hor), round), 4);
+    __m128i y = _mm_srai_epi32 (_mm_add_epi32 (
+                select_32 (chroma, opp, ver), round), 4);
+    *g = _mm_srai_epi32 (_mm_add_epi32 (
+                select_32 (chroma, cross, center), round), 4);
+    if (red_row) {
+        *r = x;
+        *b = y;
+    } else {
+        *b = x;
+        *r = y;
+    }
+}
+
+/* Interpolates the eight pixels starting at @s, which must be at an even
+ * column offset from @chroma's reference. */
+static inline void
+bayer16_mhc_8 (const uint16_t *s, int stride, __m128i chroma, int red_row,
+        __m128i *r, __m128i *g, __m128i *b)
+{
+    __m128i zero = _mm_setzero_si128 ();
+    __m128i lo[13], hi[13];
+    static const int offs[13][2] = {
+        {  0,  0 }, {  0, -1 }, {  0,  1 }, { -1,  0 }, {  1,  0 },
+        {  0, -2 }, {  0,  2 }, { -2,  0 }, {  2,  0 },
+        { -1, -1 }, { -1,  1 }, {  1, -1 }, {  1,  1 },
+    };
+    int n;
+    for (n = 0; n < 13; n++) {
+        __m128i t = _mm_loadu_si128 ((const __m128i *)(s +
+                    offs[n][0]*stride + offs[n][1]));
+        lo[n] = _mm_unpacklo_epi16 (t, zero);
+        hi[n] = _mm_unpackhi_epi16 (t, zero);
+    }
+
+    __m128i r_lo, g_lo, b_lo, r_hi, g_hi, b_hi;
+#define MHC_HALF(v, rr, gg, bb) \
+    bayer16_mhc_4 (v[0], _mm_add_epi32 (v[1], v[2]), \
+            _mm_add_epi32 (v[3], v[4]), _mm_add_epi32 (v[5], v[6]), \
+            _mm_add_epi32 (v[7], v[8]), \
+            _mm_add_epi32 (_mm_add_epi32 (v[9], v[10]), \
+                _mm_add_epi32 (v[11], v[12])), \
+            chroma, red_row, &rr, &gg, &bb)
+    MHC_HALF (lo, r_lo, g_lo, b_lo);
+    MHC_HALF (hi, r_hi, g_hi, b_hi);
+#undef MHC_HALF
+
+    *r = pack_32s_to_16u (r_lo, r_hi);
+    *g = pack_32s_to_16u (g_lo, g_hi);
+    *b = pack_32s_to_16u (b_lo, b_hi);
+}
+
+int
+cam_pixel_bayer_interpolate_to_16u_rgb_sse2 (const uint16_t * src,
+        int sstride, uint16_t * dst, int dstride, int width, int height,
+        int red_x, int red_y)
+{
+    __m128i even = _mm_set_epi32 (0, -1, 0, -1);
+    __m128i odd = _mm_set_epi32 (-1, 0, -1, 0);
+    int stride = sstride / 2;
+    int i, j, k;
+
+    for (i = 0; i < height; i++) {
+        const uint16_t * srow = src + i*stride;
+        uint16_t * drow = (uint16_t*)((uint8_t*)dst + i*dstride);
+        int red_row = (i & 1) == red_y;
+        int chroma_x = red_row ? red_x : !red_x;
+
+        /* The final block is shifted left to overlap the previous one
+         * rather than reading past the replicated border. */
+        for (j = 0; j < width; j += 8) {
+            if (j > width - 8)
+                j = width - 8;
+            __m128i chroma = ((j ^ chroma_x) & 1) ? odd : even;
+            __m128i r, g, b;
+            uint16_t rv[8] __attribute__ ((aligned (16)));
+            uint16_t gv[8] __attribute__ ((aligned (16)));
+            uint16_t bv[8] __attribute__ ((aligned (16)));
+
+            bayer16_mhc_8 (srow + j, stride, chroma, red_row, &r, &g, &b);
+            _mm_store_si128 ((__m128i *)rv, r);
+            _mm_store_si128 ((__m128i *)gv, g);
+            _mm_store_si128 ((__m128i *)bv, b);
+            for (k = 0; k < 8; k++) {
+                drow[3*(j+k)+0] = rv[k];
+                drow[3*(j+k)+1] = gv[k];
+                drow[3*(j+k)+2] = bv[k];
+            }
+        }
+    }
+    return 0;
+}
+
+int
+cam_pixel_bayer_interpolate_to_16u_gray_sse2 (const uint16_t * src,
+        int sstride, uint16_t * dst, int dstride, int width, int height,
+        int red_x, int red_y)
+{
+    __m128i even = _mm_set_epi32 (0, -1, 0, -1);
+    __m128i odd = _mm_set_epi32 (-1, 0, -1, 0);
+    __m128i zero = _mm_setzero_si128 ();
+    __m128i two = _mm_set1_epi32 (2);
+    int stride = sstride / 2;
+    int i, j;
+
+    for (i = 0; i < height; i++) {
+        const uint16_t * srow = src + i*stride;
+        uint16_t * drow = (uint16_t*)((uint8_t*)dst + i*dstride);
+        int red_row = (i & 1) == red_y;
+        int chroma_x = red_row ? red_x : !red_x;
+
+        for (j = 0; j < width; j += 8) {
+            if (j > width - 8)
+                j = width - 8;
+            __m128i chroma = ((j ^ chroma_x) & 1) ? odd : even;
+            __m128i r, g, b, lo, hi;
+
+            bayer16_mhc_8 (srow + j, stride, chroma, red_row, &r, &g, &b);
+
+            /* gray = (r + 2g + b + 2) / 4 */
+            lo = _mm_add_epi32 (_mm_add_epi32 (_mm_unpacklo_epi16 (r, zero),
+                        _mm_unpacklo_epi16 (b, zero)),
+                    _mm_slli_epi32 (_mm_unpacklo_epi16 (g, zero), 1));
+            hi = _mm_add_epi32 (_mm_add_epi32 (_mm_unpackhi_epi16 (r, zero),
+                        _mm_unpackhi_epi16 (b, zero)),
+                    _mm_slli_epi32 (_mm_unpackhi_epi16 (g, zero), 1));
+            lo = _mm_srli_epi32 (_mm_add_epi32 (lo, two), 2);
+            hi = _mm_srli_epi32 (_mm_add_epi32 (hi, two), 2);
+            _mm_storeu_si128 ((__m128i *)(drow + j),
+                    pack_32s_to_16u (lo, hi));
+        }
+    }
+    return 0;
+}
+
+/* Edge-directed demosaic.  See bayer_edge_green_row() in pixels.c for the
+ * scalar reference that these must match. */
+
+static inline __m128i
+load_8u_as_16 (const uint8_t *p)
+{
+    return _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i *) p),
+            _mm_setzero_si128 ());
+}
+
+static inline __m128i
+abs_16s (__m128i v)
+{
+    return _mm_max_epi16 (v, _mm_sub_epi16 (_mm_setzero_si128 (), v));
+}
+
+static inline __m128i
+select_16 (__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128 (_mm_and_si128 (mask, a), _mm_andnot_si128 (mask, b));
+}
+
+static void
+bayer_edge_green_row_sse2 (const uint8_t *m, int stride, uint8_t *g,
+        int width, int chroma_x)
+{
+    __m128i even = _mm_set1_epi32 (0xffff);
+    __m128i odd = _mm_slli_epi32 (even, 16);
+    int x;
+
+    for (x = 0; x < width; x += 8) {
+        if (x > width - 8)
+            x = width - 8;
+        __m128i chroma = ((x ^ chroma_x) & 1) ? odd : even;
+        const uint8_t *p = m + x;
+
+        __m128i c = load_8u_as_16 (p);
+        __m128i w = load_8u_as_16 (p - 1);
+        __m128i e = load_8u_as_16 (p + 1);
+        __m128i n = load_8u_as_16 (p - stride);
+        __m128i s = load_8u_as_16 (p + stride);
+        __m128i c2 = _mm_slli_epi16 (c, 1);
+        __m128i lh = _mm_sub_epi16 (c2, _mm_add_epi16 (
+                    load_8u_as_16 (p - 2), load_8u_as_16 (p + 2)));
+        __m128i lv = _mm_sub_epi16 (c2, _mm_add_epi16 (
+                    load_8u_as_16 (p - 2*stride),
+                    load_8u_as_16 (p + 2*stride)));
+
+        __m128i dh = _mm_add_epi16 (abs_16s (_mm_sub_epi16 (w, e)),
+                abs_16s (lh));
+        __m128i dv = _mm_add_epi16 (abs_16s (_mm_sub_epi16 (n, s)),
+                abs_16s (lv));
+        __m128i gh4 = _mm_add_epi16 (_mm_slli_epi16 (_mm_add_epi16 (w, e), 1),
+                lh);
+        __m128i gv4 = _mm_add_epi16 (_mm_slli_epi16 (_mm_add_epi16 (n, s), 1),
+                lv);
+
+        __m128i gavg = _mm_srai_epi16 (_mm_add_epi16 (gh4, gv4), 3);
+        __m128i gi = select_16 (_mm_cmplt_epi16 (dh, dv),
+                _mm_srai_epi16 (gh4, 2),
+                select_16 (_mm_cmpgt_epi16 (dh, dv),
+                    _mm_srai_epi16 (gv4, 2), gavg));
+        gi = select_16 (chroma, gi, c);
+        _mm_storel_epi64 ((__m128i *)(g + x), _mm_packus_epi16 (gi, gi));
+    }
+    g[-1] = g[1];
+    g[width] = g[width - 2];
+}
+
+static void
+bayer_edge_bgra_row_sse2 (const uint8_t *m, int stride, const uint8_t *gm,
+        const uint8_t *g0, const uint8_t *gp, uint8_t *d, int width,
+        int chroma_x, int red_row)
+{
+    __m128i even = _mm_set1_epi32 (0xffff);
+    __m128i odd = _mm_slli_epi32 (even, 16);
+    __m128i alpha = _mm_set1_epi8 ((char) 0xff);
+    int x;
+
+    for (x = 0; x < width; x += 8) {
+        if (x > width - 8)
+            x = width - 8;
+        __m128i chroma = ((x ^ chroma_x) & 1) ? odd : even;
+        const uint8_t *p = m + x;
+
+#define DIFF(mp, gp_) _mm_sub_epi16 (load_8u_as_16 (mp), load_8u_as_16 (gp_))
+        __m128i c = load_8u_as_16 (p);
+        __m128i gc = load_8u_as_16 (g0 + x);
+        __m128i dh = _mm_srai_epi16 (_mm_add_epi16 (
+                    DIFF (p - 1, g0 + x - 1), DIFF (p + 1, g0 + x + 1)), 1);
+        __m128i dv = _mm_srai_epi16 (_mm_add_epi16 (
+                    DIFF (p - stride, gm + x), DIFF (p + stride, gp + x)), 1);
+        __m128i dd = _mm_srai_epi16 (_mm_add_epi16 (
+                    _mm_add_epi16 (DIFF (p - stride - 1, gm + x - 1),
+                        DIFF (p - stride + 1, gm + x + 1)),
+                    _mm_add_epi16 (DIFF (p + stride - 1, gp + x - 1),
+                        DIFF (p + stride + 1, gp + x + 1))), 2);
+#undef DIFF
+
+        __m128i xc = select_16 (chroma, c, _mm_add_epi16 (gc, dh));
+        __m128i yc = _mm_add_epi16 (gc, select_16 (chroma, dd, dv));
+        __m128i r = red_row ? xc : yc;
+        __m128i b = red_row ? yc : xc;
+
+        __m128i bg = _mm_unpacklo_epi8 (_mm_packus_epi16 (b, b),
+                _mm_packus_epi16 (gc, gc));
+        __m128i ra = _mm_unpacklo_epi8 (_mm_packus_epi16 (r, r), alpha);
+        _mm_storeu_si128 ((__m128i *)(d + 4*x),
+                _mm_unpacklo_epi16 (bg, ra));
+        _mm_storeu_si128 ((__m128i *)(d + 4*x + 16),
+                _mm_unpackhi_epi16 (bg, ra));
+    }
+}
+
+int
+cam_pixel_bayer_interpolate_edge_to_8u_bgra_sse2 (const uint8_t * src,
+        int sstride, uint8_t * dst, int dstride, int width, int height,
+        int row_start, int row_end, int red_x, int red_y)
+{
+    /* ring buffer of three rows of interpolated green, with room for the
+     * replicated column on either side */
+    int gstride = ((width + 0xf) & ~0xf) + 32;
+    uint8_t * ring = malloc (3 * gstride);
+    int r, y;
+
+    if (!ring)
+        return -1;
+
+    for (r = row_start - 1; r <= row_end; r++) {
+        /* rows outside the image mirror the bayer border replication */
+        int sr = r < 0 ? 1 : (r >= height ? height - 2 : r);
+        int chroma_x = ((sr & 1) == red_y) ? red_x : !red_x;
+        bayer_edge_green_row_sse2 (src + sr*sstride, sstride,
+                ring + ((r + 3) % 3) * gstride + 16, width, chroma_x);
+
+        y = r - 1;
+        if (y < row_start)
+            continue;
+        int red_row = (y & 1) == red_y;
+        bayer_edge_bgra_row_sse2 (src + y*sstride, sstride,
+                ring + ((y + 2) % 3) * gstride + 16,
+                ring + ((y + 3) % 3) * gstride + 16,
+                ring + ((y + 4) % 3) * gstride + 16,
+                dst + y*dstride, width, red_row ? red_x : !red_x, red_row);
+    }
+    free (ring);
+    return 0;
+}
+
+void
+cam_pixel_resize_add_row_8u_sse2 (uint16_t *acc, const uint8_t *src, int n)
+{
+    __m128i z = _mm_setzero_si128 ();
+    int j;
+    for (j = 0; j + 16 <= n; j += 16) {
+        __m128i s = _mm_loadu_si128 ((__m128i *)(src + j));
+        __m128i a0 = _mm_loadu_si128 ((__m128i *)(acc + j));
+        __m128i a1 = _mm_loadu_si128 ((__m128i *)(acc + j + 8));
+        a0 = _mm_add_epi16 (a0, _mm_unpacklo_epi8 (s, z));
+        a1 = _mm_add_epi16 (a1, _mm_unpackhi_epi8 (s, z));
+        _mm_storeu_si128 ((__m128i *)(acc + j), a0);
+        _mm_storeu_si128 ((__m128i *)(acc + j + 8), a1);
+    }
+    for (; j < n; j++)
+        acc[j] += src[j];
+}
+
+void
+cam_pixel_resize_add_row_16u_sse2 (uint32_t *acc, const uint16_t *src,
+        int n)
+{
+    __m128i z = _mm_setzero_si128 ();
+    int j;
+    for (j = 0; j + 8 <= n; j += 8) {
+        __m128i s = _mm_loadu_si128 ((__m128i *)(src + j));
+        __m128i a0 = _mm_loadu_si128 ((__m128i *)(acc + j));
+        __m128i a1 = _mm_loadu_si128 ((__m128i *)(acc + j + 4));
+        a0 = _mm_add_epi32 (a0, _mm_unpacklo_epi16 (s, z));
+        a1 = _mm_add_epi32 (a1, _mm_unpackhi_epi16 (s, z));
+        _mm_storeu_si128 ((__m128i *)(acc + j), a0);
+        _mm_storeu_si128 ((__m128i *)(acc + j + 4), a1);
+    }
+    for (; j < n; j++)
+        acc[j] += src[j];
+}
+
+/* Computes (h0 * (128 - wy) + h1 * wy + 8192) >> 14 for as many samples as
+ * fit in whole vectors, and returns how many were done.  h0 and h1 are
+ * at most 255 * 128, so the products can be formed with pmaddwd. */
+int
+cam_pixel_resize_blend_rows_8u_sse2 (uint8_t *dst, const int16_t *h0,
+        const int16_t *h1, int n, int wy)
+{
+    __m128i w = _mm_set1_epi32 ((wy << 16) | (128 - wy));
+    __m128i round = _mm_set1_epi32 (1 << 13);
+    int j;
+    for (j = 0; j + 16 <= n; j += 16) {
+        __m128i a0 = _mm_loadu_si128 ((__m128i *)(h0 + j));
+        __m128i b0 = _mm_loadu_si128 ((__m128i *)(h1 + j));
+        __m128i a1 = _mm_loadu_si128 ((__m128i *)(h0 + j + 8));
+        __m128i b1 = _mm_loadu_si128 ((__m128i *)(h1 + j + 8));
+        __m128i v0, v1, v2, v3;
+
+        v0 = _mm_madd_epi16 (_mm_unpacklo_epi16 (a0, b0), w);
+        v1 = _mm_madd_epi16 (_mm_unpackhi_epi16 (a0, b0), w);
+        v2 = _mm_madd_epi16 (_mm_unpacklo_epi16 (a1, b1), w);
+        v3 = _mm_madd_epi16 (_mm_unpackhi_epi16 (a1, b1), w);
+        v0 = _mm_srai_epi32 (_mm_add_epi32 (v0, round), 14);
+        v1 = _mm_srai_epi32 (_mm_add_epi32 (v1, round), 14);
+        v2 = _mm_srai_epi32 (_mm_add_epi32 (v2, round), 14);
+        v3 = _mm_srai_epi32 (_mm_add_epi32 (v3, round), 14);
+
+        v0 = _mm_packs_epi32 (v0, v1);
+        v2 = _mm_packs_epi32 (v2, v3);
+        _mm_storeu_si128 ((__m128i *)(dst + j), _mm_packus_epi16 (v0, v2));
+    }
+    return j;
+}
+
+/* Bins 16 tiles of a bayer image starting at s0 (top row) and s1 (bottom
+ * row) into one red, green and blue byte per tile.  pos holds the index
+ * within the tile of the red, blue and two green pixels, numbered as in
+ * cam_pixel_split_bayer_planes_8u(). */
+static inline void
+bin_tiles_8u_sse2 (const uint8_t *s0, const uint8_t *s1, const int pos[4],
+        __m128i *r, __m128i *g, __m128i *b)
+{
+    __m128i mask = _mm_set1_epi16 (0xff);
+    __m128i a0 = _mm_loadu_si128 ((__m128i *) s0);
+    __m128i b0 = _mm_loadu_si128 ((__m128i *)(s0 + 16));
+    __m128i a1 = _mm_loadu_si128 ((__m128i *) s1);
+    __m128i b1 = _mm_loadu_si128 ((__m128i *)(s1 + 16));
+    __m128i p[4];
+
+    p[0] = _mm_packus_epi16 (_mm_and_si128 (a0, mask),
+            _mm_and_si128 (b0, mask));
+    p[1] = _mm_packus_epi16 (_mm_srli_epi16 (a0, 8), _mm_srli_epi16 (b0, 8));
+    p[2] = _mm_packus_epi16 (_mm_and_si128 (a1, mask),
+            _mm_and_si128 (b1, mask));
+    p[3] = _mm_packus_epi16 (_mm_srli_epi16 (a1, 8), _mm_srli_epi16 (b1, 8));
+
+    *r = p[pos[0]];
+    *b = p[pos[1]];
+    *g = _mm_avg_epu8 (p[pos[2]], p[pos[3]]);
+}
+
+int
+cam_pixel_bayer_bin_to_8u_bgra_sse2 (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, const int pos[4])
+{
+    __m128i alpha = _mm_set1_epi8 (0xff);
+    int i, j = 0;
+    for (i = 0; i < height; i++) {
+        const uint8_t *s0 = src + 2*i*sstride;
+        const uint8_t *s1 = s0 + sstride;
+        uint8_t *drow = dest + i*dstride;
+        for (j = 0; j + 16 <= width; j += 16) {
+            __m128i r, g, b, bg, ra;
+            bin_tiles_8u_sse2 (s0 + 2*j, s1 + 2*j, pos, &r, &g, &b);
+
+            bg = _mm_unpacklo_epi8 (b, g);
+            ra = _mm_unpacklo_epi8 (r, alpha);
+            _mm_storeu_si128 ((__m128i *)(drow + 4*j),
+                    _mm_unpacklo_epi16 (bg, ra));
+            _mm_storeu_si128 ((__m128i *)(drow + 4*j + 16),
+                    _mm_unpackhi_epi16 (bg, ra));
+            bg = _mm_unpackhi_epi8 (b, g);
+            ra = _mm_unpackhi_epi8 (r, alpha);
+            _mm_storeu_si128 ((__m128i *)(drow + 4*j + 32),
+                    _mm_unpacklo_epi16 (bg, ra));
+            _mm_storeu_si128 ((__m128i *)(drow + 4*j + 48),
+                    _mm_unpackhi_epi16 (bg, ra));
+        }
+    }
+    return j;
+}
+
+/* Luminance uses the weights of cam_pixel_convert_8u_rgb_to_8u_gray() in
+ * 8-bit fixed point, which sum to 256 so the result can't overflow */
+int
+cam_pixel_bayer_bin_to_8u_gray_sse2 (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, const int pos[4])
+{
+    __m128i z = _mm_setzero_si128 ();
+    __m128i wr = _mm_set1_epi16 (54);
+    __m128i wg = _mm_set1_epi16 (183);
+    __m128i wb = _mm_set1_epi16 (19);
+    __m128i round = _mm_set1_epi16 (128);
+    int i, j = 0;
+    for (i = 0; i < height; i++) {
+        const uint8_t *s0 = src + 2*i*sstride;
+        const uint8_t *s1 = s0 + sstride;
+        uint8_t *drow = dest + i*dstride;
+        for (j = 0; j + 16 <= width; j += 16) {
+            __m128i r, g, b, lo, hi;
+            bin_tiles_8u_sse2 (s0 + 2*j, s1 + 2*j, pos, &r, &g, &b);
+
+            lo = _mm_add_epi16 (round,
+                    _mm_mullo_epi16 (_mm_unpacklo_epi8 (r, z), wr));
+            lo = _mm_add_epi16 (lo,
+                    _mm_mullo_epi16 (_mm_unpacklo_epi8 (g, z), wg));
+            lo = _mm_add_epi16 (lo,
+                    _mm_mullo_epi16 (_mm_unpacklo_epi8 (b, z), wb));
+            hi = _mm_add_epi16 (round,
+                    _mm_mullo_epi16 (_mm_unpackhi_epi8 (r, z), wr));
+            hi = _mm_add_epi16 (hi,
+                    _mm_mullo_epi16 (_mm_unpackhi_epi8 (g, z), wg));
+            hi = _mm_add_epi16 (hi,
+                    _mm_mullo_epi16 (_mm_unpackhi_epi8 (b, z), wb));
+
+            _mm_storeu_si128 ((__m128i *)(drow + j),
+                    _mm_packus_epi16 (_mm_srli_epi16 (lo, 8),
+                        _mm_srli_epi16 (hi, 8)));
+        }
+    }
+    return j;
+}
+
+/* The tiled transposes work through square blocks of ROTATE_BLOCK source
+ * pixels, small enough that the source rows and destination rows a block
+ * touches all stay in L1. */
+#define ROTATE_BLOCK 32
+
+/* Maps a transposed source column and the first source row of a tile to
+ * the destination, for the orientations that swap the axes.  fx reverses
+ * the destination rows and fy the destination columns. */
+#define ROTATE_DEST(x, y0, tile, bpp) \
+    (dest + (fx ? width - 1 - (x) : (x)) * dstride + \
+     (fy ? height - (tile) - (y0) : (y0)) * (bpp))
+
+void
+cam_pixel_transpose_tiles_8u_c1_sse2 (uint8_t *dest, int dstride,
+        int width, int height, const uint8_t *src, int sstride,
+        int fx, int fy)
+{
+    int wt = width & ~7;
+    int ht = height & ~7;
+    int bx, by, x0, y0, i;
+    for (by = 0; by < ht; by += ROTATE_BLOCK) {
+      int by_end = by + ROTATE_BLOCK < ht ? by + ROTATE_BLOCK : ht;
+      for (bx = 0; bx < wt; bx += ROTATE_BLOCK) {
+        int bx_end = bx + ROTATE_BLOCK < wt ? bx + ROTATE_BLOCK : wt;
+        for (y0 = by; y0 < by_end; y0 += 8) {
+            for (x0 = bx; x0 < bx_end; x0 += 8) {
+                __m128i r[8], a0, a1, a2, a3, b0, b1, b2, b3, c[4];
+
+                /* loading the rows upside down reverses the order of the
+                 * pixels in each transposed row */
+                for (i = 0; i < 8; i++)
+                    r[i] = _mm_loadl_epi64 ((__m128i *)(src +
+                                (fy ? y0 + 7 - i : y0 + i) * sstride + x0));
+
+                a0 = _mm_unpacklo_epi8 (r[0], r[1]);
+                a1 = _mm_unpacklo_epi8 (r[2], r[3]);
+                a2 = _mm_unpacklo_epi8 (r[4], r[5]);
+                a3 = _mm_unpacklo_epi8 (r[6], r[7]);
+                b0 = _mm_unpacklo_epi16 (a0, a1);
+                b1 = _mm_unpackhi_epi16 (a0, a1);
+                b2 = _mm_unpacklo_epi16 (a2, a3);
+                b3 = _mm_unpackhi_epi16 (a2, a3);
+                c[0] = _mm_unpacklo_epi32 (b0, b2);
+                c[1] = _mm_unpackhi_epi32 (b0, b2);
+                c[2] = _mm_unpacklo_epi32 (b1, b3);
+                c[3] = _mm_unpackhi_epi32 (b1, b3);
+
+                for (i = 0; i < 4; i++) {
+                    _mm_storel_epi64 ((__m128i *)
+                            ROTATE_DEST (x0 + 2*i, y0, 8, 1), c[i]);
+                    _mm_storel_epi64 ((__m128i *)
+                            ROTATE_DEST (x0 + 2*i + 1, y0, 8, 1),
+                            _mm_srli_si128 (c[i], 8));
+                }
+            }
+        }
+    }
+    }
+}
+
+void
+cam_pixel_transpose_tiles_8u_c4_sse2 (uint8_t *dest, int dstride,
+        int width, int height, const uint8_t *src, int sstride,
+        int fx, int fy)
+{
+    int wt = width & ~3;
+    int ht = height & ~3;
+    int bx, by, x0, y0, i;
+    for (by = 0; by < ht; by += ROTATE_BLOCK) {
+      int by_end = by + ROTATE_BLOCK < ht ? by + ROTATE_BLOCK : ht;
+      for (bx = 0; bx < wt; bx += ROTATE_BLOCK) {
+        int bx_end = bx + ROTATE_BLOCK < wt ? bx + ROTATE_BLOCK : wt;
+        for (y0 = by; y0 < by_end; y0 += 4) {
+            for (x0 = bx; x0 < bx_end; x0 += 4) {
+                __m128i r[4], t0, t1, t2, t3;
+
+                for (i = 0; i < 4; i++)
+                    r[i] = _mm_loadu_si128 ((__m128i *)(src +
+                                (fy ? y0 + 3 - i : y0 + i) * sstride +
+                                4 * x0));
+
+                t0 = _mm_unpacklo_epi32 (r[0], r[1]);
+                t1 = _mm_unpacklo_epi32 (r[2], r[3]);
+                t2 = _mm_unpackhi_epi32 (r[0], r[1]);
+                t3 = _mm_unpackhi_epi32 (r[2], r[3]);
+
+                _mm_storeu_si128 ((__m128i *) ROTATE_DEST (x0, y0, 4, 4),
+                        _mm_unpacklo_epi64 (t0, t1));
+                _mm_storeu_si128 ((__m128i *) ROTATE_DEST (x0 + 1, y0, 4, 4),
+                        _mm_unpackhi_epi64 (t0, t1));
+                _mm_storeu_si128 ((__m128i *) ROTATE_DEST (x0 + 2, y0, 4, 4),
+                        _mm_unpacklo_epi64 (t2, t3));
+                _mm_storeu_si128 ((__m128i *) ROTATE_DEST (x0 + 3, y0, 4, 4),
+                        _mm_unpackhi_epi64 (t2, t3));
+            }
+        }
+    }
+    }
+}
+#undef ROTATE_DEST
+
+/* Reverses the order of the pixels in each row, and the order of the rows
+ * if fy is set, in 16-byte blocks.  Returns the number of source columns
+ * handled, which end up in the rightmost destination columns. */
+int
+cam_pixel_mirror_rows_8u_sse2 (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, int bpp, int fy)
+{
+    int n = 16 / bpp;
+    int i, j = 0;
+    for (i = 0; i < height; i++) {
+        const uint8_t *srow = src + i * sstride;
+        uint8_t *drow = dest + (fy ? height - 1 - i : i) * dstride;
+        for (j = 0; j + n <= width; j += n) {
+            __m128i v = _mm_loadu_si128 ((__m128i *)(srow + bpp * j));
+            v = _mm_shuffle_epi32 (v, _MM_SHUFFLE (0, 1, 2, 3));
+            if (bpp == 1) {
+                v = _mm_shufflelo_epi16 (v, _MM_SHUFFLE (2, 3, 0, 1));
+                v = _mm_shufflehi_epi16 (v, _MM_SHUFFLE (2, 3, 0, 1));
+                v = _mm_or_si128 (_mm_slli_epi16 (v, 8),
+                        _mm_srli_epi16 (v, 8));
+            }
+            _mm_storeu_si128 ((__m128i *)(drow + bpp * (width - n - j)), v);
+        }
+    }
+    return j;
+}
+
+/* Interpolates 4 gray pixels at a time.  The 2x2 blocks of source pixels
+ * have to be gathered one at a time, but the weighting of all four pixels
+ * is done together. */
+int
+cam_pixel_remap_row_8u_c1_sse2 (uint8_t *dst, const uint8_t *src,
+        int sstride, const int16_t *xy, const uint16_t *frac,
+        const int16_t *weights, int width)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i round = _mm_set1_epi32 (1 << 13);
+    int j, k;
+    for (j = 0; j + 4 <= width; j += 4) {
+        __m128i block[4], w[4];
+        for (k = 0; k < 4; k++) {
+            const uint8_t *s = src + xy[2*(j+k)+1] * sstride + xy[2*(j+k)];
+            uint16_t lo, hi;
+            memcpy (&lo, s, 2);
+            memcpy (&hi, s + sstride, 2);
+            block[k] = _mm_cvtsi32_si128 ((uint32_t) lo |
+                    ((uint32_t) hi << 16));
+            w[k] = _mm_loadl_epi64 ((__m128i *)(weights + 4 * frac[j+k]));
+        }
+        __m128i p = _mm_unpacklo_epi64 (
+                _mm_unpacklo_epi32 (block[0], block[1]),
+                _mm_unpacklo_epi32 (block[2], block[3]));
+        __m128i m01 = _mm_madd_epi16 (_mm_unpacklo_epi8 (p, zero),
+                _mm_unpacklo_epi64 (w[0], w[1]));
+        __m128i m23 = _mm_madd_epi16 (_mm_unpackhi_epi8 (p, zero),
+                _mm_unpacklo_epi64 (w[2], w[3]));
+
+        /* each pixel has its top and bottom pair sums in adjacent lanes */
+        __m128 a = _mm_castsi128_ps (m01);
+        __m128 b = _mm_castsi128_ps (m23);
+        __m128i top = _mm_castps_si128 (_mm_shuffle_ps (a, b,
+                    _MM_SHUFFLE (2, 0, 2, 0)));
+        __m128i bot = _mm_castps_si128 (_mm_shuffle_ps (a, b,
+                    _MM_SHUFFLE (3, 1, 3, 1)));
+        __m128i sum = _mm_srai_epi32 (_mm_add_epi32 (_mm_add_epi32 (top,
+                        bot), round), 14);
+        sum = _mm_packs_epi32 (sum, sum);
+        sum = _mm_packus_epi16 (sum, sum);
+        uint32_t out = _mm_cvtsi128_si32 (sum);
+        memcpy (dst + j, &out, 4);
+    }
+    return j;
+}
+
+/* Interpolates 2 pixels of 4 channels at a time.  Each 2x2 block is two
+ * 8-byte loads, with the pixels of each pair interleaved by channel so
+ * that pmaddwd weights and sums them. */
+static inline __m128i
+remap_pixel_8u_c4 (const uint8_t *s, int sstride, const int16_t *w)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    __m128i t = _mm_loadl_epi64 ((__m128i *) s);
+    __m128i b = _mm_loadl_epi64 ((__m128i *)(s + sstride));
+    t = _mm_unpacklo_epi8 (_mm_unpacklo_epi8 (t, _mm_srli_si128 (t, 4)),
+            zero);
+    b = _mm_unpacklo_epi8 (_mm_unpacklo_epi8 (b, _mm_srli_si128 (b, 4)),
+            zero);
+    __m128i wv = _mm_loadl_epi64 ((__m128i *) w);
+    return _mm_add_epi32 (
+            _mm_madd_epi16 (t, _mm_shuffle_epi32 (wv, _MM_SHUFFLE (0, 0, 0, 0))),
+            _mm_madd_epi16 (b, _mm_shuffle_epi32 (wv, _MM_SHUFFLE (1, 1, 1, 1))));
+}
+
+int
+cam_pixel_remap_row_8u_c4_sse2 (uint8_t *dst, const uint8_t *src,
+        int sstride, const int16_t *xy, const uint16_t *frac,
+        const int16_t *weights, int width)
+{
+    const __m128i round = _mm_set1_epi32 (1 << 13);
+    int j;
+    for (j = 0; j + 2 <= width; j += 2) {
+        __m128i p0 = remap_pixel_8u_c4 (src + xy[2*j+1] * sstride +
+                4 * xy[2*j], sstride, weights + 4 * frac[j]);
+        __m128i p1 = remap_pixel_8u_c4 (src + xy[2*j+3] * sstride +
+                4 * xy[2*j+2], sstride, weights + 4 * frac[j+1]);
+        p0 = _mm_srai_epi32 (_mm_add_epi32 (p0, round), 14);
+        p1 = _mm_srai_epi32 (_mm_add_epi32 (p1, round), 14);
+        __m128i v = _mm_packs_epi32 (p0, p1);
+        _mm_storel_epi64 ((__m128i *)(dst + 4 * j),
+                _mm_packus_epi16 (v, v));
+    }
+    return j;
+}
+
+/* Unpacks 16 pixels of packed 10-bit samples from 20 bytes of @s into two
+ * vectors of 16-bit samples.  The 8 high bits of each pixel are gathered
+ * from the four 5-byte groups, and each byte of low bits is repeated for
+ * its 4 pixels and shifted into place with a multiply. */
+static inline void
+unpack_10p_16 (const uint8_t *s, __m128i *p0, __m128i *p1)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i mul = _mm_setr_epi16 (64, 16, 4, 1, 64, 16, 4, 1);
+    const __m128i mask = _mm_set1_epi16 (0x3);
+    __m128i v = _mm_loadu_si128 ((__m128i *) s);
+    __m128i w = _mm_loadu_si128 ((__m128i *)(s + 4));
+    __m128i hi = _mm_unpacklo_epi64 (
+            _mm_unpacklo_epi32 (v, _mm_srli_si128 (v, 5)),
+            _mm_unpacklo_epi32 (_mm_srli_si128 (v, 10),
+                _mm_srli_si128 (w, 11)));
+    __m128i lo = _mm_unpacklo_epi16 (
+            _mm_unpacklo_epi8 (_mm_srli_si128 (v, 4), _mm_srli_si128 (v, 9)),
+            _mm_unpacklo_epi8 (_mm_srli_si128 (v, 14),
+                _mm_srli_si128 (w, 15)));
+    lo = _mm_unpacklo_epi8 (lo, lo);
+    lo = _mm_unpacklo_epi16 (lo, lo);
+    __m128i lo0 = _mm_and_si128 (_mm_srli_epi16 (_mm_mullo_epi16 (
+                    _mm_unpacklo_epi8 (lo, zero), mul), 6), mask);
+    __m128i lo1 = _mm_and_si128 (_mm_srli_epi16 (_mm_mullo_epi16 (
+                    _mm_unpackhi_epi8 (lo, zero), mul), 6), mask);
+    *p0 = _mm_or_si128 (_mm_slli_epi16 (_mm_unpacklo_epi8 (hi, zero), 2),
+            lo0);
+    *p1 = _mm_or_si128 (_mm_slli_epi16 (_mm_unpackhi_epi8 (hi, zero), 2),
+            lo1);
+}
+
+/* Unpacks 8 pixels of packed 12-bit samples from the first 12 of 16 bytes
+ * read at @s.  Each 3-byte group is moved into its own 32-bit lane, where
+ * both of its pixels can be extracted with shifts and masks. */
+static inline __m128i
+unpack_12p_8 (const uint8_t *s)
+{
+    __m128i v = _mm_loadu_si128 ((__m128i *) s);
+    __m128i g = _mm_unpacklo_epi64 (
+            _mm_unpacklo_epi32 (v, _mm_srli_si128 (v, 3)),
+            _mm_unpacklo_epi32 (_mm_srli_si128 (v, 6),
+                _mm_srli_si128 (v, 9)));
+    __m128i p0 = _mm_or_si128 (
+            _mm_slli_epi32 (_mm_and_si128 (g, _mm_set1_epi32 (0xff)), 4),
+            _mm_and_si128 (_mm_srli_epi32 (g, 16), _mm_set1_epi32 (0xf)));
+    __m128i p1 = _mm_or_si128 (
+            _mm_and_si128 (_mm_srli_epi32 (g, 4), _mm_set1_epi32 (0xff0)),
+            _mm_and_si128 (_mm_srli_epi32 (g, 20), _mm_set1_epi32 (0xf)));
+    return _mm_or_si128 (p0, _mm_slli_epi32 (p1, 16));
+}
+
+int
+cam_pixel_unpack_10p_to_16u_sse2 (uint16_t *dst, const uint8_t *src,
+        int width)
+{
+    int j;
+    for (j = 0; j + 16 <= width; j += 16) {
+        __m128i p0, p1;
+        unpack_10p_16 (src + j / 4 * 5, &p0, &p1);
+        _mm_storeu_si128 ((__m128i *)(dst + j), p0);
+        _mm_storeu_si128 ((__m128i *)(dst + j + 8), p1);
+    }
+    return j;
+}
+
+int
+cam_pixel_unpack_10p_to_8u_sse2 (uint8_t *dst, const uint8_t *src,
+        int width, int shift)
+{
+    __m128i sh = _mm_cvtsi32_si128 (shift);
+    int j;
+    for (j = 0; j + 16 <= width; j += 16) {
+        __m128i p0, p1;
+        unpack_10p_16 (src + j / 4 * 5, &p0, &p1);
+        p0 = _mm_srl_epi16 (p0, sh);
+        p1 = _mm_srl_epi16 (p1, sh);
+        _mm_storeu_si128 ((__m128i *)(dst + j), _mm_packus_epi16 (p0, p1));
+    }
+    return j;
+}
+
+/* The 12-bit loops read 4 bytes past the 12 they unpack, so they stop
+ * before those would run past the end of the row */
+int
+cam_pixel_unpack_12p_to_16u_sse2 (uint16_t *dst, const uint8_t *src,
+        int width)
+{
+    int row_bytes = (width + 1) / 2 * 3;
+    int j;
+    for (j = 0; j + 8 <= width && j / 2 * 3 + 16 <= row_bytes; j += 8)
+        _mm_storeu_si128 ((__m128i *)(dst + j), unpack_12p_8 (src + j / 2 * 3));
+    return j;
+}
+
+int
+cam_pixel_unpack_12p_to_8u_sse2 (uint8_t *dst, const uint8_t *src,
+        int width, int shift)
+{
+    __m128i sh = _mm_cvtsi32_si128 (shift);
+    int row_bytes = (width + 1) / 2 * 3;
+    int j;
+    for (j = 0; j + 16 <= width && j / 2 * 3 + 28 <= row_bytes; j += 16) {
+        __m128i p0 = _mm_srl_epi16 (unpack_12p_8 (src + j / 2 * 3), sh);
+        __m128i p1 = _mm_srl_epi16 (unpack_12p_8 (src + j / 2 * 3 + 12), sh);
+        _mm_storeu_si128 ((__m128i *)(dst + j), _mm_packus_epi16 (p0, p1));
+    }
+    return j;
+}
+
+/* Interpolates between two rows of the horizontally interpolated values
+ * of cam_pixel_convert_8u_to_tensor_rows() with weight wy out of 128 on
+ * h1, then normalizes to floats as v * scale + bias.  Returns the number
+ * of values done. */
+int
+cam_pixel_tensor_blend_rows_sse2 (float *dst, const int16_t *h0,
+        const int16_t *h1, int n, int wy, float scale, float bias)
+{
+    __m128i w = _mm_set1_epi32 ((wy << 16) | (128 - wy));
+    __m128 s = _mm_set1_ps (scale);
+    __m128 b = _mm_set1_ps (bias);
+    int j;
+    for (j = 0; j + 8 <= n; j += 8) {
+        __m128i a0 = _mm_loadu_si128 ((__m128i *)(h0 + j));
+        __m128i b0 = _mm_loadu_si128 ((__m128i *)(h1 + j));
+        __m128i v0 = _mm_madd_epi16 (_mm_unpacklo_epi16 (a0, b0), w);
+        __m128i v1 = _mm_madd_epi16 (_mm_unpackhi_epi16 (a0, b0), w);
+        _mm_storeu_ps (dst + j,
+                _mm_add_ps (_mm_mul_ps (_mm_cvtepi32_ps (v0), s), b));
+        _mm_storeu_ps (dst + j + 4,
+                _mm_add_ps (_mm_mul_ps (_mm_cvtepi32_ps (v1), s), b));
+    }
+    return j;
+}
+
+/* Splits a row of 2-channel pixels into one row per channel.  Returns the
+ * number of pixels done. */
+int
+cam_pixel_deinterleave_8u_c2_sse2 (uint8_t *d0, uint8_t *d1,
+        const uint8_t *src, int n)
+{
+    __m128i lo_mask = _mm_set1_epi16 (0xff);
+    int j;
+    for (j = 0; j + 16 <= n; j += 16) {
+        __m128i a = _mm_loadu_si128 ((const __m128i *)(src + 2*j));
+        __m128i b = _mm_loadu_si128 ((const __m128i *)(src + 2*j + 16));
+        _mm_storeu_si128 ((__m128i *)(d0 + j), _mm_packus_epi16 (
+                    _mm_and_si128 (a, lo_mask), _mm_and_si128 (b, lo_mask)));
+        _mm_storeu_si128 ((__m128i *)(d1 + j), _mm_packus_epi16 (
+                    _mm_srli_epi16 (a, 8), _mm_srli_epi16 (b, 8)));
+    }
+    return j;
+}
+
+/* Interleaves three rows of floats into rows of 3-channel pixels.
+ * Returns the number of pixels done. */
+int
+cam_pixel_interleave_32f_c3_sse2 (float *dst, const float *c0,
+        const float *c1, const float *c2, int n)
+{
+    int j;
+    for (j = 0; j + 4 <= n; j += 4) {
+        __m128 a = _mm_loadu_ps (c0 + j);
+        __m128 b = _mm_loadu_ps (c1 + j);
+        __m128 c = _mm_loadu_ps (c2 + j);
+        __m128 ab_lo = _mm_unpacklo_ps (a, b);     /* a0 b0 a1 b1 */
+        __m128 ab_hi = _mm_unpackhi_ps (a, b);     /* a2 b2 a3 b3 */
+        __m128 ca = _mm_shuffle_ps (c, a, _MM_SHUFFLE (1, 1, 0, 0));
+        __m128 bc = _mm_shuffle_ps (b, c, _MM_SHUFFLE (1, 1, 1, 1));
+        __m128 cb = _mm_shuffle_ps (c, b, _MM_SHUFFLE (3, 3, 3, 3));
+        float *d = dst + 3 * j;
+        /* a0 b0 c0 a1 */
+        _mm_storeu_ps (d, _mm_shuffle_ps (ab_lo, ca,
+                    _MM_SHUFFLE (2, 0, 1, 0)));
+        /* b1 c1 a2 b2 */
+        _mm_storeu_ps (d + 4, _mm_shuffle_ps (bc, ab_hi,
+                    _MM_SHUFFLE (1, 0, 2, 0)));
+        /* c2 a3 b3 c3 */
+        _mm_storeu_ps (d + 8, _mm_shuffle_ps (
+                    _mm_shuffle_ps (c, ab_hi, _MM_SHUFFLE (2, 2, 2, 2)),
+                    _mm_shuffle_ps (ab_hi, cb, _MM_SHUFFLE (0, 0, 3, 3)),
+                    _MM_SHUFFLE (2, 0, 2, 0)));
+    }
+    return j;
+}
+
+/* Rounds 4 floats to half precision as float_to_half() in pixels.c does,
+ * leaving the results in the low 16 bits of each 32-bit lane */
+static inline __m128i
+float_to_half_4 (__m128 f)
+{
+    __m128i u = _mm_castps_si128 (f);
+    __m128i sign = _mm_and_si128 (u, _mm_set1_epi32 (0x80000000));
+    __m128i a = _mm_xor_si128 (u, sign);
+
+    /* subnormal results */
+    __m128i sub = _mm_sub_epi32 (_mm_castps_si128 (_mm_add_ps (
+                    _mm_castsi128_ps (a), _mm_set1_ps (0.5f))),
+            _mm_set1_epi32 (0x3f000000));
+
+    /* normal results */
+    __m128i odd = _mm_and_si128 (_mm_srli_epi32 (a, 13), _mm_set1_epi32 (1));
+    __m128i norm = _mm_add_epi32 (a,
+            _mm_set1_epi32 ((int) ((uint32_t) (15 - 127) << 23) + 0xfff));
+    norm = _mm_srli_epi32 (_mm_add_epi32 (norm, odd), 13);
+
+    /* infinity and NaN */
+    __m128i nan = _mm_cmpgt_epi32 (a, _mm_set1_epi32 (0x7f800000));
+    __m128i inf = _mm_or_si128 (_mm_set1_epi32 (0x7c00),
+            _mm_and_si128 (nan, _mm_set1_epi32 (0x0200)));
+
+    __m128i is_sub = _mm_cmplt_epi32 (a, _mm_set1_epi32 (0x38800000));
+    __m128i is_inf = _mm_cmpgt_epi32 (a, _mm_set1_epi32 (0x477fffff));
+    __m128i r = _mm_or_si128 (_mm_and_si128 (is_sub, sub),
+            _mm_andnot_si128 (is_sub, norm));
+    r = _mm_or_si128 (_mm_and_si128 (is_inf, inf),
+            _mm_andnot_si128 (is_inf, r));
+    return _mm_or_si128 (r, _mm_srli_epi32 (sign, 16));
+}
+
+int
+cam_pixel_convert_32f_to_16f_sse2 (uint16_t *dst, const float *src, int n)
+{
+    int j;
+    for (j = 0; j + 8 <= n; j += 8) {
+        __m128i lo = float_to_half_4 (_mm_loadu_ps (src + j));
+        __m128i hi = float_to_half_4 (_mm_loadu_ps (src + j + 4));
+        /* sign extend so that the signed pack keeps all 16 bits */
+        lo = _mm_srai_epi32 (_mm_slli_epi32 (lo, 16), 16);
+        hi = _mm_srai_epi32 (_mm_slli_epi32 (hi, 16), 16);
+        _mm_storeu_si128 ((__m128i *)(dst + j), _mm_packs_epi32 (lo, hi));
+    }
+    return j;
+}
+
+/* Loads the neighbours of the 16 bytes at @cur + @j for a + b - c
+ * prediction, with missing neighbours as 0.  SSE2 has no variable byte
+ * shift, so the first block shifts by the distance @d of 1 or 2 with
+ * constant shifts. */
+static inline __m128i
+_shift_in_8u (const uint8_t *p, int j, int d)
+{
+    if (j)
+        return _mm_loadu_si128 ((__m128i *)(p + j - d));
+    __m128i v = _mm_loadu_si128 ((__m128i *)p);
+    return d == 1 ? _mm_slli_si128 (v, 1) : _mm_slli_si128 (v, 2);
+}
+
+static inline __m128i
+_shift_in_16u (const uint16_t *p, int j, int d)
+{
+    if (j)
+        return _mm_loadu_si128 ((__m128i *)(p + j - d));
+    __m128i v = _mm_loadu_si128 ((__m128i *)p);
+    return d == 1 ? _mm_slli_si128 (v, 2) : _mm_slli_si128 (v, 4);
+}
+
+int
+cam_pixel_lossless_residuals_8u_sse2 (uint8_t *res, const uint8_t *cur,
+        const uint8_t *up, int width, int d)
+{
+    __m128i zero = _mm_setzero_si128 ();
+    int j;
+    for (j = 0; j + 16 <= width; j += 16) {
+        __m128i x = _mm_loadu_si128 ((__m128i *)(cur + j));
+        __m128i p = _shift_in_8u (cur, j, d);
+        if (up)
+            p = _mm_sub_epi8 (_mm_add_epi8 (p,
+                        _mm_loadu_si128 ((__m128i *)(up + j))),
+                    _shift_in_8u (up, j, d));
+        __m128i r = _mm_sub_epi8 (x, p);
+        r = _mm_xor_si128 (_mm_add_epi8 (r, r), _mm_cmpgt_epi8 (zero, r));
+        _mm_storeu_si128 ((__m128i *)(res + j), r);
+    }
+    return j;
+}
+
+int
+cam_pixel_lossless_residuals_16u_sse2 (uint16_t *res, const uint16_t *cur,
+        const uint16_t *up, int width, int d)
+{
+    int j;
+    for (j = 0; j + 8 <= width; j += 8) {
+        __m128i x = _mm_loadu_si128 ((__m128i *)(cur + j));
+        __m128i p = _shift_in_16u (cur, j, d);
+        if (up)
+            p = _mm_sub_epi16 (_mm_add_epi16 (p,
+                        _mm_loadu_si128 ((__m128i *)(up + j))),
+                    _shift_in_16u (up, j, d));
+        __m128i r = _mm_sub_epi16 (x, p);
+        r = _mm_xor_si128 (_mm_add_epi16 (r, r), _mm_srai_epi16 (r, 15));
+        _mm_storeu_si128 ((__m128i *)(res + j), r);
+    }
+    return j;
+}
+
+/* Adds to every sample the one @d samples before it, and @carry, the
+ * last @d samples of the previous vector repeated */
+static inline __m128i
+_running_sum_8u (__m128i t, __m128i *carry, int d)
+{
+    if (d == 1)
+        t = _mm_add_epi8 (t, _mm_slli_si128 (t, 1));
+    t = _mm_add_epi8 (t, _mm_slli_si128 (t, 2));
+    t = _mm_add_epi8 (t, _mm_slli_si128 (t, 4));
+    t = _mm_add_epi8 (t, _mm_slli_si128 (t, 8));
+    t = _mm_add_epi8 (t, *carry);
+    __m128i last = d == 1 ? _mm_unpackhi_epi8 (t, t) : t;
+    *carry = _mm_shuffle_epi32 (_mm_shufflehi_epi16 (last, 0xff), 0xff);
+    return t;
+}
+
+static inline __m128i
+_running_sum_16u (__m128i t, __m128i *carry, int d)
+{
+    if (d == 1) {
+        t = _mm_add_epi16 (t, _mm_slli_si128 (t, 2));
+        t = _mm_add_epi16 (t, _mm_slli_si128 (t, 4));
+        t = _mm_add_epi16 (t, _mm_slli_si128 (t, 8));
+        t = _mm_add_epi16 (t, *carry);
+        *carry = _mm_shuffle_epi32 (_mm_shufflehi_epi16 (t, 0xff), 0xff);
+    } else {
+        t = _mm_add_epi16 (t, _mm_slli_si128 (t, 4));
+        t = _mm_add_epi16 (t, _mm_slli_si128 (t, 8));
+        t = _mm_add_epi16 (t, *carry);
+        *carry = _mm_shuffle_epi32 (t, 0xff);
+    }
+    return t;
+}
+
+int
+cam_pixel_lossless_reconstruct_8u_sse2 (uint8_t *cur, const uint8_t *up,
+        const uint8_t *res, int width, int d)
+{
+    __m128i one = _mm_set1_epi8 (1);
+    __m128i carry = _mm_setzero_si128 ();
+    int j;
+    for (j = 0; j + 16 <= width; j += 16) {
+        __m128i z = _mm_loadu_si128 ((__m128i *)(res + j));
+        __m128i t = _mm_xor_si128 (
+                _mm_and_si128 (_mm_srli_epi16 (z, 1), _mm_set1_epi8 (0x7f)),
+                _mm_cmpeq_epi8 (_mm_and_si128 (z, one), one));
+        if (up)
+            t = _mm_sub_epi8 (_mm_add_epi8 (t,
+                        _mm_loadu_si128 ((__m128i *)(up + j))),
+                    _shift_in_8u (up, j, d));
+        _mm_storeu_si128 ((__m128i *)(cur + j),
+                _running_sum_8u (t, &carry, d));
+    }
+    return j;
+}
+
+int
+cam_pixel_lossless_reconstruct_16u_sse2 (uint16_t *cur, const uint16_t *up,
+        const uint16_t *res, int width, int d)
+{
+    __m128i one = _mm_set1_epi16 (1);
+    __m128i carry = _mm_setzero_si128 ();
+    int j;
+    for (j = 0; j + 8 <= width; j += 8) {
+        __m128i z = _mm_loadu_si128 ((__m128i *)(res + j));
+        __m128i t = _mm_xor_si128 (_mm_srli_epi16 (z, 1),
+                _mm_cmpeq_epi16 (_mm_and_si128 (z, one), one));
+        if (up)
+            t = _mm_sub_epi16 (_mm_add_epi16 (t,
+                        _mm_loadu_si128 ((__m128i *)(up + j))),
+                    _shift_in_16u (up, j, d));
+        _mm_storeu_si128 ((__m128i *)(cur + j),
+                _running_sum_16u (t, &carry, d));
+    }
+    return j;
+}
+
+static inline int
+_bit_width_8u (__m128i v)
+{
+    v = _mm_or_si128 (v, _mm_srli_si128 (v, 8));
+    v = _mm_or_si128 (v, _mm_srli_si128 (v, 4));
+    v = _mm_or_si128 (v, _mm_srli_si128 (v, 2));
+    v = _mm_or_si128 (v, _mm_srli_si128 (v, 1));
+    int any = _mm_cvtsi128_si32 (v) & 0xff;
+    return any ? 32 - __builtin_clz (any) : 0;
+}
+
+/* Packs each half of @v as 8 n-bit values, as _pack_group() in pixels.c,
+ * and stores them in 2n bytes, writing 8 more */
+static inline uint8_t *
+_pack_block_sse2 (uint8_t *out, __m128i v, int n)
+{
+    if (n == 8) {
+        _mm_storeu_si128 ((__m128i *)out, v);
+        return out + 16;
+    }
+    __m128i m8 = _mm_set1_epi16 (0x00ff);
+    __m128i m16 = _mm_set1_epi32 (0x0000ffff);
+    __m128i m32 = _mm_set_epi32 (0, -1, 0, -1);
+    v = _mm_or_si128 (_mm_and_si128 (v, m8), _mm_sll_epi64 (
+                _mm_and_si128 (_mm_srli_epi64 (v, 8), m8),
+                _mm_cvtsi32_si128 (n)));
+    v = _mm_or_si128 (_mm_and_si128 (v, m16), _mm_sll_epi64 (
+                _mm_and_si128 (_mm_srli_epi64 (v, 16), m16),
+                _mm_cvtsi32_si128 (2 * n)));
+    v = _mm_or_si128 (_mm_and_si128 (v, m32), _mm_sll_epi64 (
+                _mm_srli_epi64 (v, 32), _mm_cvtsi32_si128 (4 * n)));
+    _mm_storel_epi64 ((__m128i *)out, v);
+    _mm_storel_epi64 ((__m128i *)(out + n), _mm_srli_si128 (v, 8));
+    return out + 2 * n;
+}
+
+/* The inverse of _pack_block_sse2(), reading 8 bytes past the block */
+static inline __m128i
+_unpack_block_sse2 (const uint8_t *in, int n)
+{
+    if (n == 8)
+        return _mm_loadu_si128 ((__m128i *)in);
+    __m128i v = _mm_unpacklo_epi64 (_mm_loadl_epi64 ((__m128i *)in),
+            _mm_loadl_epi64 ((__m128i *)(in + n)));
+    __m128i all = _mm_cmpeq_epi32 (v, v);
+    __m128i m = _mm_srl_epi64 (all, _mm_cvtsi32_si128 (64 - 4 * n));
+    v = _mm_and_si128 (v, _mm_srl_epi64 (all, _mm_cvtsi32_si128 (64 - 8 * n)));
+    v = _mm_or_si128 (_mm_and_si128 (v, m), _mm_slli_epi64 (_mm_and_si128 (
+                    _mm_srl_epi64 (v, _mm_cvtsi32_si128 (4 * n)), m), 32));
+    m = _mm_srl_epi32 (all, _mm_cvtsi32_si128 (32 - 2 * n));
+    v = _mm_or_si128 (_mm_and_si128 (v, m), _mm_slli_epi32 (_mm_and_si128 (
+                    _mm_srl_epi32 (v, _mm_cvtsi32_si128 (2 * n)), m), 16));
+    m = _mm_srl_epi16 (all, _mm_cvtsi32_si128 (16 - n));
+    return _mm_or_si128 (_mm_and_si128 (v, m), _mm_slli_epi16 (_mm_and_si128 (
+                    _mm_srl_epi16 (v, _mm_cvtsi32_si128 (n)), m), 8));
+}
+
+int
+cam_pixel_lossless_pack_8u_sse2 (uint8_t **out, const uint8_t *res,
+        int count)
+{
+    uint8_t *o = *out;
+    int j;
+    for (j = 0; j < count; j += 16) {
+        __m128i v = _mm_loadu_si128 ((__m128i *)(res + j));
+        int n = _bit_width_8u (v);
+        *o++ = n;
+        if (n)
+            o = _pack_block_sse2 (o, v, n);
+    }
+    *out = o;
+    return j;
+}
+
+int
+cam_pixel_lossless_pack_16u_sse2 (uint8_t **out, const uint16_t *res,
+        int count)
+{
+    __m128i m8 = _mm_set1_epi16 (0x00ff);
+    uint8_t *o = *out;
+    int j;
+    for (j = 0; j < count; j += 16) {
+        __m128i v0 = _mm_loadu_si128 ((__m128i *)(res + j));
+        __m128i v1 = _mm_loadu_si128 ((__m128i *)(res + j + 8));
+        __m128i lo = _mm_packus_epi16 (_mm_and_si128 (v0, m8),
+                _mm_and_si128 (v1, m8));
+        __m128i hi = _mm_packus_epi16 (_mm_srli_epi16 (v0, 8),
+                _mm_srli_epi16 (v1, 8));
+        int n = _bit_width_8u (hi);
+        n = n ? n + 8 : _bit_width_8u (lo);
+        *o++ = n;
+        if (n > 8) {
+            _mm_storeu_si128 ((__m128i *)o, lo);
+            o = _pack_block_sse2 (o + 16, hi, n - 8);
+        } else if (n) {
+            o = _pack_block_sse2 (o, lo, n);
+        }
+    }
+    *out = o;
+    return j;
+}
+
+/* Stops at the first block that is corrupt or too close to @end to be
+ * read with 8-byte loads, leaving it to the caller */
+int
+cam_pixel_lossless_unpack_8u_sse2 (uint8_t *res, const uint8_t **in,
+        const uint8_t *end, int count)
+{
+    const uint8_t *p = *in;
+    int j;
+    for (j = 0; j < count && end - p >= 1 + 16 + 8; j += 16) {
+        int n = *p;
+        if (n > 8)
+            break;
+        p++;
+        _mm_storeu_si128 ((__m128i *)(res + j), n ?
+                _unpack_block_sse2 (p, n) : _mm_setzero_si128 ());
+        p += 2 * n;
+    }
+    *in = p;
+    return j;
+}
+
+int
+cam_pixel_lossless_unpack_16u_sse2 (uint16_t *res, const uint8_t **in,
+        const uint8_t *end, int count)
+{
+    const uint8_t *p = *in;
+    int j;
+    for (j = 0; j < count && end - p >= 1 + 32 + 8; j += 16) {
+        __m128i lo, hi;
+        int n = *p;
+        if (n > 16)
+            break;
+        p++;
+        if (n > 8) {
+            lo = _mm_loadu_si128 ((__m128i *)p);
+            hi = _unpack_block_sse2 (p + 16, n - 8);
+        } else {
+            lo = n ? _unpack_block_sse2 (p, n) : _mm_setzero_si128 ();
+            hi = _mm_setzero_si128 ();
+        }
+        _mm_storeu_si128 ((__m128i *)(res + j), _mm_unpacklo_epi8 (lo, hi));
+        _mm_storeu_si128 ((__m128i *)(res + j + 8),
+                _mm_unpackhi_epi8 (lo, hi));
+        p += 2 * n;
+    }
+    *in = p;
+    return j;
+}
+
+int
+cam_pixel_delta_residuals_8u_sse2 (uint8_t *res, const uint8_t *cur,
+        const uint8_t *ref, int n)
+{
+    __m128i zero = _mm_setzero_si128 ();
+    int j;
+    for (j = 0; j + 16 <= n; j += 16) {
+        __m128i r = _mm_sub_epi8 (_mm_loadu_si128 ((__m128i *)(cur + j)),
+                _mm_loadu_si128 ((__m128i *)(ref + j)));
+        r = _mm_xor_si128 (_mm_add_epi8 (r, r), _mm_cmpgt_epi8 (zero, r));
+        _mm_storeu_si128 ((__m128i *)(res + j), r);
+    }
+    return j;
+}
+
+int
+cam_pixel_delta_reconstruct_8u_sse2 (uint8_t *cur, const uint8_t *ref,
+        const uint8_t *res, int n)
+{
+    __m128i one = _mm_set1_epi8 (1);
+    __m128i low7 = _mm_set1_epi8 (0x7f);
+    int j;
+    for (j = 0; j + 16 <= n; j += 16) {
+        __m128i z = _mm_loadu_si128 ((__m128i *)(res + j));
+        __m128i r = _mm_xor_si128 (
+                _mm_and_si128 (_mm_srli_epi16 (z, 1), low7),
+                _mm_cmpeq_epi8 (_mm_and_si128 (z, one), one));
+        _mm_storeu_si128 ((__m128i *)(cur + j), _mm_add_epi8 (r,
+                    _mm_loadu_si128 ((__m128i *)(ref + j))));
+    }
+    return j;
+}
+
+int
+cam_pixel_sad_8u_sse2 (const uint8_t *a, int astride, const uint8_t *b,
+        int bstride, int width, int height, uint64_t *sad)
+{
+    uint64_t total = 0;
+    int i, j;
+    for (i = 0; i < height; i++) {
+        const uint8_t *arow = a + i*astride;
+        const uint8_t *brow = b + i*bstride;
+        __m128i acc = _mm_setzero_si128 ();
+        for (j = 0; j + 16 <= width; j += 16) {
+            __m128i va = _mm_loadu_si128 ((const __m128i *)(arow + j));
+            __m128i vb = _mm_loadu_si128 ((const __m128i *)(brow + j));
+            acc = _mm_add_epi64 (acc, _mm_sad_epu8 (va, vb));
+        }
+        uint64_t lanes[2];
+        _mm_storeu_si128 ((__m128i *) lanes, acc);
+        total += lanes[0] + lanes[1];
+        for (; j < width; j++)
+            total += abs (arow[j] - brow[j]);
+    }
+    *sad = total;
+    return 0;
+}
@@ -16,4 +16,136 @@ cam_pixel_bayer_interpolate_to_8u_gray_sse2 (uint8_t * src, int sstride,
         uint8_t * dst, int dstride, int width, int height,
         CamPixelFormat format);
 
+int
+cam_pixel_swap_bytes_16u_sse2 (uint16_t *dest, int dstride, int width,
+        int height, const uint16_t *src, int sstride);
+int
+cam_pixel_convert_16u_gray_to_8u_gray_sse2 (uint8_t *dest, int dstride,
+        int width, int height, const uint16_t *src, int sstride, int shift,
+        int big_endian);
+int
+cam_pixel_convert_16u_gray_to_8u_gray_window_sse2 (uint8_t *dest,
+        int dstride, int width, int height, const uint16_t *src, int sstride,
+        int low, int range, int pshift, int factor, int big_endian);
+int
+cam_pixel_convert_8u_gray_to_16u_gray_sse2 (uint16_t *dest, int dstride,
+        int width, int height, const uint8_t *src, int sstride, int shift,
+        int big_endian);
+int
+cam_pixel_apply_lut_8u_sse2 (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, int channels,
+        const uint8_t *lut);
+int
+cam_pixel_apply_lut_16u_to_8u_sse2 (uint8_t *dest, int dstride, int width,
+        int height, const uint16_t *src, int sstride, int channels, int bits,
+        const uint8_t *lut, int big_endian);
+int
+cam_pixel_split_bayer_planes_16u_to_8u_sse2 (uint8_t *dst[4], int dstride,
+        const uint16_t * src, int sstride, int width, int height, int shift,
+        int big_endian);
+int
+cam_pixel_bayer_interpolate_to_16u_rgb_sse2 (const uint16_t * src,
+        int sstride, uint16_t * dst, int dstride, int width, int height,
+        int red_x, int red_y);
+int
+cam_pixel_bayer_interpolate_to_16u_gray_sse2 (const uint16_t * src,
+        int sstride, uint16_t * dst, int dstride, int width, int height,
+        int red_x, int red_y);
+int
+cam_pixel_bayer_interpolate_edge_to_8u_bgra_sse2 (const uint8_t * src,
+        int sstride, uint8_t * dst, int dstride, int width, int height,
+        int row_start, int row_end, int red_x, int red_y);
+int
+cam_pixel_bayer_bin_to_8u_bgra_sse2 (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, const int pos[4]);
+int
+cam_pixel_bayer_bin_to_8u_gray_sse2 (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, const int pos[4]);
+
+void
+cam_pixel_resize_add_row_8u_sse2 (uint16_t *acc, const uint8_t *src, int n);
+void
+cam_pixel_resize_add_row_16u_sse2 (uint32_t *acc, const uint16_t *src,
+        int n);
+int
+cam_pixel_resize_blend_rows_8u_sse2 (uint8_t *dst, const int16_t *h0,
+        const int16_t *h1, int n, int wy);
+
+void
+cam_pixel_transpose_tiles_8u_c1_sse2 (uint8_t *dest, int dstride,
+        int width, int height, const uint8_t *src, int sstride,
+        int fx, int fy);
+void
+cam_pixel_transpose_tiles_8u_c4_sse2 (uint8_t *dest, int dstride,
+        int width, int height, const uint8_t *src, int sstride,
+        int fx, int fy);
+int
+cam_pixel_mirror_rows_8u_sse2 (uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride, int bpp, int fy);
+int
+cam_pixel_remap_row_8u_c1_sse2 (uint8_t *dst, const uint8_t *src,
+        int sstride, const int16_t *xy, const uint16_t *frac,
+        const int16_t *weights, int width);
+int
+cam_pixel_remap_row_8u_c4_sse2 (uint8_t *dst, const uint8_t *src,
+        int sstride, const int16_t *xy, const uint16_t *frac,
+        const int16_t *weights, int width);
+
+int
+cam_pixel_unpack_10p_to_16u_sse2 (uint16_t *dst, const uint8_t *src,
+        int width);
+int
+cam_pixel_unpack_10p_to_8u_sse2 (uint8_t *dst, const uint8_t *src,
+        int width, int shift);
+int
+cam_pixel_unpack_12p_to_16u_sse2 (uint16_t *dst, const uint8_t *src,
+        int width);
+int
+cam_pixel_unpack_12p_to_8u_sse2 (uint8_t *dst, const uint8_t *src,
+        int width, int shift);
+int
+cam_pixel_tensor_blend_rows_sse2 (float *dst, const int16_t *h0,
+        const int16_t *h1, int n, int wy, float scale, float bias);
+int
+cam_pixel_deinterleave_8u_c2_sse2 (uint8_t *d0, uint8_t *d1,
+        const uint8_t *src, int n);
+int
+cam_pixel_interleave_32f_c3_sse2 (float *dst, const float *c0,
+        const float *c1, const float *c2, int n);
+int
+cam_pixel_convert_32f_to_16f_sse2 (uint16_t *dst, const float *src, int n);
+int
+cam_pixel_lossless_residuals_8u_sse2 (uint8_t *res, const uint8_t *cur,
+        const uint8_t *up, int width, int d);
+int
+cam_pixel_lossless_residuals_16u_sse2 (uint16_t *res, const uint16_t *cur,
+        const uint16_t *up, int width, int d);
+int
+cam_pixel_lossless_reconstruct_8u_sse2 (uint8_t *cur, const uint8_t *up,
+        const uint8_t *res, int width, int d);
+int
+cam_pixel_lossless_reconstruct_16u_sse2 (uint16_t *cur, const uint16_t *up,
+        const uint16_t *res, int width, int d);
+int
+cam_pixel_lossless_pack_8u_sse2 (uint8_t **out, const uint8_t *res,
+        int count);
+int
+cam_pixel_lossless_pack_16u_sse2 (uint8_t **out, const uint16_t *res,
+        int count);
+int
+cam_pixel_lossless_unpack_8u_sse2 (uint8_t *res, const uint8_t **in,
+        const uint8_t *end, int count);
+int
+cam_pixel_lossless_unpack_16u_sse2 (uint16_t *res, const uint8_t **in,
+        const uint8_t *end, int count);
+int
+cam_pixel_delta_residuals_8u_sse2 (uint8_t *res, const uint8_t *cur,
+        const uint8_t *ref, int n);
+int
+cam_pixel_delta_reconstruct_8u_sse2 (uint8_t *cur, const uint8_t *ref,
+        const uint8_t *res, int n);
+int
+cam_pixel_sad_8u_sse2 (const uint8_t *a, int astride, const uint8_t *b,
+        int bstride, int width, int height, uint64_t *sad);
+
 #endif
@@ -741,22 +741,22 @@ cam_pixel_bayer_interpolate_to_8u_gray_sse3 (uint8_t * src, int sstride,
         for (i = -2; i < height + 2; i += 2) {
             uint8_t * drow = dst + (i>=2)*(i-2)*dstride;
             uint8_t * srow = src + i*sstride;
-            int i5 = tmpstride * (i % 5);
-            int i4 = tmpstride * ((i+1) % 5);
-            int i3 = tmpstride * ((i+2) % 5);
-            int i2 = tmpstride * ((i+3) % 5);
-            int i1 = tmpstride * ((i+4) % 5);
+            int i5 = tmpstride * ((i+5) % 5);
+            int i4 = tmpstride * ((i+6) % 5);
+            int i3 = tmpstride * ((i+7) % 5);
+            int i2 = tmpstride * ((i+8) % 5);
+            int i1 = tmpstride * ((i+9) % 5);
 
             for (j = 0; j < width; j += 16)
                 INTERPOLATE_GRAY_ROW_GX();
 
             drow += dstride;
             srow += sstride;
-            i5 = tmpstride * ((i+1) % 5);
-            i4 = tmpstride * ((i+2) % 5);
-            i3 = tmpstride * ((i+3) % 5);
-            i2 = tmpstride * ((i+4) % 5);
-            i1 = tmpstride * ((i+5) % 5);
+            i5 = tmpstride * ((i+6) % 5);
+            i4 = tmpstride * ((i+7) % 5);
+            i3 = tmpstride * ((i+8) % 5);
+            i2 = tmpstride * ((i+9) % 5);
+            i1 = tmpstride * ((i+10) % 5);
 
             for (j = 0; j < width; j += 16)
                 INTERPOLATE_GRAY_ROW_XG();
@@ -766,22 +766,22 @@ cam_pixel_bayer_interpolate_to_8u_gray_sse3 (uint8_t * src, int sstride,
         for (i = -2; i < height + 2; i += 2) {
             uint8_t * drow = dst + (i>=2)*(i-2)*dstride;
             uint8_t * srow = src + i*sstride;
-            int i5 = tmpstride * (i % 5);
-            int i4 = tmpstride * ((i+1) % 5);
-            int i3 = tmpstride * ((i+2) % 5);
-            int i2 = tmpstride * ((i+3) % 5);
-            int i1 = tmpstride * ((i+4) % 5);
+            int i5 = tmpstride * ((i+5) % 5);
+            int i4 = tmpstride * ((i+6) % 5);
+            int i3 = tmpstride * ((i+7) % 5);
+            int i2 = tmpstride * ((i+8) % 5);
+            int i1 = tmpstride * ((i+9) % 5);
 
             for (j = 0; j < width; j += 16)
                 INTERPOLATE_GRAY_ROW_XG();
 
             drow += dstride;
             srow += sstride;
-            i5 = tmpstride * ((i+1) % 5);
-            i4 = tmpstride * ((i+2) % 5);
-            i3 = tmpstride * ((i+3) % 5);
-            i2 = tmpstride * ((i+4) % 5);
-            i1 = tmpstride * ((i+5) % 5);
+            i5 = tmpstride * ((i+6) % 5);
+            i4 = tmpstride * ((i+7) % 5);
+            i3 = tmpstride * ((i+8) % 5);
+            i2 = tmpstride * ((i+9) % 5);
+            i1 = tmpstride * ((i+10) % 5);
 
             for (j = 0; j < width; j += 16)
                 INTERPOLATE_GRAY_ROW_GX();
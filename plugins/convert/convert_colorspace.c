@@ -7,15 +7,39 @@
 
 #define err(args...) fprintf(stderr, args)
 
+/* longest chain of conversions the planner considers */
+#define MAX_HOPS 4
+
 typedef struct _CamColorConversionFilter CamColorConversionFilter;
+typedef struct _conv_info_t conv_info_t;
+
+/* a chain of conversions from the input format to @outpfmt */
+typedef struct _conv_plan_t {
+    CamPixelFormat outpfmt;
+    int nhops;
+    conv_info_t *hops[MAX_HOPS];
+    float cost;
+} conv_plan_t;
 
 struct _CamColorConversionFilter {
     CamUnit parent;
 
-    int (*cc_func)(CamColorConversionFilter *self, 
-        const CamUnitFormat *infmt, const CamFrameBuffer *inbuf,
-        const CamUnitFormat *outfmt, CamFrameBuffer *outbuf);
     GList *conversions;
+    /* the cheapest plan for each output format of the current input */
+    GList *plans;
+
+    /* the plan of the running stream, its intermediate formats, and
+     * frame buffers for the intermediates that aren't fused into bands */
+    conv_plan_t plan;
+    CamUnitFormat *mid_fmts[MAX_HOPS - 1];
+    CamFrameBuffer *mid_bufs[MAX_HOPS - 1];
+    int strip_rows;
+
+    CamUnitControl *threads_ctl;
+    CamUnitControl *shift_ctl;
+    CamUnitControl *window_ctl;
+    CamUnitControl *window_low_ctl;
+    CamUnitControl *window_high_ctl;
 };
 
 typedef struct _CamColorConversionFilterClass {
@@ -47,6 +71,7 @@ CamUnitDriver * cam_plugin_create(GTypeModule * module)
 // ============== CamColorConversionFilter ===============
 static int cam_color_conversion_filter_stream_init (CamUnit * super, 
         const CamUnitFormat * format);
+static int cam_color_conversion_filter_stream_shutdown (CamUnit * super);
 static void cam_color_conversion_filter_finalize (GObject * obj);
 static void on_input_format_changed (CamUnit *super, 
         const CamUnitFormat *infmt);
@@ -54,6 +79,8 @@ static void on_input_format_changed (CamUnit *super,
         const CamUnitFormat *infmt);
 static void on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
         const CamUnitFormat *infmt);
+static gboolean cam_color_conversion_filter_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual);
 
 typedef int (*cc_func_t)(CamColorConversionFilter *self, 
         const CamUnitFormat *infmt, const CamFrameBuffer *inbuf,
@@ -93,6 +120,10 @@ DECL_STANDARD_CONV (yuv420p_to_bgr, cam_pixel_convert_8u_yuv420p_to_8u_bgr)
 DECL_STANDARD_CONV (yuv420p_to_bgra, cam_pixel_convert_8u_yuv420p_to_8u_bgra)
 DECL_STANDARD_CONV (yuv420p_to_gray, cam_pixel_convert_8u_yuv420p_to_8u_gray)
 
+DECL_STANDARD_CONV_DEFAULT_STRIDE (nv12_to_rgb, cam_pixel_convert_8u_nv12_to_8u_rgb, 1)
+DECL_STANDARD_CONV_DEFAULT_STRIDE (nv12_to_bgr, cam_pixel_convert_8u_nv12_to_8u_bgr, 1)
+DECL_STANDARD_CONV_DEFAULT_STRIDE (nv12_to_bgra, cam_pixel_convert_8u_nv12_to_8u_bgra, 1)
+
 DECL_STANDARD_CONV_DEFAULT_STRIDE (yuyv_to_bgra, cam_pixel_convert_8u_yuyv_to_8u_bgra, 2)
 DECL_STANDARD_CONV_DEFAULT_STRIDE (yuyv_to_gray, cam_pixel_convert_8u_yuyv_to_8u_gray, 2)
 DECL_STANDARD_CONV_DEFAULT_STRIDE (yuyv_to_rgb, cam_pixel_convert_8u_yuyv_to_8u_rgb, 2)
@@ -108,7 +139,6 @@ DECL_STANDARD_CONV (iyu1_to_rgb, cam_pixel_convert_8u_iyu1_to_8u_rgb)
 DECL_STANDARD_CONV (bgra_to_rgb, cam_pixel_convert_8u_bgra_to_8u_rgb)
 DECL_STANDARD_CONV (bgra_to_bgr, cam_pixel_convert_8u_bgra_to_8u_bgr)
 DECL_STANDARD_CONV (bgr_to_rgb, cam_pixel_convert_8u_bgr_to_8u_rgb)
-#undef DECL_STANDARD_CONV
 
 static inline int 
 gray_8u_to_32f (CamColorConversionFilter *self,
@@ -120,58 +150,501 @@ gray_8u_to_32f (CamColorConversionFilter *self,
             outfmt->width, outfmt->height, inbuf->data, infmt->row_stride);
 }
 
-typedef struct _conv_info_t {
+static int
+is_big_endian_16u (CamPixelFormat pfmt)
+{
+    return (pfmt == CAM_PIXEL_FORMAT_BE_GRAY16 ||
+            pfmt == CAM_PIXEL_FORMAT_BE_RGB16 ||
+            pfmt == CAM_PIXEL_FORMAT_BE_BAYER16_GBRG ||
+            pfmt == CAM_PIXEL_FORMAT_BE_BAYER16_GRBG ||
+            pfmt == CAM_PIXEL_FORMAT_BE_BAYER16_BGGR ||
+            pfmt == CAM_PIXEL_FORMAT_BE_BAYER16_RGGB);
+}
+
+/* 16-bit and 8-bit conversions work on samples, so multi-channel rows are
+ * treated as rows of gray samples */
+static int
+samples_per_pixel (CamPixelFormat pfmt)
+{
+    return (pfmt == CAM_PIXEL_FORMAT_RGB ||
+            pfmt == CAM_PIXEL_FORMAT_BE_RGB16 ||
+            pfmt == CAM_PIXEL_FORMAT_LE_RGB16) ? 3 : 1;
+}
+
+static int
+swap_gray_16u (uint8_t *dest, int dstride, int width, int height,
+        const uint8_t *src, int sstride)
+{
+    return cam_pixel_swap_bytes_16u ((uint16_t*) dest, dstride, width,
+            height, (const uint16_t*) src, sstride);
+}
+
+static int
+swap_rgb_16u (uint8_t *dest, int dstride, int width, int height,
+        const uint8_t *src, int sstride)
+{
+    return cam_pixel_swap_bytes_16u ((uint16_t*) dest, dstride, width * 3,
+            height, (const uint16_t*) src, sstride);
+}
+
+DECL_STANDARD_CONV (gray_16u_swap, swap_gray_16u)
+DECL_STANDARD_CONV (rgb_16u_swap, swap_rgb_16u)
+#undef DECL_STANDARD_CONV
+
+/* Reduces 16-bit samples to 8 bits with either a right shift or a
+ * window/level stretch, depending on the controls */
+static int
+depth_16u_to_8u (CamColorConversionFilter *self,
+        const CamUnitFormat *infmt, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *outfmt, CamFrameBuffer *outbuf)
+{
+    int width = outfmt->width * samples_per_pixel (outfmt->pixelformat);
+    int big_endian = is_big_endian_16u (infmt->pixelformat);
+    if (cam_unit_control_get_boolean (self->window_ctl)) {
+        int low = cam_unit_control_get_int (self->window_low_ctl);
+        int high = cam_unit_control_get_int (self->window_high_ctl);
+        if (low > 0xfffe)
+            low = 0xfffe;
+        if (high <= low)
+            high = low + 1;
+        return cam_pixel_convert_16u_gray_to_8u_gray_window (outbuf->data,
+                outfmt->row_stride, width, outfmt->height,
+                (const uint16_t*) inbuf->data, infmt->row_stride, low, high,
+                big_endian);
+    }
+    return cam_pixel_convert_16u_gray_to_8u_gray (outbuf->data,
+            outfmt->row_stride, width, outfmt->height,
+            (const uint16_t*) inbuf->data, infmt->row_stride,
+            cam_unit_control_get_int (self->shift_ctl), big_endian);
+}
+
+static int
+depth_8u_to_16u (CamColorConversionFilter *self,
+        const CamUnitFormat *infmt, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *outfmt, CamFrameBuffer *outbuf)
+{
+    return cam_pixel_convert_8u_gray_to_16u_gray ((uint16_t*) outbuf->data,
+            outfmt->row_stride,
+            outfmt->width * samples_per_pixel (outfmt->pixelformat),
+            outfmt->height, inbuf->data, infmt->row_stride,
+            cam_unit_control_get_int (self->shift_ctl),
+            is_big_endian_16u (outfmt->pixelformat));
+}
+
+typedef int (*pixel_func_t)(uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride);
+
+static int
+nv12_to_yuv420p (CamColorConversionFilter *self,
+        const CamUnitFormat *infmt, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *outfmt, CamFrameBuffer *outbuf)
+{
+    return cam_pixel_convert_8u_nv12_to_8u_yuv420p (outbuf->data,
+            outfmt->row_stride, outfmt->width, outfmt->height, inbuf->data,
+            infmt->row_stride ? infmt->row_stride : infmt->width);
+}
+
+struct _conv_info_t {
     CamPixelFormat inpfmt;
     CamPixelFormat outpfmt;
     cc_func_t func;
-} conv_info_t;
+    pixel_func_t pixel_func;
+    float cost;
+};
 
+/* pixel_func is the underlying cam_pixel_ kernel if the conversion can be
+ * split into bands of rows by offsetting the buffer pointers, or NULL if
+ * it can't (e.g. planar formats).  cost is a rough time per pixel in ns,
+ * as measured by camunits-pixel-bench at 1920x1080, used to plan chains
+ * of conversions. */
 static void
 add_conv (CamColorConversionFilter *self,
-        CamPixelFormat inpfmt, CamPixelFormat outpfmt, cc_func_t func)
+        CamPixelFormat inpfmt, CamPixelFormat outpfmt, cc_func_t func,
+        pixel_func_t pixel_func, float cost)
 {
     conv_info_t *ci = (conv_info_t*)malloc (sizeof(conv_info_t));
     ci->inpfmt = inpfmt;
     ci->outpfmt = outpfmt;
     ci->func = func;
+    ci->pixel_func = pixel_func;
+    ci->cost = cost;
     self->conversions = g_list_append (self->conversions, ci);
 }
 
+typedef struct _band_args_t {
+    pixel_func_t pixel_func;
+    uint8_t *dest;
+    int dstride;
+    int width;
+    const uint8_t *src;
+    int sstride;
+    int status;
+} band_args_t;
+
+static void
+convert_band (int row_start, int row_end, void *user_data)
+{
+    band_args_t *a = (band_args_t*) user_data;
+    if (0 != a->pixel_func (a->dest + row_start * a->dstride, a->dstride,
+                a->width, row_end - row_start,
+                a->src + row_start * a->sstride, a->sstride))
+        a->status = -1;
+}
+
+/* A chain of bandable conversions is run strip by strip through two
+ * cache-sized scratch buffers, so its intermediate images never exist in
+ * full */
+typedef struct _chain_args_t {
+    const conv_plan_t *plan;
+    int first;
+    int last;
+    uint8_t *dest;
+    int dstride;
+    int width;
+    const uint8_t *src;
+    int sstride;
+    int mid_strides[MAX_HOPS - 1];
+    int strip_rows;
+    int scratch_size;
+    int status;
+} chain_args_t;
+
+static void
+convert_chain_band (int row_start, int row_end, void *user_data)
+{
+    chain_args_t *a = (chain_args_t*) user_data;
+    uint8_t *scratch[2] = {
+        (uint8_t*) malloc (a->scratch_size),
+        (uint8_t*) malloc (a->scratch_size),
+    };
+    for (int r = row_start; r < row_end; r += a->strip_rows) {
+        int rows = MIN (a->strip_rows, row_end - r);
+        const uint8_t *src = a->src + r * a->sstride;
+        int sstride = a->sstride;
+        for (int i = a->first; i <= a->last; i++) {
+            uint8_t *dest = a->dest + r * a->dstride;
+            int dstride = a->dstride;
+            if (i < a->last) {
+                dest = scratch[(i - a->first) & 1];
+                dstride = a->mid_strides[i];
+            }
+            if (0 != a->plan->hops[i]->pixel_func (dest, dstride, a->width,
+                        rows, src, sstride))
+                a->status = -1;
+            src = dest;
+            sstride = dstride;
+        }
+    }
+    free (scratch[0]);
+    free (scratch[1]);
+}
+
+/* Every intermediate image of a plan costs a pass through memory, in ns
+ * per byte, unless the conversions on both sides of it can be split into
+ * bands, in which case it only ever lives in a strip of STRIP_BYTES */
+#define FRAME_PASS_COST 0.25f
+#define BAND_PASS_COST 0.05f
+#define STRIP_BYTES 32768
+
+static int
+is_planar (CamPixelFormat pfmt)
+{
+    return (pfmt == CAM_PIXEL_FORMAT_I420 || pfmt == CAM_PIXEL_FORMAT_NV12);
+}
+
+/* planar formats are described by the stride of their luma plane */
+static int
+default_stride (CamPixelFormat pfmt, int width)
+{
+    if (is_planar (pfmt))
+        return width;
+    return width * cam_pixel_format_bpp (pfmt) / 8;
+}
+
+static int
+frame_size (const CamUnitFormat *fmt)
+{
+    if (is_planar (fmt->pixelformat))
+        return fmt->row_stride * fmt->height *
+            cam_pixel_format_bpp (fmt->pixelformat) / 8;
+    return fmt->row_stride * fmt->height;
+}
+
+/* A plan never passes through a format that carries less color or bit
+ * depth than both of its ends, even if that would be cheaper, e.g. RGB16
+ * to BGR goes through RGB, but never through GRAY */
+static int
+color_rank (CamPixelFormat pfmt)
+{
+    switch (pfmt) {
+        case CAM_PIXEL_FORMAT_GRAY:
+        case CAM_PIXEL_FORMAT_BE_GRAY16:
+        case CAM_PIXEL_FORMAT_LE_GRAY16:
+        case CAM_PIXEL_FORMAT_FLOAT_GRAY32:
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+static int
+depth_rank (CamPixelFormat pfmt)
+{
+    switch (pfmt) {
+        case CAM_PIXEL_FORMAT_BE_GRAY16:
+        case CAM_PIXEL_FORMAT_LE_GRAY16:
+        case CAM_PIXEL_FORMAT_BE_RGB16:
+        case CAM_PIXEL_FORMAT_LE_RGB16:
+        case CAM_PIXEL_FORMAT_BE_BAYER16_BGGR:
+        case CAM_PIXEL_FORMAT_BE_BAYER16_GBRG:
+        case CAM_PIXEL_FORMAT_BE_BAYER16_GRBG:
+        case CAM_PIXEL_FORMAT_BE_BAYER16_RGGB:
+        case CAM_PIXEL_FORMAT_LE_BAYER16_BGGR:
+        case CAM_PIXEL_FORMAT_LE_BAYER16_GBRG:
+        case CAM_PIXEL_FORMAT_LE_BAYER16_GRBG:
+        case CAM_PIXEL_FORMAT_LE_BAYER16_RGGB:
+            return 16;
+        default:
+            return 8;
+    }
+}
+
+static int
+keeps_fidelity (CamPixelFormat inpfmt, const conv_plan_t *plan)
+{
+    int color = MIN (color_rank (inpfmt), color_rank (plan->outpfmt));
+    int depth = MIN (depth_rank (inpfmt), depth_rank (plan->outpfmt));
+    for (int i = 0; i < plan->nhops - 1; i++) {
+        CamPixelFormat mid = plan->hops[i]->outpfmt;
+        if (color_rank (mid) < color || depth_rank (mid) < depth)
+            return 0;
+    }
+    return 1;
+}
+
+static conv_plan_t *
+find_plan (GList *plans, CamPixelFormat outpfmt)
+{
+    for (GList *piter=plans; piter; piter=piter->next) {
+        conv_plan_t *plan = (conv_plan_t*) piter->data;
+        if (plan->outpfmt == outpfmt)
+            return plan;
+    }
+    return NULL;
+}
+
+/* Extends @path by each conversion out of its last format, and keeps the
+ * cheapest plan found for each output format in self->plans or, for
+ * formats with no direct conversion, in @found */
+static void
+search_plans (CamColorConversionFilter *self, CamPixelFormat inpfmt,
+        const conv_plan_t *path, GList **found)
+{
+    conv_info_t *prev = path->nhops ? path->hops[path->nhops - 1] : NULL;
+    CamPixelFormat at = prev ? prev->outpfmt : inpfmt;
+
+    for (GList *citer=self->conversions; citer; citer=citer->next) {
+        conv_info_t *ci = (conv_info_t*) citer->data;
+        if (ci->inpfmt != at || ci->outpfmt == inpfmt)
+            continue;
+        int visited = 0;
+        for (int i = 0; i < path->nhops; i++)
+            visited |= path->hops[i]->outpfmt == ci->outpfmt;
+        if (visited)
+            continue;
+
+        conv_plan_t next = *path;
+        next.outpfmt = ci->outpfmt;
+        next.hops[next.nhops++] = ci;
+        next.cost += ci->cost;
+        if (prev) {
+            float pass = (prev->pixel_func && ci->pixel_func) ?
+                BAND_PASS_COST : FRAME_PASS_COST;
+            next.cost += pass * cam_pixel_format_bpp (at) / 8;
+        }
+
+        if (keeps_fidelity (inpfmt, &next)) {
+            conv_plan_t *best = find_plan (self->plans, next.outpfmt);
+            if (!best)
+                best = find_plan (*found, next.outpfmt);
+            if (!best) {
+                best = (conv_plan_t*) malloc (sizeof (conv_plan_t));
+                *best = next;
+                *found = g_list_prepend (*found, best);
+            } else if (next.cost < best->cost) {
+                *best = next;
+            }
+        }
+        if (next.nhops < MAX_HOPS)
+            search_plans (self, inpfmt, &next, found);
+    }
+}
+
+static gint
+compare_plan_cost (gconstpointer a, gconstpointer b)
+{
+    const conv_plan_t *pa = (const conv_plan_t*) a;
+    const conv_plan_t *pb = (const conv_plan_t*) b;
+    return (pa->cost > pb->cost) - (pa->cost < pb->cost);
+}
+
+static void
+free_plans (CamColorConversionFilter *self)
+{
+    for (GList *piter=self->plans; piter; piter=piter->next)
+        free (piter->data);
+    g_list_free (self->plans);
+    self->plans = NULL;
+}
+
+/* Plans the cheapest chain of conversions from @inpfmt to every format it
+ * can reach, into the empty self->plans.  Formats with a direct
+ * conversion come first, in the order the conversions were added,
+ * followed by the rest, cheapest first. */
+static void
+build_plans (CamColorConversionFilter *self, CamPixelFormat inpfmt)
+{
+    for (GList *citer=self->conversions; citer; citer=citer->next) {
+        conv_info_t *ci = (conv_info_t*) citer->data;
+        if (ci->inpfmt != inpfmt)
+            continue;
+        conv_plan_t *plan = (conv_plan_t*) calloc (1, sizeof (conv_plan_t));
+        plan->outpfmt = ci->outpfmt;
+        plan->nhops = 1;
+        plan->hops[0] = ci;
+        plan->cost = ci->cost;
+        self->plans = g_list_append (self->plans, plan);
+    }
+
+    conv_plan_t path;
+    memset (&path, 0, sizeof (path));
+    GList *found = NULL;
+    search_plans (self, inpfmt, &path, &found);
+    self->plans = g_list_concat (self->plans,
+            g_list_sort (found, compare_plan_cost));
+}
+
 static void
 cam_color_conversion_filter_init( CamColorConversionFilter *self )
 {
     dbg(DBG_FILTER, "color_conv filter constructor\n");
-    add_conv (self, CAM_PIXEL_FORMAT_GRAY, CAM_PIXEL_FORMAT_RGB,  gray_to_rgb);
+    add_conv (self, CAM_PIXEL_FORMAT_GRAY, CAM_PIXEL_FORMAT_RGB,  gray_to_rgb,
+            cam_pixel_convert_8u_gray_to_8u_RGB, 0.6);
 //    add_conv (self, CAM_PIXEL_FORMAT_GRAY, CAM_PIXEL_FORMAT_FLOAT_GRAY32, 
 //            gray_8u_to_32f);
-    add_conv (self, CAM_PIXEL_FORMAT_RGB,  CAM_PIXEL_FORMAT_GRAY, rgb_to_gray);
-    add_conv (self, CAM_PIXEL_FORMAT_RGB,  CAM_PIXEL_FORMAT_BGRA, rgb_to_bgra);
-    add_conv (self, CAM_PIXEL_FORMAT_RGB,  CAM_PIXEL_FORMAT_BGR, rgb_to_bgr);
-
-    add_conv (self, CAM_PIXEL_FORMAT_I420, CAM_PIXEL_FORMAT_RGB,  yuv420p_to_rgb);
-    add_conv (self, CAM_PIXEL_FORMAT_I420, CAM_PIXEL_FORMAT_RGBA, yuv420p_to_rgba);
-    add_conv (self, CAM_PIXEL_FORMAT_I420, CAM_PIXEL_FORMAT_BGR,  yuv420p_to_bgr);
-    add_conv (self, CAM_PIXEL_FORMAT_I420, CAM_PIXEL_FORMAT_BGRA, yuv420p_to_bgra);
-    add_conv (self, CAM_PIXEL_FORMAT_I420, CAM_PIXEL_FORMAT_GRAY, yuv420p_to_gray);
+    add_conv (self, CAM_PIXEL_FORMAT_RGB,  CAM_PIXEL_FORMAT_GRAY, rgb_to_gray,
+            cam_pixel_convert_8u_rgb_to_8u_gray, 2.2);
+    add_conv (self, CAM_PIXEL_FORMAT_RGB,  CAM_PIXEL_FORMAT_BGRA, rgb_to_bgra,
+            cam_pixel_convert_8u_rgb_to_8u_bgra, 0.77);
+    add_conv (self, CAM_PIXEL_FORMAT_RGB,  CAM_PIXEL_FORMAT_BGR, rgb_to_bgr,
+            cam_pixel_convert_8u_rgb_to_8u_bgr, 0.77);
+
+    add_conv (self, CAM_PIXEL_FORMAT_I420, CAM_PIXEL_FORMAT_RGB,  yuv420p_to_rgb,
+            NULL, 1.8);
+    add_conv (self, CAM_PIXEL_FORMAT_I420, CAM_PIXEL_FORMAT_RGBA, yuv420p_to_rgba,
+            NULL, 1.8);
+    add_conv (self, CAM_PIXEL_FORMAT_I420, CAM_PIXEL_FORMAT_BGR,  yuv420p_to_bgr,
+            NULL, 1.8);
+    add_conv (self, CAM_PIXEL_FORMAT_I420, CAM_PIXEL_FORMAT_BGRA, yuv420p_to_bgra,
+            NULL, 1.8);
+    add_conv (self, CAM_PIXEL_FORMAT_I420, CAM_PIXEL_FORMAT_GRAY, yuv420p_to_gray,
+            cam_pixel_convert_8u_yuv420p_to_8u_gray, 0.1);
 //    add_conv (self, CAM_PIXEL_FORMAT_YV12, CAM_PIXEL_FORMAT_GRAY, yuv420p_to_gray);
+    add_conv (self, CAM_PIXEL_FORMAT_NV12, CAM_PIXEL_FORMAT_I420,
+            nv12_to_yuv420p, NULL, 0.3);
+    /* direct, so that the common outputs skip the intermediate I420 frame */
+    add_conv (self, CAM_PIXEL_FORMAT_NV12, CAM_PIXEL_FORMAT_RGB, nv12_to_rgb,
+            NULL, 1.8);
+    add_conv (self, CAM_PIXEL_FORMAT_NV12, CAM_PIXEL_FORMAT_BGR, nv12_to_bgr,
+            NULL, 1.8);
+    add_conv (self, CAM_PIXEL_FORMAT_NV12, CAM_PIXEL_FORMAT_BGRA, nv12_to_bgra,
+            NULL, 1.8);
+    /* the luma plane of NV12 is laid out as in I420 */
+    add_conv (self, CAM_PIXEL_FORMAT_NV12, CAM_PIXEL_FORMAT_GRAY,
+            yuv420p_to_gray, cam_pixel_convert_8u_yuv420p_to_8u_gray, 0.1);
+
+    add_conv (self, CAM_PIXEL_FORMAT_YUYV, CAM_PIXEL_FORMAT_BGRA, yuyv_to_bgra,
+            cam_pixel_convert_8u_yuyv_to_8u_bgra, 2.1);
+    add_conv (self, CAM_PIXEL_FORMAT_YUYV, CAM_PIXEL_FORMAT_GRAY, yuyv_to_gray,
+            cam_pixel_convert_8u_yuyv_to_8u_gray, 0.38);
+    add_conv (self, CAM_PIXEL_FORMAT_YUYV, CAM_PIXEL_FORMAT_RGB, yuyv_to_rgb,
+            cam_pixel_convert_8u_yuyv_to_8u_rgb, 2.4);
+
+    add_conv (self, CAM_PIXEL_FORMAT_UYVY, CAM_PIXEL_FORMAT_BGRA, uyvy_to_bgra,
+            cam_pixel_convert_8u_uyvy_to_8u_bgra, 2.1);
+    add_conv (self, CAM_PIXEL_FORMAT_UYVY, CAM_PIXEL_FORMAT_GRAY, uyvy_to_gray,
+            cam_pixel_convert_8u_uyvy_to_8u_gray, 0.38);
+    add_conv (self, CAM_PIXEL_FORMAT_UYVY, CAM_PIXEL_FORMAT_RGB, uyvy_to_rgb,
+            cam_pixel_convert_8u_uyvy_to_8u_rgb, 2.4);
+
+    add_conv (self, CAM_PIXEL_FORMAT_IYU1, CAM_PIXEL_FORMAT_BGRA, iyu1_to_bgra,
+            cam_pixel_convert_8u_iyu1_to_8u_bgra, 2.0);
+    add_conv (self, CAM_PIXEL_FORMAT_IYU1, CAM_PIXEL_FORMAT_GRAY, iyu1_to_gray,
+            cam_pixel_convert_8u_iyu1_to_8u_gray, 0.4);
+    add_conv (self, CAM_PIXEL_FORMAT_IYU1, CAM_PIXEL_FORMAT_RGB, iyu1_to_rgb,
+            cam_pixel_convert_8u_iyu1_to_8u_rgb, 2.0);
+
+    add_conv (self, CAM_PIXEL_FORMAT_BGRA, CAM_PIXEL_FORMAT_RGB, bgra_to_rgb,
+            cam_pixel_convert_8u_bgra_to_8u_rgb, 0.77);
+    add_conv (self, CAM_PIXEL_FORMAT_BGRA, CAM_PIXEL_FORMAT_BGR, bgra_to_bgr,
+            cam_pixel_convert_8u_bgra_to_8u_bgr, 0.77);
+    add_conv (self, CAM_PIXEL_FORMAT_BGR, CAM_PIXEL_FORMAT_RGB, bgr_to_rgb,
+            cam_pixel_convert_8u_bgr_to_8u_rgb, 0.77);
+
+    /* byte order swaps, in both directions */
+    static const CamPixelFormat be_le_16u[][2] = {
+        { CAM_PIXEL_FORMAT_BE_GRAY16, CAM_PIXEL_FORMAT_LE_GRAY16 },
+        { CAM_PIXEL_FORMAT_BE_RGB16, CAM_PIXEL_FORMAT_LE_RGB16 },
+        { CAM_PIXEL_FORMAT_BE_BAYER16_GBRG, CAM_PIXEL_FORMAT_LE_BAYER16_GBRG },
+        { CAM_PIXEL_FORMAT_BE_BAYER16_GRBG, CAM_PIXEL_FORMAT_LE_BAYER16_GRBG },
+        { CAM_PIXEL_FORMAT_BE_BAYER16_BGGR, CAM_PIXEL_FORMAT_LE_BAYER16_BGGR },
+        { CAM_PIXEL_FORMAT_BE_BAYER16_RGGB, CAM_PIXEL_FORMAT_LE_BAYER16_RGGB },
+    };
+    for (int i = 0; i < G_N_ELEMENTS (be_le_16u); i++) {
+        int rgb = be_le_16u[i][0] == CAM_PIXEL_FORMAT_BE_RGB16;
+        cc_func_t func = rgb ? rgb_16u_swap : gray_16u_swap;
+        pixel_func_t pixel_func = rgb ? swap_rgb_16u : swap_gray_16u;
+        add_conv (self, be_le_16u[i][0], be_le_16u[i][1], func, pixel_func,
+                0.2);
+        add_conv (self, be_le_16u[i][1], be_le_16u[i][0], func, pixel_func,
+                0.2);
+    }
 
-    add_conv (self, CAM_PIXEL_FORMAT_YUYV, CAM_PIXEL_FORMAT_BGRA, yuyv_to_bgra);
-    add_conv (self, CAM_PIXEL_FORMAT_YUYV, CAM_PIXEL_FORMAT_GRAY, yuyv_to_gray);
-    add_conv (self, CAM_PIXEL_FORMAT_YUYV, CAM_PIXEL_FORMAT_RGB, yuyv_to_rgb);
-
-    add_conv (self, CAM_PIXEL_FORMAT_UYVY, CAM_PIXEL_FORMAT_BGRA, uyvy_to_bgra);
-    add_conv (self, CAM_PIXEL_FORMAT_UYVY, CAM_PIXEL_FORMAT_GRAY, uyvy_to_gray);
-    add_conv (self, CAM_PIXEL_FORMAT_UYVY, CAM_PIXEL_FORMAT_RGB, uyvy_to_rgb);
-
-    add_conv (self, CAM_PIXEL_FORMAT_IYU1, CAM_PIXEL_FORMAT_BGRA, iyu1_to_bgra);
-    add_conv (self, CAM_PIXEL_FORMAT_IYU1, CAM_PIXEL_FORMAT_GRAY, iyu1_to_gray);
-    add_conv (self, CAM_PIXEL_FORMAT_IYU1, CAM_PIXEL_FORMAT_RGB, iyu1_to_rgb);
-
-    add_conv (self, CAM_PIXEL_FORMAT_BGRA, CAM_PIXEL_FORMAT_RGB, bgra_to_rgb);
-    add_conv (self, CAM_PIXEL_FORMAT_BGRA, CAM_PIXEL_FORMAT_BGR, bgra_to_bgr);
-    add_conv (self, CAM_PIXEL_FORMAT_BGR, CAM_PIXEL_FORMAT_RGB, bgr_to_rgb);
-
-    self->cc_func = NULL;
+    /* bit depth changes.  These depend on the controls, so they can't be
+     * split into bands by convert_band() */
+    static const CamPixelFormat depth_16u_8u[][2] = {
+        { CAM_PIXEL_FORMAT_BE_GRAY16, CAM_PIXEL_FORMAT_GRAY },
+        { CAM_PIXEL_FORMAT_LE_GRAY16, CAM_PIXEL_FORMAT_GRAY },
+        { CAM_PIXEL_FORMAT_BE_RGB16, CAM_PIXEL_FORMAT_RGB },
+        { CAM_PIXEL_FORMAT_LE_RGB16, CAM_PIXEL_FORMAT_RGB },
+        { CAM_PIXEL_FORMAT_BE_BAYER16_GBRG, CAM_PIXEL_FORMAT_BAYER_GBRG },
+        { CAM_PIXEL_FORMAT_LE_BAYER16_GBRG, CAM_PIXEL_FORMAT_BAYER_GBRG },
+        { CAM_PIXEL_FORMAT_BE_BAYER16_GRBG, CAM_PIXEL_FORMAT_BAYER_GRBG },
+        { CAM_PIXEL_FORMAT_LE_BAYER16_GRBG, CAM_PIXEL_FORMAT_BAYER_GRBG },
+        { CAM_PIXEL_FORMAT_BE_BAYER16_BGGR, CAM_PIXEL_FORMAT_BAYER_BGGR },
+        { CAM_PIXEL_FORMAT_LE_BAYER16_BGGR, CAM_PIXEL_FORMAT_BAYER_BGGR },
+        { CAM_PIXEL_FORMAT_BE_BAYER16_RGGB, CAM_PIXEL_FORMAT_BAYER_RGGB },
+        { CAM_PIXEL_FORMAT_LE_BAYER16_RGGB, CAM_PIXEL_FORMAT_BAYER_RGGB },
+    };
+    for (int i = 0; i < G_N_ELEMENTS (depth_16u_8u); i++)
+        add_conv (self, depth_16u_8u[i][0], depth_16u_8u[i][1],
+                depth_16u_to_8u, NULL, 0.18);
+    add_conv (self, CAM_PIXEL_FORMAT_GRAY, CAM_PIXEL_FORMAT_LE_GRAY16,
+            depth_8u_to_16u, NULL, 0.15);
+    add_conv (self, CAM_PIXEL_FORMAT_RGB, CAM_PIXEL_FORMAT_LE_RGB16,
+            depth_8u_to_16u, NULL, 0.15);
+
+    CamUnit *super = CAM_UNIT (self);
+    self->threads_ctl = cam_unit_add_control_int (super, "threads",
+            "Threads", 1, 64, 1, 1, 1);
+    self->shift_ctl = cam_unit_add_control_int (super, "shift",
+            "Bit Shift", 0, 8, 1, 8, 0);
+    self->window_ctl = cam_unit_add_control_boolean (super, "window",
+            "Window/Level", 0, 0);
+    self->window_low_ctl = cam_unit_add_control_int (super, "window-low",
+            "Window Low", 0, 65535, 1, 0, 0);
+    self->window_high_ctl = cam_unit_add_control_int (super, "window-high",
+            "Window High", 0, 65535, 1, 65535, 0);
 
     g_signal_connect( G_OBJECT(self), "input-format-changed",
             G_CALLBACK(on_input_format_changed), NULL );
@@ -186,6 +659,10 @@ cam_color_conversion_filter_class_init( CamColorConversionFilterClass *klass )
     klass->parent_class.on_input_frame_ready = on_input_frame_ready;
     klass->parent_class.stream_init = 
         cam_color_conversion_filter_stream_init;
+    klass->parent_class.stream_shutdown =
+        cam_color_conversion_filter_stream_shutdown;
+    klass->parent_class.try_set_control =
+        cam_color_conversion_filter_try_set_control;
 }
 
 CamColorConversionFilter * 
@@ -195,17 +672,32 @@ cam_color_conversion_filter_new()
             g_object_new(cam_color_conversion_filter_get_type(), NULL));
 }
 
+static void
+release_intermediates (CamColorConversionFilter *self)
+{
+    for (int i = 0; i < MAX_HOPS - 1; i++) {
+        if (self->mid_fmts[i])
+            g_object_unref (self->mid_fmts[i]);
+        if (self->mid_bufs[i])
+            g_object_unref (self->mid_bufs[i]);
+        self->mid_fmts[i] = NULL;
+        self->mid_bufs[i] = NULL;
+    }
+    memset (&self->plan, 0, sizeof (self->plan));
+}
+
 static void
 cam_color_conversion_filter_finalize (GObject * obj)
 {
     dbg (DBG_INPUT, "color conversion finalize\n");
     CamColorConversionFilter *self = (CamColorConversionFilter*)obj;
+    release_intermediates (self);
+    free_plans (self);
     for (GList *citer=self->conversions; citer; citer=citer->next) {
         free (citer->data);
     }
     g_list_free (self->conversions);
     self->conversions = NULL;
-    self->cc_func = 0;
 
     G_OBJECT_CLASS (cam_color_conversion_filter_parent_class)->finalize (obj);
 }
@@ -219,17 +711,36 @@ cam_color_conversion_filter_stream_init (CamUnit * super,
 
     CamUnit *input = cam_unit_get_input(super);
     const CamUnitFormat *infmt = cam_unit_get_output_format(input);
-    for (GList *citer=self->conversions; citer; citer=citer->next) {
-        conv_info_t *ci = (conv_info_t*) citer->data;
-        if (ci->inpfmt  == infmt->pixelformat &&
-            ci->outpfmt == outfmt->pixelformat) {
-            self->cc_func = ci->func;
-            return 0;
-        }
+    conv_plan_t *plan = find_plan (self->plans, outfmt->pixelformat);
+    if (!plan || plan->hops[0]->inpfmt != infmt->pixelformat) {
+        dbg (DBG_INPUT, 
+                "ColorConversion couldn't find appropriate conversion function\n");
+        return -1;
     }
-    dbg (DBG_INPUT, 
-            "ColorConversion couldn't find appropriate conversion function\n");
-    return -1;
+
+    release_intermediates (self);
+    self->plan = *plan;
+    int max_stride = 0;
+    for (int i = 0; i < plan->nhops - 1; i++) {
+        CamPixelFormat pfmt = plan->hops[i]->outpfmt;
+        int stride = default_stride (pfmt, outfmt->width);
+        self->mid_fmts[i] = cam_unit_format_new (pfmt, NULL, outfmt->width,
+                outfmt->height, stride);
+        if (plan->hops[i]->pixel_func && plan->hops[i+1]->pixel_func)
+            max_stride = MAX (max_stride, stride);
+        else
+            self->mid_bufs[i] =
+                cam_framebuffer_new_alloc (frame_size (self->mid_fmts[i]));
+    }
+    self->strip_rows = max_stride ? MAX (1, STRIP_BYTES / max_stride) : 0;
+    return 0;
+}
+
+static int
+cam_color_conversion_filter_stream_shutdown (CamUnit * super)
+{
+    release_intermediates ((CamColorConversionFilter*)super);
+    return 0;
 }
 
 static void 
@@ -239,13 +750,77 @@ on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
     CamColorConversionFilter * self = (CamColorConversionFilter*)super;
     dbg(DBG_FILTER, "[%s] iterate\n", cam_unit_get_name(super));
 
-    if (!self->cc_func) return;
+    int nhops = self->plan.nhops;
+    if (!nhops) return;
 
     const CamUnitFormat *outfmt = cam_unit_get_output_format(super);
-    int out_buf_size = outfmt->height * outfmt->row_stride;
+    int out_buf_size = frame_size (outfmt);
     CamFrameBuffer *outbuf = cam_framebuffer_new_alloc (out_buf_size);
 
-    int status = self->cc_func (self, infmt, inbuf, outfmt, outbuf);
+    int status = 0;
+    int nthreads = cam_unit_control_get_int (self->threads_ctl);
+    const CamUnitFormat *srcfmt = infmt;
+    const CamFrameBuffer *srcbuf = inbuf;
+    int sstride = infmt->row_stride ? infmt->row_stride :
+        default_stride (infmt->pixelformat, infmt->width);
+    int first = 0;
+    for (int i = 0; i < nhops && 0 == status; i++) {
+        /* run conversions up to the next intermediate that isn't fused
+         * into bands */
+        if (i < nhops - 1 && !self->mid_bufs[i])
+            continue;
+        conv_info_t *ci = self->plan.hops[i];
+        const CamUnitFormat *dstfmt = outfmt;
+        CamFrameBuffer *dstbuf = outbuf;
+        if (i < nhops - 1) {
+            dstfmt = self->mid_fmts[i];
+            dstbuf = self->mid_bufs[i];
+        }
+
+        if (i > first) {
+            chain_args_t args = {
+                .plan = &self->plan,
+                .first = first,
+                .last = i,
+                .dest = dstbuf->data,
+                .dstride = dstfmt->row_stride,
+                .width = outfmt->width,
+                .src = srcbuf->data,
+                .sstride = sstride,
+                .strip_rows = self->strip_rows,
+                .status = 0,
+            };
+            int max_stride = 0;
+            for (int j = first; j < i; j++) {
+                args.mid_strides[j] = self->mid_fmts[j]->row_stride;
+                max_stride = MAX (max_stride, args.mid_strides[j]);
+            }
+            args.scratch_size = self->strip_rows * max_stride;
+            cam_pixel_parallel_for (nthreads, outfmt->height, 1,
+                    args.dstride + args.sstride, convert_chain_band, &args);
+            status = args.status;
+        } else if (nthreads > 1 && ci->pixel_func) {
+            band_args_t args = {
+                .pixel_func = ci->pixel_func,
+                .dest = dstbuf->data,
+                .dstride = dstfmt->row_stride,
+                .width = outfmt->width,
+                .src = srcbuf->data,
+                .sstride = sstride,
+                .status = 0,
+            };
+            cam_pixel_parallel_for (nthreads, outfmt->height, 1,
+                    args.dstride + args.sstride, convert_band, &args);
+            status = args.status;
+        } else {
+            status = ci->func (self, srcfmt, srcbuf, dstfmt, dstbuf);
+        }
+
+        srcfmt = dstfmt;
+        srcbuf = dstbuf;
+        sstride = dstfmt->row_stride;
+        first = i + 1;
+    }
 
     if (0 == status) {
         cam_framebuffer_copy_metadata(outbuf, inbuf);
@@ -256,22 +831,71 @@ on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
     g_object_unref (outbuf);
 }
 
+/* The depth controls only apply to the 16 to 8-bit (shift or window) and
+ * 8 to 16-bit (shift) conversions */
+static void
+update_depth_controls (CamColorConversionFilter *self, int depth_16u_in,
+        int depth_8u_in, int window)
+{
+    cam_unit_control_set_enabled (self->shift_ctl,
+            depth_8u_in || (depth_16u_in && !window));
+    cam_unit_control_set_enabled (self->window_ctl, depth_16u_in);
+    cam_unit_control_set_enabled (self->window_low_ctl,
+            depth_16u_in && window);
+    cam_unit_control_set_enabled (self->window_high_ctl,
+            depth_16u_in && window);
+}
+
+/* whether any plan for the current input format uses @func */
+static int
+has_depth_conv (CamColorConversionFilter *self, cc_func_t func)
+{
+    for (GList *piter=self->plans; piter; piter=piter->next) {
+        conv_plan_t *plan = (conv_plan_t*) piter->data;
+        for (int i = 0; i < plan->nhops; i++)
+            if (plan->hops[i]->func == func)
+                return 1;
+    }
+    return 0;
+}
+
+static gboolean
+cam_color_conversion_filter_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual)
+{
+    CamColorConversionFilter *self = (CamColorConversionFilter*)super;
+    if (ctl == self->window_ctl) {
+        update_depth_controls (self,
+                has_depth_conv (self, depth_16u_to_8u),
+                has_depth_conv (self, depth_8u_to_16u),
+                g_value_get_boolean (proposed));
+    }
+    g_value_copy (proposed, actual);
+    return TRUE;
+}
+
 static void
 on_input_format_changed (CamUnit *super, const CamUnitFormat *infmt)
 {
     CamColorConversionFilter *self = (CamColorConversionFilter*)super;
     cam_unit_remove_all_output_formats (super);
+    free_plans (self);
+    if (infmt)
+        build_plans (self, infmt->pixelformat);
+    update_depth_controls (self,
+            has_depth_conv (self, depth_16u_to_8u),
+            has_depth_conv (self, depth_8u_to_16u),
+            cam_unit_control_get_boolean (self->window_ctl));
     if (!infmt) return;
 
-    for (GList *citer=self->conversions; citer; citer=citer->next) {
-        conv_info_t *ci = (conv_info_t*) citer->data;
-
-        if (ci->inpfmt == infmt->pixelformat) {
-            int stride = infmt->width * cam_pixel_format_bpp(ci->outpfmt) / 8;
-
-            cam_unit_add_output_format (super, ci->outpfmt,
-                    NULL, infmt->width, infmt->height, 
-                    stride);
-        }
+    /* the planned cost in ns per pixel is attached to each output format
+     * as "convert:cost", for units that choose between workers */
+    for (GList *piter=self->plans; piter; piter=piter->next) {
+        conv_plan_t *plan = (conv_plan_t*) piter->data;
+        CamUnitFormat *fmt = cam_unit_add_output_format (super,
+                plan->outpfmt, NULL, infmt->width, infmt->height,
+                default_stride (plan->outpfmt, infmt->width));
+        g_object_set_data_full (G_OBJECT (fmt), "convert:cost",
+                g_memdup (&plan->cost, sizeof (float)), g_free);
     }
 }
@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camunits/plugin.h"
+#include "camunits/dbg.h"
+
+#define err(args...) fprintf(stderr, args)
+
+typedef struct _CamCropFilter {
+    CamUnit parent;
+
+    CamUnitControl *x_ctl;
+    CamUnitControl *y_ctl;
+    CamUnitControl *width_ctl;
+    CamUnitControl *height_ctl;
+
+    int x;
+    int y;
+} CamCropFilter;
+
+typedef struct _CamCropFilterClass {
+    CamUnitClass parent_class;
+} CamCropFilterClass;
+
+static CamCropFilter * cam_crop_filter_new (void);
+
+GType cam_crop_filter_get_type (void);
+CAM_PLUGIN_TYPE(CamCropFilter, cam_crop_filter, CAM_TYPE_UNIT);
+
+/* These next two functions are required as entry points for the
+ * plug-in API. */
+void cam_plugin_initialize(GTypeModule * module);
+void cam_plugin_initialize(GTypeModule * module)
+{
+    cam_crop_filter_register_type(module);
+}
+
+CamUnitDriver * cam_plugin_create(GTypeModule * module);
+CamUnitDriver * cam_plugin_create(GTypeModule * module)
+{
+    return cam_unit_driver_new_stock_full ( "convert", "crop",
+            "Crop", 0,
+            (CamUnitConstructor)cam_crop_filter_new, module);
+}
+
+// ============== CamCropFilter ===============
+static void on_input_frame_ready (CamUnit * super, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *infmt);
+static void on_input_format_changed (CamUnit *super,
+        const CamUnitFormat *infmt);
+static gboolean cam_crop_filter_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual);
+
+/* Determines the pixel alignment a crop rectangle needs to keep the
+ * layout of a format intact, e.g. even offsets so that a bayer tiling
+ * doesn't change.  Returns 0 if a format can't be cropped by offsetting
+ * a pointer (compressed or planar formats). */
+static int
+crop_alignment (CamPixelFormat pfmt, int *xalign, int *yalign)
+{
+    if (!cam_pixel_format_stride_meaningful (pfmt))
+        return 0;
+
+    *xalign = 1;
+    *yalign = 1;
+    switch (pfmt) {
+        case CAM_PIXEL_FORMAT_YUV420:
+        case CAM_PIXEL_FORMAT_YUV411P:
+        case CAM_PIXEL_FORMAT_I420:
+        case CAM_PIXEL_FORMAT_NV12:
+        case CAM_PIXEL_FORMAT_ANY:
+            return 0;
+        case CAM_PIXEL_FORMAT_UYVY:
+        case CAM_PIXEL_FORMAT_YUYV:
+            *xalign = 2;
+            break;
+        case CAM_PIXEL_FORMAT_IYU1:
+            *xalign = 4;
+            break;
+        case CAM_PIXEL_FORMAT_BAYER_BGGR:
+        case CAM_PIXEL_FORMAT_BAYER_GBRG:
+        case CAM_PIXEL_FORMAT_BAYER_GRBG:
+        case CAM_PIXEL_FORMAT_BAYER_RGGB:
+        case CAM_PIXEL_FORMAT_BE_BAYER16_BGGR:
+        case CAM_PIXEL_FORMAT_BE_BAYER16_GBRG:
+        case CAM_PIXEL_FORMAT_BE_BAYER16_GRBG:
+        case CAM_PIXEL_FORMAT_BE_BAYER16_RGGB:
+        case CAM_PIXEL_FORMAT_LE_BAYER16_BGGR:
+        case CAM_PIXEL_FORMAT_LE_BAYER16_GBRG:
+        case CAM_PIXEL_FORMAT_LE_BAYER16_GRBG:
+        case CAM_PIXEL_FORMAT_LE_BAYER16_RGGB:
+            *xalign = 2;
+            *yalign = 2;
+            break;
+        /* packed samples come in groups of 4 or 2 sharing a byte */
+        case CAM_PIXEL_FORMAT_GRAY10P:
+            *xalign = 4;
+            break;
+        case CAM_PIXEL_FORMAT_GRAY12P:
+            *xalign = 2;
+            break;
+        case CAM_PIXEL_FORMAT_BAYER10P_BGGR:
+        case CAM_PIXEL_FORMAT_BAYER10P_GBRG:
+        case CAM_PIXEL_FORMAT_BAYER10P_GRBG:
+        case CAM_PIXEL_FORMAT_BAYER10P_RGGB:
+            *xalign = 4;
+            *yalign = 2;
+            break;
+        case CAM_PIXEL_FORMAT_BAYER12P_BGGR:
+        case CAM_PIXEL_FORMAT_BAYER12P_GBRG:
+        case CAM_PIXEL_FORMAT_BAYER12P_GRBG:
+        case CAM_PIXEL_FORMAT_BAYER12P_RGGB:
+            *xalign = 2;
+            *yalign = 2;
+            break;
+        default:
+            break;
+    }
+    return cam_pixel_format_bpp (pfmt) > 0;
+}
+
+static void
+cam_crop_filter_init (CamCropFilter *self)
+{
+    dbg(DBG_FILTER, "crop filter constructor\n");
+    CamUnit *super = CAM_UNIT (self);
+
+    self->x_ctl = cam_unit_add_control_int (super, "x",
+            "X", 0, 16384, 1, 0, 1);
+    self->y_ctl = cam_unit_add_control_int (super, "y",
+            "Y", 0, 16384, 1, 0, 1);
+    self->width_ctl = cam_unit_add_control_int (super, "width",
+            "Width", 0, 16384, 1, 0, 1);
+    self->height_ctl = cam_unit_add_control_int (super, "height",
+            "Height", 0, 16384, 1, 0, 1);
+    cam_unit_control_set_ui_hints (self->x_ctl, CAM_UNIT_CONTROL_SPINBUTTON);
+    cam_unit_control_set_ui_hints (self->y_ctl, CAM_UNIT_CONTROL_SPINBUTTON);
+    cam_unit_control_set_ui_hints (self->width_ctl,
+            CAM_UNIT_CONTROL_SPINBUTTON);
+    cam_unit_control_set_ui_hints (self->height_ctl,
+            CAM_UNIT_CONTROL_SPINBUTTON);
+
+    self->x = 0;
+    self->y = 0;
+
+    g_signal_connect (G_OBJECT (self), "input-format-changed",
+            G_CALLBACK (on_input_format_changed), self);
+}
+
+static void
+cam_crop_filter_class_init (CamCropFilterClass *klass)
+{
+    dbg(DBG_FILTER, "crop filter class initializer\n");
+    klass->parent_class.on_input_frame_ready = on_input_frame_ready;
+    klass->parent_class.try_set_control = cam_crop_filter_try_set_control;
+}
+
+CamCropFilter *
+cam_crop_filter_new()
+{
+    return (CamCropFilter*)
+            g_object_new(cam_crop_filter_get_type(), NULL);
+}
+
+/* Clips the requested rectangle to the input image and rounds it to the
+ * alignment of the format, then offers it as the only output format.  The
+ * output keeps the row stride of the input, since frames are views into
+ * the input buffers. */
+static void
+update_output_formats (CamCropFilter *self, const CamUnitFormat *infmt,
+        int x, int y, int width, int height)
+{
+    CamUnit *super = CAM_UNIT (self);
+    cam_unit_remove_all_output_formats (super);
+
+    int xalign, yalign;
+    if (!infmt || !crop_alignment (infmt->pixelformat, &xalign, &yalign))
+        return;
+
+    /* clamp before rounding down, so that the offset stays aligned even
+     * when the input size is not a multiple of the alignment */
+    if (x > infmt->width - xalign) x = infmt->width - xalign;
+    if (y > infmt->height - yalign) y = infmt->height - yalign;
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    x -= x % xalign;
+    y -= y % yalign;
+
+    if (!width || width > infmt->width - x) width = infmt->width - x;
+    if (!height || height > infmt->height - y) height = infmt->height - y;
+    width -= width % xalign;
+    height -= height % yalign;
+    if (width < xalign || height < yalign)
+        return;
+
+    self->x = x;
+    self->y = y;
+
+    int stride = infmt->row_stride ? infmt->row_stride :
+        infmt->width * cam_pixel_format_bpp (infmt->pixelformat) / 8;
+    cam_unit_add_output_format (super, infmt->pixelformat, NULL,
+            width, height, stride);
+}
+
+static void
+on_input_format_changed (CamUnit *super, const CamUnitFormat *infmt)
+{
+    CamCropFilter *self = (CamCropFilter*) super;
+    update_output_formats (self, infmt,
+            cam_unit_control_get_int (self->x_ctl),
+            cam_unit_control_get_int (self->y_ctl),
+            cam_unit_control_get_int (self->width_ctl),
+            cam_unit_control_get_int (self->height_ctl));
+}
+
+static gboolean
+cam_crop_filter_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual)
+{
+    CamCropFilter *self = (CamCropFilter*) super;
+
+    int x = cam_unit_control_get_int (self->x_ctl);
+    int y = cam_unit_control_get_int (self->y_ctl);
+    int width = cam_unit_control_get_int (self->width_ctl);
+    int height = cam_unit_control_get_int (self->height_ctl);
+    if (ctl == self->x_ctl)
+        x = g_value_get_int (proposed);
+    else if (ctl == self->y_ctl)
+        y = g_value_get_int (proposed);
+    else if (ctl == self->width_ctl)
+        width = g_value_get_int (proposed);
+    else if (ctl == self->height_ctl)
+        height = g_value_get_int (proposed);
+    else
+        return FALSE;
+
+    /* the output format changes, so restart the stream.  This also
+     * restarts any units downstream. */
+    int streaming = cam_unit_is_streaming (super);
+    if (streaming)
+        cam_unit_stream_shutdown (super);
+
+    CamUnit *input = cam_unit_get_input (super);
+    update_output_formats (self,
+            input ? cam_unit_get_output_format (input) : NULL,
+            x, y, width, height);
+
+    if (streaming)
+        cam_unit_stream_init (super, NULL);
+
+    g_value_copy (proposed, actual);
+    return TRUE;
+}
+
+static void
+on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *infmt)
+{
+    CamCropFilter * self = (CamCropFilter*) super;
+    dbg(DBG_FILTER, "[%s] iterate\n", cam_unit_get_name(super));
+
+    const CamUnitFormat *outfmt = cam_unit_get_output_format(super);
+    if (!outfmt) return;
+
+    int bpp = cam_pixel_format_bpp (outfmt->pixelformat);
+    int offset = self->y * outfmt->row_stride + self->x * bpp / 8;
+
+    /* the view ends at the last byte of the last row, not at a full
+     * stride, so that it never reaches past the end of the input */
+    int length = (outfmt->height - 1) * outfmt->row_stride +
+        (outfmt->width * bpp + 7) / 8;
+
+    CamFrameBuffer *outbuf = cam_framebuffer_new_view (
+            (CamFrameBuffer*) inbuf, offset, length);
+    if (!outbuf) return;
+
+    cam_framebuffer_copy_metadata(outbuf, inbuf);
+    outbuf->bytesused = length;
+
+    cam_unit_produce_frame (super, outbuf, outfmt);
+    g_object_unref (outbuf);
+}
@@ -1,6 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <jpeglib.h>
 #include <jerror.h>
 #include <setjmp.h>
@@ -10,13 +13,84 @@
 
 #define err(args...) fprintf(stderr, args)
 
-typedef struct _CamConvertJpegCompress {
+typedef struct _CamConvertJpegCompress CamConvertJpegCompress;
+
+/* A compressor, kept for the whole stream so that its tables are only
+ * rebuilt when the quality changes.  Each encoder thread has its own. */
+typedef struct _jpeg_encoder_t jpeg_encoder_t;
+struct _jpeg_encoder_t {
+    CamConvertJpegCompress * unit;
+    GThread * thread;
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    struct jpeg_destination_mgr jdest;
+    CamFrameBuffer * outbuf;
+    int quality;
+    JSAMPROW * rows;
+    uint8_t * rgb_rows;
+
+    /* YUV input is fed to libjpeg as raw downsampled data, one iMCU row at
+     * a time.  raw_buf holds the rows that can't be read in place. */
+    CamPixelFormat pixelformat;
+    uint8_t * raw_buf;
+    int raw_width;
+    int raw_direct;
+
+    /* the rows of the frame that this compressor encodes */
+    int first_row;
+    int frame_height;
+
+    /* if the frame is split into horizontal slices, a compressor for each
+     * slice, with a buffer for each compressed slice */
+    jpeg_encoder_t * slices;
+    int nslices;
+    int slice_rows;
+    int restart_interval;
+    CamFrameBuffer ** slice_bufs;
+    int * slice_data;
+};
+
+/* A frame handed to an encoder thread.  The input is copied, since the
+ * upstream unit may reuse its buffer as soon as it has emitted it. */
+typedef struct _encode_job_t {
+    CamFrameBuffer * inbuf;
+    CamFrameBuffer * outbuf;
+    int stride;
+    int quality;
+    int done;
+} encode_job_t;
+
+struct _CamConvertJpegCompress {
     CamUnit parent;
     
     /*< private >*/
     CamUnitControl * quality_control;
+    CamUnitControl * threads_control;
+    CamUnitControl * slices_control;
     CamFrameBuffer * outbuf;
-} CamConvertJpegCompress;
+
+    jpeg_encoder_t * encoders;
+    int nencoders;
+    int nslices;
+
+    /* recent compressed frame size, decaying slowly after a large frame.
+     * Output buffers are sized from it. */
+    int size_estimate;
+
+    /* with more than one encoder, a ring of the frames in flight, oldest
+     * first.  Finished frames are emitted in input order. */
+    GAsyncQueue * job_q;
+    encode_job_t * jobs;
+    int job_head;
+    int njobs;
+    GMutex * done_mutex;
+    GCond * done_cond;
+
+    /* an encoder thread writes a byte to this pipe for each frame it
+     * finishes, so that the chain calls try_produce_frame to emit it
+     * without waiting for the next input frame */
+    int notify_fds[2];
+};
 
 typedef struct _CamConvertJpegCompressClass {
     CamUnitClass parent_class;
@@ -40,24 +114,29 @@ CamUnitDriver * cam_plugin_create(GTypeModule * module);
 CamUnitDriver * cam_plugin_create(GTypeModule * module)
 {
     return cam_unit_driver_new_stock_full ("convert", "jpeg_compress",
-            "JPEG Compress", 0,
+            "JPEG Compress", CAM_UNIT_EVENT_METHOD_FD,
             (CamUnitConstructor)cam_convert_jpeg_compress_new, module);
 }
 
-static int _jpeg_compress_8u_gray (const uint8_t * src, int width, int height, 
-        int stride, uint8_t * dest, int * destsize, int quality);
-static int _jpeg_compress_8u_rgb (const uint8_t * src, int width, int height, 
-        int stride, uint8_t * dest, int * destsize, int quality);
-static int _jpeg_compress_8u_bgra (const uint8_t * src, int width, int height, 
-        int stride, uint8_t * dest, int * destsize, int quality);
+static int _encoder_init (jpeg_encoder_t * enc, CamPixelFormat pfmt,
+        int width, int height, int quality, int nslices);
+static void _encoder_destroy (jpeg_encoder_t * enc);
+static int _compress (jpeg_encoder_t * enc, const uint8_t * src,
+        int stride, int quality, CamFrameBuffer ** dest);
 
 // ============== CamConvertJpegCompress ===============
+static void cam_convert_jpeg_compress_finalize (GObject *obj);
+static gboolean _try_produce_frame (CamUnit * super);
+static int _get_fileno (CamUnit * super);
 static void on_input_frame_ready (CamUnit * super, const CamFrameBuffer *inbuf,
         const CamUnitFormat *infmt);
 static void on_input_format_changed (CamUnit *super, 
         const CamUnitFormat *infmt);
 static int _stream_init (CamUnit * super, const CamUnitFormat * format);
 static int _stream_shutdown (CamUnit * super);
+static void * encoder_thread (void *user_data);
+
+static int ENCODER_THREAD_QUIT_REQUEST;
 
 static void
 cam_convert_jpeg_compress_init (CamConvertJpegCompress *self)
@@ -68,16 +147,44 @@ cam_convert_jpeg_compress_init (CamConvertJpegCompress *self)
 
     self->quality_control = cam_unit_add_control_int (super, "quality", 
             "Quality", 1, 100, 1, 94, 1);
+    self->threads_control = cam_unit_add_control_int (super, "threads",
+            "Encoder Threads", 1, 16, 1, 1, 1);
+    self->slices_control = cam_unit_add_control_int (super, "slices",
+            "Slices", 1, 16, 1, 1, 1);
     g_signal_connect (G_OBJECT(self), "input-format-changed",
             G_CALLBACK(on_input_format_changed), NULL);
+
+    if (0 != pipe (self->notify_fds)) {
+        perror ("pipe");
+        self->notify_fds[0] = self->notify_fds[1] = -1;
+    } else {
+        fcntl (self->notify_fds[0], F_SETFL, O_NONBLOCK);
+        fcntl (self->notify_fds[1], F_SETFL, O_NONBLOCK);
+    }
 }
 
 static void
 cam_convert_jpeg_compress_class_init (CamConvertJpegCompressClass *klass)
 {
+    GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+    gobject_class->finalize = cam_convert_jpeg_compress_finalize;
     klass->parent_class.on_input_frame_ready = on_input_frame_ready;
     klass->parent_class.stream_init = _stream_init;
     klass->parent_class.stream_shutdown = _stream_shutdown;
+    klass->parent_class.try_produce_frame = _try_produce_frame;
+    klass->parent_class.get_fileno = _get_fileno;
+    if (!g_thread_supported ()) g_thread_init (NULL);
+}
+
+static void
+cam_convert_jpeg_compress_finalize (GObject *obj)
+{
+    CamConvertJpegCompress *self = (CamConvertJpegCompress*) obj;
+    if (self->notify_fds[0] >= 0) {
+        close (self->notify_fds[0]);
+        close (self->notify_fds[1]);
+    }
+    G_OBJECT_CLASS (cam_convert_jpeg_compress_parent_class)->finalize (obj);
 }
 
 CamConvertJpegCompress * 
@@ -87,23 +194,242 @@ cam_convert_jpeg_compress_new()
             g_object_new(cam_convert_jpeg_compress_get_type(), NULL));
 }
 
+/* size in bytes of a frame, including any chroma planes */
+static int
+_frame_size (const CamUnitFormat * fmt)
+{
+    if (fmt->pixelformat == CAM_PIXEL_FORMAT_I420 ||
+        fmt->pixelformat == CAM_PIXEL_FORMAT_NV12)
+        return fmt->row_stride * fmt->height * 3 / 2;
+    return fmt->row_stride * fmt->height;
+}
+
+static void
+_copy_rows (uint8_t * dest, const uint8_t * src, int stride, int row_bytes,
+        int rows)
+{
+    for (int i = 0; i < rows; i++)
+        memcpy (dest + i * stride, src + i * stride, row_bytes);
+}
+
+/* Copies the pixels of a frame to a buffer of _frame_size() bytes with the
+ * same layout.  Only the bytes of each row that hold pixels are read,
+ * since the source may be a view that ends right after the last pixel. */
+static void
+_copy_frame (uint8_t * dest, const uint8_t * src, const CamUnitFormat * fmt)
+{
+    int stride = fmt->row_stride;
+    int height = fmt->height;
+    if (fmt->pixelformat == CAM_PIXEL_FORMAT_I420) {
+        // the U and V planes together are height rows of half the stride
+        _copy_rows (dest, src, stride, fmt->width, height);
+        _copy_rows (dest + height * stride, src + height * stride,
+                stride / 2, fmt->width / 2, height);
+    } else if (fmt->pixelformat == CAM_PIXEL_FORMAT_NV12) {
+        _copy_rows (dest, src, stride, fmt->width, height * 3 / 2);
+    } else {
+        _copy_rows (dest, src, stride, fmt->width *
+                cam_pixel_format_bpp (fmt->pixelformat) / 8, height);
+    }
+}
+
+/* smallest output buffer, which also leaves room for the JPEG headers */
+#define OUTBUF_MIN_SIZE 16384
+
+/* Makes @buf, which may be NULL, a buffer sized for the next compressed
+ * frame.  A buffer that turns out too small is grown while compressing,
+ * and one much larger than needed is released. */
+static void
+_fit_output (CamConvertJpegCompress *self, CamFrameBuffer **buf)
+{
+    int target = self->size_estimate + self->size_estimate / 2 +
+        OUTBUF_MIN_SIZE;
+    if (*buf && (*buf)->length >= target && (*buf)->length <= 2 * target)
+        return;
+    if (*buf)
+        g_object_unref (*buf);
+    *buf = cam_framebuffer_new_alloc (target);
+}
+
+static void
+_update_estimate (CamConvertJpegCompress *self, int size)
+{
+    if (size > self->size_estimate)
+        self->size_estimate = size;
+    else
+        self->size_estimate -= (self->size_estimate - size) / 16;
+}
+
+/* Emits finished frames in input order, first waiting until at most
+ * @max_pending frames are still in flight */
+static void
+_emit_finished_jobs (CamConvertJpegCompress *self, int max_pending)
+{
+    CamUnit *super = CAM_UNIT (self);
+    while (self->njobs > 0) {
+        encode_job_t *job = &self->jobs[self->job_head];
+        g_mutex_lock (self->done_mutex);
+        while (!job->done && self->njobs > max_pending)
+            g_cond_wait (self->done_cond, self->done_mutex);
+        int done = job->done;
+        g_mutex_unlock (self->done_mutex);
+        if (!done)
+            break;
+
+        if (job->outbuf->bytesused) {
+            _update_estimate (self, job->outbuf->bytesused);
+            cam_framebuffer_copy_metadata (job->outbuf, job->inbuf);
+            cam_unit_produce_frame (super, job->outbuf,
+                    cam_unit_get_output_format (super));
+        }
+        self->job_head = (self->job_head + 1) % self->nencoders;
+        self->njobs--;
+    }
+}
+
+/* Creates @nencoders compressors of @nslices slices each and, if there is
+ * more than one compressor, a thread and a job slot for each */
+static int
+_start_encoders (CamConvertJpegCompress *self, const CamUnitFormat *infmt,
+        int nencoders, int nslices)
+{
+    int quality = cam_unit_control_get_int (self->quality_control);
+    self->encoders = (jpeg_encoder_t*) calloc (nencoders,
+            sizeof (jpeg_encoder_t));
+    self->nencoders = nencoders;
+    self->nslices = nslices;
+    for (int i = 0; i < nencoders; i++) {
+        self->encoders[i].unit = self;
+        if (0 != _encoder_init (&self->encoders[i], infmt->pixelformat,
+                    infmt->width, infmt->height, quality, nslices))
+            return -1;
+    }
+    if (nencoders == 1)
+        return 0;
+
+    self->job_q = g_async_queue_new ();
+    self->done_mutex = g_mutex_new ();
+    self->done_cond = g_cond_new ();
+    self->jobs = (encode_job_t*) calloc (nencoders, sizeof (encode_job_t));
+    self->job_head = 0;
+    self->njobs = 0;
+    for (int i = 0; i < nencoders; i++) {
+        self->jobs[i].inbuf =
+            cam_framebuffer_new_alloc (_frame_size (infmt));
+        self->encoders[i].thread = g_thread_create (encoder_thread,
+                &self->encoders[i], TRUE, NULL);
+    }
+    return 0;
+}
+
+/* Emits the frames still in flight, then stops the encoder threads */
+static void
+_stop_encoders (CamConvertJpegCompress *self)
+{
+    if (self->jobs) {
+        _emit_finished_jobs (self, 0);
+        for (int i = 0; i < self->nencoders; i++)
+            g_async_queue_push (self->job_q, &ENCODER_THREAD_QUIT_REQUEST);
+        for (int i = 0; i < self->nencoders; i++) {
+            g_thread_join (self->encoders[i].thread);
+            g_object_unref (self->jobs[i].inbuf);
+            if (self->jobs[i].outbuf)
+                g_object_unref (self->jobs[i].outbuf);
+        }
+        free (self->jobs);
+        self->jobs = NULL;
+        g_async_queue_unref (self->job_q);
+        self->job_q = NULL;
+        g_mutex_free (self->done_mutex);
+        g_cond_free (self->done_cond);
+    }
+    for (int i = 0; i < self->nencoders; i++)
+        _encoder_destroy (&self->encoders[i]);
+    free (self->encoders);
+    self->encoders = NULL;
+    self->nencoders = 0;
+    self->nslices = 0;
+    if (self->outbuf)
+        g_object_unref (self->outbuf);
+    self->outbuf = NULL;
+}
+
 static int 
 _stream_init (CamUnit * super, const CamUnitFormat * fmt)
 {
     CamConvertJpegCompress *self = (CamConvertJpegCompress*) super;
-    self->outbuf = cam_framebuffer_new_alloc(fmt->width * fmt->height * 4);
+    CamUnit *input = cam_unit_get_input (super);
+    const CamUnitFormat *infmt =
+        input ? cam_unit_get_output_format (input) : NULL;
+    if (!infmt)
+        return -1;
+    // start from about 2 bits per pixel
+    self->size_estimate = infmt->width * infmt->height / 4;
+    if (0 != _start_encoders (self, infmt,
+                cam_unit_control_get_int (self->threads_control),
+                cam_unit_control_get_int (self->slices_control))) {
+        _stop_encoders (self);
+        return -1;
+    }
     return 0;
 }
 
 static int 
 _stream_shutdown (CamUnit * super)
 {
-    CamConvertJpegCompress *self = (CamConvertJpegCompress*) super;
-    g_object_unref (self->outbuf);
-    self->outbuf = NULL;
+    _stop_encoders ((CamConvertJpegCompress*) super);
     return 0;
 }
 
+static void *
+encoder_thread (void *user_data)
+{
+    jpeg_encoder_t *enc = (jpeg_encoder_t*) user_data;
+    CamConvertJpegCompress *self = enc->unit;
+
+    while (1) {
+        void *msg = g_async_queue_pop (self->job_q);
+        if (msg == &ENCODER_THREAD_QUIT_REQUEST)
+            break;
+
+        encode_job_t *job = (encode_job_t*) msg;
+        _compress (enc, job->inbuf->data, job->stride, job->quality,
+                &job->outbuf);
+
+        g_mutex_lock (self->done_mutex);
+        job->done = 1;
+        g_cond_broadcast (self->done_cond);
+        g_mutex_unlock (self->done_mutex);
+
+        // if the pipe is full, it is already readable
+        char c = 0;
+        if (self->notify_fds[1] >= 0 &&
+                write (self->notify_fds[1], &c, 1) < 0 && errno != EAGAIN)
+            perror ("write");
+    }
+    return NULL;
+}
+
+/* Called from the main loop when an encoder thread has finished a frame */
+static gboolean
+_try_produce_frame (CamUnit * super)
+{
+    CamConvertJpegCompress *self = (CamConvertJpegCompress*) super;
+    char buf[64];
+    while (read (self->notify_fds[0], buf, sizeof (buf)) > 0);
+    if (!self->jobs)
+        return FALSE;
+    int njobs = self->njobs;
+    _emit_finished_jobs (self, self->nencoders);
+    return self->njobs < njobs;
+}
+
+static int
+_get_fileno (CamUnit * super)
+{
+    return ((CamConvertJpegCompress*) super)->notify_fds[0];
+}
+
 static void 
 on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
         const CamUnitFormat *infmt)
@@ -111,26 +437,45 @@ on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
     dbg(DBG_FILTER, "[%s] iterate\n", cam_unit_get_name(super));
     CamConvertJpegCompress * self = (CamConvertJpegCompress*)super;
     const CamUnitFormat *outfmt = cam_unit_get_output_format(super);
-
-    int width = infmt->width;
-    int height = infmt->height;
-    int outsize = self->outbuf->length;
     int quality = cam_unit_control_get_int (self->quality_control);
 
-    if (infmt->pixelformat == CAM_PIXEL_FORMAT_RGB)
-        _jpeg_compress_8u_rgb (inbuf->data, width, height, infmt->row_stride,
-                self->outbuf->data, &outsize, quality);
-    else if (infmt->pixelformat == CAM_PIXEL_FORMAT_BGRA)
-        _jpeg_compress_8u_bgra (inbuf->data, width, height, infmt->row_stride,
-                self->outbuf->data, &outsize, quality);
-    else if (infmt->pixelformat == CAM_PIXEL_FORMAT_GRAY)
-        _jpeg_compress_8u_gray (inbuf->data, width, height, infmt->row_stride,
-                self->outbuf->data, &outsize, quality);
+    int nthreads = cam_unit_control_get_int (self->threads_control);
+    int nslices = cam_unit_control_get_int (self->slices_control);
+    if (nthreads != self->nencoders || nslices != self->nslices) {
+        _stop_encoders (self);
+        if (0 != _start_encoders (self, infmt, nthreads, nslices)) {
+            _stop_encoders (self);
+            return;
+        }
+    }
+
+    if (!self->jobs) {
+        _fit_output (self, &self->outbuf);
+        if (0 != _compress (&self->encoders[0], inbuf->data,
+                    infmt->row_stride, quality, &self->outbuf))
+            return;
+        _update_estimate (self, self->outbuf->bytesused);
 
-    cam_framebuffer_copy_metadata(self->outbuf, inbuf);
-    self->outbuf->bytesused = outsize;
+        cam_framebuffer_copy_metadata(self->outbuf, inbuf);
+        cam_unit_produce_frame (super, self->outbuf, outfmt);
+        return;
+    }
 
-    cam_unit_produce_frame (super, self->outbuf, outfmt);
+    // wait for a free slot, then queue a copy of the frame.  Frames are
+    // emitted up to nthreads frames late, in the order they came in.
+    _emit_finished_jobs (self, self->nencoders - 1);
+    int slot = (self->job_head + self->njobs) % self->nencoders;
+    encode_job_t *job = &self->jobs[slot];
+    _copy_frame (job->inbuf->data, inbuf->data, infmt);
+    cam_framebuffer_copy_metadata (job->inbuf, inbuf);
+    job->stride = infmt->row_stride;
+    job->quality = quality;
+    _fit_output (self, &job->outbuf);
+    job->done = 0;
+    self->njobs++;
+    g_async_queue_push (self->job_q, job);
+
+    _emit_finished_jobs (self, self->nencoders);
 }
 
 static void
@@ -140,9 +485,22 @@ on_input_format_changed (CamUnit *super, const CamUnitFormat *infmt)
 
     if (!infmt) return;
 
-    if (! (infmt->pixelformat == CAM_PIXEL_FORMAT_GRAY ||
-           infmt->pixelformat == CAM_PIXEL_FORMAT_RGB ||
-           infmt->pixelformat == CAM_PIXEL_FORMAT_BGRA)) return;
+    switch (infmt->pixelformat) {
+        case CAM_PIXEL_FORMAT_GRAY:
+        case CAM_PIXEL_FORMAT_RGB:
+        case CAM_PIXEL_FORMAT_BGRA:
+            break;
+        case CAM_PIXEL_FORMAT_I420:
+        case CAM_PIXEL_FORMAT_NV12:
+            if ((infmt->width | infmt->height) & 1) return;
+            break;
+        case CAM_PIXEL_FORMAT_YUYV:
+        case CAM_PIXEL_FORMAT_UYVY:
+            if (infmt->width & 1) return;
+            break;
+        default:
+            return;
+    }
 
     cam_unit_add_output_format (super, CAM_PIXEL_FORMAT_MJPEG,
             NULL, infmt->width, infmt->height, 0);
@@ -154,10 +512,19 @@ init_destination (j_compress_ptr cinfo)
     /* do nothing */
 }
 
+/* Called when the output buffer is full.  Moves the output to a buffer
+ * twice the size, so that a frame is never truncated. */
 static boolean
 empty_output_buffer (j_compress_ptr cinfo)
 {
-    fprintf (stderr, "Error: JPEG compressor ran out of buffer space\n");
+    jpeg_encoder_t *enc = (jpeg_encoder_t*) cinfo->client_data;
+    CamFrameBuffer *old = enc->outbuf;
+    CamFrameBuffer *buf = cam_framebuffer_new_alloc (old->length * 2);
+    memcpy (buf->data, old->data, old->length);
+    enc->jdest.next_output_byte = buf->data + old->length;
+    enc->jdest.free_in_buffer = buf->length - old->length;
+    enc->outbuf = buf;
+    g_object_unref (old);
     return TRUE;
 }
 
@@ -167,113 +534,404 @@ term_destination (j_compress_ptr cinfo)
     /* do nothing */
 }
 
-static int 
-_jpeg_compress_8u_gray (const uint8_t * src, int width, int height, int stride,
-        uint8_t * dest, int * destsize, int quality)
+/* rows of BGRA converted to RGB at a time, when libjpeg can't read BGRA.
+ * One iMCU row of 4:2:0 data. */
+#define BGRA_BATCH_ROWS 16
+
+/* Sets up a compressor for the frames of a stream.  The tables built by
+ * jpeg_set_defaults() and jpeg_set_quality() are kept across frames.
+ *
+ * With @nslices > 1, the frame is split into up to @nslices horizontal
+ * slices of whole MCU rows, which are compressed concurrently as separate
+ * images and then stitched into one baseline JPEG, with a restart
+ * interval of one slice. */
+static int
+_encoder_init (jpeg_encoder_t * enc, CamPixelFormat pfmt, int width,
+        int height, int quality, int nslices)
 {
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    struct jpeg_destination_mgr jdest;
-    int out_size = *destsize;
-
-    cinfo.err = jpeg_std_error (&jerr);
-    jpeg_create_compress (&cinfo);
-    jdest.next_output_byte = dest;
-    jdest.free_in_buffer = out_size;
-    jdest.init_destination = init_destination;
-    jdest.empty_output_buffer = empty_output_buffer;
-    jdest.term_destination = term_destination;
-    cinfo.dest = &jdest;
-
-    cinfo.image_width = width;
-    cinfo.image_height = height;
-    cinfo.input_components = 1;
-    cinfo.in_color_space = JCS_GRAYSCALE;
-    jpeg_set_defaults (&cinfo);
-    jpeg_set_quality (&cinfo, quality, TRUE);
-
-    jpeg_start_compress (&cinfo, TRUE);
-    while (cinfo.next_scanline < height) {
-        JSAMPROW row = (JSAMPROW)(src + cinfo.next_scanline * stride);
-        jpeg_write_scanlines (&cinfo, &row, 1);
+    struct jpeg_compress_struct *cinfo = &enc->cinfo;
+
+    cinfo->err = jpeg_std_error (&enc->jerr);
+    jpeg_create_compress (cinfo);
+
+    enc->jdest.init_destination = init_destination;
+    enc->jdest.empty_output_buffer = empty_output_buffer;
+    enc->jdest.term_destination = term_destination;
+    cinfo->dest = &enc->jdest;
+    cinfo->client_data = enc;
+
+    cinfo->image_width = width;
+    cinfo->image_height = height;
+    switch (pfmt) {
+        case CAM_PIXEL_FORMAT_GRAY:
+            cinfo->input_components = 1;
+            cinfo->in_color_space = JCS_GRAYSCALE;
+            break;
+        case CAM_PIXEL_FORMAT_RGB:
+            cinfo->input_components = 3;
+            cinfo->in_color_space = JCS_RGB;
+            break;
+        case CAM_PIXEL_FORMAT_BGRA:
+#ifdef JCS_EXTENSIONS
+            // libjpeg-turbo reads BGRA directly
+            cinfo->input_components = 4;
+            cinfo->in_color_space = JCS_EXT_BGRA;
+#else
+            cinfo->input_components = 3;
+            cinfo->in_color_space = JCS_RGB;
+            enc->rgb_rows = (uint8_t*) malloc (BGRA_BATCH_ROWS * width * 3);
+#endif
+            break;
+        case CAM_PIXEL_FORMAT_I420:
+        case CAM_PIXEL_FORMAT_NV12:
+        case CAM_PIXEL_FORMAT_YUYV:
+        case CAM_PIXEL_FORMAT_UYVY:
+            if (width & 1) return -1;
+            cinfo->input_components = 3;
+            cinfo->in_color_space = JCS_YCbCr;
+            break;
+        default:
+            return -1;
+    }
+    jpeg_set_defaults (cinfo);
+    enc->quality = quality;
+    jpeg_set_quality (cinfo, quality, TRUE);
+    enc->pixelformat = pfmt;
+    enc->first_row = 0;
+    enc->frame_height = height;
+
+    if (cinfo->in_color_space == JCS_YCbCr) {
+        // the default sampling is 4:2:0, which matches I420 and NV12
+        cinfo->raw_data_in = TRUE;
+        if (pfmt == CAM_PIXEL_FORMAT_YUYV || pfmt == CAM_PIXEL_FORMAT_UYVY)
+            cinfo->comp_info[0].v_samp_factor = 1;
+
+        /* libjpeg reads whole 8x8 blocks, so rows are padded to a multiple
+         * of the MCU width.  Frames whose rows are already a multiple are
+         * read in place where the layout allows. */
+        enc->raw_width = (width + 15) & ~15;
+        enc->raw_direct = enc->raw_width == width;
+        enc->raw_buf = (uint8_t*) malloc (enc->raw_width * 2 * DCTSIZE * 2);
+        enc->rows = (JSAMPROW*) malloc (4 * DCTSIZE * sizeof (JSAMPROW));
+    } else {
+        enc->rows = (JSAMPROW*) malloc (height * sizeof (JSAMPROW));
+    }
+    if (nslices <= 1)
+        return 0;
+
+    int max_h = 1, max_v = 1;
+    for (int i = 0; i < cinfo->num_components; i++) {
+        max_h = MAX (max_h, cinfo->comp_info[i].h_samp_factor);
+        max_v = MAX (max_v, cinfo->comp_info[i].v_samp_factor);
+    }
+    int mcu_width = max_h * DCTSIZE;
+    int mcu_height = max_v * DCTSIZE;
+    int mcu_rows = (height + mcu_height - 1) / mcu_height;
+    int slice_rows = (mcu_rows + nslices - 1) / nslices * mcu_height;
+    int interval = (width + mcu_width - 1) / mcu_width *
+        (slice_rows / mcu_height);
+    nslices = (height + slice_rows - 1) / slice_rows;
+    if (nslices <= 1 || interval > 65535)
+        return 0;
+
+    enc->slices = (jpeg_encoder_t*) calloc (nslices, sizeof (jpeg_encoder_t));
+    enc->nslices = nslices;
+    enc->slice_rows = slice_rows;
+    enc->restart_interval = interval;
+    enc->slice_bufs = (CamFrameBuffer**) calloc (nslices,
+            sizeof (CamFrameBuffer*));
+    enc->slice_data = (int*) calloc (nslices, sizeof (int));
+    for (int i = 0; i < nslices; i++) {
+        if (0 != _encoder_init (&enc->slices[i], pfmt, width,
+                    MIN (slice_rows, height - i * slice_rows), quality, 1))
+            return -1;
+        enc->slices[i].first_row = i * slice_rows;
+        enc->slices[i].frame_height = height;
+        enc->slice_bufs[i] = cam_framebuffer_new_alloc (
+                width * slice_rows / 4 + OUTBUF_MIN_SIZE);
     }
-    jpeg_finish_compress (&cinfo);
-    *destsize = out_size - jdest.free_in_buffer;
-    jpeg_destroy_compress (&cinfo);
     return 0;
 }
 
-static int 
-_jpeg_compress_8u_rgb (const uint8_t * src, int width, int height, int stride,
-        uint8_t * dest, int * destsize, int quality)
+static void
+_encoder_destroy (jpeg_encoder_t * enc)
 {
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    struct jpeg_destination_mgr jdest;
-    int out_size = *destsize;
-
-    cinfo.err = jpeg_std_error (&jerr);
-    jpeg_create_compress (&cinfo);
-    jdest.next_output_byte = dest;
-    jdest.free_in_buffer = out_size;
-    jdest.init_destination = init_destination;
-    jdest.empty_output_buffer = empty_output_buffer;
-    jdest.term_destination = term_destination;
-    cinfo.dest = &jdest;
-
-    cinfo.image_width = width;
-    cinfo.image_height = height;
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
-    jpeg_set_defaults (&cinfo);
-    jpeg_set_quality (&cinfo, quality, TRUE);
-
-    jpeg_start_compress (&cinfo, TRUE);
-    while (cinfo.next_scanline < height) {
-        JSAMPROW row = (JSAMPROW)(src + cinfo.next_scanline * stride);
-        jpeg_write_scanlines (&cinfo, &row, 1);
+    if (enc->cinfo.err)
+        jpeg_destroy_compress (&enc->cinfo);
+    enc->cinfo.err = NULL;
+    free (enc->rows);
+    enc->rows = NULL;
+    free (enc->rgb_rows);
+    enc->rgb_rows = NULL;
+    free (enc->raw_buf);
+    enc->raw_buf = NULL;
+    for (int i = 0; i < enc->nslices; i++) {
+        _encoder_destroy (&enc->slices[i]);
+        if (enc->slice_bufs[i])
+            g_object_unref (enc->slice_bufs[i]);
+    }
+    free (enc->slices);
+    enc->slices = NULL;
+    enc->nslices = 0;
+    free (enc->slice_bufs);
+    enc->slice_bufs = NULL;
+    free (enc->slice_data);
+    enc->slice_data = NULL;
+}
+
+typedef struct _slice_args_t {
+    jpeg_encoder_t * enc;
+    const uint8_t * src;
+    int stride;
+    int quality;
+} slice_args_t;
+
+static void
+_compress_slice_band (int first, int end, void *user_data)
+{
+    slice_args_t *a = (slice_args_t*) user_data;
+    jpeg_encoder_t *enc = a->enc;
+    for (int i = first; i < end; i++)
+        _compress (&enc->slices[i], a->src, a->stride, a->quality,
+                &enc->slice_bufs[i]);
+}
+
+/* Finds the SOS segment of a JPEG image written by libjpeg.  Sets @sos to
+ * the offset of its marker and @data to the offset of the entropy-coded
+ * data that follows it.  If @height is not 0, it replaces the height in
+ * the frame header. */
+static int
+_find_scan (uint8_t * jpeg, int size, int height, int * sos, int * data)
+{
+    int pos = 2;
+    while (pos + 4 <= size && jpeg[pos] == 0xFF) {
+        int marker = jpeg[pos+1];
+        int len = (jpeg[pos+2] << 8) | jpeg[pos+3];
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+                marker != 0xC8 && marker != 0xCC && height) {
+            jpeg[pos+5] = height >> 8;
+            jpeg[pos+6] = height & 0xff;
+        } else if (marker == 0xDA) {
+            *sos = pos;
+            *data = pos + 2 + len;
+            return *data <= size ? 0 : -1;
+        }
+        pos += 2 + len;
+    }
+    return -1;
+}
+
+/* Compresses each slice on the pixel thread pool, then concatenates the
+ * entropy-coded data of the slices separated by RSTn markers, behind the
+ * headers of the first slice plus a DRI marker.  The result is identical
+ * to compressing the whole frame with a restart interval of one slice. */
+static int
+_compress_slices (jpeg_encoder_t * enc, const uint8_t * src, int stride,
+        int quality, CamFrameBuffer ** destbuf)
+{
+    slice_args_t args = {
+        .enc = enc,
+        .src = src,
+        .stride = stride,
+        .quality = quality,
+    };
+    cam_pixel_parallel_for (enc->nslices, enc->nslices, 1,
+            enc->slice_rows * stride, _compress_slice_band, &args);
+
+    (*destbuf)->bytesused = 0;
+    uint8_t *first = enc->slice_bufs[0]->data;
+    int sos, data, unused;
+    if (0 != _find_scan (first, enc->slice_bufs[0]->bytesused,
+                enc->cinfo.image_height, &sos, &data))
+        return -1;
+    enc->slice_data[0] = data;
+
+    // headers, DRI, entropy-coded data without EOI, RSTn markers, EOI
+    int total = data + 6 + 2;
+    for (int i = 0; i < enc->nslices; i++) {
+        CamFrameBuffer *slice = enc->slice_bufs[i];
+        if (i > 0 && 0 != _find_scan (slice->data, slice->bytesused, 0,
+                    &unused, &enc->slice_data[i]))
+            return -1;
+        total += slice->bytesused - 2 - enc->slice_data[i] + (i > 0 ? 2 : 0);
     }
-    jpeg_finish_compress (&cinfo);
-    *destsize = out_size - jdest.free_in_buffer;
-    jpeg_destroy_compress (&cinfo);
+    if ((*destbuf)->length < total) {
+        g_object_unref (*destbuf);
+        *destbuf = cam_framebuffer_new_alloc (total);
+    }
+
+    uint8_t *dest = (*destbuf)->data;
+    memcpy (dest, first, sos);
+    int out = sos;
+    uint8_t dri[6] = { 0xFF, 0xDD, 0x00, 0x04,
+        enc->restart_interval >> 8, enc->restart_interval & 0xff };
+    memcpy (dest + out, dri, 6);
+    out += 6;
+    memcpy (dest + out, first + sos, data - sos);
+    out += data - sos;
+
+    for (int i = 0; i < enc->nslices; i++) {
+        CamFrameBuffer *slice = enc->slice_bufs[i];
+        // drop the EOI marker of each slice
+        int len = slice->bytesused - 2 - enc->slice_data[i];
+        if (i > 0) {
+            dest[out++] = 0xFF;
+            dest[out++] = 0xD0 + ((i - 1) & 7);
+        }
+        memcpy (dest + out, slice->data + enc->slice_data[i], len);
+        out += len;
+    }
+    dest[out++] = 0xFF;
+    dest[out++] = 0xD9;
+    (*destbuf)->bytesused = out;
     return 0;
 }
 
-static int 
-_jpeg_compress_8u_bgra (const uint8_t * src, int width, int height, int stride,
-        uint8_t * dest, int * destsize, int quality)
+/* Copies @n samples to a row of @padded samples, repeating the last */
+static void
+_pad_row (uint8_t * dest, const uint8_t * src, int n, int padded)
 {
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    struct jpeg_destination_mgr jdest;
-    int out_size = *destsize;
-
-    cinfo.err = jpeg_std_error (&jerr);
-    jpeg_create_compress (&cinfo);
-    jdest.next_output_byte = dest;
-    jdest.free_in_buffer = out_size;
-    jdest.init_destination = init_destination;
-    jdest.empty_output_buffer = empty_output_buffer;
-    jdest.term_destination = term_destination;
-    cinfo.dest = &jdest;
-
-    cinfo.image_width = width;
-    cinfo.image_height = height;
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
-    jpeg_set_defaults (&cinfo);
-    jpeg_set_quality (&cinfo, quality, TRUE);
-
-    jpeg_start_compress (&cinfo, TRUE);
-    while (cinfo.next_scanline < height) {
-        uint8_t buf[width*3];
-        cam_pixel_convert_8u_bgra_to_8u_rgb (buf, 0, width, 1,
-                src + cinfo.next_scanline * stride, 0);
-        JSAMPROW row = (JSAMPROW) buf;
-        jpeg_write_scanlines (&cinfo, &row, 1);
+    memcpy (dest, src, n);
+    memset (dest + n, src[n-1], padded - n);
+}
+
+/* Points enc->rows at the Y, Cb and Cr rows of the iMCU row that starts at
+ * row @y of the frame, unpacking them to raw_buf if needed.  Rows past the
+ * bottom of the frame repeat the last row. */
+static void
+_raw_rows (jpeg_encoder_t * enc, const uint8_t * src, int stride, int y)
+{
+    struct jpeg_compress_struct *cinfo = &enc->cinfo;
+    int width = cinfo->image_width;
+    int height = enc->frame_height;
+    int cwidth = width / 2;
+    int padded = enc->raw_width;
+    JSAMPROW *yrows = enc->rows;
+    JSAMPROW *urows = enc->rows + 2 * DCTSIZE;
+    JSAMPROW *vrows = urows + DCTSIZE;
+    uint8_t *ybuf = enc->raw_buf;
+    uint8_t *ubuf = ybuf + 2 * DCTSIZE * padded;
+    uint8_t *vbuf = ubuf + DCTSIZE * padded / 2;
+
+    if (enc->pixelformat == CAM_PIXEL_FORMAT_YUYV ||
+        enc->pixelformat == CAM_PIXEL_FORMAT_UYVY) {
+        int yo = enc->pixelformat == CAM_PIXEL_FORMAT_YUYV ? 0 : 1;
+        int co = 1 - yo;
+        for (int i = 0; i < DCTSIZE; i++) {
+            const uint8_t *row = src + MIN (y + i, height - 1) * stride;
+            uint8_t *yrow = ybuf + i * padded;
+            uint8_t *urow = ubuf + i * padded / 2;
+            uint8_t *vrow = vbuf + i * padded / 2;
+            for (int j = 0; j < cwidth; j++) {
+                yrow[2*j] = row[4*j + yo];
+                urow[j] = row[4*j + co];
+                yrow[2*j+1] = row[4*j + 2 + yo];
+                vrow[j] = row[4*j + 2 + co];
+            }
+            memset (yrow + width, yrow[width-1], padded - width);
+            memset (urow + cwidth, urow[cwidth-1], padded / 2 - cwidth);
+            memset (vrow + cwidth, vrow[cwidth-1], padded / 2 - cwidth);
+            yrows[i] = yrow;
+            urows[i] = urow;
+            vrows[i] = vrow;
+        }
+        return;
+    }
+
+    // I420 and NV12: a Y plane followed by chroma at half the resolution
+    for (int i = 0; i < 2 * DCTSIZE; i++) {
+        const uint8_t *row = src + MIN (y + i, height - 1) * stride;
+        if (enc->raw_direct) {
+            yrows[i] = (JSAMPROW) row;
+        } else {
+            yrows[i] = ybuf + i * padded;
+            _pad_row (yrows[i], row, width, padded);
+        }
+    }
+    const uint8_t *cplane = src + height * stride;
+    for (int i = 0; i < DCTSIZE; i++) {
+        int cy = MIN (y / 2 + i, height / 2 - 1);
+        if (enc->pixelformat == CAM_PIXEL_FORMAT_NV12) {
+            const uint8_t *uvrow = cplane + cy * stride;
+            uint8_t *urow = ubuf + i * padded / 2;
+            uint8_t *vrow = vbuf + i * padded / 2;
+            for (int j = 0; j < cwidth; j++) {
+                urow[j] = uvrow[2*j];
+                vrow[j] = uvrow[2*j+1];
+            }
+            memset (urow + cwidth, urow[cwidth-1], padded / 2 - cwidth);
+            memset (vrow + cwidth, vrow[cwidth-1], padded / 2 - cwidth);
+            urows[i] = urow;
+            vrows[i] = vrow;
+            continue;
+        }
+        const uint8_t *urow = cplane + cy * stride / 2;
+        const uint8_t *vrow = urow + height * stride / 4;
+        if (enc->raw_direct) {
+            urows[i] = (JSAMPROW) urow;
+            vrows[i] = (JSAMPROW) vrow;
+        } else {
+            urows[i] = ubuf + i * padded / 2;
+            vrows[i] = vbuf + i * padded / 2;
+            _pad_row (urows[i], urow, cwidth, padded / 2);
+            _pad_row (vrows[i], vrow, cwidth, padded / 2);
+        }
+    }
+}
+
+/* Compresses a frame into @dest, which is replaced by a larger buffer if
+ * the frame doesn't fit */
+static int
+_compress (jpeg_encoder_t * enc, const uint8_t * src, int stride,
+        int quality, CamFrameBuffer ** dest)
+{
+    struct jpeg_compress_struct *cinfo = &enc->cinfo;
+    int width = cinfo->image_width;
+    int height = cinfo->image_height;
+
+    if (enc->nslices)
+        return _compress_slices (enc, src, stride, quality, dest);
+
+    if (quality != enc->quality) {
+        jpeg_set_quality (cinfo, quality, TRUE);
+        enc->quality = quality;
+    }
+
+    enc->outbuf = *dest;
+    enc->jdest.next_output_byte = enc->outbuf->data;
+    enc->jdest.free_in_buffer = enc->outbuf->length;
+    jpeg_start_compress (cinfo, TRUE);
+    if (cinfo->raw_data_in) {
+        JSAMPARRAY planes[3] = {
+            enc->rows, enc->rows + 2 * DCTSIZE, enc->rows + 3 * DCTSIZE
+        };
+        int lines = cinfo->max_v_samp_factor * DCTSIZE;
+        while (cinfo->next_scanline < height) {
+            _raw_rows (enc, src, stride,
+                    enc->first_row + cinfo->next_scanline);
+            jpeg_write_raw_data (cinfo, planes, lines);
+        }
+    } else if (enc->rgb_rows) {
+        src += enc->first_row * stride;
+        while (cinfo->next_scanline < height) {
+            int n = MIN (BGRA_BATCH_ROWS, height - cinfo->next_scanline);
+            cam_pixel_convert_8u_bgra_to_8u_rgb (enc->rgb_rows, width * 3,
+                    width, n, src + cinfo->next_scanline * stride, stride);
+            for (int i = 0; i < n; i++)
+                enc->rows[i] = (JSAMPROW)(enc->rgb_rows + i * width * 3);
+            jpeg_write_scanlines (cinfo, enc->rows, n);
+        }
+    } else {
+        src += enc->first_row * stride;
+        for (int i = 0; i < height; i++)
+            enc->rows[i] = (JSAMPROW)(src + i * stride);
+        while (cinfo->next_scanline < height)
+            jpeg_write_scanlines (cinfo, enc->rows + cinfo->next_scanline,
+                    height - cinfo->next_scanline);
     }
-    jpeg_finish_compress (&cinfo);
-    *destsize = out_size - jdest.free_in_buffer;
-    jpeg_destroy_compress (&cinfo);
+    jpeg_finish_compress (cinfo);
+    *dest = enc->outbuf;
+    enc->outbuf = NULL;
+    (*dest)->bytesused = (*dest)->length - enc->jdest.free_in_buffer;
     return 0;
 }
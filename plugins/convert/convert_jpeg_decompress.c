@@ -1,6 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <jpeglib.h>
 #include <jerror.h>
 #include <setjmp.h>
@@ -10,12 +13,54 @@
 
 #define err(args...) fprintf(stderr, args)
 
-typedef struct _CamConvertJpegDecompress {
+typedef struct _CamConvertJpegDecompress CamConvertJpegDecompress;
+
+/* A decoder thread */
+typedef struct _jpeg_decoder_t {
+    CamConvertJpegDecompress * unit;
+    GThread * thread;
+} jpeg_decoder_t;
+
+/* A frame handed to a decoder thread.  The input is copied, since the
+ * upstream unit may reuse its buffer as soon as it has emitted it, and
+ * the output format and scale are those at the time the frame came in,
+ * since the unit's state may only be read from the main thread. */
+typedef struct _decode_job_t {
+    CamFrameBuffer * inbuf;
+    CamFrameBuffer * outbuf;
+    J_COLOR_SPACE out_space;
+    int width;
+    int height;
+    int stride;
+    int scale_denom;
+    int done;
+} decode_job_t;
+
+struct _CamConvertJpegDecompress {
     CamUnit parent;
     
     /*< private >*/
+    CamUnitControl * scale_ctl;
+    CamUnitControl * threads_ctl;
     CamFrameBuffer * outbuf;
-} CamConvertJpegDecompress;
+
+    jpeg_decoder_t * decoders;
+    int ndecoders;
+
+    /* with more than one decoder, a ring of the frames in flight, oldest
+     * first.  Finished frames are emitted in input order. */
+    GAsyncQueue * job_q;
+    decode_job_t * jobs;
+    int job_head;
+    int njobs;
+    GMutex * done_mutex;
+    GCond * done_cond;
+
+    /* a decoder thread writes a byte to this pipe for each frame it
+     * finishes, so that the chain calls try_produce_frame to emit it
+     * without waiting for the next input frame */
+    int notify_fds[2];
+};
 
 typedef struct _CamConvertJpegDecompressClass {
     CamUnitClass parent_class;
@@ -41,38 +86,76 @@ CamUnitDriver * cam_plugin_create(GTypeModule * module);
 CamUnitDriver * cam_plugin_create(GTypeModule * module)
 {
     return cam_unit_driver_new_stock_full ("convert", "jpeg_decompress",
-            "JPEG Decompress", 0,
+            "JPEG Decompress", CAM_UNIT_EVENT_METHOD_FD,
             (CamUnitConstructor)cam_convert_jpeg_decompress_new, module);
 }
 
 static int _jpeg_decompress (const uint8_t * src, int src_size,
         uint8_t * dest, int width, int height, int stride, 
-        J_COLOR_SPACE out_space);
+        J_COLOR_SPACE out_space, int scale_denom);
 static void _jpeg_std_huff_tables (j_decompress_ptr cinfo);
 
 // ============== CamConvertJpegDecompress ===============
+static void cam_convert_jpeg_decompress_finalize (GObject *obj);
+static gboolean _try_produce_frame (CamUnit * super);
+static int _get_fileno (CamUnit * super);
 static void on_input_frame_ready (CamUnit * super, const CamFrameBuffer *inbuf,
         const CamUnitFormat *infmt);
 static void on_input_format_changed (CamUnit *super, 
         const CamUnitFormat *infmt);
 static int _stream_init (CamUnit * super, const CamUnitFormat * format);
 static int _stream_shutdown (CamUnit * super);
+static gboolean _try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual);
+static void * decoder_thread (void *user_data);
+
+static int DECODER_THREAD_QUIT_REQUEST;
 
 static void
 cam_convert_jpeg_decompress_init (CamConvertJpegDecompress *self)
 {
     // constructor.  Initialize the unit with some reasonable defaults here.
+    CamUnit *super = CAM_UNIT (self);
+
+    /* libjpeg scales by skipping DCT coefficients, so a scaled decode is
+     * much cheaper than a full decode followed by a resize */
+    CamUnitControlEnumValue scale_entries[] = {
+        { 1, "Full size", 1 },
+        { 2, "1/2", 1 },
+        { 4, "1/4", 1 },
+        { 8, "1/8", 1 },
+        { 0, NULL, 0 }
+    };
+    self->scale_ctl = cam_unit_add_control_enum (super, "scale",
+            "Scale", 1, 1, scale_entries);
+    self->threads_ctl = cam_unit_add_control_int (super, "threads",
+            "Decoder Threads", 1, 16, 1, 1, 1);
+
     self->outbuf = NULL;
     g_signal_connect (G_OBJECT(self), "input-format-changed",
             G_CALLBACK(on_input_format_changed), NULL);
+
+    if (0 != pipe (self->notify_fds)) {
+        perror ("pipe");
+        self->notify_fds[0] = self->notify_fds[1] = -1;
+    } else {
+        fcntl (self->notify_fds[0], F_SETFL, O_NONBLOCK);
+        fcntl (self->notify_fds[1], F_SETFL, O_NONBLOCK);
+    }
 }
 
 static void
 cam_convert_jpeg_decompress_class_init (CamConvertJpegDecompressClass *klass)
 {
+    GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+    gobject_class->finalize = cam_convert_jpeg_decompress_finalize;
+    klass->parent_class.try_produce_frame = _try_produce_frame;
+    klass->parent_class.get_fileno = _get_fileno;
     klass->parent_class.on_input_frame_ready = on_input_frame_ready;
     klass->parent_class.stream_init = _stream_init;
     klass->parent_class.stream_shutdown = _stream_shutdown;
+    klass->parent_class.try_set_control = _try_set_control;
+    if (!g_thread_supported ()) g_thread_init (NULL);
 }
 
 static CamConvertJpegDecompress * 
@@ -82,23 +165,188 @@ cam_convert_jpeg_decompress_new()
             g_object_new(cam_convert_jpeg_decompress_get_type(), NULL));
 }
 
+static void
+cam_convert_jpeg_decompress_finalize (GObject *obj)
+{
+    CamConvertJpegDecompress *self = (CamConvertJpegDecompress*) obj;
+    if (self->notify_fds[0] >= 0) {
+        close (self->notify_fds[0]);
+        close (self->notify_fds[1]);
+    }
+    G_OBJECT_CLASS (cam_convert_jpeg_decompress_parent_class)->finalize (obj);
+}
+
+/* Emits finished frames in input order, first waiting until at most
+ * @max_pending frames are still in flight */
+static void
+_emit_finished_jobs (CamConvertJpegDecompress *self, int max_pending)
+{
+    CamUnit *super = CAM_UNIT (self);
+    while (self->njobs > 0) {
+        decode_job_t *job = &self->jobs[self->job_head];
+        g_mutex_lock (self->done_mutex);
+        while (!job->done && self->njobs > max_pending)
+            g_cond_wait (self->done_cond, self->done_mutex);
+        int done = job->done;
+        g_mutex_unlock (self->done_mutex);
+        if (!done)
+            break;
+
+        cam_framebuffer_copy_metadata (job->outbuf, job->inbuf);
+        cam_unit_produce_frame (super, job->outbuf,
+                cam_unit_get_output_format (super));
+        self->job_head = (self->job_head + 1) % self->ndecoders;
+        self->njobs--;
+    }
+}
+
+/* With more than one decoder, creates a thread and a job slot for each.
+ * A single decoder decodes inline into outbuf. */
+static int
+_start_decoders (CamConvertJpegDecompress *self, const CamUnitFormat *outfmt,
+        int ndecoders)
+{
+    int outsize = outfmt->row_stride * outfmt->height;
+    self->ndecoders = ndecoders;
+    if (ndecoders == 1) {
+        self->outbuf = cam_framebuffer_new_alloc (outsize);
+        return 0;
+    }
+
+    self->decoders = (jpeg_decoder_t*) calloc (ndecoders,
+            sizeof (jpeg_decoder_t));
+    self->job_q = g_async_queue_new ();
+    self->done_mutex = g_mutex_new ();
+    self->done_cond = g_cond_new ();
+    self->jobs = (decode_job_t*) calloc (ndecoders, sizeof (decode_job_t));
+    self->job_head = 0;
+    self->njobs = 0;
+    for (int i = 0; i < ndecoders; i++) {
+        // the input buffer grows as needed, see on_input_frame_ready
+        self->jobs[i].inbuf = cam_framebuffer_new_alloc (outsize);
+        self->jobs[i].outbuf = cam_framebuffer_new_alloc (outsize);
+        self->decoders[i].unit = self;
+        self->decoders[i].thread = g_thread_create (decoder_thread,
+                &self->decoders[i], TRUE, NULL);
+    }
+    return 0;
+}
+
+/* Emits the frames still in flight, then stops the decoder threads */
+static void
+_stop_decoders (CamConvertJpegDecompress *self)
+{
+    if (self->jobs) {
+        _emit_finished_jobs (self, 0);
+        for (int i = 0; i < self->ndecoders; i++)
+            g_async_queue_push (self->job_q, &DECODER_THREAD_QUIT_REQUEST);
+        for (int i = 0; i < self->ndecoders; i++) {
+            g_thread_join (self->decoders[i].thread);
+            g_object_unref (self->jobs[i].inbuf);
+            g_object_unref (self->jobs[i].outbuf);
+        }
+        free (self->jobs);
+        self->jobs = NULL;
+        free (self->decoders);
+        self->decoders = NULL;
+        g_async_queue_unref (self->job_q);
+        self->job_q = NULL;
+        g_mutex_free (self->done_mutex);
+        g_cond_free (self->done_cond);
+    }
+    self->ndecoders = 0;
+    if (self->outbuf)
+        g_object_unref (self->outbuf);
+    self->outbuf = NULL;
+}
+
 static int 
 _stream_init (CamUnit * super, const CamUnitFormat * fmt)
 {
     CamConvertJpegDecompress *self = (CamConvertJpegDecompress*) (super);
-    self->outbuf = cam_framebuffer_new_alloc(fmt->width*fmt->height*4);
-    return 0;
+    return _start_decoders (self, fmt,
+            cam_unit_control_get_int (self->threads_ctl));
 }
 
 static int 
 _stream_shutdown (CamUnit * super)
 {
-    CamConvertJpegDecompress *self = (CamConvertJpegDecompress*) super;
-    g_object_unref (self->outbuf);
-    self->outbuf = NULL;
+    _stop_decoders ((CamConvertJpegDecompress*) super);
     return 0;
 }
 
+/* The color space libjpeg decodes to for an output format.  For gray
+ * output, libjpeg skips the chroma components after entropy decoding. */
+static J_COLOR_SPACE
+_out_space (const CamUnitFormat *outfmt)
+{
+    switch (outfmt->pixelformat) {
+        case CAM_PIXEL_FORMAT_RGB:
+            return JCS_RGB;
+        case CAM_PIXEL_FORMAT_GRAY:
+            return JCS_GRAYSCALE;
+#ifdef JCS_EXTENSIONS
+        case CAM_PIXEL_FORMAT_BGRA:
+            return JCS_EXT_BGRA;
+        case CAM_PIXEL_FORMAT_BGR:
+            return JCS_EXT_BGR;
+#endif
+        default:
+            return JCS_UNKNOWN;
+    }
+}
+
+static void *
+decoder_thread (void *user_data)
+{
+    jpeg_decoder_t *dec = (jpeg_decoder_t*) user_data;
+    CamConvertJpegDecompress *self = dec->unit;
+
+    while (1) {
+        void *msg = g_async_queue_pop (self->job_q);
+        if (msg == &DECODER_THREAD_QUIT_REQUEST)
+            break;
+
+        decode_job_t *job = (decode_job_t*) msg;
+        _jpeg_decompress (job->inbuf->data, job->inbuf->bytesused,
+                job->outbuf->data, job->width, job->height, job->stride,
+                job->out_space, job->scale_denom);
+        job->outbuf->bytesused = job->stride * job->height;
+
+        g_mutex_lock (self->done_mutex);
+        job->done = 1;
+        g_cond_broadcast (self->done_cond);
+        g_mutex_unlock (self->done_mutex);
+
+        // if the pipe is full, it is already readable
+        char c = 0;
+        if (self->notify_fds[1] >= 0 &&
+                write (self->notify_fds[1], &c, 1) < 0 && errno != EAGAIN)
+            perror ("write");
+    }
+    return NULL;
+}
+
+/* Called from the main loop when a decoder thread has finished a frame */
+static gboolean
+_try_produce_frame (CamUnit * super)
+{
+    CamConvertJpegDecompress *self = (CamConvertJpegDecompress*) super;
+    char buf[64];
+    while (read (self->notify_fds[0], buf, sizeof (buf)) > 0);
+    if (!self->jobs)
+        return FALSE;
+    int njobs = self->njobs;
+    _emit_finished_jobs (self, self->ndecoders);
+    return self->njobs < njobs;
+}
+
+static int
+_get_fileno (CamUnit * super)
+{
+    return ((CamConvertJpegDecompress*) super)->notify_fds[0];
+}
+
 static void 
 on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
         const CamUnitFormat *infmt)
@@ -106,42 +354,137 @@ on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
     CamConvertJpegDecompress *self = (CamConvertJpegDecompress*) (super);
     const CamUnitFormat *outfmt = cam_unit_get_output_format(super);
 
-    J_COLOR_SPACE out_space;
-    if (outfmt->pixelformat == CAM_PIXEL_FORMAT_RGB) {
-        out_space = JCS_RGB;
-    } else if(outfmt->pixelformat == CAM_PIXEL_FORMAT_GRAY) {
-        out_space = JCS_GRAYSCALE;
-    } else {
+    J_COLOR_SPACE out_space = _out_space (outfmt);
+    if (out_space == JCS_UNKNOWN) {
         g_warning("invalid output pixel format");
         return;
     }
 
-    _jpeg_decompress (inbuf->data, inbuf->bytesused,
-                self->outbuf->data, infmt->width, infmt->height, 
-                outfmt->row_stride, out_space);
-    self->outbuf->bytesused = outfmt->row_stride * infmt->height;
-    cam_framebuffer_copy_metadata (self->outbuf, inbuf);
+    int nthreads = cam_unit_control_get_int (self->threads_ctl);
+    if (nthreads != self->ndecoders) {
+        _stop_decoders (self);
+        _start_decoders (self, outfmt, nthreads);
+    }
 
-    cam_unit_produce_frame (super, self->outbuf, outfmt);
+    if (!self->jobs) {
+        _jpeg_decompress (inbuf->data, inbuf->bytesused,
+                self->outbuf->data, outfmt->width, outfmt->height, 
+                outfmt->row_stride, out_space,
+                cam_unit_control_get_enum (self->scale_ctl));
+        self->outbuf->bytesused = outfmt->row_stride * outfmt->height;
+        cam_framebuffer_copy_metadata (self->outbuf, inbuf);
+
+        cam_unit_produce_frame (super, self->outbuf, outfmt);
+        return;
+    }
+
+    // wait for a free slot, then queue a copy of the frame.  Frames are
+    // emitted up to nthreads frames late, in the order they came in.
+    _emit_finished_jobs (self, self->ndecoders - 1);
+    int slot = (self->job_head + self->njobs) % self->ndecoders;
+    decode_job_t *job = &self->jobs[slot];
+    if (job->inbuf->length < inbuf->bytesused) {
+        g_object_unref (job->inbuf);
+        job->inbuf = cam_framebuffer_new_alloc (inbuf->bytesused);
+    }
+    memcpy (job->inbuf->data, inbuf->data, inbuf->bytesused);
+    job->inbuf->bytesused = inbuf->bytesused;
+    cam_framebuffer_copy_metadata (job->inbuf, inbuf);
+    job->out_space = out_space;
+    job->width = outfmt->width;
+    job->height = outfmt->height;
+    job->stride = outfmt->row_stride;
+    job->scale_denom = cam_unit_control_get_enum (self->scale_ctl);
+    job->done = 0;
+    self->njobs++;
+    g_async_queue_push (self->job_q, job);
+
+    _emit_finished_jobs (self, self->ndecoders);
 }
 
 static void
-on_input_format_changed (CamUnit *super, const CamUnitFormat *infmt)
+update_output_formats (CamConvertJpegDecompress *self,
+        const CamUnitFormat *infmt, int scale_denom)
 {
+    CamUnit *super = CAM_UNIT (self);
     cam_unit_remove_all_output_formats (super);
     if (!infmt || infmt->pixelformat != CAM_PIXEL_FORMAT_MJPEG) return;
 
-    int stride_rgb = infmt->width * 3;
+    // same rounding as libjpeg's jpeg_calc_output_dimensions
+    int width = (infmt->width + scale_denom - 1) / scale_denom;
+    int height = (infmt->height + scale_denom - 1) / scale_denom;
+
+    int stride_rgb = width * 3;
     cam_unit_add_output_format (super, CAM_PIXEL_FORMAT_RGB,
-            NULL, infmt->width, infmt->height, 
+            NULL, width, height, 
             stride_rgb);
 
-    int stride_gray = infmt->width;
+#ifdef JCS_EXTENSIONS
+    // libjpeg-turbo writes these byte orders directly
+    int stride_bgra = width * 4;
+    cam_unit_add_output_format (super, CAM_PIXEL_FORMAT_BGRA,
+            NULL, width, height, 
+            stride_bgra);
+
+    int stride_bgr = width * 3;
+    cam_unit_add_output_format (super, CAM_PIXEL_FORMAT_BGR,
+            NULL, width, height, 
+            stride_bgr);
+#endif
+
+    int stride_gray = width;
     cam_unit_add_output_format (super, CAM_PIXEL_FORMAT_GRAY,
-            NULL, infmt->width, infmt->height, 
+            NULL, width, height, 
             stride_gray);
 }
 
+static void
+on_input_format_changed (CamUnit *super, const CamUnitFormat *infmt)
+{
+    CamConvertJpegDecompress *self = (CamConvertJpegDecompress*) (super);
+    update_output_formats (self, infmt,
+            cam_unit_control_get_enum (self->scale_ctl));
+}
+
+static gboolean
+_try_set_control (CamUnit *super, const CamUnitControl *ctl,
+        const GValue *proposed, GValue *actual)
+{
+    CamConvertJpegDecompress *self = (CamConvertJpegDecompress*) (super);
+    if (ctl == self->scale_ctl &&
+            g_value_get_int (proposed) !=
+            cam_unit_control_get_enum (self->scale_ctl)) {
+        /* the output size changes, so renegotiate the format, keeping the
+         * same pixel format.  Restarting the stream also restarts any
+         * units downstream. */
+        int streaming = cam_unit_is_streaming (super);
+        CamPixelFormat pfmt = CAM_PIXEL_FORMAT_ANY;
+        if (streaming) {
+            pfmt = cam_unit_get_output_format (super)->pixelformat;
+            cam_unit_stream_shutdown (super);
+        }
+
+        CamUnit *input = cam_unit_get_input (super);
+        update_output_formats (self,
+                input ? cam_unit_get_output_format (input) : NULL,
+                g_value_get_int (proposed));
+
+        if (streaming) {
+            const CamUnitFormat *fmt = NULL;
+            GList *formats = cam_unit_get_output_formats (super);
+            for (GList *iter = formats; iter; iter = iter->next) {
+                CamUnitFormat *f = CAM_UNIT_FORMAT (iter->data);
+                if (f->pixelformat == pfmt)
+                    fmt = f;
+            }
+            g_list_free (formats);
+            cam_unit_stream_init (super, fmt);
+        }
+    }
+    g_value_copy (proposed, actual);
+    return TRUE;
+}
+
 static void
 init_source (j_decompress_ptr cinfo)
 {
@@ -181,9 +524,12 @@ _error_exit (j_common_ptr cinfo)
     longjmp(err->setjmp_buffer, 1);
 }
 
+/* Decodes @src into a @width x @height image, which must be the size of
+ * the JPEG image divided by @scale_denom (1, 2, 4 or 8), rounded up */
 static int
 _jpeg_decompress (const uint8_t * src, int src_size,
-        uint8_t * dest, int width, int height, int stride, J_COLOR_SPACE out_space)
+        uint8_t * dest, int width, int height, int stride, J_COLOR_SPACE out_space,
+        int scale_denom)
 {
     struct jpeg_decompress_struct cinfo;
     struct jpeg_source_mgr jsrc;
@@ -210,6 +556,8 @@ _jpeg_decompress (const uint8_t * src, int src_size,
 
     jpeg_read_header (&cinfo, TRUE);
     cinfo.out_color_space = out_space;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scale_denom;
 
     if (! (cinfo.dc_huff_tbl_ptrs[0] || cinfo.dc_huff_tbl_ptrs[1] ||
            cinfo.ac_huff_tbl_ptrs[0] || cinfo.ac_huff_tbl_ptrs[1])) {
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camunits/plugin.h"
+#include "camunits/dbg.h"
+
+#define err(args...) fprintf(stderr, args)
+
+typedef struct _CamLosslessCompress {
+    CamUnit parent;
+
+    CamUnitControl *threads_ctl;
+
+    CamPixelFormat pixelformat;
+    int max_size;
+} CamLosslessCompress;
+
+typedef struct _CamLosslessCompressClass {
+    CamUnitClass parent_class;
+} CamLosslessCompressClass;
+
+static CamLosslessCompress * cam_lossless_compress_new (void);
+
+GType cam_lossless_compress_get_type (void);
+CAM_PLUGIN_TYPE(CamLosslessCompress, cam_lossless_compress, CAM_TYPE_UNIT);
+
+/* These next two functions are required as entry points for the
+ * plug-in API. */
+void cam_plugin_initialize(GTypeModule * module);
+void cam_plugin_initialize(GTypeModule * module)
+{
+    cam_lossless_compress_register_type(module);
+}
+
+CamUnitDriver * cam_plugin_create(GTypeModule * module);
+CamUnitDriver * cam_plugin_create(GTypeModule * module)
+{
+    return cam_unit_driver_new_stock_full ( "convert", "lossless_compress",
+            "Lossless Compress", 0,
+            (CamUnitConstructor)cam_lossless_compress_new, module);
+}
+
+// ============== CamLosslessCompress ===============
+static void on_input_frame_ready (CamUnit * super, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *infmt);
+static int cam_lossless_compress_stream_init (CamUnit * super,
+        const CamUnitFormat * fmt);
+static void on_input_format_changed (CamUnit *super,
+        const CamUnitFormat *infmt);
+static gboolean cam_lossless_compress_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual);
+
+static void
+cam_lossless_compress_init (CamLosslessCompress *self)
+{
+    dbg(DBG_FILTER, "lossless compress constructor\n");
+    CamUnit *super = CAM_UNIT (self);
+
+    self->threads_ctl = cam_unit_add_control_int (super, "threads",
+            "Threads", 1, 64, 1, 1, 1);
+
+    self->pixelformat = CAM_PIXEL_FORMAT_INVALID;
+    self->max_size = 0;
+
+    g_signal_connect (G_OBJECT (self), "input-format-changed",
+            G_CALLBACK (on_input_format_changed), self);
+}
+
+static void
+cam_lossless_compress_class_init (CamLosslessCompressClass *klass)
+{
+    dbg(DBG_FILTER, "lossless compress class initializer\n");
+    klass->parent_class.on_input_frame_ready = on_input_frame_ready;
+    klass->parent_class.stream_init = cam_lossless_compress_stream_init;
+    klass->parent_class.try_set_control =
+        cam_lossless_compress_try_set_control;
+}
+
+CamLosslessCompress *
+cam_lossless_compress_new()
+{
+    return (CamLosslessCompress*)
+            g_object_new(cam_lossless_compress_get_type(), NULL);
+}
+
+static void
+on_input_format_changed (CamUnit *super, const CamUnitFormat *infmt)
+{
+    cam_unit_remove_all_output_formats (super);
+    if (!infmt)
+        return;
+
+    CamPixelFormat tag = cam_pixel_format_lossless (infmt->pixelformat);
+    if (tag == CAM_PIXEL_FORMAT_INVALID)
+        return;
+
+    cam_unit_add_output_format (super, tag, NULL,
+            infmt->width, infmt->height, 0);
+}
+
+static gboolean
+cam_lossless_compress_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual)
+{
+    CamLosslessCompress *self = (CamLosslessCompress*) super;
+    if (ctl == self->threads_ctl) {
+        g_value_copy (proposed, actual);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static int
+cam_lossless_compress_stream_init (CamUnit * super,
+        const CamUnitFormat * outfmt)
+{
+    CamLosslessCompress * self = (CamLosslessCompress*) super;
+    CamUnit * input = cam_unit_get_input (super);
+    const CamUnitFormat * infmt = cam_unit_get_output_format (input);
+
+    if (outfmt->pixelformat != cam_pixel_format_lossless (infmt->pixelformat))
+        return -1;
+
+    self->pixelformat = infmt->pixelformat;
+    self->max_size = cam_pixel_lossless_max_size (infmt->pixelformat,
+            infmt->width, infmt->height);
+    if (self->max_size < 0)
+        return -1;
+
+    dbg(DBG_FILTER, "lossless compress %s %dx%d\n",
+            cam_pixel_format_nickname (infmt->pixelformat),
+            infmt->width, infmt->height);
+    return 0;
+}
+
+static void
+on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *infmt)
+{
+    CamLosslessCompress * self = (CamLosslessCompress*) super;
+    dbg(DBG_FILTER, "[%s] iterate\n", cam_unit_get_name(super));
+
+    if (self->max_size <= 0) return;
+
+    const CamUnitFormat *outfmt = cam_unit_get_output_format(super);
+    CamFrameBuffer *outbuf = cam_framebuffer_new_alloc (self->max_size);
+
+    int sstride = infmt->row_stride ? infmt->row_stride :
+        infmt->width * cam_pixel_format_bpp (infmt->pixelformat) / 8;
+
+    int size = cam_pixel_lossless_encode (outbuf->data, outbuf->length,
+            inbuf->data, sstride, self->pixelformat,
+            infmt->width, infmt->height,
+            cam_unit_control_get_int (self->threads_ctl));
+
+    if (size > 0) {
+        cam_framebuffer_copy_metadata(outbuf, inbuf);
+        outbuf->bytesused = size;
+        cam_unit_produce_frame (super, outbuf, outfmt);
+    } else {
+        err("LosslessCompress: couldn't compress frame\n");
+    }
+
+    g_object_unref (outbuf);
+}
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camunits/plugin.h"
+#include "camunits/dbg.h"
+
+#define err(args...) fprintf(stderr, args)
+
+typedef struct _CamLosslessDecompress {
+    CamUnit parent;
+
+    CamUnitControl *threads_ctl;
+
+    CamPixelFormat pixelformat;
+} CamLosslessDecompress;
+
+typedef struct _CamLosslessDecompressClass {
+    CamUnitClass parent_class;
+} CamLosslessDecompressClass;
+
+static CamLosslessDecompress * cam_lossless_decompress_new (void);
+
+GType cam_lossless_decompress_get_type (void);
+CAM_PLUGIN_TYPE(CamLosslessDecompress, cam_lossless_decompress,
+        CAM_TYPE_UNIT);
+
+/* These next two functions are required as entry points for the
+ * plug-in API. */
+void cam_plugin_initialize(GTypeModule * module);
+void cam_plugin_initialize(GTypeModule * module)
+{
+    cam_lossless_decompress_register_type(module);
+}
+
+CamUnitDriver * cam_plugin_create(GTypeModule * module);
+CamUnitDriver * cam_plugin_create(GTypeModule * module)
+{
+    return cam_unit_driver_new_stock_full ( "convert", "lossless_decompress",
+            "Lossless Decompress", 0,
+            (CamUnitConstructor)cam_lossless_decompress_new, module);
+}
+
+// ============== CamLosslessDecompress ===============
+static void on_input_frame_ready (CamUnit * super, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *infmt);
+static int cam_lossless_decompress_stream_init (CamUnit * super,
+        const CamUnitFormat * fmt);
+static void on_input_format_changed (CamUnit *super,
+        const CamUnitFormat *infmt);
+static gboolean cam_lossless_decompress_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual);
+
+static void
+cam_lossless_decompress_init (CamLosslessDecompress *self)
+{
+    dbg(DBG_FILTER, "lossless decompress constructor\n");
+    CamUnit *super = CAM_UNIT (self);
+
+    self->threads_ctl = cam_unit_add_control_int (super, "threads",
+            "Threads", 1, 64, 1, 1, 1);
+
+    self->pixelformat = CAM_PIXEL_FORMAT_INVALID;
+
+    g_signal_connect (G_OBJECT (self), "input-format-changed",
+            G_CALLBACK (on_input_format_changed), self);
+}
+
+static void
+cam_lossless_decompress_class_init (CamLosslessDecompressClass *klass)
+{
+    dbg(DBG_FILTER, "lossless decompress class initializer\n");
+    klass->parent_class.on_input_frame_ready = on_input_frame_ready;
+    klass->parent_class.stream_init = cam_lossless_decompress_stream_init;
+    klass->parent_class.try_set_control =
+        cam_lossless_decompress_try_set_control;
+}
+
+CamLosslessDecompress *
+cam_lossless_decompress_new()
+{
+    return (CamLosslessDecompress*)
+            g_object_new(cam_lossless_decompress_get_type(), NULL);
+}
+
+/* The stream tag names the format of the decompressed images, so there is
+ * exactly one output format */
+static void
+on_input_format_changed (CamUnit *super, const CamUnitFormat *infmt)
+{
+    cam_unit_remove_all_output_formats (super);
+    if (!infmt)
+        return;
+
+    CamPixelFormat pfmt = cam_pixel_format_lossless_source (
+            infmt->pixelformat);
+    if (pfmt == CAM_PIXEL_FORMAT_INVALID)
+        return;
+
+    int stride = infmt->width * cam_pixel_format_bpp (pfmt) / 8;
+    stride = (stride + 0xf) & (~0xf);
+    cam_unit_add_output_format (super, pfmt, NULL,
+            infmt->width, infmt->height, stride);
+}
+
+static gboolean
+cam_lossless_decompress_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual)
+{
+    CamLosslessDecompress *self = (CamLosslessDecompress*) super;
+    if (ctl == self->threads_ctl) {
+        g_value_copy (proposed, actual);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static int
+cam_lossless_decompress_stream_init (CamUnit * super,
+        const CamUnitFormat * outfmt)
+{
+    CamLosslessDecompress * self = (CamLosslessDecompress*) super;
+    CamUnit * input = cam_unit_get_input (super);
+    const CamUnitFormat * infmt = cam_unit_get_output_format (input);
+
+    self->pixelformat = cam_pixel_format_lossless_source (infmt->pixelformat);
+    if (outfmt->pixelformat != self->pixelformat)
+        return -1;
+
+    dbg(DBG_FILTER, "lossless decompress %s %dx%d\n",
+            cam_pixel_format_nickname (outfmt->pixelformat),
+            outfmt->width, outfmt->height);
+    return 0;
+}
+
+static void
+on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *infmt)
+{
+    CamLosslessDecompress * self = (CamLosslessDecompress*) super;
+    dbg(DBG_FILTER, "[%s] iterate\n", cam_unit_get_name(super));
+
+    if (self->pixelformat == CAM_PIXEL_FORMAT_INVALID) return;
+
+    const CamUnitFormat *outfmt = cam_unit_get_output_format(super);
+    int out_buf_size = outfmt->height * outfmt->row_stride;
+    CamFrameBuffer *outbuf = cam_framebuffer_new_alloc (out_buf_size);
+
+    int status = cam_pixel_lossless_decode (outbuf->data, outfmt->row_stride,
+            outfmt->width, outfmt->height, self->pixelformat,
+            inbuf->data, inbuf->bytesused,
+            cam_unit_control_get_int (self->threads_ctl));
+
+    if (0 == status) {
+        cam_framebuffer_copy_metadata(outbuf, inbuf);
+        outbuf->bytesused = out_buf_size;
+        cam_unit_produce_frame (super, outbuf, outfmt);
+    } else {
+        err("LosslessDecompress: couldn't decompress frame\n");
+    }
+
+    g_object_unref (outbuf);
+}
@@ -0,0 +1,499 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "camunits/plugin.h"
+#include "camunits/dbg.h"
+
+#define err(args...) fprintf(stderr, args)
+
+enum {
+    PARAM_GAMMA = 0,
+    PARAM_BRIGHTNESS,
+    PARAM_CONTRAST,
+    PARAM_GAIN_R,
+    PARAM_GAIN_G,
+    PARAM_GAIN_B,
+    NUM_PARAMS
+};
+
+static const struct {
+    const char *id;
+    const char *name;
+    float min;
+    float max;
+    float step;
+    float default_val;
+} params[NUM_PARAMS] = {
+    { "gamma", "Gamma", 0.1, 10, 0.01, 1 },
+    { "brightness", "Brightness", -1, 1, 0.01, 0 },
+    { "contrast", "Contrast", 0, 10, 0.01, 1 },
+    { "gain-r", "Gain Red", 0, 10, 0.01, 1 },
+    { "gain-g", "Gain Green", 0, 10, 0.01, 1 },
+    { "gain-b", "Gain Blue", 0, 10, 0.01, 1 },
+};
+
+typedef enum {
+    COLORMAP_NONE = 0,
+    COLORMAP_JET,
+    COLORMAP_HOT,
+    COLORMAP_COOL,
+} colormap_t;
+
+/* The values of the controls that shape the tables.  They are kept here
+ * as well, since try_set_control has to build tables from a proposed value
+ * before the control takes it. */
+typedef struct _lut_params_t {
+    double p[NUM_PARAMS];
+    int invert;
+    int colormap;
+    int bits;
+} lut_params_t;
+
+/* A complete set of tables for one input and output format.  Tables are
+ * never changed once built.  New control values build a new set, which
+ * replaces the old one in one step, and each frame holds a reference to the
+ * set it started with, so a frame never sees half of an update. */
+typedef struct _lut_tables_t {
+    int refcount;
+    int src_channels;
+    int dst_channels;
+    /* index bits of each table: 8 for 8-bit sources */
+    int bits;
+    int big_endian;
+    uint8_t *data;
+} lut_tables_t;
+
+typedef struct _CamLutFilter {
+    CamUnit parent;
+
+    CamUnitControl *param_ctls[NUM_PARAMS];
+    CamUnitControl *invert_ctl;
+    CamUnitControl *colormap_ctl;
+    CamUnitControl *bits_ctl;
+    CamUnitControl *threads_ctl;
+
+    lut_params_t params;
+    GMutex *tables_lock;
+    lut_tables_t *tables;
+} CamLutFilter;
+
+typedef struct _CamLutFilterClass {
+    CamUnitClass parent_class;
+} CamLutFilterClass;
+
+/* Arguments for looking up one band of rows with lut_band() */
+typedef struct _lut_args_t {
+    const lut_tables_t *tables;
+    uint8_t *dst;
+    int dstride;
+    const uint8_t *src;
+    int sstride;
+    int width;
+    int status;
+} lut_args_t;
+
+static CamLutFilter * cam_lut_filter_new (void);
+
+GType cam_lut_filter_get_type (void);
+CAM_PLUGIN_TYPE(CamLutFilter, cam_lut_filter, CAM_TYPE_UNIT);
+
+/* These next two functions are required as entry points for the
+ * plug-in API. */
+void cam_plugin_initialize(GTypeModule * module);
+void cam_plugin_initialize(GTypeModule * module)
+{
+    cam_lut_filter_register_type(module);
+}
+
+CamUnitDriver * cam_plugin_create(GTypeModule * module);
+CamUnitDriver * cam_plugin_create(GTypeModule * module)
+{
+    return cam_unit_driver_new_stock_full ( "convert", "lut",
+            "Lookup Table", 0,
+            (CamUnitConstructor)cam_lut_filter_new, module);
+}
+
+// ============== CamLutFilter ===============
+static void cam_lut_filter_finalize (GObject *obj);
+static void on_input_frame_ready (CamUnit * super, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *infmt);
+static int cam_lut_filter_stream_init (CamUnit * super,
+        const CamUnitFormat * fmt);
+static int cam_lut_filter_stream_shutdown (CamUnit * super);
+static void on_input_format_changed (CamUnit *super,
+        const CamUnitFormat *infmt);
+static gboolean cam_lut_filter_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual);
+
+static int
+channels_for_format (CamPixelFormat pfmt)
+{
+    switch (pfmt) {
+        case CAM_PIXEL_FORMAT_GRAY:
+        case CAM_PIXEL_FORMAT_BE_GRAY16:
+        case CAM_PIXEL_FORMAT_LE_GRAY16:
+            return 1;
+        case CAM_PIXEL_FORMAT_RGB:
+        case CAM_PIXEL_FORMAT_BGR:
+        case CAM_PIXEL_FORMAT_BE_RGB16:
+        case CAM_PIXEL_FORMAT_LE_RGB16:
+            return 3;
+        case CAM_PIXEL_FORMAT_RGBA:
+        case CAM_PIXEL_FORMAT_BGRA:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+static int
+is_16u (CamPixelFormat pfmt)
+{
+    return cam_pixel_format_bpp (pfmt) / channels_for_format (pfmt) == 16;
+}
+
+/* The output is always 8 bits per channel.  A colormap turns gray into
+ * RGB; color images ignore it. */
+static CamPixelFormat
+output_format (CamPixelFormat pfmt, int colormap)
+{
+    switch (pfmt) {
+        case CAM_PIXEL_FORMAT_GRAY:
+        case CAM_PIXEL_FORMAT_BE_GRAY16:
+        case CAM_PIXEL_FORMAT_LE_GRAY16:
+            return colormap == COLORMAP_NONE ? CAM_PIXEL_FORMAT_GRAY :
+                CAM_PIXEL_FORMAT_RGB;
+        case CAM_PIXEL_FORMAT_BE_RGB16:
+        case CAM_PIXEL_FORMAT_LE_RGB16:
+            return CAM_PIXEL_FORMAT_RGB;
+        default:
+            return pfmt;
+    }
+}
+
+static void
+cam_lut_filter_init (CamLutFilter *self)
+{
+    dbg(DBG_FILTER, "lut filter constructor\n");
+    CamUnit *super = CAM_UNIT (self);
+
+    for (int i = 0; i < NUM_PARAMS; i++) {
+        self->param_ctls[i] = cam_unit_add_control_float (super,
+                params[i].id, params[i].name, params[i].min, params[i].max,
+                params[i].step, params[i].default_val, 1);
+        self->params.p[i] = params[i].default_val;
+    }
+    self->invert_ctl = cam_unit_add_control_boolean (super, "invert",
+            "Invert", 0, 1);
+
+    CamUnitControlEnumValue colormap_entries[] = {
+        { COLORMAP_NONE, "None", 1 },
+        { COLORMAP_JET, "Jet", 1 },
+        { COLORMAP_HOT, "Hot", 1 },
+        { COLORMAP_COOL, "Cool", 1 },
+        { 0, NULL, 0 }
+    };
+    self->colormap_ctl = cam_unit_add_control_enum (super, "colormap",
+            "False Color", COLORMAP_NONE, 1, colormap_entries);
+    self->bits_ctl = cam_unit_add_control_int (super, "bits",
+            "Input Bits", 1, 16, 1, 16, 1);
+    cam_unit_control_set_ui_hints (self->bits_ctl,
+            CAM_UNIT_CONTROL_SPINBUTTON);
+    self->threads_ctl = cam_unit_add_control_int (super, "threads",
+            "Threads", 1, 64, 1, 1, 1);
+
+    self->params.invert = 0;
+    self->params.colormap = COLORMAP_NONE;
+    self->params.bits = 16;
+    self->tables_lock = g_mutex_new ();
+    self->tables = NULL;
+
+    g_signal_connect (G_OBJECT (self), "input-format-changed",
+            G_CALLBACK (on_input_format_changed), self);
+}
+
+static void
+cam_lut_filter_class_init (CamLutFilterClass *klass)
+{
+    dbg(DBG_FILTER, "lut filter class initializer\n");
+    GObjectClass * gobject_class = G_OBJECT_CLASS (klass);
+    gobject_class->finalize = cam_lut_filter_finalize;
+    klass->parent_class.on_input_frame_ready = on_input_frame_ready;
+    klass->parent_class.stream_init = cam_lut_filter_stream_init;
+    klass->parent_class.stream_shutdown = cam_lut_filter_stream_shutdown;
+    klass->parent_class.try_set_control = cam_lut_filter_try_set_control;
+    if (!g_thread_supported ()) g_thread_init (NULL);
+}
+
+CamLutFilter *
+cam_lut_filter_new()
+{
+    return (CamLutFilter*)
+            g_object_new(cam_lut_filter_get_type(), NULL);
+}
+
+static void
+tables_unref (lut_tables_t *tables)
+{
+    if (!tables || !g_atomic_int_dec_and_test (&tables->refcount))
+        return;
+    free (tables->data);
+    free (tables);
+}
+
+/* Returns a reference to the current tables, or NULL */
+static lut_tables_t *
+get_tables (CamLutFilter *self)
+{
+    g_mutex_lock (self->tables_lock);
+    lut_tables_t *tables = self->tables;
+    if (tables)
+        g_atomic_int_inc (&tables->refcount);
+    g_mutex_unlock (self->tables_lock);
+    return tables;
+}
+
+/* Makes @tables current, taking over the caller's reference */
+static void
+set_tables (CamLutFilter *self, lut_tables_t *tables)
+{
+    g_mutex_lock (self->tables_lock);
+    lut_tables_t *old = self->tables;
+    self->tables = tables;
+    g_mutex_unlock (self->tables_lock);
+    tables_unref (old);
+}
+
+static void
+cam_lut_filter_finalize (GObject * obj)
+{
+    CamLutFilter *self = (CamLutFilter*) obj;
+    set_tables (self, NULL);
+    g_mutex_free (self->tables_lock);
+
+    G_OBJECT_CLASS (cam_lut_filter_parent_class)->finalize (obj);
+}
+
+static void
+update_output_formats (CamLutFilter *self, const CamUnitFormat *infmt)
+{
+    CamUnit *super = CAM_UNIT (self);
+    cam_unit_remove_all_output_formats (super);
+    if (!infmt || !channels_for_format (infmt->pixelformat))
+        return;
+
+    CamPixelFormat pfmt = output_format (infmt->pixelformat,
+            self->params.colormap);
+    int stride = infmt->width * cam_pixel_format_bpp (pfmt) / 8;
+    stride = (stride + 0xf) & (~0xf);
+    cam_unit_add_output_format (super, pfmt, NULL, infmt->width,
+            infmt->height, stride);
+}
+
+static void
+on_input_format_changed (CamUnit *super, const CamUnitFormat *infmt)
+{
+    update_output_formats ((CamLutFilter*) super, infmt);
+}
+
+static double
+clamp01 (double x)
+{
+    return x < 0 ? 0 : x > 1 ? 1 : x;
+}
+
+/* Component @k (0 red, 1 green, 2 blue) of colormap @colormap at @x */
+static double
+colormap_value (int colormap, int k, double x)
+{
+    switch (colormap) {
+        case COLORMAP_JET:
+            return clamp01 (1.5 - fabs (4 * x - 3 + k));
+        case COLORMAP_HOT:
+            return clamp01 (3 * x - k);
+        case COLORMAP_COOL:
+            return k == 0 ? x : k == 1 ? 1 - x : 1;
+        default:
+            return x;
+    }
+}
+
+/* Builds the tables that map @in to @out.  Each output channel gets a
+ * table indexed by the input channel it comes from, or by the gray value
+ * when a colormap expands gray to RGB.  Values are taken through the gain
+ * of their color, brightness and contrast, then gamma, then inversion and
+ * the colormap. */
+static lut_tables_t *
+build_tables (CamPixelFormat in, CamPixelFormat out, const lut_params_t *lp)
+{
+    lut_tables_t *tables = calloc (1, sizeof (lut_tables_t));
+    tables->refcount = 1;
+    tables->src_channels = channels_for_format (in);
+    tables->dst_channels = channels_for_format (out);
+    tables->bits = is_16u (in) ? lp->bits : 8;
+    tables->big_endian = in == CAM_PIXEL_FORMAT_BE_GRAY16 ||
+        in == CAM_PIXEL_FORMAT_BE_RGB16;
+    tables->data = malloc (tables->dst_channels << tables->bits);
+
+    int expand = tables->src_channels == 1 && tables->dst_channels > 1;
+    int bgr = out == CAM_PIXEL_FORMAT_BGR || out == CAM_PIXEL_FORMAT_BGRA;
+    int max = (1 << tables->bits) - 1;
+    double inv_gamma = 1.0 / lp->p[PARAM_GAMMA];
+
+    for (int k = 0; k < tables->dst_channels; k++) {
+        uint8_t *t = tables->data + (k << tables->bits);
+        if (k == 3) {
+            /* alpha passes through */
+            for (int v = 0; v <= max; v++)
+                t[v] = v;
+            continue;
+        }
+        double gain = 1;
+        if (tables->src_channels > 1)
+            gain = lp->p[PARAM_GAIN_R + (bgr ? 2 - k : k)];
+        for (int v = 0; v <= max; v++) {
+            double y = (double) v / max * gain;
+            y = (y - 0.5) * lp->p[PARAM_CONTRAST] + 0.5 +
+                lp->p[PARAM_BRIGHTNESS];
+            y = pow (clamp01 (y), inv_gamma);
+            if (lp->invert)
+                y = 1 - y;
+            if (expand)
+                y = colormap_value (lp->colormap, k, y);
+            t[v] = (uint8_t) lrint (y * 255);
+        }
+    }
+    return tables;
+}
+
+static gboolean
+cam_lut_filter_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual)
+{
+    CamLutFilter *self = (CamLutFilter*) super;
+    lut_params_t *lp = &self->params;
+    int old_colormap = lp->colormap;
+    int i;
+
+    for (i = 0; i < NUM_PARAMS && ctl != self->param_ctls[i]; i++);
+    if (i < NUM_PARAMS)
+        lp->p[i] = g_value_get_float (proposed);
+    else if (ctl == self->invert_ctl)
+        lp->invert = g_value_get_boolean (proposed);
+    else if (ctl == self->colormap_ctl)
+        lp->colormap = g_value_get_int (proposed);
+    else if (ctl == self->bits_ctl)
+        lp->bits = g_value_get_int (proposed);
+
+    CamUnit *input = cam_unit_get_input (super);
+    const CamUnitFormat *infmt = input ?
+        cam_unit_get_output_format (input) : NULL;
+    if (ctl == self->threads_ctl || !infmt) {
+        /* nothing to rebuild */
+    } else if (output_format (infmt->pixelformat, old_colormap) !=
+            output_format (infmt->pixelformat, lp->colormap)) {
+        /* false color turns gray into RGB, so renegotiate */
+        int streaming = cam_unit_is_streaming (super);
+        if (streaming)
+            cam_unit_stream_shutdown (super);
+        update_output_formats (self, infmt);
+        if (streaming)
+            cam_unit_stream_init (super, NULL);
+    } else if (cam_unit_is_streaming (super)) {
+        /* the format stays, so new tables simply replace the old ones
+         * without restarting the stream */
+        const CamUnitFormat *outfmt = cam_unit_get_output_format (super);
+        set_tables (self, build_tables (infmt->pixelformat,
+                    outfmt->pixelformat, lp));
+    }
+
+    g_value_copy (proposed, actual);
+    return TRUE;
+}
+
+static int
+cam_lut_filter_stream_init (CamUnit * super, const CamUnitFormat * outfmt)
+{
+    CamLutFilter * self = (CamLutFilter*) super;
+    CamUnit * input = cam_unit_get_input (super);
+    const CamUnitFormat * infmt = cam_unit_get_output_format (input);
+
+    if (!channels_for_format (infmt->pixelformat) ||
+        outfmt->pixelformat != output_format (infmt->pixelformat,
+            self->params.colormap))
+        return -1;
+
+    set_tables (self, build_tables (infmt->pixelformat, outfmt->pixelformat,
+                &self->params));
+    return 0;
+}
+
+static int
+cam_lut_filter_stream_shutdown (CamUnit * super)
+{
+    set_tables ((CamLutFilter*) super, NULL);
+    return 0;
+}
+
+static void
+lut_band (int row_start, int row_end, void *user_data)
+{
+    lut_args_t *a = (lut_args_t*) user_data;
+    const lut_tables_t *t = a->tables;
+    uint8_t *dst = a->dst + row_start * a->dstride;
+    const uint8_t *src = a->src + row_start * a->sstride;
+    int status;
+
+    if (t->bits == 8)
+        status = cam_pixel_apply_lut_8u_multi (dst, a->dstride, a->width,
+                row_end - row_start, src, a->sstride, t->src_channels,
+                t->dst_channels, t->data);
+    else
+        status = cam_pixel_apply_lut_16u_to_8u (dst, a->dstride, a->width,
+                row_end - row_start, (const uint16_t*) src, a->sstride,
+                t->src_channels, t->dst_channels, t->bits, t->data,
+                t->big_endian);
+    if (0 != status)
+        a->status = -1;
+}
+
+static void
+on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *infmt)
+{
+    CamLutFilter * self = (CamLutFilter*) super;
+    dbg(DBG_FILTER, "[%s] iterate\n", cam_unit_get_name(super));
+
+    lut_tables_t *tables = get_tables (self);
+    if (!tables) return;
+
+    const CamUnitFormat *outfmt = cam_unit_get_output_format(super);
+    int out_buf_size = outfmt->height * outfmt->row_stride;
+    CamFrameBuffer *outbuf = cam_framebuffer_new_alloc (out_buf_size);
+
+    lut_args_t args = {
+        .tables = tables,
+        .dst = outbuf->data,
+        .dstride = outfmt->row_stride,
+        .src = inbuf->data,
+        .sstride = infmt->row_stride ? infmt->row_stride :
+            infmt->width * cam_pixel_format_bpp (infmt->pixelformat) / 8,
+        .width = infmt->width,
+        .status = 0,
+    };
+
+    cam_pixel_parallel_for (cam_unit_control_get_int (self->threads_ctl),
+            outfmt->height, 1, args.sstride + outfmt->row_stride,
+            lut_band, &args);
+    tables_unref (tables);
+
+    if (0 == args.status) {
+        cam_framebuffer_copy_metadata(outbuf, inbuf);
+        outbuf->bytesused = out_buf_size;
+        cam_unit_produce_frame (super, outbuf, outfmt);
+    }
+
+    g_object_unref (outbuf);
+}
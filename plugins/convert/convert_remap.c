@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camunits/plugin.h"
+#include "camunits/dbg.h"
+
+#define err(args...) fprintf(stderr, args)
+
+/* Pinhole camera parameters, with radial (k1, k2, k3) and tangential (p1,
+ * p2) distortion as in the Brown-Conrady model */
+enum {
+    PARAM_FX,
+    PARAM_FY,
+    PARAM_CX,
+    PARAM_CY,
+    PARAM_K1,
+    PARAM_K2,
+    PARAM_P1,
+    PARAM_P2,
+    PARAM_K3,
+    NUM_PARAMS
+};
+
+static const struct {
+    const char *id;
+    const char *name;
+    float min;
+    float max;
+    float step;
+    float default_val;
+} params[NUM_PARAMS] = {
+    { "fx", "Focal Length X", 0, 100000, 0.1, 0 },
+    { "fy", "Focal Length Y", 0, 100000, 0.1, 0 },
+    { "cx", "Principal Point X", -1, 32767, 0.1, -1 },
+    { "cy", "Principal Point Y", -1, 32767, 0.1, -1 },
+    { "k1", "Radial K1", -10, 10, 0.001, 0 },
+    { "k2", "Radial K2", -10, 10, 0.001, 0 },
+    { "p1", "Tangential P1", -1, 1, 0.0001, 0 },
+    { "p2", "Tangential P2", -1, 1, 0.0001, 0 },
+    { "k3", "Radial K3", -10, 10, 0.001, 0 },
+};
+
+typedef struct _CamRemapFilter {
+    CamUnit parent;
+
+    CamUnitControl *param_ctls[NUM_PARAMS];
+    CamUnitControl *file_ctl;
+    CamUnitControl *threads_ctl;
+
+    CamPixelRemap *map;
+    int channels;
+} CamRemapFilter;
+
+typedef struct _CamRemapFilterClass {
+    CamUnitClass parent_class;
+} CamRemapFilterClass;
+
+/* Arguments for remapping one band of output rows with remap_band() */
+typedef struct _remap_args_t {
+    uint8_t *dst;
+    int dstride;
+    const uint8_t *src;
+    int sstride;
+    int channels;
+    const CamPixelRemap *map;
+    int status;
+} remap_args_t;
+
+static CamRemapFilter * cam_remap_filter_new (void);
+
+GType cam_remap_filter_get_type (void);
+CAM_PLUGIN_TYPE(CamRemapFilter, cam_remap_filter, CAM_TYPE_UNIT);
+
+/* These next two functions are required as entry points for the
+ * plug-in API. */
+void cam_plugin_initialize(GTypeModule * module);
+void cam_plugin_initialize(GTypeModule * module)
+{
+    cam_remap_filter_register_type(module);
+}
+
+CamUnitDriver * cam_plugin_create(GTypeModule * module);
+CamUnitDriver * cam_plugin_create(GTypeModule * module)
+{
+    return cam_unit_driver_new_stock_full ( "convert", "remap",
+            "Undistort", 0,
+            (CamUnitConstructor)cam_remap_filter_new, module);
+}
+
+// ============== CamRemapFilter ===============
+static void cam_remap_filter_finalize (GObject * obj);
+static void on_input_frame_ready (CamUnit * super, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *infmt);
+static int cam_remap_filter_stream_init (CamUnit * super,
+        const CamUnitFormat * fmt);
+static int cam_remap_filter_stream_shutdown (CamUnit * super);
+static void on_input_format_changed (CamUnit *super,
+        const CamUnitFormat *infmt);
+static gboolean cam_remap_filter_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual);
+
+static int
+channels_for_format (CamPixelFormat pfmt)
+{
+    switch (pfmt) {
+        case CAM_PIXEL_FORMAT_GRAY:
+            return 1;
+        case CAM_PIXEL_FORMAT_RGB:
+        case CAM_PIXEL_FORMAT_BGR:
+            return 3;
+        case CAM_PIXEL_FORMAT_RGBA:
+        case CAM_PIXEL_FORMAT_BGRA:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+static void
+cam_remap_filter_init (CamRemapFilter *self)
+{
+    dbg(DBG_FILTER, "remap filter constructor\n");
+    CamUnit *super = CAM_UNIT (self);
+
+    self->file_ctl = cam_unit_add_control_string (super, "calibration-file",
+            "Calibration File", "", 1);
+    cam_unit_control_set_ui_hints (self->file_ctl, CAM_UNIT_CONTROL_FILENAME);
+    for (int i = 0; i < NUM_PARAMS; i++) {
+        self->param_ctls[i] = cam_unit_add_control_float (super,
+                params[i].id, params[i].name, params[i].min, params[i].max,
+                params[i].step, params[i].default_val, 1);
+        cam_unit_control_set_ui_hints (self->param_ctls[i],
+                CAM_UNIT_CONTROL_SPINBUTTON);
+    }
+    self->threads_ctl = cam_unit_add_control_int (super, "threads",
+            "Threads", 1, 64, 1, 1, 1);
+
+    self->map = NULL;
+    self->channels = 0;
+
+    g_signal_connect (G_OBJECT (self), "input-format-changed",
+            G_CALLBACK (on_input_format_changed), self);
+}
+
+static void
+cam_remap_filter_class_init (CamRemapFilterClass *klass)
+{
+    dbg(DBG_FILTER, "remap filter class initializer\n");
+    GObjectClass * gobject_class = G_OBJECT_CLASS (klass);
+    gobject_class->finalize = cam_remap_filter_finalize;
+    klass->parent_class.on_input_frame_ready = on_input_frame_ready;
+    klass->parent_class.stream_init = cam_remap_filter_stream_init;
+    klass->parent_class.stream_shutdown = cam_remap_filter_stream_shutdown;
+    klass->parent_class.try_set_control = cam_remap_filter_try_set_control;
+}
+
+CamRemapFilter *
+cam_remap_filter_new()
+{
+    return (CamRemapFilter*)
+            g_object_new(cam_remap_filter_get_type(), NULL);
+}
+
+static void
+cam_remap_filter_finalize (GObject * obj)
+{
+    CamRemapFilter *self = (CamRemapFilter*) obj;
+    cam_pixel_remap_free (self->map);
+    self->map = NULL;
+
+    G_OBJECT_CLASS (cam_remap_filter_parent_class)->finalize (obj);
+}
+
+static void
+update_output_formats (CamRemapFilter *self, const CamUnitFormat *infmt)
+{
+    CamUnit *super = CAM_UNIT (self);
+    cam_unit_remove_all_output_formats (super);
+    if (!infmt || !channels_for_format (infmt->pixelformat) ||
+        infmt->width < 2 || infmt->height < 2)
+        return;
+
+    int stride = infmt->width * cam_pixel_format_bpp (infmt->pixelformat) / 8;
+    stride = (stride + 0xf) & (~0xf);
+    cam_unit_add_output_format (super, infmt->pixelformat, NULL,
+            infmt->width, infmt->height, stride);
+}
+
+static void
+on_input_format_changed (CamUnit *super, const CamUnitFormat *infmt)
+{
+    update_output_formats ((CamRemapFilter*) super, infmt);
+}
+
+static void
+get_params (CamRemapFilter *self, double *p)
+{
+    for (int i = 0; i < NUM_PARAMS; i++)
+        p[i] = cam_unit_control_get_float (self->param_ctls[i]);
+}
+
+/* Builds the map that undistorts a @width x @height image taken with
+ * camera parameters @p.  The undistorted image is rendered with the same
+ * pinhole camera, without distortion, so that the centre of the image keeps
+ * its scale.  A focal length of 0 is taken to be the image width, and a
+ * negative principal point the centre of the image. */
+static CamPixelRemap *
+build_map (int width, int height, const double *p)
+{
+    CamPixelRemap *map = cam_pixel_remap_new (width, height, width, height);
+    if (!map)
+        return NULL;
+
+    double fx = p[PARAM_FX] > 0 ? p[PARAM_FX] : width;
+    double fy = p[PARAM_FY] > 0 ? p[PARAM_FY] : width;
+    double cx = p[PARAM_CX] >= 0 ? p[PARAM_CX] : (width - 1) / 2.0;
+    double cy = p[PARAM_CY] >= 0 ? p[PARAM_CY] : (height - 1) / 2.0;
+
+    for (int i = 0; i < height; i++) {
+        double y = (i - cy) / fy;
+        for (int j = 0; j < width; j++) {
+            double x = (j - cx) / fx;
+            double r2 = x * x + y * y;
+            double radial = 1 + r2 * (p[PARAM_K1] +
+                    r2 * (p[PARAM_K2] + r2 * p[PARAM_K3]));
+            double xd = x * radial + 2 * p[PARAM_P1] * x * y +
+                p[PARAM_P2] * (r2 + 2 * x * x);
+            double yd = y * radial + p[PARAM_P1] * (r2 + 2 * y * y) +
+                2 * p[PARAM_P2] * x * y;
+            cam_pixel_remap_set (map, j, i, fx * xd + cx, fy * yd + cy);
+        }
+    }
+    return map;
+}
+
+/* Reads camera parameters from the [camera] group of a key file, with one
+ * key per control id, e.g. "fx=1210.5".  Missing keys keep the values
+ * already in @p. */
+static int
+load_calibration (const char *fname, double *p)
+{
+    GKeyFile *kf = g_key_file_new ();
+    GError *gerr = NULL;
+    if (!g_key_file_load_from_file (kf, fname, G_KEY_FILE_NONE, &gerr)) {
+        err ("Remap: unable to load %s: %s\n", fname, gerr->message);
+        g_error_free (gerr);
+        g_key_file_free (kf);
+        return -1;
+    }
+    for (int i = 0; i < NUM_PARAMS; i++) {
+        if (!g_key_file_has_key (kf, "camera", params[i].id, NULL))
+            continue;
+        double val = g_key_file_get_double (kf, "camera", params[i].id,
+                &gerr);
+        if (gerr) {
+            err ("Remap: %s: %s\n", fname, gerr->message);
+            g_error_free (gerr);
+            g_key_file_free (kf);
+            return -1;
+        }
+        p[i] = val;
+    }
+    g_key_file_free (kf);
+    return 0;
+}
+
+static gboolean
+cam_remap_filter_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual)
+{
+    CamRemapFilter *self = (CamRemapFilter*) super;
+    double p[NUM_PARAMS];
+    get_params (self, p);
+
+    if (ctl == self->file_ctl) {
+        const char *fname = g_value_get_string (proposed);
+        if (fname && strlen (fname)) {
+            if (load_calibration (fname, p) < 0)
+                return FALSE;
+            for (int i = 0; i < NUM_PARAMS; i++)
+                cam_unit_control_force_set_float (self->param_ctls[i], p[i]);
+        }
+    } else {
+        int i;
+        for (i = 0; i < NUM_PARAMS && ctl != self->param_ctls[i]; i++);
+        if (i < NUM_PARAMS)
+            p[i] = g_value_get_float (proposed);
+    }
+
+    /* the output format doesn't change, so the map is simply replaced */
+    if (self->map) {
+        CamPixelRemap *map = build_map (self->map->width, self->map->height,
+                p);
+        if (map) {
+            cam_pixel_remap_free (self->map);
+            self->map = map;
+        }
+    }
+
+    g_value_copy (proposed, actual);
+    return TRUE;
+}
+
+static int
+cam_remap_filter_stream_init (CamUnit * super, const CamUnitFormat * outfmt)
+{
+    CamRemapFilter * self = (CamRemapFilter*) super;
+    CamUnit * input = cam_unit_get_input (super);
+    const CamUnitFormat * infmt = cam_unit_get_output_format (input);
+
+    self->channels = channels_for_format (infmt->pixelformat);
+    if (!self->channels || outfmt->pixelformat != infmt->pixelformat)
+        return -1;
+
+    double p[NUM_PARAMS];
+    get_params (self, p);
+    cam_pixel_remap_free (self->map);
+    self->map = build_map (outfmt->width, outfmt->height, p);
+    return self->map ? 0 : -1;
+}
+
+static int
+cam_remap_filter_stream_shutdown (CamUnit * super)
+{
+    CamRemapFilter * self = (CamRemapFilter*) super;
+    cam_pixel_remap_free (self->map);
+    self->map = NULL;
+    return 0;
+}
+
+static void
+remap_band (int row_start, int row_end, void *user_data)
+{
+    remap_args_t *a = (remap_args_t*) user_data;
+    if (0 != cam_pixel_remap_8u_rows (a->dst, a->dstride, a->src,
+                a->sstride, a->channels, a->map, row_start, row_end))
+        a->status = -1;
+}
+
+static void
+on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *infmt)
+{
+    CamRemapFilter * self = (CamRemapFilter*) super;
+    dbg(DBG_FILTER, "[%s] iterate\n", cam_unit_get_name(super));
+
+    if (!self->map) return;
+
+    const CamUnitFormat *outfmt = cam_unit_get_output_format(super);
+    int out_buf_size = outfmt->height * outfmt->row_stride;
+    CamFrameBuffer *outbuf = cam_framebuffer_new_alloc (out_buf_size);
+
+    remap_args_t args = {
+        .dst = outbuf->data,
+        .dstride = outfmt->row_stride,
+        .src = inbuf->data,
+        .sstride = infmt->row_stride ? infmt->row_stride :
+            infmt->width * self->channels,
+        .channels = self->channels,
+        .map = self->map,
+        .status = 0,
+    };
+
+    /* each output row reads its own map entries, 6 bytes per pixel, and
+     * source rows nearby */
+    cam_pixel_parallel_for (cam_unit_control_get_int (self->threads_ctl),
+            outfmt->height, 1, 2 * outfmt->row_stride + 6 * outfmt->width,
+            remap_band, &args);
+
+    if (0 == args.status) {
+        cam_framebuffer_copy_metadata(outbuf, inbuf);
+        outbuf->bytesused = out_buf_size;
+        cam_unit_produce_frame (super, outbuf, outfmt);
+    }
+
+    g_object_unref (outbuf);
+}
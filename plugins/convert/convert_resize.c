@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camunits/plugin.h"
+#include "camunits/dbg.h"
+
+#define err(args...) fprintf(stderr, args)
+
+enum {
+    RESIZE_COPY = 0,
+    RESIZE_BOX,
+    RESIZE_BILINEAR
+};
+
+typedef struct _CamResizeFilter {
+    CamUnit parent;
+
+    CamUnitControl *width_ctl;
+    CamUnitControl *height_ctl;
+    CamUnitControl *keep_aspect_ctl;
+    CamUnitControl *threads_ctl;
+
+    int method;
+    int channels;
+    int is_16u;
+} CamResizeFilter;
+
+typedef struct _CamResizeFilterClass {
+    CamUnitClass parent_class;
+} CamResizeFilterClass;
+
+/* Arguments for resizing one band of output rows with resize_band() */
+typedef struct _resize_args_t {
+    int method;
+    int channels;
+    int is_16u;
+    uint8_t *dst;
+    int dstride;
+    int dwidth;
+    int dheight;
+    const uint8_t *src;
+    int sstride;
+    int swidth;
+    int sheight;
+    int status;
+} resize_args_t;
+
+static CamResizeFilter * cam_resize_filter_new (void);
+
+GType cam_resize_filter_get_type (void);
+CAM_PLUGIN_TYPE(CamResizeFilter, cam_resize_filter, CAM_TYPE_UNIT);
+
+/* These next two functions are required as entry points for the
+ * plug-in API. */
+void cam_plugin_initialize(GTypeModule * module);
+void cam_plugin_initialize(GTypeModule * module)
+{
+    cam_resize_filter_register_type(module);
+}
+
+CamUnitDriver * cam_plugin_create(GTypeModule * module);
+CamUnitDriver * cam_plugin_create(GTypeModule * module)
+{
+    return cam_unit_driver_new_stock_full ( "convert", "resize",
+            "Resize", 0,
+            (CamUnitConstructor)cam_resize_filter_new, module);
+}
+
+// ============== CamResizeFilter ===============
+static void on_input_frame_ready (CamUnit * super, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *infmt);
+static int cam_resize_filter_stream_init (CamUnit * super,
+        const CamUnitFormat * fmt);
+static void on_input_format_changed (CamUnit *super,
+        const CamUnitFormat *infmt);
+static gboolean cam_resize_filter_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual);
+
+/* Returns the number of interleaved channels of a format that can be
+ * resized, or 0 if the format is not supported */
+static int
+resize_channels (CamPixelFormat pfmt)
+{
+    switch (pfmt) {
+        case CAM_PIXEL_FORMAT_GRAY:
+        case CAM_PIXEL_FORMAT_LE_GRAY16:
+            return 1;
+        case CAM_PIXEL_FORMAT_RGB:
+        case CAM_PIXEL_FORMAT_BGR:
+            return 3;
+        case CAM_PIXEL_FORMAT_RGBA:
+        case CAM_PIXEL_FORMAT_BGRA:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+static void
+cam_resize_filter_init (CamResizeFilter *self)
+{
+    dbg(DBG_FILTER, "resize filter constructor\n");
+    CamUnit *super = CAM_UNIT (self);
+
+    self->width_ctl = cam_unit_add_control_int (super, "width",
+            "Width", 0, 16384, 1, 0, 1);
+    self->height_ctl = cam_unit_add_control_int (super, "height",
+            "Height", 0, 16384, 1, 0, 1);
+    self->keep_aspect_ctl = cam_unit_add_control_boolean (super,
+            "keep-aspect", "Keep Aspect Ratio", 1, 1);
+    self->threads_ctl = cam_unit_add_control_int (super, "threads",
+            "Threads", 1, 64, 1, 1, 1);
+    cam_unit_control_set_ui_hints (self->width_ctl,
+            CAM_UNIT_CONTROL_SPINBUTTON);
+    cam_unit_control_set_ui_hints (self->height_ctl,
+            CAM_UNIT_CONTROL_SPINBUTTON);
+
+    self->method = RESIZE_COPY;
+    self->channels = 0;
+    self->is_16u = 0;
+
+    g_signal_connect (G_OBJECT (self), "input-format-changed",
+            G_CALLBACK (on_input_format_changed), self);
+}
+
+static void
+cam_resize_filter_class_init (CamResizeFilterClass *klass)
+{
+    dbg(DBG_FILTER, "resize filter class initializer\n");
+    klass->parent_class.on_input_frame_ready = on_input_frame_ready;
+    klass->parent_class.stream_init = cam_resize_filter_stream_init;
+    klass->parent_class.try_set_control = cam_resize_filter_try_set_control;
+}
+
+CamResizeFilter *
+cam_resize_filter_new()
+{
+    return (CamResizeFilter*)
+            g_object_new(cam_resize_filter_get_type(), NULL);
+}
+
+/* Computes the output size from the requested width and height.  A
+ * requested size of 0 means "same as the input", or, if the aspect ratio
+ * is kept, "follow the other dimension".  If both are set and the aspect
+ * ratio is kept, the width wins. */
+static void
+compute_output_size (const CamUnitFormat *infmt, int req_width,
+        int req_height, int keep_aspect, int *width, int *height)
+{
+    int w = req_width ? req_width : infmt->width;
+    int h = req_height ? req_height : infmt->height;
+
+    if (keep_aspect && req_width)
+        h = (int)(((int64_t) infmt->height * w + infmt->width / 2) /
+                infmt->width);
+    else if (keep_aspect && req_height)
+        w = (int)(((int64_t) infmt->width * h + infmt->height / 2) /
+                infmt->height);
+
+    *width = w < 1 ? 1 : w;
+    *height = h < 1 ? 1 : h;
+}
+
+static void
+update_output_formats (CamResizeFilter *self, const CamUnitFormat *infmt,
+        int req_width, int req_height, int keep_aspect)
+{
+    CamUnit *super = CAM_UNIT (self);
+    cam_unit_remove_all_output_formats (super);
+    if (!infmt || !resize_channels (infmt->pixelformat))
+        return;
+
+    int width, height;
+    compute_output_size (infmt, req_width, req_height, keep_aspect,
+            &width, &height);
+
+    /* offer only the one size, so that stream_init can't pick another */
+    int stride = width * cam_pixel_format_bpp (infmt->pixelformat) / 8;
+    stride = (stride + 0xf) & (~0xf);
+    cam_unit_add_output_format (super, infmt->pixelformat, NULL,
+            width, height, stride);
+}
+
+static void
+on_input_format_changed (CamUnit *super, const CamUnitFormat *infmt)
+{
+    CamResizeFilter *self = (CamResizeFilter*) super;
+    update_output_formats (self, infmt,
+            cam_unit_control_get_int (self->width_ctl),
+            cam_unit_control_get_int (self->height_ctl),
+            cam_unit_control_get_boolean (self->keep_aspect_ctl));
+}
+
+static gboolean
+cam_resize_filter_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual)
+{
+    CamResizeFilter *self = (CamResizeFilter*) super;
+    if (ctl == self->threads_ctl) {
+        g_value_copy (proposed, actual);
+        return TRUE;
+    }
+
+    int req_width = cam_unit_control_get_int (self->width_ctl);
+    int req_height = cam_unit_control_get_int (self->height_ctl);
+    int keep_aspect = cam_unit_control_get_boolean (self->keep_aspect_ctl);
+    if (ctl == self->width_ctl)
+        req_width = g_value_get_int (proposed);
+    else if (ctl == self->height_ctl)
+        req_height = g_value_get_int (proposed);
+    else if (ctl == self->keep_aspect_ctl)
+        keep_aspect = g_value_get_boolean (proposed);
+    else
+        return FALSE;
+
+    /* the output size changes, so renegotiate the format.  Restarting the
+     * stream also restarts any units downstream. */
+    int streaming = cam_unit_is_streaming (super);
+    if (streaming)
+        cam_unit_stream_shutdown (super);
+
+    CamUnit *input = cam_unit_get_input (super);
+    update_output_formats (self,
+            input ? cam_unit_get_output_format (input) : NULL,
+            req_width, req_height, keep_aspect);
+
+    if (streaming)
+        cam_unit_stream_init (super, NULL);
+
+    g_value_copy (proposed, actual);
+    return TRUE;
+}
+
+static int
+cam_resize_filter_stream_init (CamUnit * super, const CamUnitFormat * outfmt)
+{
+    CamResizeFilter * self = (CamResizeFilter*) super;
+    CamUnit * input = cam_unit_get_input (super);
+    const CamUnitFormat * infmt = cam_unit_get_output_format (input);
+
+    self->channels = resize_channels (infmt->pixelformat);
+    if (!self->channels || outfmt->pixelformat != infmt->pixelformat)
+        return -1;
+    self->is_16u = infmt->pixelformat == CAM_PIXEL_FORMAT_LE_GRAY16;
+
+    /* area averaging is exact and cheaper when the input divides evenly
+     * into the output */
+    if (outfmt->width == infmt->width && outfmt->height == infmt->height)
+        self->method = RESIZE_COPY;
+    else if (infmt->width % outfmt->width == 0 &&
+            infmt->height % outfmt->height == 0 &&
+            infmt->width / outfmt->width <= 256 &&
+            infmt->height / outfmt->height <= 256)
+        self->method = RESIZE_BOX;
+    else
+        self->method = RESIZE_BILINEAR;
+
+    dbg(DBG_FILTER, "resize %dx%d -> %dx%d (method %d)\n",
+            infmt->width, infmt->height, outfmt->width, outfmt->height,
+            self->method);
+    return 0;
+}
+
+/* Box bands are independent blocks of source rows, so they are split by
+ * offsetting the buffer pointers.  Bilinear bands share source rows at
+ * their edges and use the _rows variants instead. */
+static void
+resize_band (int row_start, int row_end, void *user_data)
+{
+    resize_args_t *a = (resize_args_t*) user_data;
+    int rows = row_end - row_start;
+    int status = 0;
+
+    if (a->method == RESIZE_BOX) {
+        int fy = a->sheight / a->dheight;
+        uint8_t *dst = a->dst + row_start * a->dstride;
+        const uint8_t *src = a->src + row_start * fy * a->sstride;
+        if (a->is_16u)
+            status = cam_pixel_resize_box_16u ((uint16_t*) dst, a->dstride,
+                    a->dwidth, rows, (const uint16_t*) src, a->sstride,
+                    a->swidth, rows * fy, a->channels);
+        else
+            status = cam_pixel_resize_box_8u (dst, a->dstride,
+                    a->dwidth, rows, src, a->sstride,
+                    a->swidth, rows * fy, a->channels);
+    } else {
+        if (a->is_16u)
+            status = cam_pixel_resize_bilinear_16u_rows ((uint16_t*) a->dst,
+                    a->dstride, a->dwidth, a->dheight,
+                    (const uint16_t*) a->src, a->sstride,
+                    a->swidth, a->sheight, a->channels, row_start, row_end);
+        else
+            status = cam_pixel_resize_bilinear_8u_rows (a->dst, a->dstride,
+                    a->dwidth, a->dheight, a->src, a->sstride,
+                    a->swidth, a->sheight, a->channels, row_start, row_end);
+    }
+
+    if (0 != status)
+        a->status = -1;
+}
+
+static void
+on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *infmt)
+{
+    CamResizeFilter * self = (CamResizeFilter*) super;
+    dbg(DBG_FILTER, "[%s] iterate\n", cam_unit_get_name(super));
+
+    if (!self->channels) return;
+
+    const CamUnitFormat *outfmt = cam_unit_get_output_format(super);
+    int out_buf_size = outfmt->height * outfmt->row_stride;
+    CamFrameBuffer *outbuf = cam_framebuffer_new_alloc (out_buf_size);
+
+    int sstride = infmt->row_stride ? infmt->row_stride :
+        infmt->width * cam_pixel_format_bpp (infmt->pixelformat) / 8;
+
+    int status;
+    if (self->method == RESIZE_COPY) {
+        status = cam_pixel_copy_8u_generic (inbuf->data, sstride,
+                outbuf->data, outfmt->row_stride, 0, 0, 0, 0,
+                infmt->width, infmt->height,
+                cam_pixel_format_bpp (infmt->pixelformat));
+    } else {
+        resize_args_t args = {
+            .method = self->method,
+            .channels = self->channels,
+            .is_16u = self->is_16u,
+            .dst = outbuf->data,
+            .dstride = outfmt->row_stride,
+            .dwidth = outfmt->width,
+            .dheight = outfmt->height,
+            .src = inbuf->data,
+            .sstride = sstride,
+            .swidth = infmt->width,
+            .sheight = infmt->height,
+            .status = 0,
+        };
+        int row_bytes = outfmt->row_stride +
+            sstride * infmt->height / outfmt->height;
+        cam_pixel_parallel_for (cam_unit_control_get_int (self->threads_ctl),
+                outfmt->height, 1, row_bytes, resize_band, &args);
+        status = args.status;
+    }
+
+    if (0 == status) {
+        cam_framebuffer_copy_metadata(outbuf, inbuf);
+        outbuf->bytesused = out_buf_size;
+        cam_unit_produce_frame (super, outbuf, outfmt);
+    }
+
+    g_object_unref (outbuf);
+}
@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camunits/plugin.h"
+#include "camunits/dbg.h"
+
+#define err(args...) fprintf(stderr, args)
+
+typedef int (*rotate_func_t)(uint8_t *dest, int dstride, int width,
+        int height, const uint8_t *src, int sstride,
+        CamPixelOrientation orientation);
+
+typedef struct _CamRotateFilter {
+    CamUnit parent;
+
+    CamUnitControl *orientation_ctl;
+    CamUnitControl *threads_ctl;
+
+    rotate_func_t rotate_func;
+    int bpp;
+} CamRotateFilter;
+
+typedef struct _CamRotateFilterClass {
+    CamUnitClass parent_class;
+} CamRotateFilterClass;
+
+/* Arguments for reorienting one band of output rows with rotate_band() */
+typedef struct _rotate_args_t {
+    rotate_func_t rotate_func;
+    CamPixelOrientation orientation;
+    int bpp;
+    uint8_t *dst;
+    int dstride;
+    const uint8_t *src;
+    int sstride;
+    int swidth;
+    int sheight;
+    int status;
+} rotate_args_t;
+
+static CamRotateFilter * cam_rotate_filter_new (void);
+
+GType cam_rotate_filter_get_type (void);
+CAM_PLUGIN_TYPE(CamRotateFilter, cam_rotate_filter, CAM_TYPE_UNIT);
+
+/* These next two functions are required as entry points for the
+ * plug-in API. */
+void cam_plugin_initialize(GTypeModule * module);
+void cam_plugin_initialize(GTypeModule * module)
+{
+    cam_rotate_filter_register_type(module);
+}
+
+CamUnitDriver * cam_plugin_create(GTypeModule * module);
+CamUnitDriver * cam_plugin_create(GTypeModule * module)
+{
+    return cam_unit_driver_new_stock_full ( "convert", "rotate",
+            "Rotate", 0,
+            (CamUnitConstructor)cam_rotate_filter_new, module);
+}
+
+// ============== CamRotateFilter ===============
+static void on_input_frame_ready (CamUnit * super, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *infmt);
+static int cam_rotate_filter_stream_init (CamUnit * super,
+        const CamUnitFormat * fmt);
+static void on_input_format_changed (CamUnit *super,
+        const CamUnitFormat *infmt);
+static gboolean cam_rotate_filter_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual);
+
+static rotate_func_t
+rotate_func_for_format (CamPixelFormat pfmt)
+{
+    switch (pfmt) {
+        case CAM_PIXEL_FORMAT_GRAY:
+            return cam_pixel_rotate_8u_gray;
+        case CAM_PIXEL_FORMAT_RGB:
+        case CAM_PIXEL_FORMAT_BGR:
+            return cam_pixel_rotate_8u_rgb;
+        case CAM_PIXEL_FORMAT_RGBA:
+        case CAM_PIXEL_FORMAT_BGRA:
+            return cam_pixel_rotate_8u_bgra;
+        default:
+            return NULL;
+    }
+}
+
+static void
+cam_rotate_filter_init (CamRotateFilter *self)
+{
+    dbg(DBG_FILTER, "rotate filter constructor\n");
+    CamUnit *super = CAM_UNIT (self);
+
+    CamUnitControlEnumValue orientation_entries[] = {
+        { CAM_PIXEL_ORIENTATION_NORMAL, "None", 1 },
+        { CAM_PIXEL_ORIENTATION_ROTATE_90, "Rotate 90\302\260 clockwise", 1 },
+        { CAM_PIXEL_ORIENTATION_ROTATE_180, "Rotate 180\302\260", 1 },
+        { CAM_PIXEL_ORIENTATION_ROTATE_270,
+            "Rotate 90\302\260 counterclockwise", 1 },
+        { CAM_PIXEL_ORIENTATION_FLIP_HORIZONTAL, "Flip horizontally", 1 },
+        { CAM_PIXEL_ORIENTATION_FLIP_VERTICAL, "Flip vertically", 1 },
+        { CAM_PIXEL_ORIENTATION_TRANSPOSE, "Transpose", 1 },
+        { CAM_PIXEL_ORIENTATION_TRANSVERSE, "Transverse", 1 },
+        { 0, NULL, 0 }
+    };
+
+    self->orientation_ctl = cam_unit_add_control_enum (super, "orientation",
+            "Orientation", CAM_PIXEL_ORIENTATION_NORMAL, 1,
+            orientation_entries);
+    self->threads_ctl = cam_unit_add_control_int (super, "threads",
+            "Threads", 1, 64, 1, 1, 1);
+
+    self->rotate_func = NULL;
+    self->bpp = 0;
+
+    g_signal_connect (G_OBJECT (self), "input-format-changed",
+            G_CALLBACK (on_input_format_changed), self);
+}
+
+static void
+cam_rotate_filter_class_init (CamRotateFilterClass *klass)
+{
+    dbg(DBG_FILTER, "rotate filter class initializer\n");
+    klass->parent_class.on_input_frame_ready = on_input_frame_ready;
+    klass->parent_class.stream_init = cam_rotate_filter_stream_init;
+    klass->parent_class.try_set_control = cam_rotate_filter_try_set_control;
+}
+
+CamRotateFilter *
+cam_rotate_filter_new()
+{
+    return (CamRotateFilter*)
+            g_object_new(cam_rotate_filter_get_type(), NULL);
+}
+
+static void
+update_output_formats (CamRotateFilter *self, const CamUnitFormat *infmt,
+        CamPixelOrientation orientation)
+{
+    CamUnit *super = CAM_UNIT (self);
+    cam_unit_remove_all_output_formats (super);
+    if (!infmt || !rotate_func_for_format (infmt->pixelformat))
+        return;
+
+    int width = infmt->width;
+    int height = infmt->height;
+    if (cam_pixel_orientation_swaps_axes (orientation)) {
+        width = infmt->height;
+        height = infmt->width;
+    }
+
+    int stride = width * cam_pixel_format_bpp (infmt->pixelformat) / 8;
+    stride = (stride + 0xf) & (~0xf);
+    cam_unit_add_output_format (super, infmt->pixelformat, NULL,
+            width, height, stride);
+}
+
+static void
+on_input_format_changed (CamUnit *super, const CamUnitFormat *infmt)
+{
+    CamRotateFilter *self = (CamRotateFilter*) super;
+    update_output_formats (self, infmt,
+            cam_unit_control_get_enum (self->orientation_ctl));
+}
+
+static gboolean
+cam_rotate_filter_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual)
+{
+    CamRotateFilter *self = (CamRotateFilter*) super;
+    if (ctl == self->orientation_ctl) {
+        CamPixelOrientation old_orientation =
+            cam_unit_control_get_enum (self->orientation_ctl);
+        CamPixelOrientation orientation = g_value_get_int (proposed);
+
+        /* only a change between landscape and portrait changes the
+         * output format */
+        if (cam_pixel_orientation_swaps_axes (orientation) !=
+                cam_pixel_orientation_swaps_axes (old_orientation)) {
+            int streaming = cam_unit_is_streaming (super);
+            if (streaming)
+                cam_unit_stream_shutdown (super);
+
+            CamUnit *input = cam_unit_get_input (super);
+            update_output_formats (self,
+                    input ? cam_unit_get_output_format (input) : NULL,
+                    orientation);
+
+            if (streaming)
+                cam_unit_stream_init (super, NULL);
+        }
+    }
+    g_value_copy (proposed, actual);
+    return TRUE;
+}
+
+static int
+cam_rotate_filter_stream_init (CamUnit * super, const CamUnitFormat * outfmt)
+{
+    CamRotateFilter * self = (CamRotateFilter*) super;
+    CamUnit * input = cam_unit_get_input (super);
+    const CamUnitFormat * infmt = cam_unit_get_output_format (input);
+
+    self->rotate_func = rotate_func_for_format (infmt->pixelformat);
+    if (!self->rotate_func || outfmt->pixelformat != infmt->pixelformat)
+        return -1;
+    self->bpp = cam_pixel_format_bpp (infmt->pixelformat) / 8;
+    return 0;
+}
+
+/* A band of output rows comes from a strip of source columns when the
+ * axes are swapped, or from a strip of source rows otherwise.  Reoriented
+ * on its own, the strip lands exactly on the band, so bands only need
+ * their pointers offset.  The strip runs backwards through the source
+ * when the orientation reverses the direction the band is taken from. */
+static void
+rotate_band (int row_start, int row_end, void *user_data)
+{
+    rotate_args_t *a = (rotate_args_t*) user_data;
+    int rows = row_end - row_start;
+    const uint8_t *src;
+    int width, height;
+
+    if (cam_pixel_orientation_swaps_axes (a->orientation)) {
+        int reversed = a->orientation == CAM_PIXEL_ORIENTATION_ROTATE_270 ||
+            a->orientation == CAM_PIXEL_ORIENTATION_TRANSVERSE;
+        int col = reversed ? a->swidth - row_end : row_start;
+        src = a->src + col * a->bpp;
+        width = rows;
+        height = a->sheight;
+    } else {
+        int reversed = a->orientation == CAM_PIXEL_ORIENTATION_ROTATE_180 ||
+            a->orientation == CAM_PIXEL_ORIENTATION_FLIP_VERTICAL;
+        int row = reversed ? a->sheight - row_end : row_start;
+        src = a->src + row * a->sstride;
+        width = a->swidth;
+        height = rows;
+    }
+
+    if (0 != a->rotate_func (a->dst + row_start * a->dstride, a->dstride,
+                width, height, src, a->sstride, a->orientation))
+        a->status = -1;
+}
+
+static void
+on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *infmt)
+{
+    CamRotateFilter * self = (CamRotateFilter*) super;
+    dbg(DBG_FILTER, "[%s] iterate\n", cam_unit_get_name(super));
+
+    if (!self->rotate_func) return;
+
+    const CamUnitFormat *outfmt = cam_unit_get_output_format(super);
+    int out_buf_size = outfmt->height * outfmt->row_stride;
+    CamFrameBuffer *outbuf = cam_framebuffer_new_alloc (out_buf_size);
+
+    rotate_args_t args = {
+        .rotate_func = self->rotate_func,
+        .orientation = cam_unit_control_get_enum (self->orientation_ctl),
+        .bpp = self->bpp,
+        .dst = outbuf->data,
+        .dstride = outfmt->row_stride,
+        .src = inbuf->data,
+        .sstride = infmt->row_stride ? infmt->row_stride :
+            infmt->width * self->bpp,
+        .swidth = infmt->width,
+        .sheight = infmt->height,
+        .status = 0,
+    };
+
+    /* a band of output rows reads a strip of the source that is as long
+     * as an output row.  When transposing, bands are kept to multiples of
+     * the 8x8 tiles of the SIMD path so that only the last band has to
+     * finish its edge one pixel at a time. */
+    int row_multiple =
+        cam_pixel_orientation_swaps_axes (args.orientation) ? 8 : 1;
+    cam_pixel_parallel_for (cam_unit_control_get_int (self->threads_ctl),
+            outfmt->height, row_multiple, 2 * outfmt->row_stride,
+            rotate_band, &args);
+
+    if (0 == args.status) {
+        cam_framebuffer_copy_metadata(outbuf, inbuf);
+        outbuf->bytesused = out_buf_size;
+        cam_unit_produce_frame (super, outbuf, outfmt);
+    }
+
+    g_object_unref (outbuf);
+}
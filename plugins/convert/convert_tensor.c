@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camunits/plugin.h"
+#include "camunits/dbg.h"
+
+#define err(args...) fprintf(stderr, args)
+
+enum {
+    PARAM_MEAN_R = 0,
+    PARAM_MEAN_G,
+    PARAM_MEAN_B,
+    PARAM_STD_R,
+    PARAM_STD_G,
+    PARAM_STD_B,
+    NUM_PARAMS
+};
+
+/* Means and standard deviations are for pixel values scaled to 0 - 1, as
+ * published for most networks.  Gray images use the red values. */
+static const struct {
+    const char *id;
+    const char *name;
+    float min;
+    float max;
+    float step;
+    float default_val;
+} params[NUM_PARAMS] = {
+    { "mean-r", "Mean Red", -10, 10, 0.001, 0 },
+    { "mean-g", "Mean Green", -10, 10, 0.001, 0 },
+    { "mean-b", "Mean Blue", -10, 10, 0.001, 0 },
+    { "std-r", "Std Dev Red", 0.001, 100, 0.001, 1 },
+    { "std-g", "Std Dev Green", 0.001, 100, 0.001, 1 },
+    { "std-b", "Std Dev Blue", 0.001, 100, 0.001, 1 },
+};
+
+typedef struct _CamTensorFilter {
+    CamUnit parent;
+
+    CamUnitControl *width_ctl;
+    CamUnitControl *height_ctl;
+    CamUnitControl *letterbox_ctl;
+    CamUnitControl *pad_ctl;
+    CamUnitControl *bgr_ctl;
+    CamUnitControl *param_ctls[NUM_PARAMS];
+    CamUnitControl *threads_ctl;
+
+    int src_channels;
+    int channels;
+    int flags;
+} CamTensorFilter;
+
+typedef struct _CamTensorFilterClass {
+    CamUnitClass parent_class;
+} CamTensorFilterClass;
+
+/* Arguments for converting one band of tensor rows with tensor_band() */
+typedef struct _tensor_args_t {
+    CamPixelTensor tensor;
+    uint8_t *dst;
+    int dstride;
+    const uint8_t *src;
+    int sstride;
+    int status;
+} tensor_args_t;
+
+static CamTensorFilter * cam_tensor_filter_new (void);
+
+GType cam_tensor_filter_get_type (void);
+CAM_PLUGIN_TYPE(CamTensorFilter, cam_tensor_filter, CAM_TYPE_UNIT);
+
+/* These next two functions are required as entry points for the
+ * plug-in API. */
+void cam_plugin_initialize(GTypeModule * module);
+void cam_plugin_initialize(GTypeModule * module)
+{
+    cam_tensor_filter_register_type(module);
+}
+
+CamUnitDriver * cam_plugin_create(GTypeModule * module);
+CamUnitDriver * cam_plugin_create(GTypeModule * module)
+{
+    return cam_unit_driver_new_stock_full ( "convert", "tensor",
+            "Tensor", 0,
+            (CamUnitConstructor)cam_tensor_filter_new, module);
+}
+
+// ============== CamTensorFilter ===============
+static void on_input_frame_ready (CamUnit * super, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *infmt);
+static int cam_tensor_filter_stream_init (CamUnit * super,
+        const CamUnitFormat * fmt);
+static void on_input_format_changed (CamUnit *super,
+        const CamUnitFormat *infmt);
+static gboolean cam_tensor_filter_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual);
+
+/* Returns the number of interleaved channels of an input format, or 0 if
+ * the format is not supported */
+static int
+input_channels (CamPixelFormat pfmt)
+{
+    switch (pfmt) {
+        case CAM_PIXEL_FORMAT_GRAY:
+            return 1;
+        case CAM_PIXEL_FORMAT_RGB:
+        case CAM_PIXEL_FORMAT_BGR:
+            return 3;
+        case CAM_PIXEL_FORMAT_RGBA:
+        case CAM_PIXEL_FORMAT_BGRA:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+/* Returns the CamPixelTensorFlags for a tensor format, or -1 if @pfmt is
+ * not one */
+static int
+tensor_flags (CamPixelFormat pfmt)
+{
+    switch (pfmt) {
+        case CAM_PIXEL_FORMAT_FLOAT_GRAY32:
+        case CAM_PIXEL_FORMAT_FLOAT_RGB32:
+            return 0;
+        case CAM_PIXEL_FORMAT_FLOAT_RGB32_PLANAR:
+            return CAM_PIXEL_TENSOR_PLANAR;
+        case CAM_PIXEL_FORMAT_HALF_GRAY16:
+        case CAM_PIXEL_FORMAT_HALF_RGB16:
+            return CAM_PIXEL_TENSOR_HALF;
+        case CAM_PIXEL_FORMAT_HALF_RGB16_PLANAR:
+            return CAM_PIXEL_TENSOR_PLANAR | CAM_PIXEL_TENSOR_HALF;
+        default:
+            return -1;
+    }
+}
+
+static void
+cam_tensor_filter_init (CamTensorFilter *self)
+{
+    dbg(DBG_FILTER, "tensor filter constructor\n");
+    CamUnit *super = CAM_UNIT (self);
+
+    self->width_ctl = cam_unit_add_control_int (super, "width",
+            "Width", 0, 16384, 1, 0, 1);
+    self->height_ctl = cam_unit_add_control_int (super, "height",
+            "Height", 0, 16384, 1, 0, 1);
+    self->letterbox_ctl = cam_unit_add_control_boolean (super,
+            "letterbox", "Letterbox", 0, 1);
+    self->pad_ctl = cam_unit_add_control_int (super, "pad",
+            "Padding Value", 0, 255, 1, 0, 1);
+    self->bgr_ctl = cam_unit_add_control_boolean (super, "bgr",
+            "BGR Order", 0, 1);
+    cam_unit_control_set_ui_hints (self->width_ctl,
+            CAM_UNIT_CONTROL_SPINBUTTON);
+    cam_unit_control_set_ui_hints (self->height_ctl,
+            CAM_UNIT_CONTROL_SPINBUTTON);
+    for (int i = 0; i < NUM_PARAMS; i++) {
+        self->param_ctls[i] = cam_unit_add_control_float (super,
+                params[i].id, params[i].name, params[i].min, params[i].max,
+                params[i].step, params[i].default_val, 1);
+        cam_unit_control_set_ui_hints (self->param_ctls[i],
+                CAM_UNIT_CONTROL_SPINBUTTON);
+    }
+    self->threads_ctl = cam_unit_add_control_int (super, "threads",
+            "Threads", 1, 64, 1, 1, 1);
+
+    self->src_channels = 0;
+    self->channels = 0;
+    self->flags = 0;
+
+    g_signal_connect (G_OBJECT (self), "input-format-changed",
+            G_CALLBACK (on_input_format_changed), self);
+}
+
+static void
+cam_tensor_filter_class_init (CamTensorFilterClass *klass)
+{
+    dbg(DBG_FILTER, "tensor filter class initializer\n");
+    klass->parent_class.on_input_frame_ready = on_input_frame_ready;
+    klass->parent_class.stream_init = cam_tensor_filter_stream_init;
+    klass->parent_class.try_set_control = cam_tensor_filter_try_set_control;
+}
+
+CamTensorFilter *
+cam_tensor_filter_new()
+{
+    return (CamTensorFilter*)
+            g_object_new(cam_tensor_filter_get_type(), NULL);
+}
+
+/* Offers the tensor formats for one size.  Planar formats put the planes
+ * one after the other, with row_stride giving the stride of a plane row.
+ * Rows are not padded, since inference engines expect dense tensors. */
+static void
+update_output_formats (CamTensorFilter *self, const CamUnitFormat *infmt,
+        int req_width, int req_height)
+{
+    CamUnit *super = CAM_UNIT (self);
+    cam_unit_remove_all_output_formats (super);
+    if (!infmt || !input_channels (infmt->pixelformat))
+        return;
+
+    int width = req_width ? req_width : infmt->width;
+    int height = req_height ? req_height : infmt->height;
+
+    static const CamPixelFormat gray_fmts[] = {
+        CAM_PIXEL_FORMAT_FLOAT_GRAY32,
+        CAM_PIXEL_FORMAT_HALF_GRAY16,
+    };
+    static const CamPixelFormat color_fmts[] = {
+        CAM_PIXEL_FORMAT_FLOAT_RGB32_PLANAR,
+        CAM_PIXEL_FORMAT_FLOAT_RGB32,
+        CAM_PIXEL_FORMAT_HALF_RGB16_PLANAR,
+        CAM_PIXEL_FORMAT_HALF_RGB16,
+    };
+    int gray = infmt->pixelformat == CAM_PIXEL_FORMAT_GRAY;
+    const CamPixelFormat *fmts = gray ? gray_fmts : color_fmts;
+    int nfmts = gray ? G_N_ELEMENTS (gray_fmts) : G_N_ELEMENTS (color_fmts);
+
+    for (int i = 0; i < nfmts; i++) {
+        int stride = width * cam_pixel_format_bpp (fmts[i]) / 8;
+        if (tensor_flags (fmts[i]) & CAM_PIXEL_TENSOR_PLANAR)
+            stride /= 3;
+        cam_unit_add_output_format (super, fmts[i], NULL, width, height,
+                stride);
+    }
+}
+
+static void
+on_input_format_changed (CamUnit *super, const CamUnitFormat *infmt)
+{
+    CamTensorFilter *self = (CamTensorFilter*) super;
+    update_output_formats (self, infmt,
+            cam_unit_control_get_int (self->width_ctl),
+            cam_unit_control_get_int (self->height_ctl));
+}
+
+static gboolean
+cam_tensor_filter_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual)
+{
+    CamTensorFilter *self = (CamTensorFilter*) super;
+    if (ctl == self->width_ctl || ctl == self->height_ctl) {
+        int req_width = ctl == self->width_ctl ? g_value_get_int (proposed) :
+            cam_unit_control_get_int (self->width_ctl);
+        int req_height = ctl == self->height_ctl ? g_value_get_int (proposed) :
+            cam_unit_control_get_int (self->height_ctl);
+
+        /* the tensor size changes, so renegotiate the format */
+        int streaming = cam_unit_is_streaming (super);
+        if (streaming)
+            cam_unit_stream_shutdown (super);
+
+        CamUnit *input = cam_unit_get_input (super);
+        update_output_formats (self,
+                input ? cam_unit_get_output_format (input) : NULL,
+                req_width, req_height);
+
+        if (streaming)
+            cam_unit_stream_init (super, NULL);
+    }
+
+    /* everything else is read for each frame */
+    g_value_copy (proposed, actual);
+    return TRUE;
+}
+
+static int
+cam_tensor_filter_stream_init (CamUnit * super, const CamUnitFormat * outfmt)
+{
+    CamTensorFilter * self = (CamTensorFilter*) super;
+    CamUnit * input = cam_unit_get_input (super);
+    const CamUnitFormat * infmt = cam_unit_get_output_format (input);
+
+    self->src_channels = input_channels (infmt->pixelformat);
+    self->flags = tensor_flags (outfmt->pixelformat);
+    if (!self->src_channels || self->flags < 0)
+        return -1;
+    self->channels = self->src_channels == 1 ? 1 : 3;
+
+    dbg(DBG_FILTER, "tensor %dx%d -> %dx%d %s\n", infmt->width,
+            infmt->height, outfmt->width, outfmt->height,
+            cam_pixel_format_nickname (outfmt->pixelformat));
+    return 0;
+}
+
+/* Each band of tensor rows covers the same rows of every plane, and reads
+ * the source rows it needs on its own */
+static void
+tensor_band (int row_start, int row_end, void *user_data)
+{
+    tensor_args_t *a = (tensor_args_t*) user_data;
+    if (0 != cam_pixel_convert_8u_to_tensor_rows (a->dst, a->dstride,
+                a->src, a->sstride, &a->tensor, row_start, row_end))
+        a->status = -1;
+}
+
+static void
+on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *infmt)
+{
+    CamTensorFilter * self = (CamTensorFilter*) super;
+    dbg(DBG_FILTER, "[%s] iterate\n", cam_unit_get_name(super));
+
+    if (!self->src_channels) return;
+
+    const CamUnitFormat *outfmt = cam_unit_get_output_format(super);
+    int planes = self->flags & CAM_PIXEL_TENSOR_PLANAR ? self->channels : 1;
+    int out_buf_size = planes * outfmt->height * outfmt->row_stride;
+    CamFrameBuffer *outbuf = cam_framebuffer_new_alloc (out_buf_size);
+
+    tensor_args_t args;
+    memset (&args, 0, sizeof (args));
+    CamPixelTensor *t = &args.tensor;
+    t->width = outfmt->width;
+    t->height = outfmt->height;
+    t->channels = self->channels;
+    t->flags = self->flags;
+    t->src_width = infmt->width;
+    t->src_height = infmt->height;
+    t->src_channels = self->src_channels;
+    t->pad = cam_unit_control_get_int (self->pad_ctl);
+    cam_pixel_tensor_fit (t,
+            cam_unit_control_get_boolean (self->letterbox_ctl));
+
+    /* tensor channel c holds color (bgr ? 2 - c : c) of RGB order, which
+     * sits at byte (2 - color) of BGR and BGRA pixels */
+    int bgr_out = cam_unit_control_get_boolean (self->bgr_ctl);
+    int bgr_in = infmt->pixelformat == CAM_PIXEL_FORMAT_BGR ||
+        infmt->pixelformat == CAM_PIXEL_FORMAT_BGRA;
+    for (int c = 0; c < self->channels; c++) {
+        int color = self->channels == 1 ? 0 : bgr_out ? 2 - c : c;
+        cam_pixel_tensor_set_channel (t, c, bgr_in ? 2 - color : color,
+                cam_unit_control_get_float (
+                    self->param_ctls[PARAM_MEAN_R + color]),
+                cam_unit_control_get_float (
+                    self->param_ctls[PARAM_STD_R + color]));
+    }
+
+    args.dst = outbuf->data;
+    args.dstride = outfmt->row_stride;
+    args.src = inbuf->data;
+    args.sstride = infmt->row_stride ? infmt->row_stride :
+        infmt->width * self->src_channels;
+    args.status = 0;
+
+    int row_bytes = planes * outfmt->row_stride +
+        args.sstride * infmt->height / outfmt->height;
+    cam_pixel_parallel_for (cam_unit_control_get_int (self->threads_ctl),
+            outfmt->height, 1, row_bytes, tensor_band, &args);
+
+    if (0 == args.status) {
+        cam_framebuffer_copy_metadata(outbuf, inbuf);
+        outbuf->bytesused = out_buf_size;
+        cam_unit_produce_frame (super, outbuf, outfmt);
+    }
+
+    g_object_unref (outbuf);
+}
@@ -10,6 +10,7 @@ typedef struct _CamConvertToRgb8 {
 
     /*< private >*/
     CamUnit *worker;
+    CamPixelFormat worker_pfmt;
     CamUnitManager *manager;
 } CamConvertToRgb8;
 
@@ -68,6 +69,7 @@ cam_convert_to_rgb8_init (CamConvertToRgb8 *self)
     cam_unit_set_preferred_format (CAM_UNIT (self), CAM_PIXEL_FORMAT_RGB, 0, 0,
             NULL);
     self->worker = NULL;
+    self->worker_pfmt = CAM_PIXEL_FORMAT_INVALID;
     self->manager = cam_unit_manager_get_and_ref();
     g_signal_connect (G_OBJECT(self), "input-format-changed",
             G_CALLBACK(on_input_format_changed), NULL);
@@ -157,17 +159,87 @@ on_worker_frame_ready (CamUnit *worker, const CamFrameBuffer *inbuf,
     }
 }
 
+/* Units that may convert the input to RGB, with a rough cost in ns per
+ * pixel for workers that don't report one in the "convert:cost" data of
+ * their output formats */
+static const struct {
+    const char *unit_id;
+    float cost;
+} worker_candidates[] = {
+    { "convert.colorspace", 1 },
+    { "convert.fast_debayer", 3 },
+    { "ipp.jpeg_decompress", 4 },
+    { "framewave.jpeg_decompress", 5 },
+    { "convert.jpeg_decompress", 8 },
+};
+
+/* cost of the internal BGRA to RGB conversion in on_worker_frame_ready */
+#define BGRA_TO_RGB_COST 0.8f
+
+static float
+worker_format_cost (const CamUnitFormat *wfmt, float default_cost)
+{
+    const float *cost = (const float*) g_object_get_data (G_OBJECT (wfmt),
+            "convert:cost");
+    float c = cost ? *cost : default_cost;
+    if (wfmt->pixelformat == CAM_PIXEL_FORMAT_BGRA)
+        return c + BGRA_TO_RGB_COST;
+    return c;
+}
+
+/* Tries each available worker unit on the input of @self, and keeps the
+ * one that produces RGB, directly or through BGRA, at the lowest cost.
+ * The pixel format of the winning output is stored in worker_pfmt. */
 static void
-_maybe_set_worker(CamConvertToRgb8 *self, const char *unit_id)
+choose_worker (CamConvertToRgb8 *self)
 {
-    if(!self->worker && 
-        cam_unit_manager_find_unit_description(self->manager, unit_id)) {
-        self->worker = 
-            cam_unit_manager_create_unit_by_id(self->manager, unit_id);
-        if(self->worker) {
-            dbg(DBG_DRIVER, "using worker unit [%s]\n", unit_id);
+    CamUnit *input = cam_unit_get_input (CAM_UNIT (self));
+    float best_cost = G_MAXFLOAT;
+
+    for (int i = 0; i < G_N_ELEMENTS (worker_candidates); i++) {
+        const char *unit_id = worker_candidates[i].unit_id;
+        if (!cam_unit_manager_find_unit_description (self->manager, unit_id))
+            continue;
+        CamUnit *worker =
+            cam_unit_manager_create_unit_by_id (self->manager, unit_id);
+        if (!worker)
+            continue;
+        g_object_ref_sink (worker);
+        cam_unit_set_input (worker, input);
+
+        float cost = G_MAXFLOAT;
+        CamPixelFormat pfmt = CAM_PIXEL_FORMAT_INVALID;
+        GList *worker_formats = cam_unit_get_output_formats (worker);
+        for (GList *witer=worker_formats; witer; witer=witer->next) {
+            CamUnitFormat *wfmt = CAM_UNIT_FORMAT (witer->data);
+            if (wfmt->pixelformat != CAM_PIXEL_FORMAT_RGB &&
+                wfmt->pixelformat != CAM_PIXEL_FORMAT_BGRA)
+                continue;
+            float c = worker_format_cost (wfmt, worker_candidates[i].cost);
+            // on a tie, RGB wins since it skips the internal conversion
+            if (c < cost || (c == cost &&
+                        wfmt->pixelformat == CAM_PIXEL_FORMAT_RGB)) {
+                cost = c;
+                pfmt = wfmt->pixelformat;
+            }
+        }
+        g_list_free (worker_formats);
+
+        if (cost < best_cost) {
+            if (self->worker)
+                g_object_unref (self->worker);
+            self->worker = worker;
+            self->worker_pfmt = pfmt;
+            best_cost = cost;
+        } else {
+            g_object_unref (worker);
         }
     }
+    if (self->worker) {
+        dbg(DBG_DRIVER, "using worker unit [%s] with %s output\n",
+                cam_unit_get_id (self->worker),
+                cam_pixel_format_nickname (self->worker_pfmt));
+    }
 }
 
 static void
@@ -190,66 +262,28 @@ on_input_format_changed (CamUnit *super, const CamUnitFormat *infmt)
                 infmt->name, infmt->width, infmt->height, 
                 infmt->row_stride);
     } else {
-        switch (infmt->pixelformat) {
-            case CAM_PIXEL_FORMAT_I420:
-            case CAM_PIXEL_FORMAT_GRAY:
-            case CAM_PIXEL_FORMAT_YUYV:
-            case CAM_PIXEL_FORMAT_UYVY:
-            case CAM_PIXEL_FORMAT_BGRA:
-            case CAM_PIXEL_FORMAT_BGR:
-                _maybe_set_worker(self, "convert.colorspace");
-                break;
-            case CAM_PIXEL_FORMAT_MJPEG:
-                // use the Intel IPP library for JPEG decompression if it
-                // is available
-                _maybe_set_worker(self, "ipp.jpeg_decompress");
-
-                // if not, then try the Framewave library.
-                _maybe_set_worker(self, "framewave.jpeg_decompress");
-
-                // Lastly, fall back to libjpeg
-                _maybe_set_worker(self, "convert.jpeg_decompress");
-                break;
-            case CAM_PIXEL_FORMAT_BAYER_BGGR:
-            case CAM_PIXEL_FORMAT_BAYER_RGGB:
-            case CAM_PIXEL_FORMAT_BAYER_GBRG:
-            case CAM_PIXEL_FORMAT_BAYER_GRBG:
-                _maybe_set_worker(self, "convert.fast_debayer");
-                break;
-            default:
-                return;
-        }
-
+        choose_worker (self);
         if(!self->worker) {
             return;
         }
-        g_object_ref_sink (self->worker);
 
         g_signal_connect (G_OBJECT (self->worker), "frame-ready",
                 G_CALLBACK (on_worker_frame_ready), self);
-        cam_unit_set_input (self->worker, cam_unit_get_input(super));
 
+        // use the worker output that choose_worker costed: RGB as is, or
+        // BGRA converted to RGB internally
         GList * worker_formats = cam_unit_get_output_formats (self->worker);
+        CamPixelFormat wpfmt = self->worker_pfmt;
         for (GList *witer=worker_formats; witer; witer=witer->next) {
             CamUnitFormat *wfmt = CAM_UNIT_FORMAT (witer->data);
-            if (wfmt->pixelformat == CAM_PIXEL_FORMAT_RGB) {
-                CamUnitFormat *my_fmt = cam_unit_add_output_format (super,
-                        wfmt->pixelformat, wfmt->name, wfmt->width, 
-                        wfmt->height, wfmt->row_stride);
-                g_object_set_data (G_OBJECT (my_fmt), "convert_to_rgb8:wfmt", 
-                        wfmt);
-
-            } else if (! strcmp(cam_unit_get_id(self->worker), 
-                        "convert.fast_debayer") &&
-                    wfmt->pixelformat == CAM_PIXEL_FORMAT_BGRA) {
-                // hack.  fast debayer filter only produces BGRA, so just do an
-                // internal conversion to RGB later on
-                CamUnitFormat *my_fmt = cam_unit_add_output_format (super,
-                        CAM_PIXEL_FORMAT_RGB, wfmt->name, wfmt->width, 
-                        wfmt->height, wfmt->width*3);
-                g_object_set_data (G_OBJECT (my_fmt), "convert_to_rgb8:wfmt", 
-                        wfmt);
-            }
+            if (wfmt->pixelformat != wpfmt)
+                continue;
+            CamUnitFormat *my_fmt = cam_unit_add_output_format (super,
+                    CAM_PIXEL_FORMAT_RGB, wfmt->name, wfmt->width, 
+                    wfmt->height, wpfmt == CAM_PIXEL_FORMAT_RGB ?
+                    wfmt->row_stride : wfmt->width*3);
+            g_object_set_data (G_OBJECT (my_fmt), "convert_to_rgb8:wfmt", 
+                    wfmt);
         }
         g_list_free (worker_formats);
     }
@@ -28,6 +28,11 @@ enum {
     OPTION_RGGB
 };
 
+enum {
+    METHOD_MALVAR = 0,
+    METHOD_EDGE
+};
+
 static CamPixelFormat _option_to_pfmt[] = {
     CAM_PIXEL_FORMAT_BAYER_GBRG,
     CAM_PIXEL_FORMAT_BAYER_GRBG,
@@ -38,13 +43,47 @@ static CamPixelFormat _option_to_pfmt[] = {
 typedef struct _CamFastBayerFilter {
     CamUnit parent;
     CamUnitControl *bayer_tile_ctl;
-
-    uint8_t * aligned_buffer;
+    CamUnitControl *shift_ctl;
+    CamUnitControl *method_ctl;
+    CamUnitControl *threads_ctl;
+    CamUnitControl *half_ctl;
 
     uint8_t * planes[4];
     int plane_stride;
+
+    // padded native-endian copy of 16-bit input, for 16-bit outputs
+    uint8_t * mosaic16;
+    int mosaic16_stride;
+
+    // padded 8-bit copy of the input, for edge-directed BGRA output
+    uint8_t * mosaic8;
+    int mosaic8_stride;
 } CamFastBayerFilter;
 
+enum {
+    INTERP_8U_BGRA,
+    INTERP_8U_EDGE,
+    INTERP_8U_GRAY,
+    INTERP_16U_RGB,
+    INTERP_16U_GRAY,
+    BIN_8U_BGRA,
+    BIN_8U_RGB,
+    BIN_8U_GRAY
+};
+
+/* Arguments for interpolating one band of rows with interpolate_band() */
+typedef struct _interp_args_t {
+    int kind;
+    uint8_t * src;
+    uint8_t * planes[4];
+    int sstride;
+    uint8_t * dst;
+    int dstride;
+    int width;
+    int height;
+    CamPixelFormat tiling;
+} interp_args_t;
+
 typedef struct _CamFastBayerFilterClass {
     CamUnitClass parent_class;
 } CamFastBayerFilterClass;
@@ -78,6 +117,8 @@ static int cam_fast_bayer_filter_stream_init (CamUnit * super,
 static int cam_fast_bayer_filter_stream_shutdown (CamUnit * super);
 static void on_input_format_changed (CamUnit *super, 
         const CamUnitFormat *infmt);
+static gboolean cam_fast_bayer_filter_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual);
 
 static int
 is_bayer_pixel_format(CamPixelFormat pfmt)
@@ -88,6 +129,47 @@ is_bayer_pixel_format(CamPixelFormat pfmt)
             pfmt == CAM_PIXEL_FORMAT_BAYER_RGGB);
 }
 
+static int
+is_bayer16_pixel_format(CamPixelFormat pfmt)
+{
+    return (pfmt == CAM_PIXEL_FORMAT_BE_BAYER16_GBRG ||
+            pfmt == CAM_PIXEL_FORMAT_BE_BAYER16_GRBG ||
+            pfmt == CAM_PIXEL_FORMAT_BE_BAYER16_BGGR ||
+            pfmt == CAM_PIXEL_FORMAT_BE_BAYER16_RGGB ||
+            pfmt == CAM_PIXEL_FORMAT_LE_BAYER16_GBRG ||
+            pfmt == CAM_PIXEL_FORMAT_LE_BAYER16_GRBG ||
+            pfmt == CAM_PIXEL_FORMAT_LE_BAYER16_BGGR ||
+            pfmt == CAM_PIXEL_FORMAT_LE_BAYER16_RGGB);
+}
+
+/* Returns the sample size of MIPI-style packed bayer formats, or 0 */
+static int
+packed_bayer_bits(CamPixelFormat pfmt)
+{
+    switch (pfmt) {
+        case CAM_PIXEL_FORMAT_BAYER10P_GBRG:
+        case CAM_PIXEL_FORMAT_BAYER10P_GRBG:
+        case CAM_PIXEL_FORMAT_BAYER10P_BGGR:
+        case CAM_PIXEL_FORMAT_BAYER10P_RGGB:
+        case CAM_PIXEL_FORMAT_BAYER12P_GBRG:
+        case CAM_PIXEL_FORMAT_BAYER12P_GRBG:
+        case CAM_PIXEL_FORMAT_BAYER12P_BGGR:
+        case CAM_PIXEL_FORMAT_BAYER12P_RGGB:
+            return cam_pixel_format_packed_bits(pfmt);
+        default:
+            return 0;
+    }
+}
+
+static int
+is_big_endian_pixel_format(CamPixelFormat pfmt)
+{
+    return (pfmt == CAM_PIXEL_FORMAT_BE_BAYER16_GBRG ||
+            pfmt == CAM_PIXEL_FORMAT_BE_BAYER16_GRBG ||
+            pfmt == CAM_PIXEL_FORMAT_BE_BAYER16_BGGR ||
+            pfmt == CAM_PIXEL_FORMAT_BE_BAYER16_RGGB);
+}
+
 static void
 cam_fast_bayer_filter_init( CamFastBayerFilter *self )
 {
@@ -102,15 +184,29 @@ cam_fast_bayer_filter_init( CamFastBayerFilter *self )
         { OPTION_RGGB, "RGGB", 1 },
         { 0, NULL, 0 }
     };
+    CamUnitControlEnumValue method_entries[] = {
+        { METHOD_MALVAR, "Malvar-He-Cutler", 1 },
+        { METHOD_EDGE, "Edge-directed", 1 },
+        { 0, NULL, 0 }
+    };
 
     self->bayer_tile_ctl = cam_unit_add_control_enum (super, "tiling", 
             "Tiling", OPTION_GBRG, 1, tiling_entries);
+    self->shift_ctl = cam_unit_add_control_int (super, "shift",
+            "16-to-8 Shift", 0, 8, 1, 8, 0);
+    self->method_ctl = cam_unit_add_control_enum (super, "method",
+            "Method", METHOD_MALVAR, 1, method_entries);
+    self->threads_ctl = cam_unit_add_control_int (super, "threads",
+            "Threads", 1, 64, 1, 1, 1);
+    self->half_ctl = cam_unit_add_control_boolean (super, "half-resolution",
+            "Half Resolution", 0, 1);
 
     for (int i = 0; i < 4; i++) {
         self->planes[i] = NULL;
     }
 
-    self->aligned_buffer = NULL;
+    self->mosaic16 = NULL;
+    self->mosaic8 = NULL;
 
     g_signal_connect (G_OBJECT (self), "input-format-changed",
             G_CALLBACK (on_input_format_changed), self);
@@ -123,6 +219,7 @@ cam_fast_bayer_filter_class_init( CamFastBayerFilterClass *klass )
     klass->parent_class.on_input_frame_ready = on_input_frame_ready;
     klass->parent_class.stream_init = cam_fast_bayer_filter_stream_init;
     klass->parent_class.stream_shutdown = cam_fast_bayer_filter_stream_shutdown;
+    klass->parent_class.try_set_control = cam_fast_bayer_filter_try_set_control;
 }
 
 static int
@@ -132,19 +229,37 @@ cam_fast_bayer_filter_stream_init (CamUnit * super, const CamUnitFormat * fmt)
     CamUnit * input = cam_unit_get_input(super);
     const CamUnitFormat * infmt = cam_unit_get_output_format(input);
 
-    if(is_bayer_pixel_format(infmt->pixelformat)) {
+    if(is_bayer_pixel_format(infmt->pixelformat) ||
+       is_bayer16_pixel_format(infmt->pixelformat) ||
+       packed_bayer_bits(infmt->pixelformat)) {
         int tiling = OPTION_GBRG;
         switch (infmt->pixelformat) {
             case CAM_PIXEL_FORMAT_BAYER_GBRG:
+            case CAM_PIXEL_FORMAT_BE_BAYER16_GBRG:
+            case CAM_PIXEL_FORMAT_LE_BAYER16_GBRG:
+            case CAM_PIXEL_FORMAT_BAYER10P_GBRG:
+            case CAM_PIXEL_FORMAT_BAYER12P_GBRG:
                 tiling = OPTION_GBRG;
                 break;
             case CAM_PIXEL_FORMAT_BAYER_GRBG:
+            case CAM_PIXEL_FORMAT_BE_BAYER16_GRBG:
+            case CAM_PIXEL_FORMAT_LE_BAYER16_GRBG:
+            case CAM_PIXEL_FORMAT_BAYER10P_GRBG:
+            case CAM_PIXEL_FORMAT_BAYER12P_GRBG:
                 tiling = OPTION_GRBG;
                 break;
             case CAM_PIXEL_FORMAT_BAYER_BGGR:
+            case CAM_PIXEL_FORMAT_BE_BAYER16_BGGR:
+            case CAM_PIXEL_FORMAT_LE_BAYER16_BGGR:
+            case CAM_PIXEL_FORMAT_BAYER10P_BGGR:
+            case CAM_PIXEL_FORMAT_BAYER12P_BGGR:
                 tiling = OPTION_BGGR;
                 break;
             case CAM_PIXEL_FORMAT_BAYER_RGGB:
+            case CAM_PIXEL_FORMAT_BE_BAYER16_RGGB:
+            case CAM_PIXEL_FORMAT_LE_BAYER16_RGGB:
+            case CAM_PIXEL_FORMAT_BAYER10P_RGGB:
+            case CAM_PIXEL_FORMAT_BAYER12P_RGGB:
                 tiling = OPTION_RGGB;
                 break;
             default:
@@ -159,7 +274,25 @@ cam_fast_bayer_filter_stream_init (CamUnit * super, const CamUnitFormat * fmt)
 
     const CamUnitFormat *outfmt = cam_unit_get_output_format(super);
 
-    if (outfmt->pixelformat == CAM_PIXEL_FORMAT_GRAY) {
+    if (outfmt->width != infmt->width) {
+        /* binning reads the input directly, but 16-bit and packed input
+         * is first shifted down to 8 bits */
+        if (is_bayer16_pixel_format(infmt->pixelformat) ||
+            packed_bayer_bits(infmt->pixelformat)) {
+            self->mosaic8_stride = (infmt->width + 0xf) & (~0xf);
+            self->mosaic8 = MALLOC_ALIGNED (self->mosaic8_stride *
+                    infmt->height);
+        }
+    }
+    else if (outfmt->pixelformat == CAM_PIXEL_FORMAT_LE_RGB16 ||
+        outfmt->pixelformat == CAM_PIXEL_FORMAT_LE_GRAY16) {
+        /* 2 pixels of border on each side for the replicated bayer
+         * border */
+        self->mosaic16_stride = ((outfmt->width + 4) * 2 + 0xf) & (~0xf);
+        self->mosaic16 = MALLOC_ALIGNED (self->mosaic16_stride *
+                (outfmt->height + 4));
+    }
+    else if (outfmt->pixelformat == CAM_PIXEL_FORMAT_GRAY) {
         int width = outfmt->width;
         int height = outfmt->height;
         self->plane_stride = ((width + 0xf)&(~0xf)) + 32;
@@ -176,6 +309,10 @@ cam_fast_bayer_filter_stream_init (CamUnit * super, const CamUnitFormat * fmt)
         for (i = 0; i < 4; i++)
             self->planes[i] = MALLOC_ALIGNED (self->plane_stride *
                     (height + 2));
+
+        self->mosaic8_stride = ((outfmt->width + 0xf)&(~0xf)) + 32;
+        self->mosaic8 = MALLOC_ALIGNED (self->mosaic8_stride *
+                (outfmt->height + 4));
     }
 
     return 0;
@@ -192,8 +329,11 @@ cam_fast_bayer_filter_stream_shutdown (CamUnit * super)
         self->planes[i] = NULL;
     }
 
-    free(self->aligned_buffer);
-    self->aligned_buffer = NULL;
+    free(self->mosaic16);
+    self->mosaic16 = NULL;
+
+    free(self->mosaic8);
+    self->mosaic8 = NULL;
 
     return 0;
 }
@@ -210,6 +350,78 @@ cam_fast_bayer_filter_new()
             g_object_new(cam_fast_bayer_filter_get_type(), NULL);
 }
 
+/* All of the interpolation kernels read a replicated border outside of the
+ * rows they produce, so an even-aligned band of output rows can be
+ * computed independently of the others. */
+static void
+interpolate_band (int row_start, int row_end, void *user_data)
+{
+    interp_args_t *a = (interp_args_t*) user_data;
+    int rows = row_end - row_start;
+    uint8_t * src = a->src + row_start * a->sstride;
+    uint8_t * dst = a->dst + row_start * a->dstride;
+
+    switch (a->kind) {
+        case INTERP_8U_BGRA:
+            {
+                uint8_t * planes[4];
+                int i;
+                for (i = 0; i < 4; i++)
+                    planes[i] = a->planes[i] + row_start / 2 * a->sstride;
+                cam_pixel_bayer_interpolate_to_8u_bgra (planes, a->sstride,
+                        dst, a->dstride, a->width, rows, a->tiling);
+            }
+            break;
+        case INTERP_8U_EDGE:
+            cam_pixel_bayer_interpolate_edge_to_8u_bgra_rows (a->src,
+                    a->sstride, a->dst, a->dstride, a->width, a->height,
+                    row_start, row_end, a->tiling);
+            break;
+        case INTERP_8U_GRAY:
+            cam_pixel_bayer_interpolate_to_8u_gray (src, a->sstride,
+                    dst, a->dstride, a->width, rows, a->tiling);
+            break;
+        case INTERP_16U_RGB:
+            cam_pixel_bayer_interpolate_to_16u_rgb ((uint16_t*) src,
+                    a->sstride, (uint16_t*) dst, a->dstride, a->width, rows,
+                    a->tiling);
+            break;
+        case INTERP_16U_GRAY:
+            cam_pixel_bayer_interpolate_to_16u_gray ((uint16_t*) src,
+                    a->sstride, (uint16_t*) dst, a->dstride, a->width, rows,
+                    a->tiling);
+            break;
+        case BIN_8U_BGRA:
+            cam_pixel_bayer_bin_to_8u_bgra (dst, a->dstride, a->width, rows,
+                    a->src + 2 * row_start * a->sstride, a->sstride,
+                    a->tiling);
+            break;
+        case BIN_8U_RGB:
+            cam_pixel_bayer_bin_to_8u_rgb (dst, a->dstride, a->width, rows,
+                    a->src + 2 * row_start * a->sstride, a->sstride,
+                    a->tiling);
+            break;
+        case BIN_8U_GRAY:
+            cam_pixel_bayer_bin_to_8u_gray (dst, a->dstride, a->width, rows,
+                    a->src + 2 * row_start * a->sstride, a->sstride,
+                    a->tiling);
+            break;
+    }
+}
+
+/* Unpacks a packed 10 or 12-bit image to 8 bits per pixel */
+static void
+unpack_packed_to_8u (uint8_t *dest, int dstride, int width, int height,
+        const uint8_t *src, int sstride, int bits, int shift)
+{
+    if (bits == 10)
+        cam_pixel_unpack_10p_to_8u (dest, dstride, width, height,
+                src, sstride, shift);
+    else
+        cam_pixel_unpack_12p_to_8u (dest, dstride, width, height,
+                src, sstride, shift);
+}
+
 static void 
 on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
         const CamUnitFormat *infmt)
@@ -219,40 +431,126 @@ on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
     const CamUnitFormat *outfmt = cam_unit_get_output_format(super);
 
     int out_buf_size = outfmt->height * outfmt->row_stride;
-    int in_buf_size = infmt->height * infmt->row_stride;
     CamFrameBuffer *outbuf = cam_framebuffer_new_alloc (out_buf_size);
 
     const uint8_t *in_data = inbuf->data;
+    int in_16u = is_bayer16_pixel_format(infmt->pixelformat);
+    int big_endian = is_big_endian_pixel_format(infmt->pixelformat);
+    int packed_bits = packed_bayer_bits(infmt->pixelformat);
+    int shift = cam_unit_control_get_int(self->shift_ctl);
 
-    // if the input buffer is not 16-byte aligned, then make an aligned copy.
-    if(!CAM_IS_ALIGNED16(inbuf->data)) {
-        if(! self->aligned_buffer) {
-            self->aligned_buffer = MALLOC_ALIGNED(in_buf_size);
-        }
-        memcpy(self->aligned_buffer, inbuf->data, inbuf->bytesused);
-        in_data = self->aligned_buffer;
-    }
+    /* the shift control is set up for 16-bit samples; shifting packed
+     * samples further than their extra bits would only throw precision
+     * away, so clamp it here rather than overwrite the user's setting */
+    if (packed_bits && shift > packed_bits - 8)
+        shift = packed_bits - 8;
 
     int tiling_option = cam_unit_control_get_enum(self->bayer_tile_ctl);
     CamPixelFormat tiling = _option_to_pfmt[tiling_option];
 
-    if (outfmt->pixelformat == CAM_PIXEL_FORMAT_GRAY) {
+    interp_args_t args;
+    args.dst = outbuf->data;
+    args.dstride = outfmt->row_stride;
+    args.width = outfmt->width;
+    args.height = outfmt->height;
+    args.tiling = tiling;
+
+    if (outfmt->width != infmt->width) {
+        if (in_16u) {
+            cam_pixel_convert_16u_gray_to_8u_gray (self->mosaic8,
+                    self->mosaic8_stride, infmt->width, infmt->height,
+                    (const uint16_t*) in_data, infmt->row_stride,
+                    shift, big_endian);
+            args.src = self->mosaic8;
+            args.sstride = self->mosaic8_stride;
+        } else if (packed_bits) {
+            unpack_packed_to_8u (self->mosaic8, self->mosaic8_stride,
+                    infmt->width, infmt->height, in_data, infmt->row_stride,
+                    packed_bits, shift);
+            args.src = self->mosaic8;
+            args.sstride = self->mosaic8_stride;
+        } else {
+            args.src = (uint8_t*) in_data;
+            args.sstride = infmt->row_stride;
+        }
+        if (outfmt->pixelformat == CAM_PIXEL_FORMAT_BGRA)
+            args.kind = BIN_8U_BGRA;
+        else if (outfmt->pixelformat == CAM_PIXEL_FORMAT_RGB)
+            args.kind = BIN_8U_RGB;
+        else
+            args.kind = BIN_8U_GRAY;
+    }
+    else if (outfmt->pixelformat == CAM_PIXEL_FORMAT_LE_RGB16 ||
+        outfmt->pixelformat == CAM_PIXEL_FORMAT_LE_GRAY16) {
+        uint16_t * mosaic = (uint16_t*)(self->mosaic16 +
+                2*self->mosaic16_stride + 4);
+        if (packed_bits == 10)
+            cam_pixel_unpack_10p_to_16u (mosaic, self->mosaic16_stride,
+                    infmt->width, infmt->height, in_data, infmt->row_stride);
+        else if (packed_bits == 12)
+            cam_pixel_unpack_12p_to_16u (mosaic, self->mosaic16_stride,
+                    infmt->width, infmt->height, in_data, infmt->row_stride);
+        else if (big_endian)
+            cam_pixel_swap_bytes_16u (mosaic, self->mosaic16_stride,
+                    infmt->width, infmt->height,
+                    (const uint16_t*) in_data, infmt->row_stride);
+        else
+            cam_pixel_copy_8u_generic (in_data, infmt->row_stride,
+                    (uint8_t*) mosaic, self->mosaic16_stride,
+                    0, 0, 0, 0, infmt->width, infmt->height, 16);
+        cam_pixel_replicate_bayer_border_16u (mosaic, self->mosaic16_stride,
+                outfmt->width, outfmt->height);
+
+        args.kind = outfmt->pixelformat == CAM_PIXEL_FORMAT_LE_RGB16 ?
+            INTERP_16U_RGB : INTERP_16U_GRAY;
+        args.src = (uint8_t*) mosaic;
+        args.sstride = self->mosaic16_stride;
+    }
+    else if (outfmt->pixelformat == CAM_PIXEL_FORMAT_GRAY) {
         uint8_t * plane = self->planes[0] + 2*self->plane_stride + 16;
-        int i;
-        for (i = 0; i < outfmt->height; i++) {
-            uint8_t * drow = plane + i*self->plane_stride;
-            const uint8_t * srow = in_data + i*infmt->row_stride;
-            memcpy (drow, srow, infmt->width);
-            //memset (drow, 128, infmt->width);
+        if (in_16u) {
+            cam_pixel_convert_16u_gray_to_8u_gray (plane, self->plane_stride,
+                    infmt->width, infmt->height,
+                    (const uint16_t*) in_data, infmt->row_stride,
+                    shift, big_endian);
+        } else if (packed_bits) {
+            unpack_packed_to_8u (plane, self->plane_stride,
+                    infmt->width, infmt->height, in_data, infmt->row_stride,
+                    packed_bits, shift);
+        } else {
+            int i;
+            for (i = 0; i < outfmt->height; i++) {
+                uint8_t * drow = plane + i*self->plane_stride;
+                const uint8_t * srow = in_data + i*infmt->row_stride;
+                memcpy (drow, srow, infmt->width);
+            }
         }
         cam_pixel_replicate_bayer_border_8u (plane, self->plane_stride,
                 outfmt->width, outfmt->height);
-        cam_pixel_bayer_interpolate_to_8u_gray (plane, self->plane_stride,
-                outbuf->data, outfmt->row_stride, outfmt->width,
-                outfmt->height, tiling);
-
-        //uint8_t * d = outbuf->data + 8*outfmt->row_stride;
-        //printf ("%d %d\n", d[0], d[1]);
+        args.kind = INTERP_8U_GRAY;
+        args.src = plane;
+        args.sstride = self->plane_stride;
+    }
+    else if (cam_unit_control_get_enum(self->method_ctl) == METHOD_EDGE) {
+        uint8_t * mosaic = self->mosaic8 + 2*self->mosaic8_stride + 16;
+        if (in_16u)
+            cam_pixel_convert_16u_gray_to_8u_gray (mosaic,
+                    self->mosaic8_stride, infmt->width, infmt->height,
+                    (const uint16_t*) in_data, infmt->row_stride,
+                    shift, big_endian);
+        else if (packed_bits)
+            unpack_packed_to_8u (mosaic, self->mosaic8_stride,
+                    infmt->width, infmt->height, in_data, infmt->row_stride,
+                    packed_bits, shift);
+        else
+            cam_pixel_copy_8u_generic (in_data, infmt->row_stride,
+                    mosaic, self->mosaic8_stride,
+                    0, 0, 0, 0, infmt->width, infmt->height, 8);
+        cam_pixel_replicate_bayer_border_8u (mosaic, self->mosaic8_stride,
+                outfmt->width, outfmt->height);
+        args.kind = INTERP_8U_EDGE;
+        args.src = mosaic;
+        args.sstride = self->mosaic8_stride;
     }
     else {
         uint8_t * planes[] = {
@@ -265,18 +563,37 @@ on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
         int p_width = outfmt->width / 2;
         int p_height = outfmt->height / 2;
 
-        cam_pixel_split_bayer_planes_8u (planes, self->plane_stride,
-                in_data, infmt->row_stride, p_width, p_height);
+        if (in_16u)
+            cam_pixel_split_bayer_planes_16u_to_8u (planes,
+                    self->plane_stride, (const uint16_t*) in_data,
+                    infmt->row_stride, p_width, p_height, shift, big_endian);
+        else if (packed_bits == 10)
+            cam_pixel_split_bayer_planes_10p_to_8u (planes,
+                    self->plane_stride, in_data, infmt->row_stride,
+                    p_width, p_height, shift);
+        else if (packed_bits == 12)
+            cam_pixel_split_bayer_planes_12p_to_8u (planes,
+                    self->plane_stride, in_data, infmt->row_stride,
+                    p_width, p_height, shift);
+        else
+            cam_pixel_split_bayer_planes_8u (planes, self->plane_stride,
+                    in_data, infmt->row_stride, p_width, p_height);
         int i;
         for (i = 0; i < 4; i++)
             cam_pixel_replicate_border_8u (planes[i], self->plane_stride,
                     p_width, p_height);
 
-        cam_pixel_bayer_interpolate_to_8u_bgra (planes, self->plane_stride,
-                outbuf->data, outfmt->row_stride, outfmt->width, outfmt->height,
-                tiling);
+        args.kind = INTERP_8U_BGRA;
+        args.src = planes[0];
+        for (i = 0; i < 4; i++)
+            args.planes[i] = planes[i];
+        args.sstride = self->plane_stride;
     }
 
+    cam_pixel_parallel_for (cam_unit_control_get_int(self->threads_ctl),
+            outfmt->height, 2, outfmt->row_stride + infmt->row_stride,
+            interpolate_band, &args);
+
     cam_framebuffer_copy_metadata(outbuf, inbuf);
     outbuf->bytesused = out_buf_size;
 
@@ -284,23 +601,59 @@ on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
     g_object_unref (outbuf);
 }
 
+/* Offers full-resolution demosaiced formats, or, in half-resolution mode,
+ * the formats produced by binning each bayer tile into one pixel.  Only
+ * one of the two sets is offered at a time so that stream_init can't pick
+ * the wrong one. */
 static void
-on_input_format_changed (CamUnit *super, const CamUnitFormat *infmt)
+update_output_formats (CamFastBayerFilter *self, const CamUnitFormat *infmt,
+        int half)
 {
+    CamUnit *super = CAM_UNIT (self);
     cam_unit_remove_all_output_formats (super);
 
+    cam_unit_control_set_enabled (self->shift_ctl,
+            infmt && (is_bayer16_pixel_format(infmt->pixelformat) ||
+                packed_bayer_bits(infmt->pixelformat)));
+    cam_unit_control_set_enabled (self->method_ctl, !half);
+
     if (!infmt) return;
 
-    if (! is_bayer_pixel_format(infmt->pixelformat) &&
+    int packed_bits = packed_bayer_bits(infmt->pixelformat);
+
+    /* packed input is unpacked to 16 bits for the 16-bit outputs */
+    int in_16u = is_bayer16_pixel_format(infmt->pixelformat) ||
+        packed_bits;
+    if (! is_bayer_pixel_format(infmt->pixelformat) && ! in_16u &&
           infmt->pixelformat != CAM_PIXEL_FORMAT_GRAY) 
         return;
 
-    CamPixelFormat outfmts[2] = {
+    if (half) {
+        CamPixelFormat binfmts[3] = {
+            CAM_PIXEL_FORMAT_BGRA,
+            CAM_PIXEL_FORMAT_RGB,
+            CAM_PIXEL_FORMAT_GRAY
+        };
+        int width = infmt->width / 2;
+        int height = infmt->height / 2;
+        for (int i=0; i<3; i++) {
+            int stride = width * cam_pixel_format_bpp(binfmts[i]) / 8;
+            stride = (stride + 0x7f)&(~0x7f);
+            cam_unit_add_output_format (super, binfmts[i],
+                    NULL, width, height, stride);
+        }
+        return;
+    }
+
+    CamPixelFormat outfmts[4] = {
         CAM_PIXEL_FORMAT_BGRA,
-        CAM_PIXEL_FORMAT_GRAY
+        CAM_PIXEL_FORMAT_GRAY,
+        CAM_PIXEL_FORMAT_LE_RGB16,
+        CAM_PIXEL_FORMAT_LE_GRAY16
     };
+    int noutfmts = in_16u ? 4 : 2;
 
-    for (int i=0; i<2; i++) {
+    for (int i=0; i<noutfmts; i++) {
         CamPixelFormat out_pixelformat = outfmts[i];
 
         int stride = infmt->width * cam_pixel_format_bpp(out_pixelformat) / 8;
@@ -313,3 +666,35 @@ on_input_format_changed (CamUnit *super, const CamUnitFormat *infmt)
                 stride);
     }
 }
+
+static void
+on_input_format_changed (CamUnit *super, const CamUnitFormat *infmt)
+{
+    CamFastBayerFilter * self = (CamFastBayerFilter*) super;
+    update_output_formats (self, infmt,
+            cam_unit_control_get_boolean (self->half_ctl));
+}
+
+static gboolean
+cam_fast_bayer_filter_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual)
+{
+    CamFastBayerFilter * self = (CamFastBayerFilter*) super;
+    if (ctl == self->half_ctl) {
+        /* switching modes changes the output size, so restart the stream
+         * with the new set of formats */
+        int streaming = cam_unit_is_streaming (super);
+        if (streaming)
+            cam_unit_stream_shutdown (super);
+
+        CamUnit *input = cam_unit_get_input (super);
+        update_output_formats (self,
+                input ? cam_unit_get_output_format (input) : NULL,
+                g_value_get_boolean (proposed));
+
+        if (streaming)
+            cam_unit_stream_init (super, NULL);
+    }
+    g_value_copy (proposed, actual);
+    return TRUE;
+}
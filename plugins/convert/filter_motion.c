@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camunits/plugin.h"
+#include "camunits/dbg.h"
+
+#define err(args...) fprintf(stderr, args)
+
+typedef struct _CamMotionFilter {
+    CamUnit parent;
+
+    CamUnitControl *scale_ctl;
+    CamUnitControl *adapt_ctl;
+    CamUnitControl *score_ctl;
+
+    // reduced-resolution image and running background, both rw * channels
+    // samples wide.  background is the running average, background8 its
+    // rounded copy that frames are compared against.
+    int rw;
+    int rh;
+    int channels;
+    int scale;
+    uint8_t *reduced;
+    uint8_t *background8;
+    float *background;
+    int have_background;
+} CamMotionFilter;
+
+typedef struct _CamMotionFilterClass {
+    CamUnitClass parent_class;
+} CamMotionFilterClass;
+
+static CamMotionFilter * cam_motion_filter_new (void);
+
+GType cam_motion_filter_get_type (void);
+CAM_PLUGIN_TYPE(CamMotionFilter, cam_motion_filter, CAM_TYPE_UNIT);
+
+/* These next two functions are required as entry points for the
+ * plug-in API. */
+void cam_plugin_initialize(GTypeModule * module);
+void cam_plugin_initialize(GTypeModule * module)
+{
+    cam_motion_filter_register_type(module);
+}
+
+CamUnitDriver * cam_plugin_create(GTypeModule * module);
+CamUnitDriver * cam_plugin_create(GTypeModule * module)
+{
+    return cam_unit_driver_new_stock_full ( "filter", "motion",
+            "Motion Detection", 0,
+            (CamUnitConstructor)cam_motion_filter_new, module);
+}
+
+// ============== CamMotionFilter ===============
+static void cam_motion_filter_finalize (GObject *obj);
+static void on_input_frame_ready (CamUnit * super, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *infmt);
+static void on_input_format_changed (CamUnit *super,
+        const CamUnitFormat *infmt);
+static gboolean cam_motion_filter_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual);
+
+static void
+cam_motion_filter_init (CamMotionFilter *self)
+{
+    dbg(DBG_FILTER, "motion filter constructor\n");
+    CamUnit *super = CAM_UNIT (self);
+
+    CamUnitControlEnumValue scale_entries[] = {
+        { 2, "1/2", 1 },
+        { 4, "1/4", 1 },
+        { 8, "1/8", 1 },
+        { 16, "1/16", 1 },
+        { 0, NULL, 0 }
+    };
+    self->scale_ctl = cam_unit_add_control_enum (super, "scale",
+            "Scale", 4, 1, scale_entries);
+    self->adapt_ctl = cam_unit_add_control_int (super, "adaptation",
+            "Background Frames", 1, 1000, 1, 50, 1);
+    self->score_ctl = cam_unit_add_control_float (super, "score",
+            "Motion Score", 0, 255, 0.01, 0, 0);
+
+    self->rw = 0;
+    self->rh = 0;
+    self->channels = 0;
+    self->scale = 0;
+    self->reduced = NULL;
+    self->background8 = NULL;
+    self->background = NULL;
+    self->have_background = 0;
+
+    g_signal_connect (G_OBJECT (self), "input-format-changed",
+            G_CALLBACK (on_input_format_changed), self);
+}
+
+static void
+cam_motion_filter_class_init (CamMotionFilterClass *klass)
+{
+    dbg(DBG_FILTER, "motion filter class initializer\n");
+    GObjectClass * gobject_class = G_OBJECT_CLASS (klass);
+    gobject_class->finalize = cam_motion_filter_finalize;
+    klass->parent_class.on_input_frame_ready = on_input_frame_ready;
+    klass->parent_class.try_set_control = cam_motion_filter_try_set_control;
+}
+
+CamMotionFilter *
+cam_motion_filter_new()
+{
+    return (CamMotionFilter*)
+            g_object_new(cam_motion_filter_get_type(), NULL);
+}
+
+static void
+free_buffers (CamMotionFilter *self)
+{
+    free (self->reduced);
+    free (self->background8);
+    free (self->background);
+    self->reduced = NULL;
+    self->background8 = NULL;
+    self->background = NULL;
+    self->rw = self->rh = self->channels = self->scale = 0;
+    self->have_background = 0;
+}
+
+static void
+cam_motion_filter_finalize (GObject * obj)
+{
+    free_buffers ((CamMotionFilter*) obj);
+    G_OBJECT_CLASS (cam_motion_filter_parent_class)->finalize (obj);
+}
+
+/* Number of interleaved 8-bit channels that are reduced, or 0 if the
+ * format is not supported.  Planar formats only use their Y plane, and
+ * Bayer mosaics are reduced as gray, which is exact for the even scales
+ * offered since every block covers whole tiles. */
+static int
+channels_for_format (CamPixelFormat pfmt)
+{
+    switch (pfmt) {
+        case CAM_PIXEL_FORMAT_GRAY:
+        case CAM_PIXEL_FORMAT_BAYER_BGGR:
+        case CAM_PIXEL_FORMAT_BAYER_GBRG:
+        case CAM_PIXEL_FORMAT_BAYER_GRBG:
+        case CAM_PIXEL_FORMAT_BAYER_RGGB:
+        case CAM_PIXEL_FORMAT_I420:
+        case CAM_PIXEL_FORMAT_YUV420:
+        case CAM_PIXEL_FORMAT_NV12:
+            return 1;
+        case CAM_PIXEL_FORMAT_YUYV:
+        case CAM_PIXEL_FORMAT_UYVY:
+            return 2;
+        case CAM_PIXEL_FORMAT_RGB:
+        case CAM_PIXEL_FORMAT_BGR:
+            return 3;
+        case CAM_PIXEL_FORMAT_RGBA:
+        case CAM_PIXEL_FORMAT_BGRA:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+static void
+on_input_format_changed (CamUnit *super, const CamUnitFormat *infmt)
+{
+    CamMotionFilter *self = (CamMotionFilter*) super;
+    cam_unit_remove_all_output_formats (super);
+    self->have_background = 0;
+    if (!infmt || !channels_for_format (infmt->pixelformat))
+        return;
+
+    // the input format is passed through
+    cam_unit_add_output_format (super, infmt->pixelformat,
+            infmt->name, infmt->width, infmt->height,
+            infmt->row_stride);
+}
+
+static gboolean
+cam_motion_filter_try_set_control (CamUnit *super,
+        const CamUnitControl *ctl, const GValue *proposed, GValue *actual)
+{
+    CamMotionFilter *self = (CamMotionFilter*) super;
+    if (ctl == self->scale_ctl || ctl == self->adapt_ctl) {
+        g_value_copy (proposed, actual);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/* Makes sure the buffers match the input format and scale, starting over
+ * with a new background if they did not.  Returns 0 on success. */
+static int
+setup_buffers (CamMotionFilter *self, const CamUnitFormat *infmt, int scale)
+{
+    int channels = channels_for_format (infmt->pixelformat);
+    int rw = infmt->width / scale;
+    int rh = infmt->height / scale;
+    if (self->reduced && self->rw == rw && self->rh == rh &&
+            self->channels == channels && self->scale == scale)
+        return 0;
+
+    free_buffers (self);
+    if (!channels || rw < 1 || rh < 1) {
+        err ("MotionFilter: can't reduce %dx%d %s by %d\n",
+                infmt->width, infmt->height,
+                cam_pixel_format_nickname (infmt->pixelformat), scale);
+        return -1;
+    }
+    int n = rw * channels * rh;
+    self->reduced = malloc (n);
+    self->background8 = malloc (n);
+    self->background = malloc (n * sizeof (float));
+    self->rw = rw;
+    self->rh = rh;
+    self->channels = channels;
+    self->scale = scale;
+    return 0;
+}
+
+static void
+on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
+        const CamUnitFormat *infmt)
+{
+    CamMotionFilter * self = (CamMotionFilter*) super;
+    dbg(DBG_FILTER, "[%s] iterate\n", cam_unit_get_name(super));
+
+    const CamUnitFormat *outfmt = cam_unit_get_output_format(super);
+    if (!outfmt) return;
+
+    int scale = cam_unit_control_get_enum (self->scale_ctl);
+    if (setup_buffers (self, infmt, scale) < 0)
+        return;
+
+    int channels = self->channels;
+    int rstride = self->rw * channels;
+    int n = rstride * self->rh;
+    int sstride = infmt->row_stride ? infmt->row_stride :
+        infmt->width * channels;
+
+    // reduce the part of the image that is a whole number of blocks
+    if (0 != cam_pixel_resize_box_8u (self->reduced, rstride,
+                self->rw, self->rh, inbuf->data, sstride,
+                self->rw * scale, self->rh * scale, channels))
+        return;
+
+    double score = 0;
+    if (!self->have_background) {
+        for (int i = 0; i < n; i++)
+            self->background[i] = self->reduced[i];
+        memcpy (self->background8, self->reduced, n);
+        self->have_background = 1;
+    } else {
+        uint64_t sad;
+        cam_pixel_sad_8u (self->reduced, rstride, self->background8,
+                rstride, rstride, self->rh, &sad);
+        score = (double) sad / n;
+
+        // exponential running average with a time constant of
+        // adaptation frames
+        float alpha = 1.0f / cam_unit_control_get_int (self->adapt_ctl);
+        for (int i = 0; i < n; i++) {
+            float b = self->background[i];
+            b += (self->reduced[i] - b) * alpha;
+            self->background[i] = b;
+            self->background8[i] = (uint8_t) (b + 0.5f);
+        }
+    }
+
+    // the frame data is passed through untouched
+    CamFrameBuffer *outbuf = cam_framebuffer_new_view (
+            (CamFrameBuffer*) inbuf, 0, inbuf->bytesused);
+    if (!outbuf) return;
+    cam_framebuffer_copy_metadata (outbuf, inbuf);
+    outbuf->bytesused = inbuf->bytesused;
+
+    char str[20];
+    snprintf (str, sizeof (str), "%.2f", score);
+    cam_framebuffer_metadata_set (outbuf, "Motion Score",
+            (uint8_t *) str, strlen (str));
+    cam_unit_control_force_set_float (self->score_ctl, score);
+
+    cam_unit_produce_frame (super, outbuf, outfmt);
+    g_object_unref (outbuf);
+}
@@ -19,11 +19,20 @@ typedef struct _CamLoggerUnit {
     CamUnitControl *record_ctl;
     CamUnitControl *desired_filename_ctl;
     CamUnitControl *auto_suffix_ctl;
+    CamUnitControl *keyframe_interval_ctl;
+    CamUnitControl *motion_threshold_ctl;
+    CamUnitControl *preroll_ctl;
+    CamUnitControl *postroll_ctl;
 //    CamUnitControl *actual_filename_ctl;
 
     GAsyncQueue *msg_q;
     GThread *writer_thread;
 
+    // motion gating.  While there is no motion, copies of the most recent
+    // frames are kept in preroll_q as format, framebuffer pairs.
+    GQueue *preroll_q;
+    int postroll_left;
+
     char *fname;
     char *basename;
 
@@ -90,11 +99,23 @@ cam_logger_unit_init (CamLoggerUnit *self)
 //    self->actual_filename_ctl = cam_unit_add_control_string(super, 
 //            "actual-filename", "Filename Auto Suffix", "", 0);
 
+    self->keyframe_interval_ctl = cam_unit_add_control_int (super,
+            "keyframe-interval", "Keyframe Interval", 0, 3600, 1, 0, 1);
+
+    self->motion_threshold_ctl = cam_unit_add_control_float (super,
+            "motion-threshold", "Motion Threshold", 0, 255, 0.1, 0, 1);
+    self->preroll_ctl = cam_unit_add_control_int (super, "pre-roll",
+            "Pre-roll Frames", 0, 300, 1, 30, 1);
+    self->postroll_ctl = cam_unit_add_control_int (super, "post-roll",
+            "Post-roll Frames", 0, 3000, 1, 30, 1);
+
     self->record_ctl = cam_unit_add_control_boolean(super, "record", "Record", 
             0, 1); 
 
     self->msg_q = g_async_queue_new ();
     self->writer_thread = NULL;
+    self->preroll_q = g_queue_new ();
+    self->postroll_left = 0;
 
     g_signal_connect (G_OBJECT (self), "input-format-changed",
             G_CALLBACK (on_input_format_changed), self);
@@ -110,6 +131,16 @@ cam_logger_unit_class_init (CamLoggerUnitClass *klass)
     if (!g_thread_supported ()) g_thread_init (NULL);
 }
 
+/* Drops all but the newest @keep frames from the pre-roll buffer */
+static void
+trim_preroll (CamLoggerUnit *self, int keep)
+{
+    while (g_queue_get_length (self->preroll_q) > 2 * keep) {
+        g_object_unref (g_queue_pop_head (self->preroll_q));
+        g_object_unref (g_queue_pop_head (self->preroll_q));
+    }
+}
+
 static void
 log_finalize (GObject *obj)
 {
@@ -120,6 +151,8 @@ log_finalize (GObject *obj)
         g_thread_join (self->writer_thread);
     }
     g_async_queue_unref (self->msg_q);
+    trim_preroll (self, 0);
+    g_queue_free (self->preroll_q);
     
     if (self->camlog) { 
         dbg (DBG_FILTER, "LoggerUnit: closing camlog\n");
@@ -152,6 +185,52 @@ on_input_format_changed (CamUnit *super, const CamUnitFormat *infmt)
             infmt->row_stride);
 }
 
+static void
+copy_frame (const CamFrameBuffer *inbuf, const CamUnitFormat *infmt,
+        CamUnitFormat **fmt_copy, CamFrameBuffer **buf_copy)
+{
+    *fmt_copy = cam_unit_format_new (infmt->pixelformat,
+            infmt->name, infmt->width, infmt->height,
+            infmt->row_stride);
+    *buf_copy = cam_framebuffer_new_alloc (inbuf->bytesused);
+    memcpy ((*buf_copy)->data, inbuf->data, inbuf->bytesused);
+    (*buf_copy)->bytesused = inbuf->bytesused;
+    cam_framebuffer_copy_metadata (*buf_copy, inbuf);
+}
+
+/* Returns 1 if @inbuf should be logged under motion gating, i.e. if gating
+ * is off, the frame has no motion score, its score exceeds the threshold,
+ * or it is within the post-roll of the last such frame. */
+static int
+has_motion (CamLoggerUnit *self, const CamFrameBuffer *inbuf)
+{
+    double threshold = cam_unit_control_get_float (self->motion_threshold_ctl);
+    if (threshold <= 0)
+        return 1;
+
+    int len;
+    const uint8_t *value = cam_framebuffer_metadata_get (inbuf,
+            "Motion Score", &len);
+    if (!value)
+        return 1;
+
+    char str[32];
+    if (len >= sizeof (str))
+        len = sizeof (str) - 1;
+    memcpy (str, value, len);
+    str[len] = '\0';
+
+    if (strtod (str, NULL) > threshold) {
+        self->postroll_left = cam_unit_control_get_int (self->postroll_ctl);
+        return 1;
+    }
+    if (self->postroll_left > 0) {
+        self->postroll_left--;
+        return 1;
+    }
+    return 0;
+}
+
 static void 
 on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf, 
         const CamUnitFormat *infmt)
@@ -166,20 +245,46 @@ on_input_frame_ready (CamUnit *super, const CamFrameBuffer *inbuf,
     if (recording && !self->camlog)
         load_camlog (self, NULL);
 
-    if (recording && self->camlog) {
+    int gated = recording && self->camlog && !has_motion (self, inbuf);
+
+    if (gated) {
+        // keep the frame in case motion starts within the pre-roll
+        int preroll = cam_unit_control_get_int (self->preroll_ctl);
+        if (preroll > 0) {
+            CamUnitFormat *fmt_copy;
+            CamFrameBuffer *buf_copy;
+            copy_frame (inbuf, infmt, &fmt_copy, &buf_copy);
+            g_queue_push_tail (self->preroll_q, fmt_copy);
+            g_queue_push_tail (self->preroll_q, buf_copy);
+        }
+        trim_preroll (self, preroll);
+    }
+    else if (recording && self->camlog) {
+        // the frames leading up to the motion go first.  If the writer
+        // can't take them all along with this frame, the oldest are dropped.
+        if (!g_queue_is_empty (self->preroll_q)) {
+            int room = (MAX_UNWRITTEN_FRAMES * 2 -
+                    g_async_queue_length (self->msg_q)) / 2 - 1;
+            int npreroll = g_queue_get_length (self->preroll_q) / 2;
+            if (npreroll > room) {
+                fprintf (stderr, "%s:%d - disk too slow, dropping %d "
+                        "pre-roll frames\n", __FILE__, __LINE__,
+                        npreroll - MAX (room, 0));
+                trim_preroll (self, MAX (room, 0));
+            }
+            while (!g_queue_is_empty (self->preroll_q))
+                g_async_queue_push (self->msg_q,
+                        g_queue_pop_head (self->preroll_q));
+        }
+
         if (g_async_queue_length (self->msg_q) > MAX_UNWRITTEN_FRAMES * 2) {
             fprintf (stderr, "%s:%d - disk too slow, dropping frame\n",
                     __FILE__, __LINE__);
         }
         else {
-            CamUnitFormat *fmt_copy = cam_unit_format_new (infmt->pixelformat,
-                    infmt->name, infmt->width, infmt->height, 
-                    infmt->row_stride);
-            CamFrameBuffer *buf_copy = 
-                cam_framebuffer_new_alloc (inbuf->bytesused);
-            memcpy (buf_copy->data, inbuf->data, inbuf->bytesused);
-            buf_copy->bytesused = inbuf->bytesused;
-            cam_framebuffer_copy_metadata (buf_copy, inbuf);
+            CamUnitFormat *fmt_copy;
+            CamFrameBuffer *buf_copy;
+            copy_frame (inbuf, infmt, &fmt_copy, &buf_copy);
 
             g_async_queue_push (self->msg_q, fmt_copy);
             g_async_queue_push (self->msg_q, buf_copy);
@@ -255,6 +360,8 @@ load_camlog (CamLoggerUnit *self, const char *fname)
         err ("LoggerUnit: unable to open new log file [%s]\n", filename);
         return -1;
     }
+    cam_log_set_keyframe_interval (self->camlog,
+            cam_unit_control_get_int (self->keyframe_interval_ctl));
 
     g_object_set_data(G_OBJECT(self), "actual-filename", self->fname);
 //    printf ("Logging frames to \"%s\"\n", filename);
@@ -280,10 +387,17 @@ try_set_control (CamUnit *super,
         }
         g_value_copy (proposed, actual);
         cam_unit_control_set_enabled (self->desired_filename_ctl, !recording);
+        cam_unit_control_set_enabled (self->keyframe_interval_ctl, !recording);
+        trim_preroll (self, 0);
+        self->postroll_left = 0;
     } else if (ctl == self->desired_filename_ctl) {
         g_value_copy(proposed, actual);
     } else if(ctl == self->auto_suffix_ctl) {
         g_value_copy(proposed, actual);
+    } else if (ctl == self->keyframe_interval_ctl ||
+            ctl == self->motion_threshold_ctl ||
+            ctl == self->preroll_ctl || ctl == self->postroll_ctl) {
+        g_value_copy (proposed, actual);
     }
 
     return TRUE;